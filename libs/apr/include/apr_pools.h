@@ -422,6 +422,13 @@ APR_DECLARE(void) apr_pool_mutex_set(apr_pool_t *pool,
 									 apr_thread_mutex_t *mutex);
 #endif
 
+/**
+ * Get the number of bytes a pool currently holds from its allocator,
+ * including the unused tail of its active block.
+ * @param pool The pool to measure (subpools are not included)
+ */
+APR_DECLARE(apr_size_t) apr_pool_footprint(apr_pool_t *pool);
+
 
 /*
  * User data management
@@ -737,6 +737,26 @@ APR_DECLARE(void) apr_pool_mutex_set(apr_pool_t *pool,
 }
 #endif
 
+APR_DECLARE(apr_size_t) apr_pool_footprint(apr_pool_t *pool)
+{
+    apr_memnode_t *node;
+    apr_size_t size = 0;
+
+#if APR_HAS_THREADS
+	if (pool->user_mutex) apr_thread_mutex_lock(pool->user_mutex);
+#endif
+    node = pool->active;
+    do {
+        size += node->endp - (char *)node;
+        node = node->next;
+    } while (node != pool->active);
+#if APR_HAS_THREADS
+	if (pool->user_mutex) apr_thread_mutex_unlock(pool->user_mutex);
+#endif
+
+    return size;
+}
+
 APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
 {
     apr_memnode_t *active;
@@ -1796,6 +1816,11 @@ APR_DECLARE(apr_size_t) apr_pool_num_bytes(apr_pool_t *pool, int recurse)
     return size;
 }
 
+APR_DECLARE(apr_size_t) apr_pool_footprint(apr_pool_t *pool)
+{
+    return apr_pool_num_bytes(pool, 0);
+}
+
 APR_DECLARE(void) apr_pool_lock(apr_pool_t *pool, int flag)
 {
 }
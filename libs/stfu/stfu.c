@@ -32,51 +32,78 @@
 #pragma warning(disable: 4706)
 #endif
 
-struct stfu_queue {
-	struct stfu_frame *array;
-	struct stfu_frame int_frame;
-	uint32_t array_size;
-	uint32_t array_len;	
-	uint32_t wr_len;
-	uint32_t last_index;
-};
-typedef struct stfu_queue stfu_queue_t;
+#define STFU_TS_DIFF(a, b) ((int32_t)((a) - (b)))
+/* packets per window for the transit time floor, so clock drift can't pin an old minimum forever */
+#define STFU_BASE_WINDOW 250
 
 struct stfu_instance {
-	struct stfu_queue a_queue;
-	struct stfu_queue b_queue;
-	struct stfu_queue *in_queue;
-	struct stfu_queue *out_queue;
-	uint32_t last_ts;
+	struct stfu_frame *array;
+	uint32_t *order;
+	uint32_t *free_list;
+	uint32_t array_size;
+	uint32_t array_len;
+	uint32_t free_len;
+	struct stfu_frame out_frame;
 	uint32_t interval;
-	uint32_t miss_count;
+	uint32_t last_diff;
+	uint32_t max_ts;
+	uint8_t have_max_ts;
 	uint8_t running;
+	uint32_t next_ts;
+	uint32_t plc_run;
+	uint32_t over_count;
+	uint32_t tick;
+	int32_t last_transit;
+	uint8_t have_transit;
+	int32_t base_transit;
+	int32_t window_min;
+	uint32_t window_count;
+	uint32_t peak;
+	uint32_t jitter16;
+	uint32_t target;
+	uint32_t min_delay;
+	uint32_t max_delay;
+	stfu_n_plc_func_t plc_func;
+	void *plc_user_data;
+	stfu_report_t stats;
 };
 
 
-static stfu_status_t stfu_n_resize_aqueue(stfu_queue_t *queue, uint32_t qlen)
+static stfu_frame_t *stfu_n_head(stfu_instance_t *i)
+{
+	return i->array_len ? &i->array[i->order[0]] : NULL;
+}
+
+static stfu_frame_t *stfu_n_tail(stfu_instance_t *i)
 {
-    unsigned char *m;
+	return i->array_len ? &i->array[i->order[i->array_len - 1]] : NULL;
+}
 
-    if (qlen <= queue->array_size) {
-        return STFU_IT_FAILED;;
-    }
+static void stfu_n_pop(stfu_instance_t *i)
+{
+	if (i->array_len) {
+		i->free_list[i->free_len++] = i->order[0];
+		memmove(i->order, i->order + 1, --i->array_len * sizeof(*i->order));
+	}
+}
 
-	m = realloc(queue->array, qlen * sizeof(struct stfu_frame));
-    assert(m);
-    memset(m + queue->array_size, 0, qlen * sizeof(struct stfu_frame) - queue->array_size);
-    queue->array = (struct stfu_frame *) m;
-	queue->array_size = qlen;
-	return STFU_IT_WORKED;
+static void stfu_n_flush(stfu_instance_t *i)
+{
+	while (i->array_len) {
+		stfu_n_pop(i);
+	}
+	i->running = 0;
+	i->plc_run = 0;
+	i->over_count = 0;
 }
 
-static void stfu_n_init_aqueue(stfu_queue_t *queue, uint32_t qlen)
+/* The transit floor only means something within one sender timeline, jitter and peak describe the network and are kept */
+static void stfu_n_rebase_transit(stfu_instance_t *i)
 {
-	queue->array = calloc(qlen, sizeof(struct stfu_frame));
-	assert(queue->array != NULL);
-	memset(queue->array, 0, sizeof(struct stfu_frame) * qlen);	
-	queue->array_size = qlen;
-	queue->int_frame.plc = 1;
+	i->have_transit = 0;
+	i->base_transit = 0;
+	i->window_min = 0;
+	i->window_count = 0;
 }
 
 void stfu_n_destroy(stfu_instance_t **i)
@@ -86,32 +113,94 @@ void stfu_n_destroy(stfu_instance_t **i)
 	if (i && *i) {
 		ii = *i;
 		*i = NULL;
-		free(ii->a_queue.array);
-		free(ii->b_queue.array);
+		free(ii->array);
+		free(ii->order);
+		free(ii->free_list);
 		free(ii);
 	}
 }
 
 void stfu_n_report(stfu_instance_t *i, stfu_report_t *r)
 {
-    assert(i);
-    r->in_len = i->in_queue->array_len;
-    r->in_size = i->in_queue->array_size;
-    r->out_len = i->out_queue->array_len;
-    r->out_size = i->out_queue->array_size;
+	assert(i);
+	*r = i->stats;
+	r->in_len = i->array_len;
+	r->in_size = i->array_size;
+	r->out_len = i->target;
+	r->out_size = i->max_delay;
+	r->interval = i->interval;
+	r->jitter = i->jitter16 >> 4;
+}
+
+/* Grow the number of frames we can hold, queued frames keep their slots */
+static stfu_status_t stfu_n_grow(stfu_instance_t *i, uint32_t size)
+{
+	void *m;
+	uint32_t x;
+
+	if (size <= i->array_size) {
+		return STFU_IT_FAILED;
+	}
+
+	m = realloc(i->array, size * sizeof(*i->array));
+	assert(m);
+	i->array = m;
+	m = realloc(i->order, size * sizeof(*i->order));
+	assert(m);
+	i->order = m;
+	m = realloc(i->free_list, size * sizeof(*i->free_list));
+	assert(m);
+	i->free_list = m;
+
+	memset(i->array + i->array_size, 0, (size - i->array_size) * sizeof(*i->array));
+	for (x = i->array_size; x < size; x++) {
+		i->free_list[i->free_len++] = x;
+	}
+	i->array_size = size;
+
+	return STFU_IT_WORKED;
+}
+
+void stfu_n_set_delay_range(stfu_instance_t *i, uint32_t min_frames, uint32_t max_frames)
+{
+	if (!min_frames) {
+		min_frames = 1;
+	}
+	if (max_frames < min_frames) {
+		max_frames = min_frames;
+	}
+	if (max_frames + STFU_SHRINK_SLACK + 1 > i->array_size) {
+		stfu_n_grow(i, max_frames + STFU_SHRINK_SLACK + 1);
+	}
+
+	i->min_delay = min_frames;
+	i->max_delay = max_frames;
+
+	if (i->target < min_frames) {
+		i->target = min_frames;
+	} else if (i->target > max_frames) {
+		i->target = max_frames;
+	}
+}
+
+void stfu_n_set_plc_func(stfu_instance_t *i, stfu_n_plc_func_t func, void *user_data)
+{
+	i->plc_func = func;
+	i->plc_user_data = user_data;
 }
 
-stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen) 
+stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen)
 {
-    stfu_status_t s;
+	if (qlen <= i->max_delay) {
+		return STFU_IT_FAILED;
+	}
+
+	stfu_n_set_delay_range(i, i->min_delay, qlen);
 
-    if ((s = stfu_n_resize_aqueue(&i->a_queue, qlen)) == STFU_IT_WORKED) {
-        s = stfu_n_resize_aqueue(&i->b_queue, qlen);
-    }
-    
-    return s;
+	return STFU_IT_WORKED;
 }
 
+/* qlen is the longest delay in frames the buffer may grow to, it starts at one frame and adapts to the jitter it sees */
 stfu_instance_t *stfu_n_init(uint32_t qlen)
 {
 	struct stfu_instance *i;
@@ -121,199 +210,286 @@ stfu_instance_t *stfu_n_init(uint32_t qlen)
 		return NULL;
 	}
 	memset(i, 0, sizeof(*i));
-	stfu_n_init_aqueue(&i->a_queue, qlen);
-	stfu_n_init_aqueue(&i->b_queue, qlen);
-	i->in_queue = &i->a_queue;
-	i->out_queue = &i->b_queue;
+
+	if (!qlen) {
+		qlen = 1;
+	}
+
+	stfu_n_grow(i, qlen * 2 > qlen + STFU_SHRINK_SLACK + 1 ? qlen * 2 : qlen + STFU_SHRINK_SLACK + 1);
+	stfu_n_set_delay_range(i, 1, qlen);
+	i->out_frame.plc = 0;
+
 	return i;
 }
 
+/* Start over on a new talkspurt, what we learned about the interval and the network is kept */
 void stfu_n_reset(stfu_instance_t *i)
 {
-	i->in_queue = &i->a_queue;
-	i->out_queue = &i->b_queue;
-	i->in_queue->array_len = 0;
-	i->out_queue->array_len = 0;
-	i->out_queue->wr_len = 0;
-	i->out_queue->last_index = 0;
-	i->miss_count = 0;	
-	i->last_ts = 0;
-	i->running = 0;
-	i->miss_count = 0;
-	i->interval = 0;
+	stfu_n_flush(i);
+	i->have_max_ts = 0;
+	i->out_frame.dlen = 0;
 }
 
-static int32_t stfu_n_measure_interval(stfu_queue_t *queue)
+/* Start over on a new timeline (new SSRC or a timestamp jump), transit times are measured from scratch */
+void stfu_n_resync(stfu_instance_t *i)
 {
-	uint32_t index;
-	int32_t d, most = 0, last = 0, this, track[STFU_MAX_TRACK] = {0};
-
-	for(index = 0; index < queue->array_len; index++) {
-		this = queue->array[index].ts;
-		if (last) {
-
-			if ((d = this - last) > 0 && d / 10 < STFU_MAX_TRACK) {
-				track[(d/10)]++;
-			}
-		}
+	stfu_n_reset(i);
+	stfu_n_rebase_transit(i);
+}
 
-		last = this;
+/* Learn the frame interval from the timestamp step between packets that arrive in order */
+static void stfu_n_measure_interval(stfu_instance_t *i, uint32_t diff)
+{
+	if (!diff || diff / 10 >= STFU_MAX_TRACK) {
+		i->last_diff = 0;
+		return;
 	}
 
-	for(index = 0; index < STFU_MAX_TRACK; index++) {
-		if (track[index] > track[most]) {
-			most = index;
-		}
+	if (diff == i->last_diff && (!i->interval || diff < i->interval)) {
+		i->interval = diff;
 	}
 
-	return most * 10;
+	i->last_diff = diff;
 }
 
-static int16_t stfu_n_process(stfu_instance_t *i, stfu_queue_t *queue)
+/* Track how late each packet is compared to the earliest one we have seen and size the target delay from it */
+static void stfu_n_update_delay(stfu_instance_t *i, uint32_t ts)
 {
-	if (!i->interval && !(i->interval = stfu_n_measure_interval(queue))) {
-		return -1;
+	int32_t transit, d;
+	uint32_t dev, target;
+
+	if (!i->interval) {
+		return;
+	}
+
+	transit = (int32_t)(i->tick * i->interval - ts);
+
+	if (!i->have_transit) {
+		i->have_transit = 1;
+		i->last_transit = i->base_transit = i->window_min = transit;
+		i->window_count = 0;
+		return;
 	}
 
-	return 0;
+	d = transit - i->last_transit;
+	if (d < 0) {
+		d = -d;
+	}
+	i->last_transit = transit;
+	i->jitter16 += d - ((i->jitter16 + 8) >> 4);
+
+	if (transit < i->window_min) {
+		i->window_min = transit;
+	}
+	if (transit < i->base_transit) {
+		i->base_transit = transit;
+	}
+	if (++i->window_count >= STFU_BASE_WINDOW) {
+		i->base_transit = i->window_min;
+		i->window_min = transit;
+		i->window_count = 0;
+	}
+
+	dev = (uint32_t)(transit - i->base_transit);
+
+	/* jump to any new peak right away, let it bleed off slowly */
+	if (dev > i->peak) {
+		i->peak = dev;
+	} else {
+		i->peak -= (i->peak >> 8) ? (i->peak >> 8) : (i->peak ? 1 : 0);
+	}
+
+	target = (i->peak + i->interval - 1) / i->interval + 1;
+
+	if (target < i->min_delay) {
+		target = i->min_delay;
+	} else if (target > i->max_delay) {
+		target = i->max_delay;
+	}
+
+	i->target = target;
 }
 
 stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void *data, size_t datalen, int last)
 {
-	uint32_t index;
-	stfu_frame_t *frame;
+	uint32_t index, pos;
+	stfu_frame_t *frame, *head;
 	size_t cplen = 0;
 
-	if (last || i->in_queue->array_len == i->in_queue->array_size) {
-		stfu_queue_t *other_queue;
+	if (last) {
+		return STFU_IM_DONE;
+	}
+
+	i->stats.packets++;
 
-		if (i->out_queue->wr_len < i->out_queue->array_len) {
-			return STFU_IT_FAILED;
+	if (i->have_max_ts) {
+		int32_t diff = STFU_TS_DIFF(ts, i->max_ts);
+
+		if (i->interval && (diff > (int32_t) (STFU_MAX_JUMP * i->interval) || diff < -(int32_t) (STFU_MAX_JUMP * i->interval))) {
+			/* new stream or the sender restarted its clock, whatever we hold is from another timeline */
+			i->stats.ts_jumps++;
+			stfu_n_resync(i);
+		} else if (diff > 0) {
+			stfu_n_measure_interval(i, (uint32_t) diff);
+		} else if (diff < 0) {
+			i->stats.reordered++;
 		}
+	}
+
+	if (i->running && STFU_TS_DIFF(ts, i->next_ts) < 0) {
+		/* already played or concealed that one */
+		i->stats.late++;
+		return STFU_IT_FAILED;
+	}
+
+	if (!i->have_max_ts || STFU_TS_DIFF(ts, i->max_ts) > 0) {
+		i->max_ts = ts;
+		i->have_max_ts = 1;
+	}
 
-		other_queue = i->in_queue;
-		i->in_queue = i->out_queue;
-		i->out_queue = other_queue;
+	stfu_n_update_delay(i, ts);
 
-		i->in_queue->array_len = 0;
-		i->out_queue->wr_len = 0;
-		i->out_queue->last_index = 0;
-		i->miss_count = 0;
+	/* keep the queue sorted by timestamp, in order arrivals land at the end */
+	for (pos = i->array_len; pos > 0; pos--) {
+		int32_t d = STFU_TS_DIFF(i->array[i->order[pos - 1]].ts, ts);
 
-		if (stfu_n_process(i, i->out_queue) < 0) {
-            if (i->in_queue->array_len == i->in_queue->array_size && i->out_queue->array_len == i->out_queue->array_size) {
-                stfu_n_resize(i, i->out_queue->array_size * 2);
-            }
-			//return STFU_IT_FAILED;
+		if (d == 0) {
+			i->stats.duplicate++;
+			return STFU_IT_FAILED;
 		}
-		for(index = 0; index < i->out_queue->array_len; index++) {
-			i->out_queue->array[index].was_read = 0;
+		if (d < 0) {
+			break;
 		}
 	}
 
-	if (last) {
-		return STFU_IM_DONE;
+	if (!i->free_len) {
+		/* out of room, the oldest frame goes */
+		i->stats.dropped++;
+		if (!pos) {
+			return STFU_IT_FAILED;
+		}
+		stfu_n_pop(i);
+		pos--;
+		if (i->running && (head = stfu_n_head(i))) {
+			i->next_ts = head->ts;
+		}
 	}
 
-	index = i->in_queue->array_len++;
-	frame = &i->in_queue->array[index];
+	index = i->free_list[--i->free_len];
+	memmove(i->order + pos + 1, i->order + pos, (i->array_len - pos) * sizeof(*i->order));
+	i->order[pos] = index;
+	i->array_len++;
+
+	frame = &i->array[index];
 
 	if ((cplen = datalen) > sizeof(frame->data)) {
 		cplen = sizeof(frame->data);
 	}
 
 	memcpy(frame->data, data, cplen);
-    frame->pt = pt;
+	frame->pt = pt;
 	frame->ts = ts;
 	frame->dlen = cplen;
-	frame->was_read = 0;	
+	frame->was_read = 0;
+	frame->plc = 0;
 
 	return STFU_IT_WORKED;
 }
 
-stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
+static stfu_frame_t *stfu_n_play(stfu_instance_t *i)
 {
-	uint32_t index, index2;
-	uint32_t should_have = 0;
-	stfu_frame_t *frame = NULL, *rframe = NULL;
+	stfu_frame_t *frame = stfu_n_head(i);
 
-	if (((i->out_queue->wr_len == i->out_queue->array_len) || !i->out_queue->array_len)) {
-		return NULL;
-	}
+	i->out_frame.ts = frame->ts;
+	i->out_frame.pt = frame->pt;
+	i->out_frame.dlen = frame->dlen;
+	i->out_frame.plc = 0;
+	i->out_frame.was_read = 1;
+	memcpy(i->out_frame.data, frame->data, frame->dlen);
 
-	if (i->running) {
-		should_have = i->last_ts + i->interval;
-	} else {
-		should_have = i->out_queue->array[0].ts;
-	}
+	i->next_ts = frame->ts + i->interval;
+	i->plc_run = 0;
+	stfu_n_pop(i);
+
+	return &i->out_frame;
+}
+
+/* Call once per frame interval, the returned frame stays valid until the next call */
+stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
+{
+	stfu_frame_t *head;
+	uint32_t span;
+
+	i->tick++;
+	head = stfu_n_head(i);
 
-	for(index = 0; index < i->out_queue->array_len; index++) {
-		if (i->out_queue->array[index].was_read) {
-			continue;
+	if (!i->running) {
+		if (!i->interval || !head) {
+			return NULL;
 		}
 
-		frame = &i->out_queue->array[index];
-
-		if (frame->ts != should_have) {
-			unsigned int tried = 0;
-			for (index2 = 0; index2 < i->out_queue->array_len; index2++) {
-				if (i->out_queue->array[index2].was_read) {
-					continue;
-				}
-				tried++;
-				if (i->out_queue->array[index2].ts == should_have) {
-					rframe = &i->out_queue->array[index2];
-					i->out_queue->last_index = index2;
-					goto done;
-				}
-			}
-			for (index2 = 0; index2 < i->in_queue->array_len; index2++) {
-				if (i->in_queue->array[index2].was_read) {
-					continue;
-				}
-				tried++;
-				if (i->in_queue->array[index2].ts == should_have) {
-					rframe = &i->in_queue->array[index2];
-					goto done;
-				}
-			}
+		/* prime the buffer up to the target delay */
+		span = STFU_TS_DIFF(stfu_n_tail(i)->ts, head->ts) / i->interval + 1;
+		if (span < i->target) {
+			return NULL;
+		}
+		i->running = 1;
+		i->next_ts = head->ts;
+		i->plc_run = 0;
+		i->over_count = 0;
+	}
 
-			i->miss_count++;
+	while ((head = stfu_n_head(i)) && STFU_TS_DIFF(head->ts, i->next_ts) < 0) {
+		i->stats.late++;
+		stfu_n_pop(i);
+	}
 
-			if (i->miss_count > 10 || (i->in_queue->array_len == i->in_queue->array_size) || tried >= i->in_queue->array_size) {
-				i->running = 0;
-				i->interval = 0;
-				i->out_queue->wr_len = i->out_queue->array_size;
-				return NULL;
+	if (head && head->ts == i->next_ts) {
+		span = STFU_TS_DIFF(stfu_n_tail(i)->ts, head->ts) / i->interval + 1;
+
+		/* sitting on more delay than the network needs, play one frame short to catch up */
+		if (span > i->target + STFU_SHRINK_SLACK && i->array_len > 1) {
+			if (++i->over_count >= i->target * 2) {
+				i->over_count = 0;
+				i->stats.dropped++;
+				stfu_n_pop(i);
+				head = stfu_n_head(i);
+				i->next_ts = head->ts;
 			}
-
-			i->last_ts = should_have;
-			rframe = &i->out_queue->int_frame;
-			rframe->dlen = i->out_queue->array[i->out_queue->last_index].dlen;
-			/* poor man's plc..  Copy the last frame, but we flag it so you can use a better one if you wish */
-			memcpy(rframe->data, i->out_queue->array[i->out_queue->last_index].data, rframe->dlen);
-			rframe->ts = should_have;
-			i->out_queue->wr_len++;
-			i->running = 1;
-			return rframe;			
 		} else {
-			rframe = &i->out_queue->array[index];
-			i->out_queue->last_index = index;
-			goto done;
+			i->over_count = 0;
 		}
+
+		return stfu_n_play(i);
 	}
 
-done:
+	if (head && STFU_TS_DIFF(head->ts, i->next_ts) > (int32_t) (STFU_MAX_JUMP * i->interval)) {
+		i->stats.ts_jumps++;
+		i->next_ts = head->ts;
+		return stfu_n_play(i);
+	}
 
-	if (rframe) {
-		i->out_queue->wr_len++;
-		i->last_ts = rframe->ts;
-		rframe->was_read = 1;
-		i->running = 1;
-		i->miss_count = 0;
+	if (i->plc_run >= STFU_MAX_PLC || !i->out_frame.dlen) {
+		/* the sender has gone quiet (DTX) or we have nothing to conceal with */
+		if (head) {
+			i->next_ts = head->ts;
+			return stfu_n_play(i);
+		}
+		i->running = 0;
+		return NULL;
+	}
+
+	/* missing frame: conceal it, by default with a copy of the last one */
+	i->plc_run++;
+	i->stats.plc++;
+	i->out_frame.ts = i->next_ts;
+	i->out_frame.plc = 1;
+	if (i->plc_func) {
+		i->plc_func(i, &i->out_frame, i->plc_run, i->plc_user_data);
 	}
+	i->next_ts += i->interval;
 
-	return rframe;
+	return &i->out_frame;
 }
 
 /* For Emacs:
@@ -65,6 +65,12 @@ typedef unsigned long   in_addr_t;
 #define STFU_DATALEN 16384
 #define STFU_QLEN 300
 #define STFU_MAX_TRACK 256
+/* consecutive missing frames we conceal before treating the stream as paused (DTX) */
+#define STFU_MAX_PLC 5
+/* a gap of more than this many frames is a timestamp jump, not loss */
+#define STFU_MAX_JUMP 50
+/* frames over the target delay we tolerate before dropping one to catch up */
+#define STFU_SHRINK_SLACK 2
 
 typedef enum {
 	STFU_IT_FAILED,
@@ -86,21 +92,38 @@ struct stfu_instance;
 typedef struct stfu_instance stfu_instance_t;
 
 typedef struct {
-	uint32_t in_len;
-	uint32_t in_size;
-	uint32_t out_len;
-	uint32_t out_size;
-
+	uint32_t in_len;		/* frames waiting to be played */
+	uint32_t in_size;		/* frames we can hold */
+	uint32_t out_len;		/* current target delay in frames */
+	uint32_t out_size;		/* largest target delay allowed */
+	uint32_t interval;		/* timestamp units per frame */
+	uint32_t jitter;		/* RFC 3550 interarrival jitter in timestamp units */
+	uint32_t packets;
+	uint32_t late;
+	uint32_t reordered;
+	uint32_t duplicate;
+	uint32_t dropped;
+	uint32_t plc;
+	uint32_t ts_jumps;
 } stfu_report_t;
 
+/*
+ * Called when a frame is missing at playout time.  frame holds a copy of the last frame played
+ * (plain repetition), count is how many frames in a row have been concealed so far.
+ * Rewrite frame->data/dlen and return non-zero to provide your own concealment.
+ */
+typedef int (*stfu_n_plc_func_t)(stfu_instance_t *i, stfu_frame_t *frame, uint32_t count, void *user_data);
 
 void stfu_n_report(stfu_instance_t *i, stfu_report_t *r);
 void stfu_n_destroy(stfu_instance_t **i);
 stfu_instance_t *stfu_n_init(uint32_t qlen);
 stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen);
+void stfu_n_set_delay_range(stfu_instance_t *i, uint32_t min_frames, uint32_t max_frames);
+void stfu_n_set_plc_func(stfu_instance_t *i, stfu_n_plc_func_t func, void *user_data);
 stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void *data, size_t datalen, int last);
 stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i);
 void stfu_n_reset(stfu_instance_t *i);
+void stfu_n_resync(stfu_instance_t *i);
 
 #define stfu_im_done(i) stfu_n_add_data(i, 0, NULL, 0, 1)
 #define stfu_n_eat(i,t,p,d,l) stfu_n_add_data(i, t, p, d, l, 0)
@@ -0,0 +1,247 @@
+/*
+ * STFU trace replay
+ *
+ * stfu never reads a clock, it only sees stfu_n_add_data() and one stfu_n_read_a_frame() per frame
+ * interval, so an arrival trace can be played through it offline and the result is the same every run.
+ *
+ * stfu_replay                      run the built in scenarios and fail on a regression
+ * stfu_replay trace [ms [qlen]]    replay a trace, one packet per line: arrival_ms rtp_ts [m]
+ *                                  (ms is the frame interval, default 20, qlen the longest delay, default 10)
+ *
+ * cc -Ilibs/stfu libs/stfu/stfu.c libs/stfu/stfu_replay.c -o stfu_replay
+ */
+#include "stfu.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REPLAY_MAX 100000
+
+typedef struct {
+	uint32_t arrival;
+	uint32_t ts;
+	int m;
+} replay_packet_t;
+
+typedef struct {
+	uint32_t played;
+	uint32_t plc;
+	uint32_t empty;
+	uint32_t target_before_m;
+	uint32_t target_after_m;
+	uint32_t marks;
+} replay_result_t;
+
+static replay_packet_t packets[REPLAY_MAX];
+
+static int by_arrival(const void *a, const void *b)
+{
+	const replay_packet_t *pa = a, *pb = b;
+
+	return pa->arrival < pb->arrival ? -1 : pa->arrival > pb->arrival;
+}
+
+/* Feed the packets in arrival order and read one frame every ms, like switch_rtp does with a timer */
+static void replay(stfu_instance_t *jb, replay_packet_t *p, int count, uint32_t ms, replay_result_t *res)
+{
+	uint32_t now, end;
+	char data[160] = { 0 };
+	int x = 0, since_m = -1;
+
+	memset(res, 0, sizeof(*res));
+	qsort(p, count, sizeof(*p), by_arrival);
+	end = count ? p[count - 1].arrival + 20 * ms : 0;
+
+	for (now = 0; now <= end; now += ms) {
+		stfu_frame_t *frame;
+
+		for (; x < count && p[x].arrival <= now; x++) {
+			stfu_report_t r;
+
+			if (p[x].m) {
+				stfu_n_report(jb, &r);
+				res->target_before_m += r.out_len;
+				stfu_n_reset(jb);
+				res->marks++;
+				since_m = 0;
+			}
+
+			stfu_n_eat(jb, p[x].ts, 0, data, sizeof(data));
+
+			/* a few packets into the new talkspurt the target must still be what the network needed before it */
+			if (since_m >= 0 && ++since_m == 3) {
+				stfu_n_report(jb, &r);
+				res->target_after_m += r.out_len;
+				since_m = -1;
+			}
+		}
+
+		if (!(frame = stfu_n_read_a_frame(jb))) {
+			res->empty++;
+		} else if (frame->plc) {
+			res->plc++;
+		} else {
+			res->played++;
+		}
+	}
+}
+
+static void print_report(const char *name, stfu_instance_t *jb, replay_result_t *res)
+{
+	stfu_report_t r;
+
+	stfu_n_report(jb, &r);
+	printf("%s: played %u plc %u empty %u | interval %u jitter %u target %u/%u late %u reordered %u dup %u dropped %u jumps %u\n",
+		   name, res->played, res->plc, res->empty, r.interval, r.jitter, r.out_len, r.out_size,
+		   r.late, r.reordered, r.duplicate, r.dropped, r.ts_jumps);
+}
+
+/* small deterministic generator so every run sees the same network */
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(uint32_t range)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return (rnd_state >> 16) % range;
+}
+
+static int check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+	return ok ? 0 : 1;
+}
+
+/* 20ms talkspurts of 50 frames with 10 frames of silence between them and up to 60ms of jitter */
+static int scenario_talkspurts(void)
+{
+	stfu_instance_t *jb = stfu_n_init(10);
+	replay_result_t res;
+	stfu_report_t r;
+	int n = 0, spurt, k, bad = 0;
+
+	rnd_state = 1;
+	for (spurt = 0; spurt < 20; spurt++) {
+		for (k = 0; k < 50; k++) {
+			uint32_t slot = spurt * 60 + k;
+
+			packets[n].ts = slot * 160;
+			packets[n].arrival = slot * 20 + rnd(60);
+			packets[n].m = !k;
+			n++;
+		}
+	}
+
+	replay(jb, packets, n, 20, &res);
+	print_report("talkspurts", jb, &res);
+	stfu_n_report(jb, &r);
+
+	bad += check(r.interval == 160, "interval learned from the timestamps");
+	bad += check(r.out_len > 1, "target delay grew to cover the jitter");
+	bad += check(res.target_after_m == res.target_before_m, "marker resets keep the target delay");
+	bad += check(r.ts_jumps == 0, "silence between talkspurts is not a timestamp jump");
+	bad += check(res.plc <= res.marks * STFU_MAX_PLC + 10, "concealment is mostly the tail of each talkspurt");
+
+	stfu_n_destroy(&jb);
+
+	return bad;
+}
+
+/* a steady stream whose sender restarts its timestamps half way through */
+static int scenario_jump(void)
+{
+	stfu_instance_t *jb = stfu_n_init(10);
+	replay_result_t res;
+	stfu_report_t r;
+	int n, bad = 0;
+
+	for (n = 0; n < 1000; n++) {
+		packets[n].ts = (n < 500 ? 0 : 0x40000000) + n * 160;
+		packets[n].arrival = n * 20;
+		packets[n].m = 0;
+	}
+
+	replay(jb, packets, n, 20, &res);
+	print_report("jump", jb, &res);
+	stfu_n_report(jb, &r);
+
+	bad += check(r.ts_jumps >= 1, "timestamp jump detected");
+	bad += check(res.plc <= STFU_MAX_PLC, "a jump costs no more than one concealment run");
+	bad += check(res.played >= 990, "playout continues on the new timeline");
+
+	stfu_n_destroy(&jb);
+
+	return bad;
+}
+
+/* the interval bound is the one the old histogram had, steps up to 2559 are frame intervals */
+static int scenario_interval(void)
+{
+	stfu_instance_t *jb;
+	replay_result_t res;
+	stfu_report_t r;
+	uint32_t step[2] = { 2550, 2560 };
+	int n, s, bad = 0;
+
+	for (s = 0; s < 2; s++) {
+		jb = stfu_n_init(10);
+
+		for (n = 0; n < 100; n++) {
+			packets[n].ts = n * step[s];
+			packets[n].arrival = n * 20;
+			packets[n].m = 0;
+		}
+
+		replay(jb, packets, n, 20, &res);
+		stfu_n_report(jb, &r);
+		bad += check(s ? r.interval == 0 : r.interval == step[s], s ? "a 2560 step is not an interval" : "a 2550 step is an interval");
+		stfu_n_destroy(&jb);
+	}
+
+	return bad;
+}
+
+static int replay_file(const char *path, uint32_t ms, uint32_t qlen)
+{
+	stfu_instance_t *jb;
+	replay_result_t res;
+	FILE *f;
+	char line[256], m[8];
+	int n = 0;
+
+	if (!(f = fopen(path, "r"))) {
+		perror(path);
+		return 1;
+	}
+
+	while (n < REPLAY_MAX && fgets(line, sizeof(line), f)) {
+		m[0] = '\0';
+		if (sscanf(line, "%u %u %7s", &packets[n].arrival, &packets[n].ts, m) >= 2) {
+			packets[n].m = m[0] == 'm';
+			n++;
+		}
+	}
+	fclose(f);
+
+	jb = stfu_n_init(qlen);
+	replay(jb, packets, n, ms, &res);
+	print_report(path, jb, &res);
+	stfu_n_destroy(&jb);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int bad = 0;
+
+	if (argc > 1) {
+		return replay_file(argv[1], argc > 2 ? atoi(argv[2]) : 20, argc > 3 ? atoi(argv[3]) : 10);
+	}
+
+	bad += scenario_talkspurts();
+	bad += scenario_jump();
+	bad += scenario_interval();
+
+	printf("%s\n", bad ? "FAIL" : "PASS");
+
+	return bad ? 1 : 0;
+}
@@ -88,5 +88,78 @@ uint8_t ulaw_to_alaw(uint8_t ulaw)
 	return ulaw_to_alaw_table[ulaw];
 }
 
+/*- End of function --------------------------------------------------------*/
+
+/* Both companders here quantize negative input one step later than positive input, so
+   (linear - (linear < 0)) >> 2 selects the same code for every sample in a group of four.
+   That keeps the encode tables at 16K entries each, small enough to stay in cache. */
+#define G711_ENCODE_OFFSET 8193
+#define G711_ENCODE_SIZE (G711_ENCODE_OFFSET + 8192)
+#define G711_ENCODE_INDEX(_l) (((((int) (_l)) + (((int) (_l)) >> 31)) >> 2) + G711_ENCODE_OFFSET)
+
+static uint8_t linear_to_ulaw_table[G711_ENCODE_SIZE];
+static uint8_t linear_to_alaw_table[G711_ENCODE_SIZE];
+static int16_t ulaw_to_linear_table[256];
+static int16_t alaw_to_linear_table[256];
+
+void g711_init_tables(void)
+{
+	int i;
+
+	for (i = -32768; i < 32768; i++) {
+		linear_to_ulaw_table[G711_ENCODE_INDEX(i)] = linear_to_ulaw(i);
+		linear_to_alaw_table[G711_ENCODE_INDEX(i)] = linear_to_alaw(i);
+	}
+
+	for (i = 0; i < 256; i++) {
+		ulaw_to_linear_table[i] = ulaw_to_linear((uint8_t) i);
+		alaw_to_linear_table[i] = alaw_to_linear((uint8_t) i);
+	}
+}
+
+/*- End of function --------------------------------------------------------*/
+
+void ulaw_encode_block(uint8_t *ulaw, const int16_t *linear, int samples)
+{
+	int i;
+
+	for (i = 0; i < samples; i++) {
+		ulaw[i] = linear_to_ulaw_table[G711_ENCODE_INDEX(linear[i])];
+	}
+}
+
+/*- End of function --------------------------------------------------------*/
+
+void ulaw_decode_block(int16_t *linear, const uint8_t *ulaw, int samples)
+{
+	int i;
+
+	for (i = 0; i < samples; i++) {
+		linear[i] = ulaw_to_linear_table[ulaw[i]];
+	}
+}
+
+/*- End of function --------------------------------------------------------*/
+
+void alaw_encode_block(uint8_t *alaw, const int16_t *linear, int samples)
+{
+	int i;
+
+	for (i = 0; i < samples; i++) {
+		alaw[i] = linear_to_alaw_table[G711_ENCODE_INDEX(linear[i])];
+	}
+}
+
+/*- End of function --------------------------------------------------------*/
+
+void alaw_decode_block(int16_t *linear, const uint8_t *alaw, int samples)
+{
+	int i;
+
+	for (i = 0; i < samples; i++) {
+		linear[i] = alaw_to_linear_table[alaw[i]];
+	}
+}
+
 /*- End of function --------------------------------------------------------*/
 /*- End of file ------------------------------------------------------------*/
@@ -0,0 +1,180 @@
+/*
+ * g711_test.c - check the table driven G.711 block coders against the inline coders
+ *
+ * Every linear input and every code is run through both, any difference fails the test.
+ * Then one 20ms packet is coded over and over by each to show what the tables buy.
+ *
+ * cc -O2 -Isrc/include src/g711.c src/g711_test.c -o g711_test && ./g711_test [iterations]
+ *
+ * This file is in the public domain, like g711.c itself.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifndef _MSC_VER
+#include <inttypes.h>
+#endif
+
+#include "g711.h"
+
+#define PACKET_SAMPLES 160
+
+static int check_encode(const char *name, void (*block) (uint8_t *, const int16_t *, int), uint8_t (*single) (int))
+{
+	static int16_t linear[65536];
+	static uint8_t coded[65536];
+	int i, bad = 0;
+
+	for (i = 0; i < 65536; i++) {
+		linear[i] = (int16_t) (i - 32768);
+	}
+
+	block(coded, linear, 65536);
+
+	for (i = 0; i < 65536; i++) {
+		if (coded[i] != single(linear[i])) {
+			if (bad++ < 10) {
+				fprintf(stderr, "%s encode %d: block %u inline %u\n", name, linear[i], coded[i], single(linear[i]));
+			}
+		}
+	}
+
+	printf("%s encode: 65536 inputs, %d mismatches\n", name, bad);
+
+	return bad;
+}
+
+static int check_decode(const char *name, void (*block) (int16_t *, const uint8_t *, int), int16_t (*single) (uint8_t))
+{
+	uint8_t coded[256];
+	int16_t linear[256];
+	int i, bad = 0;
+
+	for (i = 0; i < 256; i++) {
+		coded[i] = (uint8_t) i;
+	}
+
+	block(linear, coded, 256);
+
+	for (i = 0; i < 256; i++) {
+		if (linear[i] != single(coded[i])) {
+			if (bad++ < 10) {
+				fprintf(stderr, "%s decode %d: block %d inline %d\n", name, i, linear[i], single(coded[i]));
+			}
+		}
+	}
+
+	printf("%s decode: 256 codes, %d mismatches\n", name, bad);
+
+	return bad;
+}
+
+/* the inline coders are static inline in g711.h, these give them an address */
+static uint8_t ulaw_encode_one(int linear)
+{
+	return linear_to_ulaw(linear);
+}
+
+static uint8_t alaw_encode_one(int linear)
+{
+	return linear_to_alaw(linear);
+}
+
+static int16_t ulaw_decode_one(uint8_t ulaw)
+{
+	return ulaw_to_linear(ulaw);
+}
+
+static int16_t alaw_decode_one(uint8_t alaw)
+{
+	return alaw_to_linear(alaw);
+}
+
+static double seconds(clock_t start)
+{
+	return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench(int iterations)
+{
+	int16_t linear[PACKET_SAMPLES];
+	uint8_t coded[PACKET_SAMPLES];
+	unsigned int sink = 0;
+	clock_t start;
+	double inline_enc, block_enc, inline_dec, block_dec;
+	int i, j;
+
+	/* something speech shaped, so the inline coder's branches are not all taken the same way */
+	for (i = 0; i < PACKET_SAMPLES; i++) {
+		linear[i] = (int16_t) (((i * 7919) % 65536) - 32768) / ((i % 7) + 1);
+	}
+
+	start = clock();
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < PACKET_SAMPLES; i++) {
+			coded[i] = linear_to_ulaw(linear[i]);
+		}
+		sink += coded[j % PACKET_SAMPLES];
+		linear[j % PACKET_SAMPLES] ^= 1;
+	}
+	inline_enc = seconds(start);
+
+	start = clock();
+	for (j = 0; j < iterations; j++) {
+		ulaw_encode_block(coded, linear, PACKET_SAMPLES);
+		sink += coded[j % PACKET_SAMPLES];
+		linear[j % PACKET_SAMPLES] ^= 1;
+	}
+	block_enc = seconds(start);
+
+	start = clock();
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < PACKET_SAMPLES; i++) {
+			linear[i] = ulaw_to_linear(coded[i]);
+		}
+		sink += linear[j % PACKET_SAMPLES];
+		coded[j % PACKET_SAMPLES]++;
+	}
+	inline_dec = seconds(start);
+
+	start = clock();
+	for (j = 0; j < iterations; j++) {
+		ulaw_decode_block(linear, coded, PACKET_SAMPLES);
+		sink += linear[j % PACKET_SAMPLES];
+		coded[j % PACKET_SAMPLES]++;
+	}
+	block_dec = seconds(start);
+
+	printf("%d packets of %d samples (checksum %u)\n", iterations, PACKET_SAMPLES, sink);
+	printf("ulaw encode: inline %.3fs block %.3fs\n", inline_enc, block_enc);
+	printf("ulaw decode: inline %.3fs block %.3fs\n", inline_dec, block_dec);
+}
+
+int main(int argc, char *argv[])
+{
+	int bad = 0, iterations = 200000;
+
+	if (argc > 1) {
+		iterations = atoi(argv[1]);
+	}
+
+	g711_init_tables();
+
+	bad += check_encode("ulaw", ulaw_encode_block, ulaw_encode_one);
+	bad += check_encode("alaw", alaw_encode_block, alaw_encode_one);
+	bad += check_decode("ulaw", ulaw_decode_block, ulaw_decode_one);
+	bad += check_decode("alaw", alaw_decode_block, alaw_decode_one);
+
+	if (bad) {
+		fprintf(stderr, "FAIL\n");
+		return 1;
+	}
+
+	if (iterations > 0) {
+		bench(iterations);
+	}
+
+	return 0;
+}
@@ -333,6 +333,39 @@ extern "C" {
 */
 	uint8_t ulaw_to_alaw(uint8_t ulaw);
 
+/*! \brief Build the lookup tables used by the block coders below.
+    \note Call it once before any of them is used, the core does so when it loads its PCM codecs.
+*/
+	void g711_init_tables(void);
+
+/*! \brief Encode a block of linear samples to u-law, bit exact with linear_to_ulaw().
+    \param ulaw The u-law output buffer.
+    \param linear The linear samples to encode.
+    \param samples The number of samples.
+*/
+	void ulaw_encode_block(uint8_t *ulaw, const int16_t *linear, int samples);
+
+/*! \brief Decode a block of u-law samples to linear, bit exact with ulaw_to_linear().
+    \param linear The linear output buffer.
+    \param ulaw The u-law samples to decode.
+    \param samples The number of samples.
+*/
+	void ulaw_decode_block(int16_t *linear, const uint8_t *ulaw, int samples);
+
+/*! \brief Encode a block of linear samples to A-law, bit exact with linear_to_alaw().
+    \param alaw The A-law output buffer.
+    \param linear The linear samples to encode.
+    \param samples The number of samples.
+*/
+	void alaw_encode_block(uint8_t *alaw, const int16_t *linear, int samples);
+
+/*! \brief Decode a block of A-law samples to linear, bit exact with alaw_to_linear().
+    \param linear The linear output buffer.
+    \param alaw The A-law samples to decode.
+    \param samples The number of samples.
+*/
+	void alaw_decode_block(int16_t *linear, const uint8_t *alaw, int samples);
+
 #ifdef __cplusplus
 }
 #endif
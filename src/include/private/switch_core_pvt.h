@@ -147,6 +147,9 @@ struct switch_core_session {
 	switch_queue_t *private_event_queue_pri;
 	switch_thread_rwlock_t *bug_rwlock;
 	switch_media_bug_t *bugs;
+	/* media threads walking the bug list, by epoch, see switch_core_media_bug_enter() */
+	volatile uint32_t bug_readers[2];
+	volatile uint32_t bug_epoch;
 	switch_app_log_t *app_log;
 	uint32_t stack_count;
 
@@ -169,16 +172,25 @@ struct switch_core_session {
 	uint32_t soft_lock;
 };
 
+/* single producer/single consumer audio ring, written by the media thread and drained by the bug */
+typedef struct switch_media_bug_ring {
+	uint8_t *data;
+	uint32_t size;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t flush;
+	uint32_t flushed;
+	volatile uint32_t dropped;
+} switch_media_bug_ring_t;
+
 struct switch_media_bug {
-	switch_buffer_t *raw_write_buffer;
-	switch_buffer_t *raw_read_buffer;
+	switch_media_bug_ring_t *raw_write_buffer;
+	switch_media_bug_ring_t *raw_read_buffer;
 	switch_frame_t *read_replace_frame_in;
 	switch_frame_t *read_replace_frame_out;
 	switch_frame_t *write_replace_frame_in;
 	switch_frame_t *write_replace_frame_out;
 	switch_media_bug_callback_t callback;
-	switch_mutex_t *read_mutex;
-	switch_mutex_t *write_mutex;
 	switch_core_session_t *session;
 	void *user_data;
 	uint32_t flags;
@@ -233,6 +245,7 @@ struct switch_runtime {
 	switch_profile_timer_t *profile_timer;
 	double profile_time;
 	double min_idle_time;
+	uint32_t cpu_count;
 };
 
 extern struct switch_runtime runtime;
@@ -244,6 +257,8 @@ struct switch_session_manager {
 	uint32_t session_count;
 	uint32_t session_limit;
 	switch_size_t session_id;
+	switch_mutex_t *index_mutex;
+	switch_hash_t *var_index;
 };
 
 extern struct switch_session_manager session_manager;
@@ -254,6 +269,21 @@ switch_status_t switch_core_sqldb_start(switch_memory_pool_t *pool, switch_bool_
 void switch_core_sqldb_stop(void);
 void switch_core_session_init(switch_memory_pool_t *pool);
 void switch_core_session_uninit(void);
+void switch_core_session_index_update(const char *uuid, const char *var_name, const char *old_val, const char *new_val);
 void switch_core_state_machine_init(switch_memory_pool_t *pool);
 switch_memory_pool_t *switch_core_memory_init(void);
 void switch_core_memory_stop(void);
+uint32_t switch_core_cpu_slot(uint32_t slots);
+void switch_core_probes_init(void);
+void switch_core_probes_shutdown(void);
+void switch_core_memory_pool_recycle_max(uint32_t max);
+void switch_core_memory_pool_account(switch_memory_pool_t *pool, const char *endpoint, const char *app);
+void switch_regex_cache_init(switch_memory_pool_t *pool);
+void switch_regex_cache_shutdown(void);
+void switch_resample_cache_init(switch_memory_pool_t *pool);
+void switch_resample_cache_shutdown(void);
+void switch_core_file_cache_init(switch_memory_pool_t *pool);
+void switch_core_file_cache_shutdown(void);
+uint32_t switch_core_media_bug_enter(switch_core_session_t *session);
+void switch_core_media_bug_leave(switch_core_session_t *session, uint32_t epoch);
+switch_size_t switch_core_media_bug_ring_write(switch_media_bug_ring_t *ring, const void *data, switch_size_t datalen);
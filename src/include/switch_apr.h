@@ -431,6 +431,20 @@ SWITCH_DECLARE(switch_status_t) switch_thread_rwlock_unlock(switch_thread_rwlock
 
 /** @} */
 
+/**
+ * @defgroup switch_memory_barrier Memory Barrier
+ * @ingroup switch_apr
+ * @{
+ */
+
+/**
+ * Keep the loads and stores before the call from being reordered with the ones after it,
+ * for data handed between threads without a lock
+ */
+SWITCH_DECLARE(void) switch_memory_barrier(void);
+
+/** @} */
+
 /**
  * @defgroup switch_thread_cond Condition Variable Routines
  * @ingroup switch_apr 
@@ -977,6 +991,13 @@ SWITCH_DECLARE(switch_status_t) switch_thread_create(switch_thread_t ** new_thre
 /** Freeswitch's socket address type, used to ensure protocol independence */
 	 typedef struct apr_sockaddr_t switch_sockaddr_t;
 
+/** The native socket descriptor under a switch_socket_t */
+#ifdef WIN32
+	 typedef SOCKET switch_os_socket_t;
+#else
+	 typedef int switch_os_socket_t;
+#endif
+
 	 typedef enum {
 		 SWITCH_SHUTDOWN_READ,	   /**< no longer allow read request */
 		 SWITCH_SHUTDOWN_WRITE,	   /**< no longer allow write requests */
@@ -1004,6 +1025,13 @@ SWITCH_DECLARE(switch_status_t) switch_thread_create(switch_thread_t ** new_thre
  */
 SWITCH_DECLARE(switch_status_t) switch_socket_create(switch_socket_t ** new_sock, int family, int type, int protocol, switch_memory_pool_t *pool);
 
+/**
+ * Get the native descriptor of a socket, for use with OS specific pollers.
+ * @param thesock The descriptor
+ * @param sock The socket
+ */
+SWITCH_DECLARE(switch_status_t) switch_os_sock_get(switch_os_socket_t *thesock, switch_socket_t *sock);
+
 /**
  * Shutdown either reading, writing, or both sides of a socket.
  * @param sock The socket to close 
@@ -1133,6 +1161,27 @@ SWITCH_DECLARE(switch_status_t) switch_socket_sendto(switch_socket_t *sock, swit
  */
 SWITCH_DECLARE(switch_status_t) switch_socket_recvfrom(switch_sockaddr_t *from, switch_socket_t *sock, int32_t flags, char *buf, size_t *len);
 
+/**
+ * Read several datagrams from a non-blocking socket in one call where the platform allows it
+ * @param sock The socket to use
+ * @param from Array of count switch_sockaddr_t to fill in the sender of each datagram
+ * @param bufs Array of count buffers to use
+ * @param lens Array of count buffer lengths, replaced with the length of each datagram
+ * @param count The number of buffers available, replaced with the number of datagrams read
+ * @remark returns SWITCH_STATUS_BREAK when nothing was waiting
+ */
+SWITCH_DECLARE(switch_status_t) switch_socket_recvmmsg(switch_socket_t *sock, switch_sockaddr_t **from, char **bufs, switch_size_t *lens, uint32_t *count);
+
+/**
+ * Send several datagrams to one address in one call where the platform allows it
+ * @param sock The socket to use
+ * @param where The switch_sockaddr_t describing where to send the data
+ * @param bufs Array of count buffers to send
+ * @param lens Array of count buffer lengths
+ * @param count The number of buffers to send, replaced with the number actually sent
+ */
+SWITCH_DECLARE(switch_status_t) switch_socket_sendmmsg(switch_socket_t *sock, switch_sockaddr_t *where, char **bufs, switch_size_t *lens, uint32_t *count);
+
 SWITCH_DECLARE(switch_status_t) switch_socket_atmark(switch_socket_t *sock, int *atmark);
 
 /**
@@ -262,6 +262,14 @@ SWITCH_DECLARE(switch_status_t) switch_channel_export_variable_printf(switch_cha
 SWITCH_DECLARE(const char *) switch_channel_get_variable_dup(switch_channel_t *channel, const char *varname, switch_bool_t dup);
 #define switch_channel_get_variable(_c, _v) switch_channel_get_variable_dup(_c, _v, SWITCH_TRUE)
 
+/*!
+  \brief Retrieve a copy of a channel variable that lives outside the session pool
+  \param channel channel to retrieve variable from
+  \param varname the name of the variable
+  \return a malloc'd copy of the value (caller frees) or NULL if the channel doesn't have it, no caller profile or global fallback
+*/
+SWITCH_DECLARE(char *) switch_channel_get_variable_strdup(switch_channel_t *channel, const char *varname);
+
 SWITCH_DECLARE(switch_status_t) switch_channel_get_variables(switch_channel_t *channel, switch_event_t **event);
 
 SWITCH_DECLARE(switch_status_t) switch_channel_pass_callee_id(switch_channel_t *channel, switch_channel_t *other_channel);
@@ -225,6 +225,13 @@ SWITCH_DECLARE(void) switch_core_media_bug_set_read_replace_frame(_In_ switch_me
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove(_In_ switch_core_session_t *session, _Inout_ switch_media_bug_t **bug);
 SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *session);
 
+/*!
+  \brief Count the media bugs attached to a session
+  \param session the session to check
+  \return the number of bugs
+*/
+SWITCH_DECLARE(uint32_t) switch_core_media_bug_count(switch_core_session_t *session);
+
 /*!
   \brief Remove media bug callback
   \param bug bug to remove
@@ -782,6 +789,32 @@ SWITCH_DECLARE(void) switch_core_session_hupall(_In_ switch_call_cause_t cause);
   \param cause the hangup cause to apply to the hungup channels
 */
 SWITCH_DECLARE(void) switch_core_session_hupall_matching_var(_In_ const char *var_name, _In_ const char *var_val, _In_ switch_call_cause_t cause);
+
+/*! 
+  \brief Run a callback on every live session, each one is read locked for the duration of the callback
+  \param callback the callback to run, return non-zero to stop walking
+  \param pArg user data for the callback
+  \return the number of sessions walked
+*/
+SWITCH_DECLARE(uint32_t) switch_core_session_walk(_In_ switch_core_session_walk_callback_t callback, _In_opt_ void *pArg);
+
+/*! 
+  \brief Run a callback on every live session with a specific channel variable value
+  \param var_name The variable name to look for (sip_call_id and presence_id are indexed, anything else is a scan)
+  \param var_val The value to look for 
+  \param callback the callback to run, return non-zero to stop walking
+  \param pArg user data for the callback
+  \return the number of sessions walked
+*/
+SWITCH_DECLARE(uint32_t) switch_core_session_walk_matching_var(_In_ const char *var_name, _In_ const char *var_val,
+															   _In_ switch_core_session_walk_callback_t callback, _In_opt_ void *pArg);
+
+/*! 
+  \brief Check if lookups on a channel variable are indexed
+  \param var_name The variable name
+  \return SWITCH_TRUE if the variable is indexed
+*/
+SWITCH_DECLARE(switch_bool_t) switch_core_session_var_indexed(_In_z_ const char *var_name);
 /*! 
   \brief Hangup all sessions that belong to an endpoint
   \param endpoint_interface The endpoint interface 
@@ -1600,6 +1633,25 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(_In_ switch_file_handle_t
 
 SWITCH_DECLARE(switch_status_t) switch_core_file_truncate(switch_file_handle_t *fh, int64_t offset);
 
+/*!
+  \brief Get or set the size of the decoded file cache
+  \param megs the new size in megabytes, 0 disables the cache and drops what it holds
+  \return the previous size
+*/
+SWITCH_DECLARE(uint32_t) switch_core_file_cache_size(uint32_t megs);
+
+/*!
+  \brief Drop every decoded file from the cache, handles playing from it keep their copy
+  \return the number of entries dropped
+*/
+SWITCH_DECLARE(uint32_t) switch_core_file_cache_flush(void);
+
+/*!
+  \brief Write the file cache counters to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_stats(switch_stream_handle_t *stream);
+
 
 ///\}
 
@@ -1978,6 +2030,11 @@ SWITCH_DECLARE(void) switch_core_memory_reclaim(void);
 SWITCH_DECLARE(void) switch_core_memory_reclaim_events(void);
 SWITCH_DECLARE(void) switch_core_memory_reclaim_logger(void);
 SWITCH_DECLARE(void) switch_core_memory_reclaim_all(void);
+/*!
+  \brief Write pool recycling counters and per endpoint/application pool high-water marks to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_core_memory_pool_stats(switch_stream_handle_t *stream);
 SWITCH_DECLARE(void) switch_core_setrlimits(void);
 SWITCH_DECLARE(switch_time_t) switch_time_ref(void);
 SWITCH_DECLARE(void) switch_time_sync(void);
@@ -1996,10 +2053,64 @@ SWITCH_DECLARE(void) switch_time_set_monotonic(switch_bool_t enable);
 SWITCH_DECLARE(void) switch_time_set_nanosleep(switch_bool_t enable);
 SWITCH_DECLARE(void) switch_time_set_matrix(switch_bool_t enable);
 SWITCH_DECLARE(void) switch_time_set_cond_yield(switch_bool_t enable);
+SWITCH_DECLARE(void) switch_time_set_timerfd(switch_bool_t enable);
 SWITCH_DECLARE(uint32_t) switch_core_min_dtmf_duration(uint32_t duration);
 SWITCH_DECLARE(uint32_t) switch_core_max_dtmf_duration(uint32_t duration);
 SWITCH_DECLARE(double) switch_core_min_idle_cpu(double new_limit);
 SWITCH_DECLARE(double) switch_core_idle_cpu(void);
+
+SWITCH_DECLARE_DATA extern volatile int switch_core_probes_active;
+
+/*!
+  \brief Start timing a probe point, returns 0 when the probes are off
+*/
+#define switch_core_probe_start() (switch_core_probes_active ? switch_time_ref() : 0)
+
+/*!
+  \brief Record the time elapsed since switch_core_probe_start() into a probe histogram
+  \param _probe the switch_probe_t to record into
+  \param _start the value returned by switch_core_probe_start()
+*/
+#define switch_core_probe_end(_probe, _start) if (_start) switch_core_probe_record(_probe, switch_time_ref() - (_start))
+
+/*!
+  \brief Add one sample to a probe histogram
+  \param probe the probe
+  \param usec the sample in microseconds
+*/
+SWITCH_DECLARE(void) switch_core_probe_record(switch_probe_t probe, switch_time_t usec);
+
+/*!
+  \brief Turn the latency probes on or off
+  \param on SWITCH_TRUE to start sampling
+*/
+SWITCH_DECLARE(void) switch_core_probes_set(switch_bool_t on);
+
+/*!
+  \brief Clear all probe histograms
+*/
+SWITCH_DECLARE(void) switch_core_probes_reset(void);
+
+/*!
+  \brief Get the name of a probe
+  \param probe the probe
+  \return the name or NULL
+*/
+SWITCH_DECLARE(const char *) switch_core_probe_name(switch_probe_t probe);
+
+/*!
+  \brief Write the count, percentiles and max of every probe to a stream
+  \param stream the stream to write to
+  \param csv write comma separated values instead of a table
+*/
+SWITCH_DECLARE(void) switch_core_probes_dump(switch_stream_handle_t *stream, switch_bool_t csv);
+
+/*!
+  \brief Fire one CUSTOM core::probes event per probe that has samples
+  \return SWITCH_STATUS_SUCCESS if events were fired
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_probes_fire_events(void);
+SWITCH_DECLARE(uint32_t) switch_core_cpu_count(void);
 SWITCH_DECLARE(uint32_t) switch_core_default_dtmf_duration(uint32_t duration);
 SWITCH_DECLARE(switch_status_t) switch_console_set_complete(const char *string);
 SWITCH_DECLARE(switch_status_t) switch_console_set_alias(const char *string);
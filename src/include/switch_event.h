@@ -69,7 +69,10 @@ SWITCH_BEGIN_EXTERN_C
 	char *value;
 	/*! hash of the header name */
 	unsigned long hash;
+	/*! storage flags (private to the event engine) */
+	int flags;
 	struct switch_event_header *next;
+	struct switch_event_header *prev;
 };
 
 /*! \brief Representation of an event */
@@ -96,6 +99,14 @@ struct switch_event {
 	unsigned long key;
 	struct switch_event *next;
 	int flags;
+	/*! number of headers in the list */
+	uint32_t header_count;
+	/*! open addressed index on the header hash, built once the event grows past a few headers */
+	switch_event_header_t **index;
+	/*! size of the index (power of 2) */
+	uint32_t index_size;
+	/*! one block holding the headers copied by switch_event_dup */
+	void *arena;
 };
 
 typedef enum {
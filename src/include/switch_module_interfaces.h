@@ -359,6 +359,12 @@ struct switch_file_handle {
 	char *file_path;
 	char *spool_path;
 	const char *prefix;
+	/*! decoded audio served from the core file cache instead of the module */
+	struct switch_file_cache_entry *cache_entry;
+	switch_size_t cache_pos;
+	/*! decoded audio collected on a cache miss, published at the end of the file */
+	switch_buffer_t *cache_fill;
+	char *cache_key;
 };
 
 /*! \brief Abstract interface to an asr module */
@@ -15,6 +15,9 @@
 /* Define if you have clock_nanosleep() */
 #cmakedefine HAVE_CLOCK_NANOSLEEP
 
+/* Define to 1 if you have the `timerfd_create' function. */
+#cmakedefine HAVE_TIMERFD_CREATE
+
 /* Define to 1 if you have the <dirent.h> header file, and it defines `DIR'.
    */
 #cmakedefine HAVE_DIRENT_H
@@ -83,6 +86,9 @@
 /* Define to 1 if you have the `pselect' function. */
 #cmakedefine HAVE_PSELECT
 
+/* Define to 1 if you have the `recvmmsg' function. */
+#cmakedefine HAVE_RECVMMSG
+
 /* RLIMIT_MEMLOCK constant for setrlimit */
 #cmakedefine HAVE_RLIMIT_MEMLOCK
 
@@ -92,6 +98,12 @@
 /* SCHED_RR constant for sched_setscheduler */
 #cmakedefine HAVE_SCHED_RR
 
+/* Define to 1 if you have the `sched_getcpu' function. */
+#cmakedefine HAVE_SCHED_GETCPU
+
+/* Define to 1 if you have the `sendmmsg' function. */
+#cmakedefine HAVE_SENDMMSG
+
 /* Define to 1 if you have the `sched_setscheduler' function. */
 #cmakedefine HAVE_SCHED_SETSCHEDULER
 
@@ -132,6 +144,9 @@
    */
 #cmakedefine HAVE_SYS_DIR_H
 
+/* Define to 1 if you have the <sys/epoll.h> header file. */
+#cmakedefine HAVE_SYS_EPOLL_H
+
 /* Define to 1 if you have the <sys/filio.h> header file. */
 #cmakedefine HAVE_SYS_FILIO_H
 
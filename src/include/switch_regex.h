@@ -70,6 +70,24 @@ SWITCH_DECLARE(switch_status_t) switch_regex_match(const char *target, const cha
 */
 SWITCH_DECLARE(switch_status_t) switch_regex_match_partial(const char *target, const char *expression, int *partial_match);
 
+/*!
+ \brief Drop every compiled expression held in the regex cache
+*/
+SWITCH_DECLARE(void) switch_regex_cache_flush(void);
+
+/*!
+ \brief Query or change the maximum number of compiled expressions kept in the regex cache
+ \param new_size the new size (0 disables the cache) or (uint32_t) -1 to leave it alone
+ \return the current size
+*/
+SWITCH_DECLARE(uint32_t) switch_regex_cache_size(uint32_t new_size);
+
+/*!
+ \brief Write the regex cache statistics to a stream
+ \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_regex_cache_status(switch_stream_handle_t *stream);
+
 
 #define switch_regex_safe_free(re)	if (re) {\
 				switch_regex_free(re);\
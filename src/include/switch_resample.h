@@ -42,7 +42,9 @@
 
 #ifndef SWITCH_RESAMPLE_H
 #define SWITCH_RESAMPLE_H
-#define SWITCH_RESAMPLE_QUALITY 2
+/* pass as the quality to get whatever switch_resample_default_quality() says, any 0-10 is used as is */
+#define SWITCH_RESAMPLE_QUALITY -1
+#define SWITCH_RESAMPLE_DEFAULT_QUALITY 2
 #include <switch.h>
 SWITCH_BEGIN_EXTERN_C
 /*!
@@ -66,6 +68,10 @@ SWITCH_BEGIN_EXTERN_C
 	uint32_t to_len;
 	/*! the total size of the to buffer */
 	uint32_t to_size;
+	/*! the quality the resampler was built with */
+	int quality;
+	/*! the number of interleaved channels */
+	uint32_t channels;
 
 } switch_audio_resampler_t;
 
@@ -74,8 +80,9 @@ SWITCH_BEGIN_EXTERN_C
   \param new_resampler NULL pointer to aim at the new handle
   \param from_rate the rate to transfer from in hz
   \param to_rate the rate to transfer to in hz
-  \param quality the quality desired
+  \param quality the quality desired, SWITCH_RESAMPLE_QUALITY means the configured default
   \return SWITCH_STATUS_SUCCESS if the handle was created
+  \note handles come from a cache of idle resamplers when one with the same rates, quality and channels is available
  */
 SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
 															   uint32_t from_rate, uint32_t to_rate, uint32_t to_size,
@@ -90,6 +97,20 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
  */
 SWITCH_DECLARE(void) switch_resample_destroy(switch_audio_resampler_t **resampler);
 
+/*!
+  \brief Get or set the quality used for handles created with SWITCH_RESAMPLE_QUALITY
+  \param quality the new quality (0-10) or -1 to leave it alone
+  \return the quality in effect
+ */
+SWITCH_DECLARE(int) switch_resample_default_quality(int quality);
+
+/*!
+  \brief Get or set how many idle resamplers are kept for reuse
+  \param new_size the new size, 0 disables the cache
+  \return the previous size
+ */
+SWITCH_DECLARE(uint32_t) switch_resample_cache_size(uint32_t new_size);
+
 /*!
   \brief Resample one float buffer into another using specifications of a given handle
   \param resampler the resample handle
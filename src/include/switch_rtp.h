@@ -90,6 +90,19 @@ SWITCH_DECLARE(void) switch_rtp_get_random(void *buf, uint32_t len);
 SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool);
 SWITCH_DECLARE(void) switch_rtp_shutdown(void);
 
+/*!
+  \brief Hand RTP sockets to a pool of epoll reactor threads instead of reading them from the session threads
+  \param threads number of reactor threads, -1 for one per cpu, 0 to disable
+  \note must be called before the first RTP session is created
+*/
+SWITCH_DECLARE(void) switch_rtp_set_reactor_threads(int threads);
+
+/*!
+  \brief Write the RTP reactor counters (packets, reads, session wakeups, drops) to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_rtp_reactor_stats(switch_stream_handle_t *stream);
+
 /*!
   \brief Set/Get RTP start port
   \param port new value (if > 0)
@@ -226,7 +239,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_activate_rtcp(switch_rtp_t *rtp_sessi
 /*! 
   \brief Acvite a jitter buffer on an RTP session
   \param rtp_session the rtp session
-  \param queue_frames the number of frames to delay
+  \param queue_frames the most frames the buffer may delay, the actual delay adapts to the measured jitter
   \return SWITCH_STATUS_SUCCESS
 */
 SWITCH_DECLARE(switch_status_t) switch_rtp_activate_jitter_buffer(switch_rtp_t *rtp_session, uint32_t queue_frames);
@@ -368,6 +381,24 @@ SWITCH_DECLARE(switch_status_t) switch_rtcp_zerocopy_read_frame(switch_rtp_t *rt
 
 SWITCH_DECLARE(void) rtp_flush_read_buffer(switch_rtp_t *rtp_session, switch_rtp_flush_t flush);
 
+/*!
+  \brief Relay audio received on one RTP session straight out of another from the reactor thread
+  \param rtp_session the RTP session to read from
+  \param peer the RTP session to send on, NULL to stop relaying
+  \return SWITCH_STATUS_SUCCESS if the packets are being relayed
+  \note payload type, SSRC, sequence and timestamp are rewritten into the peer's own stream,
+        both sessions must be serviced by the RTP reactor and use the same codec
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_set_relay(switch_rtp_t *rtp_session, switch_rtp_t *peer);
+
+/*!
+  \brief Keep the media timeout of a relaying RTP session running while its read path is bypassed
+  \param rtp_session the RTP session being relayed from
+  \return SWITCH_STATUS_TIMEOUT once no packet was relayed for the session's max missed packets, SWITCH_STATUS_SUCCESS otherwise
+  \note call it periodically from the thread that would otherwise read the session
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_relay_check(switch_rtp_t *rtp_session);
+
 /*!
   \brief Enable VAD on an RTP Session
   \param rtp_session the RTP session
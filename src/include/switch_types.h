@@ -476,6 +476,12 @@ typedef struct {
 	switch_size_t dtmf_packet_count;
 	switch_size_t cng_packet_count;
 	switch_size_t flush_packet_count;
+	switch_size_t jb_plc_packet_count;
+	switch_size_t jb_late_packet_count;
+	switch_size_t jb_reorder_packet_count;
+	switch_size_t jb_drop_packet_count;
+	switch_size_t jb_jitter_ms;
+	switch_size_t jb_target_ms;
 } switch_rtp_numbers_t;
 
 typedef struct {
@@ -1548,6 +1554,32 @@ typedef enum {
 	SCSC_SHUTDOWN_CHECK
 } switch_session_ctl_t;
 
+/*!
+  \enum switch_probe_t
+  \brief Latency probe points on the media and signalling hot paths
+<pre>
+	SWITCH_PROBE_READ_FRAME   - switch_core_session_read_frame after the endpoint returned a frame
+	SWITCH_PROBE_WRITE_FRAME  - switch_core_session_write_frame
+	SWITCH_PROBE_CODEC_ENCODE - switch_core_codec_encode
+	SWITCH_PROBE_CODEC_DECODE - switch_core_codec_decode
+	SWITCH_PROBE_MEDIA_BUG    - one pass over the read or write media bugs of a session
+	SWITCH_PROBE_RTP_READ     - switch_rtp_zerocopy_read_frame (includes the socket wait in blocking mode)
+	SWITCH_PROBE_EVENT_FIRE   - switch_event_fire
+	SWITCH_PROBE_XML_FETCH    - the xml bindings consulted by switch_xml_locate
+</pre>
+ */
+typedef enum {
+	SWITCH_PROBE_READ_FRAME,
+	SWITCH_PROBE_WRITE_FRAME,
+	SWITCH_PROBE_CODEC_ENCODE,
+	SWITCH_PROBE_CODEC_DECODE,
+	SWITCH_PROBE_MEDIA_BUG,
+	SWITCH_PROBE_RTP_READ,
+	SWITCH_PROBE_EVENT_FIRE,
+	SWITCH_PROBE_XML_FETCH,
+	SWITCH_PROBE_MAX
+} switch_probe_t;
+
 typedef enum {
 	SSH_FLAG_STICKY = (1 << 0)
 } switch_state_handler_flag_t;
@@ -1619,6 +1651,7 @@ typedef struct switch_console_callback_match switch_console_callback_match_t;
 typedef switch_status_t (*switch_console_complete_callback_t) (const char *, const char *, switch_console_callback_match_t **matches);
 typedef switch_bool_t (*switch_media_bug_callback_t) (switch_media_bug_t *, void *, switch_abc_type_t);
 typedef switch_bool_t (*switch_tone_detect_callback_t) (switch_core_session_t *, const char *, const char *);
+typedef int (*switch_core_session_walk_callback_t) (switch_core_session_t *session, void *pArg);
 typedef struct switch_xml_binding switch_xml_binding_t;
 
 typedef switch_status_t (*switch_core_codec_encode_func_t) (switch_codec_t *codec,
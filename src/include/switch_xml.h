@@ -379,6 +379,13 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user_merged(const char *key, c
 
 SWITCH_DECLARE(void) switch_xml_merge_user(switch_xml_t user, switch_xml_t domain, switch_xml_t group);
 
+///\brief drop located users from the directory cache
+///\param key the key the user was looked up by or NULL for any
+///\param user_name the user or NULL for any
+///\param domain_name the domain or NULL for any
+///\return the number of entries removed
+SWITCH_DECLARE(uint32_t) switch_xml_clear_user_cache(const char *key, const char *user_name, const char *domain_name);
+
 SWITCH_DECLARE(switch_xml_t) switch_xml_dup(switch_xml_t xml);
 
 ///\brief open a config in the core registry
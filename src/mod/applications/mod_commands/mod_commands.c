@@ -108,6 +108,91 @@ SWITCH_STANDARD_API(db_cache_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define REGEX_CACHE_SYNTAX "status|flush|size [<entries>]"
+SWITCH_STANDARD_API(regex_cache_function)
+{
+	int argc;
+	char *mydata = NULL, *argv[2];
+
+	if (zstr(cmd)) {
+		goto error;
+	}
+
+	mydata = strdup(cmd);
+	switch_assert(mydata);
+
+	argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+
+	if (argc < 1) {
+		goto error;
+	}
+	if (!strcasecmp(argv[0], "status")) {
+		switch_regex_cache_status(stream);
+		goto ok;
+	} else if (!strcasecmp(argv[0], "flush")) {
+		switch_regex_cache_flush();
+		stream->write_function(stream, "+OK\n");
+		goto ok;
+	} else if (!strcasecmp(argv[0], "size")) {
+		uint32_t size = (uint32_t) -1;
+
+		if (argc > 1 && !zstr(argv[1])) {
+			size = (uint32_t) atoi(argv[1]);
+		}
+		stream->write_function(stream, "+OK %u\n", switch_regex_cache_size(size));
+		goto ok;
+	}
+
+  error:
+	stream->write_function(stream, "-USAGE: %s\n", REGEX_CACHE_SYNTAX);
+  ok:
+	switch_safe_free(mydata);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define PROBES_SYNTAX "[on|off|reset|csv|event]"
+SWITCH_STANDARD_API(probes_function)
+{
+	if (zstr(cmd)) {
+		switch_core_probes_dump(stream, SWITCH_FALSE);
+	} else if (!strcasecmp(cmd, "on")) {
+		switch_core_probes_set(SWITCH_TRUE);
+		stream->write_function(stream, "+OK\n");
+	} else if (!strcasecmp(cmd, "off")) {
+		switch_core_probes_set(SWITCH_FALSE);
+		stream->write_function(stream, "+OK\n");
+	} else if (!strcasecmp(cmd, "reset")) {
+		switch_core_probes_reset();
+		stream->write_function(stream, "+OK\n");
+	} else if (!strcasecmp(cmd, "csv")) {
+		switch_core_probes_dump(stream, SWITCH_TRUE);
+	} else if (!strcasecmp(cmd, "event")) {
+		if (switch_core_probes_fire_events() == SWITCH_STATUS_SUCCESS) {
+			stream->write_function(stream, "+OK\n");
+		} else {
+			stream->write_function(stream, "-ERR no samples\n");
+		}
+	} else {
+		stream->write_function(stream, "-USAGE: %s\n", PROBES_SYNTAX);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define FILE_CACHE_SYNTAX "[status|flush]"
+SWITCH_STANDARD_API(file_cache_function)
+{
+	if (zstr(cmd) || !strcasecmp(cmd, "status")) {
+		switch_core_file_cache_stats(stream);
+	} else if (!strcasecmp(cmd, "flush")) {
+		stream->write_function(stream, "+OK %u file(s) flushed\n", switch_core_file_cache_flush());
+	} else {
+		stream->write_function(stream, "-USAGE: %s\n", FILE_CACHE_SYNTAX);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(host_lookup_function)
 {
 	char host[256] = "";
@@ -1072,6 +1157,32 @@ SWITCH_STANDARD_API(find_user_function)
 	return _find_user(cmd, session, stream, SWITCH_FALSE);
 }
 
+#define XML_FLUSH_CACHE_SYNTAX "[<key> [<user> [<domain>]]]"
+SWITCH_STANDARD_API(xml_flush_function)
+{
+	char *mydata = NULL, *argv[3] = { 0 };
+	int argc, i;
+	uint32_t count;
+
+	if (!zstr(cmd)) {
+		mydata = strdup(cmd);
+		switch_assert(mydata);
+		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+
+		for (i = 0; i < argc; i++) {
+			if (!strcmp(argv[i], "*")) {
+				argv[i] = NULL;
+			}
+		}
+	}
+
+	count = switch_xml_clear_user_cache(argv[0], argv[1], argv[2]);
+	stream->write_function(stream, "+OK cleared %u entr%s\n", count, count == 1 ? "y" : "ies");
+
+	switch_safe_free(mydata);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(xml_locate_function)
 {
 	switch_xml_t xml = NULL, obj = NULL;
@@ -1510,6 +1621,9 @@ SWITCH_STANDARD_API(status_function)
 	stream->write_function(stream, "%d session(s) %d/%d\n", switch_core_session_count(), last_sps, sps);
 	stream->write_function(stream, "%d session(s) max\n", switch_core_session_limit(0));
 	stream->write_function(stream, "min idle cpu %0.2f/%0.2f\n", switch_core_min_idle_cpu(-1.0), switch_core_idle_cpu());
+	switch_core_memory_pool_stats(stream);
+	switch_core_file_cache_stats(stream);
+	switch_rtp_reactor_stats(stream);
 
 	if (html) {
 		stream->write_function(stream, "</b>\n");
@@ -3381,6 +3495,187 @@ SWITCH_STANDARD_API(alias_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* 
+   show channels is answered from the live sessions instead of the core db, the columns match the channels table so
+   the output doesn't change for anybody parsing it.  show calls still reads the calls table, a bridge row there can't
+   be rebuilt exactly from the sessions.
+*/
+
+static char *LIVE_CHANNEL_COLS[] = {
+	"uuid", "direction", "created", "created_epoch", "name", "state", "cid_name", "cid_num", "ip_addr", "dest",
+	"application", "application_data", "dialplan", "context", "read_codec", "read_rate", "write_codec", "write_rate",
+	"secure", "hostname", "presence_id", "presence_data", "callstate", "callee_name", "callee_num", "callee_direction",
+	"call_uuid", NULL
+};
+
+#define LIVE_MAX_COLS 27
+
+struct live_row {
+	switch_time_t created;
+	char *argv[LIVE_MAX_COLS];
+};
+
+struct live_holder {
+	struct live_row **rows;
+	uint32_t count;
+	uint32_t max;
+	char *like;
+};
+
+static const char *live_time_str(switch_time_t t, char *buf, switch_size_t len)
+{
+	switch_time_exp_t tm;
+	switch_size_t retsize;
+
+	switch_time_exp_lt(&tm, t);
+	switch_strftime_nocheck(buf, &retsize, len, "%Y-%m-%d %T", &tm);
+
+	return buf;
+}
+
+static char *live_var(switch_channel_t *channel, const char *name)
+{
+	char *r = switch_channel_get_variable_strdup(channel, name);
+
+	return r ? r : strdup("");
+}
+
+static void live_channel_row(switch_core_session_t *session, struct live_row *row)
+{
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	switch_caller_profile_t *cp = switch_channel_get_caller_profile(channel);
+	char buf[80];
+	char *sas1, *sas2;
+	const char *crypto;
+	int x = 0;
+
+	row->created = (cp && cp->times) ? cp->times->created : switch_micro_time_now();
+
+	row->argv[x++] = strdup(switch_core_session_get_uuid(session));
+	row->argv[x++] = strdup(switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND ? "outbound" : "inbound");
+	row->argv[x++] = strdup(live_time_str(row->created, buf, sizeof(buf)));
+	row->argv[x++] = switch_mprintf("%ld", (long) (row->created / 1000000));
+	row->argv[x++] = strdup(switch_str_nil(switch_channel_get_name(channel)));
+	row->argv[x++] = strdup(switch_channel_state_name(switch_channel_get_state(channel)));
+	row->argv[x++] = strdup(cp ? switch_str_nil(cp->caller_id_name) : "");
+	row->argv[x++] = strdup(cp ? switch_str_nil(cp->caller_id_number) : "");
+	row->argv[x++] = strdup(cp ? switch_str_nil(cp->network_addr) : "");
+	row->argv[x++] = strdup(cp ? switch_str_nil(cp->destination_number) : "");
+	row->argv[x++] = live_var(channel, SWITCH_CURRENT_APPLICATION_VARIABLE);
+	row->argv[x++] = live_var(channel, SWITCH_CURRENT_APPLICATION_DATA_VARIABLE);
+	row->argv[x++] = strdup(cp ? switch_str_nil(cp->dialplan) : "");
+	row->argv[x++] = strdup(cp ? switch_str_nil(cp->context) : "");
+	row->argv[x++] = live_var(channel, "read_codec");
+	row->argv[x++] = live_var(channel, "read_rate");
+	row->argv[x++] = live_var(channel, "write_codec");
+	row->argv[x++] = live_var(channel, "write_rate");
+	sas1 = switch_channel_get_variable_strdup(channel, "zrtp_sas1_string_audio");
+	sas2 = switch_channel_get_variable_strdup(channel, "zrtp_sas2_string_audio");
+	if (sas1 && sas2) {
+		row->argv[x++] = switch_mprintf("zrtp:%s:%s", sas1, sas2);
+	} else if ((crypto = switch_channel_get_variable(channel, "sip_has_crypto"))) {
+		/* set by switch_rtp_add_crypto_key, the same place that fires CALL_SECURE for srtp */
+		row->argv[x++] = switch_mprintf("srtp:%s", crypto);
+	} else {
+		row->argv[x++] = strdup("");
+	}
+	switch_safe_free(sas1);
+	switch_safe_free(sas2);
+	row->argv[x++] = strdup(switch_str_nil(switch_core_get_variable("hostname")));
+	row->argv[x++] = live_var(channel, "presence_id");
+	row->argv[x++] = live_var(channel, "presence_data");
+	row->argv[x++] = strdup(switch_channel_callstate2str(switch_channel_get_callstate(channel)));
+	row->argv[x++] = strdup(cp ? switch_str_nil(cp->callee_id_name) : "");
+	row->argv[x++] = strdup(cp ? switch_str_nil(cp->callee_id_number) : "");
+	row->argv[x++] = live_var(channel, "sip_callee_id_direction");
+	row->argv[x++] = live_var(channel, "call_uuid");
+}
+
+static void live_row_free(struct live_row *row)
+{
+	int x;
+
+	for (x = 0; x < LIVE_MAX_COLS; x++) {
+		switch_safe_free(row->argv[x]);
+	}
+	free(row);
+}
+
+static int live_collect_callback(switch_core_session_t *session, void *pArg)
+{
+	struct live_holder *lh = (struct live_holder *) pArg;
+	struct live_row *row;
+
+	switch_zmalloc(row, sizeof(*row));
+	live_channel_row(session, row);
+
+	/* uuid, name, cid_name, cid_num */
+	if (lh->like && !switch_stristr(lh->like, row->argv[0]) && !switch_stristr(lh->like, row->argv[4]) &&
+		!switch_stristr(lh->like, row->argv[6]) && !switch_stristr(lh->like, row->argv[7])) {
+		live_row_free(row);
+		return 0;
+	}
+
+	if (lh->count == lh->max) {
+		lh->max = lh->max ? lh->max * 2 : 64;
+		lh->rows = realloc(lh->rows, lh->max * sizeof(*lh->rows));
+		switch_assert(lh->rows);
+	}
+
+	lh->rows[lh->count++] = row;
+
+	return 0;
+}
+
+static int live_row_cmp(const void *a, const void *b)
+{
+	const struct live_row *ra = *(const struct live_row **) a, *rb = *(const struct live_row **) b;
+
+	return ra->created < rb->created ? -1 : ra->created > rb->created ? 1 : 0;
+}
+
+/* feeds the live rows to the same callbacks the sql results go through */
+static void show_live(const char *like, switch_core_db_callback_func_t callback, struct holder *holder)
+{
+	struct live_holder lh = { 0 };
+	char **cols = LIVE_CHANNEL_COLS;
+	char *mylike = NULL, *p, *q;
+	int argc = 0;
+	uint32_t x;
+
+	while (cols[argc]) {
+		argc++;
+	}
+
+	if (!zstr(like)) {
+		/* the sql version took a like pattern, the wildcards just mean substring here */
+		mylike = strdup(like);
+		for (p = q = mylike; *p; p++) {
+			if (*p != '%') {
+				*q++ = *p;
+			}
+		}
+		*q = '\0';
+		if (*mylike) {
+			lh.like = mylike;
+		}
+	}
+
+	switch_core_session_walk(live_collect_callback, &lh);
+
+	if (lh.count > 1) {
+		qsort(lh.rows, lh.count, sizeof(*lh.rows), live_row_cmp);
+	}
+
+	for (x = 0; x < lh.count; x++) {
+		callback(holder, argc, lh.rows[x]->argv, cols);
+		live_row_free(lh.rows[x]);
+	}
+
+	switch_safe_free(lh.rows);
+	switch_safe_free(mylike);
+}
+
 #define SHOW_SYNTAX "codec|endpoint|application|api|dialplan|file|timer|calls [count]|channels [count|like <match string>]|distinct_channels|aliases|complete|chat|management|modules|nat_map|say|interfaces|interface_types|tasks|limits"
 SWITCH_STANDARD_API(show_function)
 {
@@ -3395,6 +3690,8 @@ SWITCH_STANDARD_API(show_function)
 	switch_core_flag_t cflags = switch_core_flags();
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
 	char hostname[256] = "";
+	int live = 0;
+	char *like = NULL;
 	gethostname(hostname, sizeof(hostname));
 
 	if (switch_core_db_handle(&db) != SWITCH_STATUS_SUCCESS) {
@@ -3429,7 +3726,7 @@ SWITCH_STANDARD_API(show_function)
 
 	holder.print_title = 1;
 
-	if (!(cflags & SCF_USE_SQL) && command && !strcasecmp(command, "channels")) {
+	if (!(cflags & SCF_USE_SQL) && command && !strcasecmp(command, "distinct_channels")) {
 		stream->write_function(stream, "-ERR SQL DISABLED NO CHANNEL DATA AVAILABLE!\n");
 		goto end;
 	}
@@ -3480,32 +3777,15 @@ SWITCH_STANDARD_API(show_function)
 			}
 		}
 	} else if (!strcasecmp(command, "channels") && argv[1] && !strcasecmp(argv[1], "like")) {
+		live = 1;
 		if (argv[2]) {
-			char *p;
-			for (p = argv[2]; p && *p; p++) {
-				if (*p == '\'' || *p == ';') {
-					*p = ' ';
-				}
-			}
-			if (strchr(argv[2], '%')) {
-				sprintf(sql,
-						"select * from channels where hostname='%s' and uuid like '%s' or name like '%s' or cid_name like '%s' or cid_num like '%s' order by created_epoch",
-						hostname, argv[2], argv[2], argv[2], argv[2]);
-			} else {
-				sprintf(sql,
-						"select * from channels where hostname='%s' and uuid like '%%%s%%' or name like '%%%s%%' or cid_name like '%%%s%%' or cid_num like '%%%s%%' order by created_epoch",
-						hostname, argv[2], argv[2], argv[2], argv[2]);
-
-			}
-
+			like = argv[2];
 			if (argv[4] && !strcasecmp(argv[3], "as")) {
 				as = argv[4];
 			}
-		} else {
-			sprintf(sql, "select * from channels where hostname='%s' order by created_epoch", hostname);
 		}
 	} else if (!strcasecmp(command, "channels")) {
-		sprintf(sql, "select * from channels where hostname='%s' order by created_epoch", hostname);
+		live = 1;
 		if (argv[1] && !strcasecmp(argv[1], "count")) {
 			holder.justcount = 1;
 			if (argv[3] && !strcasecmp(argv[2], "as")) {
@@ -3567,7 +3847,11 @@ SWITCH_STANDARD_API(show_function)
 				holder.delim = ",";
 			}
 		}
-		switch_cache_db_execute_sql_callback(db, sql, show_callback, &holder, &errmsg);
+		if (live) {
+			show_live(like, show_callback, &holder);
+		} else {
+			switch_cache_db_execute_sql_callback(db, sql, show_callback, &holder, &errmsg);
+		}
 		if (holder.http) {
 			holder.stream->write_function(holder.stream, "</table>");
 		}
@@ -3583,7 +3867,11 @@ SWITCH_STANDARD_API(show_function)
 			stream->write_function(stream, "\n%u total.\n", holder.count);
 		}
 	} else if (!strcasecmp(as, "xml")) {
-		switch_cache_db_execute_sql_callback(db, sql, show_as_xml_callback, &holder, &errmsg);
+		if (live) {
+			show_live(like, show_as_xml_callback, &holder);
+		} else {
+			switch_cache_db_execute_sql_callback(db, sql, show_as_xml_callback, &holder, &errmsg);
+		}
 
 		if (errmsg) {
 			stream->write_function(stream, "-ERR SQL Error [%s]\n", errmsg);
@@ -4518,6 +4806,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	SWITCH_ADD_API(commands_api_interface, "console_complete_xml", "", console_complete_xml_function, "<line>");
 	SWITCH_ADD_API(commands_api_interface, "create_uuid", "Create a uuid", uuid_function, UUID_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "db_cache", "db cache management", db_cache_function, "status");
+	SWITCH_ADD_API(commands_api_interface, "regex_cache", "regex cache management", regex_cache_function, REGEX_CACHE_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "probes", "hot path latency histograms", probes_function, PROBES_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "file_cache", "decoded file cache", file_cache_function, FILE_CACHE_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "domain_exists", "check if a domain exists", domain_exists_function, "<domain>");
 	SWITCH_ADD_API(commands_api_interface, "echo", "echo", echo_function, "<data>");
 	SWITCH_ADD_API(commands_api_interface, "escape", "escape a string", escape_function, "<data>");
@@ -4606,12 +4897,23 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	SWITCH_ADD_API(commands_api_interface, "uuid_transfer", "Transfer a session", transfer_function, TRANSFER_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "uuid_simplify", "Try to cut out of a call path / attended xfer", uuid_simplify_function, SIMPLIFY_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "xml_locate", "find some xml", xml_locate_function, "[root | <section> <tag> <tag_attr_name> <tag_attr_val>]");
+	SWITCH_ADD_API(commands_api_interface, "xml_flush_cache", "clear xml user cache", xml_flush_function, XML_FLUSH_CACHE_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "xml_wrap", "Wrap another api command in xml", xml_wrap_api_function, "<command> <args>");
 	switch_console_set_complete("add alias add");
 	switch_console_set_complete("add alias del");
 	switch_console_set_complete("add complete add");
 	switch_console_set_complete("add complete del");
 	switch_console_set_complete("add db_cache status");
+	switch_console_set_complete("add regex_cache status");
+	switch_console_set_complete("add regex_cache flush");
+	switch_console_set_complete("add regex_cache size");
+	switch_console_set_complete("add probes on");
+	switch_console_set_complete("add probes off");
+	switch_console_set_complete("add probes reset");
+	switch_console_set_complete("add probes csv");
+	switch_console_set_complete("add probes event");
+	switch_console_set_complete("add file_cache status");
+	switch_console_set_complete("add file_cache flush");
 	switch_console_set_complete("add fsctl debug_level");
 	switch_console_set_complete("add fsctl last_sps");
 	switch_console_set_complete("add fsctl default_dtmf_duration");
@@ -35,6 +35,13 @@
  *
  */
 #include <switch.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CONF_MIX_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CONF_MIX_NEON
+#endif
 //#define INTENSE_DEBUG
 SWITCH_MODULE_LOAD_FUNCTION(mod_conference_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_conference_shutdown);
@@ -56,6 +63,13 @@ static int EC = 0;
 #define CONF_DBUFFER_MAX 0
 #define CONF_CHAT_PROTO "conf"
 
+/* upper bound for the mix-threads profile param */
+#define CONF_MIX_MAX_THREADS 16
+/* fewer listeners than this are always written by the conference thread alone */
+#define CONF_MIX_PARALLEL_MIN 64
+/* distinct codec setups a conference will run shared encoders for */
+#define CONF_MAX_SHARED_ENCODERS 8
+
 #ifndef MIN
 #define MIN(a, b) ((a)<(b)?(a):(b))
 #endif
@@ -176,7 +190,8 @@ typedef enum {
 	CFLAG_BRIDGE_TO = (1 << 6),
 	CFLAG_WAIT_MOD = (1 << 7),
 	CFLAG_VID_FLOOR = (1 << 8),
-	CFLAG_WASTE_BANDWIDTH = (1 << 9)
+	CFLAG_WASTE_BANDWIDTH = (1 << 9),
+	CFLAG_SHARED_ENCODER = (1 << 10)
 } conf_flag_t;
 
 typedef enum {
@@ -304,6 +319,7 @@ typedef struct conference_obj {
 	int mux_loop_count;
 	int member_loop_count;
 	int agc_level;
+	uint32_t mix_threads;
 
 	uint32_t avg_score;
 	uint32_t avg_itt;
@@ -325,6 +341,8 @@ struct conference_member {
 	switch_memory_pool_t *pool;
 	switch_buffer_t *audio_buffer;
 	switch_buffer_t *mux_buffer;
+	switch_buffer_t *enc_buffer;
+	struct conference_encoder *encoder;
 	switch_buffer_t *resample_buffer;
 	uint32_t flags;
 	uint32_t score;
@@ -368,6 +386,52 @@ struct conference_member {
 	struct conference_member *next;
 };
 
+/* One encoder shared by the members who are not talking and whose channels write with the same codec implementation */
+typedef struct conference_encoder {
+	const switch_codec_implementation_t *impl;
+	char *fmtp;
+	switch_codec_t codec;
+	switch_audio_resampler_t *resampler;
+	int ready;
+	uint32_t tick;
+	uint32_t datalen;
+	uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	struct conference_encoder *next;
+} conference_encoder_t;
+
+/* Header in front of every packet in a member's enc_buffer */
+typedef struct conference_enc_packet {
+	const switch_codec_implementation_t *impl;
+	uint32_t datalen;
+} conference_enc_packet_t;
+
+/* A run of listeners whose mix-minus frames are built and queued by one mixer thread */
+typedef struct conference_mix_slice {
+	conference_member_t **members;
+	uint32_t count;
+	const int32_t *main_frame;
+	const int16_t *total_frame;
+	uint32_t samples;
+	switch_queue_t *done;
+	int ok;
+} conference_mix_slice_t;
+
+/* Helper threads that share the per member output work of a large conference, started the first time it gets large */
+typedef struct conference_mixer {
+	uint32_t want;
+	int spawned;
+	switch_memory_pool_t *pool;
+	uint32_t threads;
+	switch_thread_t *thread[CONF_MIX_MAX_THREADS];
+	switch_queue_t *queue[CONF_MIX_MAX_THREADS];
+	switch_queue_t *done;
+	conference_mix_slice_t slice[CONF_MIX_MAX_THREADS + 1];
+	conference_member_t **members;
+	uint32_t members_size;
+	conference_encoder_t *encoders;
+	uint32_t tick;
+} conference_mixer_t;
+
 /* Record Node */
 typedef struct conference_record {
 	conference_obj_t *conference;
@@ -1000,14 +1064,352 @@ static void *SWITCH_THREAD_FUNC conference_video_thread_run(switch_thread_t *thr
 }
 
 /* Main monitor thread (1 per distinct conference room) */
+/* Add a member's samples into the 32 bit main frame */
+static inline void conference_mix_add(int32_t *main_frame, const int16_t *data, uint32_t samples)
+{
+	uint32_t x = 0;
+
+#if defined(CONF_MIX_SSE2)
+	for (; x + 8 <= samples; x += 8) {
+		__m128i in = _mm_loadu_si128((const __m128i *) (data + x));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+		_mm_storeu_si128((__m128i *) (main_frame + x), _mm_add_epi32(_mm_loadu_si128((__m128i *) (main_frame + x)), lo));
+		_mm_storeu_si128((__m128i *) (main_frame + x + 4), _mm_add_epi32(_mm_loadu_si128((__m128i *) (main_frame + x + 4)), hi));
+	}
+#elif defined(CONF_MIX_NEON)
+	for (; x + 8 <= samples; x += 8) {
+		int16x8_t in = vld1q_s16(data + x);
+		vst1q_s32(main_frame + x, vaddw_s16(vld1q_s32(main_frame + x), vget_low_s16(in)));
+		vst1q_s32(main_frame + x + 4, vaddw_s16(vld1q_s32(main_frame + x + 4), vget_high_s16(in)));
+	}
+#endif
+
+	for (; x < samples; x++) {
+		main_frame[x] += (int32_t) data[x];
+	}
+}
+
+/* Take our own contribution (if any) back out of the main frame and clip it to 16 bit */
+static inline void conference_mix_minus(int16_t *out, const int32_t *main_frame, const int16_t *own, uint32_t samples)
+{
+	uint32_t x = 0;
+	int32_t z;
+
+#if defined(CONF_MIX_SSE2)
+	for (; x + 8 <= samples; x += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *) (main_frame + x));
+		__m128i hi = _mm_loadu_si128((const __m128i *) (main_frame + x + 4));
+
+		if (own) {
+			__m128i in = _mm_loadu_si128((const __m128i *) (own + x));
+			lo = _mm_sub_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+			hi = _mm_sub_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16));
+		}
+
+		_mm_storeu_si128((__m128i *) (out + x), _mm_packs_epi32(lo, hi));
+	}
+#elif defined(CONF_MIX_NEON)
+	for (; x + 8 <= samples; x += 8) {
+		int32x4_t lo = vld1q_s32(main_frame + x);
+		int32x4_t hi = vld1q_s32(main_frame + x + 4);
+
+		if (own) {
+			int16x8_t in = vld1q_s16(own + x);
+			lo = vsubw_s16(lo, vget_low_s16(in));
+			hi = vsubw_s16(hi, vget_high_s16(in));
+		}
+
+		vst1q_s16(out + x, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+#endif
+
+	for (; x < samples; x++) {
+		z = main_frame[x];
+		if (own) {
+			z -= (int32_t) own[x];
+		}
+		switch_normalize_to_16bit(z);
+		out[x] = (int16_t) z;
+	}
+}
+
+/* Queue the mix for every listener in the slice, members who are not talking all get the same pre-clipped total frame */
+static void conference_mix_slice_run(conference_mix_slice_t *slice)
+{
+	int16_t write_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	uint32_t bytes = slice->samples * 2;
+	uint32_t i;
+
+	slice->ok = 1;
+
+	for (i = 0; i < slice->count; i++) {
+		conference_member_t *omember = slice->members[i];
+		const int16_t *frame = slice->total_frame;
+
+		if (omember->encoder) {
+			conference_enc_packet_t pkt;
+
+			pkt.impl = omember->encoder->impl;
+			pkt.datalen = omember->encoder->datalen;
+
+			switch_mutex_lock(omember->audio_out_mutex);
+			if (!switch_buffer_write(omember->enc_buffer, &pkt, sizeof(pkt)) ||
+				!switch_buffer_write(omember->enc_buffer, omember->encoder->data, pkt.datalen)) {
+				slice->ok = 0;
+			}
+			switch_mutex_unlock(omember->audio_out_mutex);
+
+			if (!slice->ok) {
+				break;
+			}
+
+			continue;
+		}
+
+		if (switch_test_flag(omember, MFLAG_HAS_AUDIO)) {
+			conference_mix_minus(write_frame, slice->main_frame, (int16_t *) omember->frame, slice->samples);
+			frame = write_frame;
+		}
+
+		switch_mutex_lock(omember->audio_out_mutex);
+		if (!switch_buffer_write(omember->mux_buffer, frame, bytes)) {
+			slice->ok = 0;
+		}
+		switch_mutex_unlock(omember->audio_out_mutex);
+
+		if (!slice->ok) {
+			break;
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC conference_mix_thread_run(switch_thread_t *thread, void *obj)
+{
+	switch_queue_t *queue = (switch_queue_t *) obj;
+	void *pop = NULL;
+
+	while (switch_queue_pop(queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		conference_mix_slice_t *slice = (conference_mix_slice_t *) pop;
+
+		conference_mix_slice_run(slice);
+		switch_queue_push(slice->done, slice);
+	}
+
+	return NULL;
+}
+
+static void conference_mixer_start(conference_obj_t *conference, conference_mixer_t *mixer)
+{
+	memset(mixer, 0, sizeof(*mixer));
+	mixer->want = conference->mix_threads;
+	mixer->pool = conference->pool;
+}
+
+/* Most conferences never reach CONF_MIX_PARALLEL_MIN listeners so the helpers are only started once one does */
+static void conference_mixer_spawn(conference_mixer_t *mixer)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	uint32_t i;
+
+	mixer->spawned = 1;
+
+	switch_queue_create(&mixer->done, CONF_MIX_MAX_THREADS + 1, mixer->pool);
+
+	switch_threadattr_create(&thd_attr, mixer->pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	for (i = 0; i < mixer->want; i++) {
+		switch_queue_create(&mixer->queue[i], 2, mixer->pool);
+
+		if (switch_thread_create(&mixer->thread[i], thd_attr, conference_mix_thread_run, mixer->queue[i], mixer->pool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot start mixer thread %u, running with %u\n", i, i);
+			break;
+		}
+
+		mixer->threads++;
+	}
+}
+
+/* Find (or set up) the shared encoder for a member with no audio in this tick, NULL means the member encodes its own mix as usual */
+static conference_encoder_t *conference_member_encoder(conference_obj_t *conference, conference_mixer_t *mixer, conference_member_t *member)
+{
+	conference_encoder_t *encoder;
+	switch_codec_t *write_codec;
+	const switch_codec_implementation_t *impl;
+	int count = 0;
+
+	if (!member->session || !member->enc_buffer || switch_test_flag(member, MFLAG_NOCHANNEL) ||
+		switch_test_flag(member, MFLAG_HAS_AUDIO) || !switch_test_flag(member, MFLAG_CAN_HEAR) ||
+		member->volume_out_level || member->fnode || switch_core_media_bug_count(member->session)) {
+		return NULL;
+	}
+
+	if (!(write_codec = switch_core_session_get_write_codec(member->session)) || !switch_core_codec_ready(write_codec) ||
+		!(impl = write_codec->implementation) || impl->microseconds_per_packet != (int) conference->interval * 1000) {
+		return NULL;
+	}
+
+	for (encoder = mixer->encoders; encoder; encoder = encoder->next) {
+		if (encoder->impl == impl && !strcmp(encoder->fmtp, switch_str_nil(write_codec->fmtp_in))) {
+			return encoder->ready ? encoder : NULL;
+		}
+		count++;
+	}
+
+	if (count >= CONF_MAX_SHARED_ENCODERS) {
+		return NULL;
+	}
+
+	switch_zmalloc(encoder, sizeof(*encoder));
+	encoder->impl = impl;
+	encoder->fmtp = strdup(switch_str_nil(write_codec->fmtp_in));
+	encoder->tick = mixer->tick - 1;
+	encoder->next = mixer->encoders;
+	mixer->encoders = encoder;
+
+	if (switch_core_codec_init(&encoder->codec, impl->iananame, write_codec->fmtp_in, impl->samples_per_second, impl->microseconds_per_packet / 1000,
+							   impl->number_of_channels, SWITCH_CODEC_FLAG_ENCODE, NULL, NULL) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot share an encoder for %s@%uh\n", impl->iananame, impl->samples_per_second);
+		return NULL;
+	}
+
+	/* sharing only makes sense when the channel will take our payload as-is */
+	if (encoder->codec.implementation != impl) {
+		return NULL;
+	}
+
+	if (impl->actual_samples_per_second != conference->rate &&
+		switch_resample_create(&encoder->resampler, conference->rate, impl->actual_samples_per_second,
+							   SWITCH_RECOMMENDED_BUFFER_SIZE, SWITCH_RESAMPLE_QUALITY, 1) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Conference %s sharing one %s@%uh encoder\n",
+					  conference->name, impl->iananame, impl->samples_per_second);
+	encoder->ready = 1;
+
+	return encoder;
+}
+
+/* Encode this tick's common mix once for the group */
+static int conference_encoder_run(conference_encoder_t *encoder, uint32_t tick, int16_t *total_frame, uint32_t samples, uint32_t rate)
+{
+	int16_t *data = total_frame;
+	uint32_t datalen = samples * 2, enc_rate = 0, flag = 0;
+
+	if (encoder->tick == tick) {
+		return encoder->ready;
+	}
+
+	encoder->tick = tick;
+
+	if (encoder->resampler) {
+		switch_resample_process(encoder->resampler, total_frame, samples);
+		data = encoder->resampler->to;
+		datalen = encoder->resampler->to_len * 2;
+		rate = encoder->impl->actual_samples_per_second;
+	}
+
+	encoder->datalen = sizeof(encoder->data);
+
+	if (switch_core_codec_encode(&encoder->codec, NULL, data, datalen, rate, encoder->data, &encoder->datalen, &enc_rate, &flag) != SWITCH_STATUS_SUCCESS) {
+		encoder->datalen = 0;
+	}
+
+	return encoder->datalen ? 1 : 0;
+}
+
+static void conference_mixer_stop(conference_mixer_t *mixer)
+{
+	conference_encoder_t *encoder;
+	switch_status_t st;
+	uint32_t i;
+
+	for (i = 0; i < mixer->threads; i++) {
+		switch_queue_push(mixer->queue[i], NULL);
+	}
+
+	for (i = 0; i < mixer->threads; i++) {
+		switch_thread_join(&st, mixer->thread[i]);
+	}
+
+	mixer->threads = 0;
+	switch_safe_free(mixer->members);
+
+	while ((encoder = mixer->encoders)) {
+		mixer->encoders = encoder->next;
+
+		if (switch_core_codec_ready(&encoder->codec)) {
+			switch_core_codec_destroy(&encoder->codec);
+		}
+		if (encoder->resampler) {
+			switch_resample_destroy(&encoder->resampler);
+		}
+		switch_safe_free(encoder->fmtp);
+		free(encoder);
+	}
+}
+
+/* Write the mix-minus frame to every listener, split across the mixer threads when there are enough of them */
+static int conference_mixer_write(conference_mixer_t *mixer, uint32_t count, const int32_t *main_frame, const int16_t *total_frame, uint32_t samples)
+{
+	uint32_t slices = 1, per, i, off = 0;
+	int ok = 1;
+
+	if (count >= CONF_MIX_PARALLEL_MIN) {
+		if (mixer->want && !mixer->spawned) {
+			conference_mixer_spawn(mixer);
+		}
+
+		if (mixer->threads) {
+			slices = MIN(mixer->threads + 1, count / (CONF_MIX_PARALLEL_MIN / 2));
+		}
+	}
+
+	per = (count + slices - 1) / slices;
+
+	for (i = 0; i < slices; i++) {
+		conference_mix_slice_t *slice = &mixer->slice[i];
+
+		slice->members = mixer->members + off;
+		slice->count = MIN(per, count - off);
+		slice->main_frame = main_frame;
+		slice->total_frame = total_frame;
+		slice->samples = samples;
+		slice->done = mixer->done;
+		off += slice->count;
+
+		if (i) {
+			switch_queue_push(mixer->queue[i - 1], slice);
+		}
+	}
+
+	/* the conference thread takes the first slice itself */
+	conference_mix_slice_run(&mixer->slice[0]);
+	ok = mixer->slice[0].ok;
+
+	for (i = 1; i < slices; i++) {
+		void *pop = NULL;
+
+		switch_queue_pop(mixer->done, &pop);
+		if (!((conference_mix_slice_t *) pop)->ok) {
+			ok = 0;
+		}
+	}
+
+	return ok;
+}
+
 static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *obj)
 {
 	conference_obj_t *conference = (conference_obj_t *) obj;
 	conference_member_t *imember, *omember;
 	uint32_t samples = switch_samples_per_packet(conference->rate, conference->interval);
 	uint32_t bytes = samples * 2;
-	uint8_t ready = 0, total = 0;
+	uint32_t ready = 0, total = 0;
 	switch_timer_t timer = { 0 };
+	conference_mixer_t mixer;
 	switch_event_t *event;
 	uint8_t *file_frame;
 	uint8_t *async_file_frame;
@@ -1035,6 +1437,8 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	globals.threads++;
 	switch_mutex_unlock(globals.hash_mutex);
 
+	conference_mixer_start(conference, &mixer);
+
 	conference->is_recording = 0;
 
 	while (globals.running && !switch_test_flag(conference, CFLAG_DESTRUCT)) {
@@ -1210,6 +1614,8 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 			/* Use more bits in the main_frame to preserve the exact sum of the audio samples. */
 			int main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
 			int16_t write_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
+			int16_t total_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+			uint32_t listeners = 0;
 
 
 			/* Init the main frame with file data if there is any. */
@@ -1244,10 +1650,7 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 					}
 				}
 				
-				bptr = (int16_t *) omember->frame;
-				for (x = 0; x < omember->read / 2; x++) {
-					main_frame[x] += (int32_t) bptr[x];
-				}
+				conference_mix_add(main_frame, (int16_t *) omember->frame, omember->read / 2);
 			}
 
 			if (conference->agc_level && conference->member_loop_count) {
@@ -1270,8 +1673,55 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 			   check if our audio is involved and if so, subtract it from the sample so we don't hear ourselves.
 			   Since main frame was 32 bit int, we did not lose any detail, now that we have to convert to 16 bit we can
 			   cut it off at the min and max range if need be and write the frame to the output buffer.
+			   Without relationships the mix-minus is the same for everyone who is not talking, so it is clipped once
+			   and only the members with audio of their own get a frame built for them.
 			 */
-			for (omember = conference->members; omember; omember = omember->next) {
+			for (omember = conference->members; omember && !conference->relationship_total; omember = omember->next) {
+				if (!switch_test_flag(omember, MFLAG_RUNNING)) {
+					continue;
+				}
+
+				if (!switch_test_flag(omember, MFLAG_CAN_HEAR) && !switch_test_flag(omember, MFLAG_WASTE_BANDWIDTH)
+					&& !switch_test_flag(conference, CFLAG_WASTE_BANDWIDTH)) {
+					continue;
+				}
+
+				if (listeners == mixer.members_size) {
+					mixer.members_size = mixer.members_size ? mixer.members_size * 2 : 64;
+					mixer.members = realloc(mixer.members, mixer.members_size * sizeof(*mixer.members));
+					switch_assert(mixer.members);
+				}
+
+				mixer.members[listeners++] = omember;
+			}
+
+			if (listeners) {
+				uint32_t i;
+
+				conference_mix_minus(total_frame, main_frame, NULL, bytes / 2);
+				mixer.tick++;
+
+				/* members on the same codec with no audio of their own all hear total_frame, encode it once per group and hand out the payload */
+				for (i = 0; i < listeners; i++) {
+					conference_member_t *lmember = mixer.members[i];
+
+					lmember->encoder = NULL;
+
+					if (switch_test_flag(conference, CFLAG_SHARED_ENCODER)) {
+						conference_encoder_t *encoder = conference_member_encoder(conference, &mixer, lmember);
+
+						if (encoder && conference_encoder_run(encoder, mixer.tick, total_frame, bytes / 2, conference->rate)) {
+							lmember->encoder = encoder;
+						}
+					}
+				}
+
+				if (!conference_mixer_write(&mixer, listeners, main_frame, total_frame, bytes / 2)) {
+					goto end;
+				}
+			}
+
+			for (omember = conference->members; omember && conference->relationship_total; omember = omember->next) {
 				switch_size_t ok = 1;
 
 				if (!switch_test_flag(omember, MFLAG_RUNNING)) {
@@ -1364,6 +1814,8 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	/* Rinse ... Repeat */
   end:
 
+	conference_mixer_stop(&mixer);
+
 	if (switch_event_create(&event, SWITCH_EVENT_PRESENCE_IN) == SWITCH_STATUS_SUCCESS) {
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "proto", CONF_CHAT_PROTO);
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "login", conference->name);
@@ -2446,7 +2898,7 @@ static void conference_loop_output(conference_member_t *member)
 		caller_control_action_t *caller_action = NULL;
 		int use_timer = 0;
 		switch_buffer_t *use_buffer = NULL;
-		uint32_t mux_used = 0;
+		uint32_t mux_used = 0, enc_used = 0;
 
 		switch_mutex_lock(member->write_mutex);
 
@@ -2533,6 +2985,12 @@ static void conference_loop_output(conference_member_t *member)
 
 		use_buffer = NULL;
 		mux_used = (uint32_t) switch_buffer_inuse(member->mux_buffer);
+		enc_used = member->enc_buffer ? (uint32_t) switch_buffer_inuse(member->enc_buffer) : 0;
+
+		if (enc_used > flush_len) {
+			/* getting behind, clear the buffer */
+			switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
+		}
 
 		if (mux_used) {
 			if (mux_used < bytes) {
@@ -2549,9 +3007,40 @@ static void conference_loop_output(conference_member_t *member)
 
 		use_timer = 1;
 
-		if (mux_used) {
+		if (!mux_used && enc_used >= sizeof(conference_enc_packet_t)) {
+			/* the conference already encoded this frame for us, pass it straight to the channel */
+			conference_enc_packet_t pkt = { 0 };
+			switch_frame_t enc_frame = { 0 };
+			uint8_t enc_data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+			switch_codec_t *session_codec = switch_core_session_get_write_codec(member->session);
+
+			switch_mutex_lock(member->audio_out_mutex);
+			if (switch_buffer_read(member->enc_buffer, &pkt, sizeof(pkt)) == sizeof(pkt) && pkt.datalen <= sizeof(enc_data)) {
+				pkt.datalen = (uint32_t) switch_buffer_read(member->enc_buffer, enc_data, pkt.datalen);
+			} else {
+				pkt.datalen = 0;
+			}
+			switch_mutex_unlock(member->audio_out_mutex);
+
+			/* drop anything encoded before a codec change */
+			if (pkt.datalen && session_codec && session_codec->implementation == pkt.impl) {
+				enc_frame.codec = session_codec;
+				enc_frame.data = enc_data;
+				enc_frame.datalen = pkt.datalen;
+				enc_frame.buflen = sizeof(enc_data);
+				enc_frame.samples = pkt.impl->samples_per_packet;
+				enc_frame.rate = pkt.impl->actual_samples_per_second;
+				enc_frame.payload = pkt.impl->ianacode;
+				enc_frame.timestamp = timer.samplecount;
+				switch_core_session_write_frame(member->session, &enc_frame, SWITCH_IO_FLAG_NONE, 0);
+			}
+		} else if (mux_used) {
 			/* Flush the output buffer and write all the data (presumably muxed) back to the channel */
 			switch_mutex_lock(member->audio_out_mutex);
+			if (enc_used) {
+				/* we just left a shared encoder, whatever it queued is stale now */
+				switch_buffer_zero(member->enc_buffer);
+			}
 			write_frame.data = data;
 			use_buffer = member->mux_buffer;
 			low_count = 0;
@@ -2605,6 +3094,11 @@ static void conference_loop_output(conference_member_t *member)
 				switch_buffer_zero(member->mux_buffer);
 				switch_mutex_unlock(member->audio_out_mutex);
 			}
+			if (member->enc_buffer && switch_buffer_inuse(member->enc_buffer)) {
+				switch_mutex_lock(member->audio_out_mutex);
+				switch_buffer_zero(member->enc_buffer);
+				switch_mutex_unlock(member->audio_out_mutex);
+			}
 			switch_clear_flag_locked(member, MFLAG_FLUSH_BUFFER);
 		}
 
@@ -5103,6 +5597,8 @@ static void set_cflags(const char *flags, uint32_t *f)
 				*f |= CFLAG_VID_FLOOR;
 			} else if (!strcasecmp(argv[i], "waste-bandwidth")) {
 				*f |= CFLAG_WASTE_BANDWIDTH;
+			} else if (!strcasecmp(argv[i], "shared-encoder")) {
+				*f |= CFLAG_SHARED_ENCODER;
 			}
 		}
 
@@ -5298,6 +5794,12 @@ static int setup_media(conference_member_t *member, conference_obj_t *conference
 		goto codec_done1;
 	}
 
+	/* Setup a buffer for audio already encoded by a shared encoder */
+	if (switch_buffer_create_dynamic(&member->enc_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
+		goto codec_done1;
+	}
+
 	return 0;
 
   codec_done1:
@@ -5760,6 +6262,7 @@ SWITCH_STANDARD_APP(conference_function)
 	switch_buffer_destroy(&member.resample_buffer);
 	switch_buffer_destroy(&member.audio_buffer);
 	switch_buffer_destroy(&member.mux_buffer);
+	switch_buffer_destroy(&member.enc_buffer);
 	if (conference && member.dtmf_parser != conference->dtmf_parser) {
 		switch_ivr_digit_stream_parser_destroy(member.dtmf_parser);
 	}
@@ -6048,6 +6551,7 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_m
 	char *verbose_events = NULL;
 	char *auto_record = NULL;
 	char *terminate_on_silence = NULL;
+	uint32_t mix_threads = 0;
 	
 	/* Validate the conference name */
 	if (zstr(name)) {
@@ -6181,6 +6685,14 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_m
 				auto_record = val;
 			} else if (!strcasecmp(var, "terminate-on-silence") && !zstr(val)) {
 				terminate_on_silence = val;
+			} else if (!strcasecmp(var, "mix-threads") && !zstr(val)) {
+				int tmp = atoi(val);
+
+				if (tmp >= 0 && tmp <= CONF_MIX_MAX_THREADS) {
+					mix_threads = (uint32_t) tmp;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "mix-threads must be between 0 and %d\n", CONF_MIX_MAX_THREADS);
+				}
 			}
 		}
 
@@ -6233,6 +6745,7 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_m
 	}
 
 	conference->comfort_noise_level = comfort_noise_level;
+	conference->mix_threads = mix_threads;
 	conference->caller_id_name = switch_core_strdup(conference->pool, caller_id_name);
 	conference->caller_id_number = switch_core_strdup(conference->pool, caller_id_number);
 
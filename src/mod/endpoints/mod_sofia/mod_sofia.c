@@ -1766,6 +1766,9 @@ static switch_status_t sofia_receive_message(switch_core_session_t *session, swi
 						tech_pvt->last_sent_callee_id_name = switch_core_session_strdup(tech_pvt->session, name);
 						tech_pvt->last_sent_callee_id_number = switch_core_session_strdup(tech_pvt->session, number);
 
+						/* show channels reports which way the callee id went */
+						switch_channel_set_variable(channel, "sip_callee_id_direction", "SEND");
+
 						if (switch_event_create(&event, SWITCH_EVENT_CALL_UPDATE) == SWITCH_STATUS_SUCCESS) {
 							const char *uuid = switch_channel_get_variable(channel, SWITCH_SIGNAL_BOND_VARIABLE);
 							switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Direction", "SEND");
@@ -4126,7 +4129,7 @@ static void general_event_handler(switch_event_t *event)
 
 					nua_notify(nh,
 							   NUTAG_NEWSUB(1),
-							   NUTAG_WITH_THIS(profile->nua),
+							   SOFIATAG_WITH_THIS(profile->nua),
 							   SIPTAG_EVENT_STR(es), TAG_IF(ct, SIPTAG_CONTENT_TYPE_STR(ct)), TAG_IF(!zstr(body), SIPTAG_PAYLOAD_STR(body)), TAG_END());
 
 					sofia_glue_release_profile(profile);
@@ -4308,7 +4311,7 @@ static void general_event_handler(switch_event_t *event)
 			}
 
 			nua_info(nh,
-					 NUTAG_WITH_THIS(profile->nua),
+					 SOFIATAG_WITH_THIS(profile->nua),
 					 TAG_IF(ct, SIPTAG_CONTENT_TYPE_STR(ct)),
 					 TAG_IF(cd, SIPTAG_CONTENT_DISPOSITION_STR(cd)),
 					 TAG_IF(alert_info, SIPTAG_ALERT_INFO_STR(alert_info)),
@@ -47,6 +47,7 @@
 #include <switch_version.h>
 #define SOFIA_NAT_SESSION_TIMEOUT 1800
 #define SOFIA_MAX_ACL 100
+#define SOFIA_MAX_DISPATCH_THREADS 64
 #ifdef _MSC_VER
 #define HAVE_FUNCTION 1
 #else
@@ -558,6 +559,13 @@ struct sofia_profile {
 	char *contact_user;
 	char *local_network;
 	uint32_t trans_timeout;
+	uint32_t dispatch_threads;
+	uint32_t dispatch_running;
+	switch_queue_t *dispatch_queue[SOFIA_MAX_DISPATCH_THREADS];
+	switch_thread_t *dispatch_thread[SOFIA_MAX_DISPATCH_THREADS];
+	/* handles and call-ids with events still queued, and the dispatch thread they are pinned to */
+	switch_hash_t *dispatch_inflight;
+	switch_mutex_t *dispatch_mutex;
 };
 
 struct private_object {
@@ -778,6 +786,11 @@ void sofia_event_callback(nua_event_t event,
 						  char const *phrase,
 						  nua_t *nua, sofia_profile_t *profile, nua_handle_t *nh, sofia_private_t *sofia_private, sip_t const *sip, tagi_t tags[]);
 
+msg_t *sofia_current_request(nua_t *nua);
+
+/* like NUTAG_WITH_THIS() but also valid on the profile dispatch threads */
+#define SOFIATAG_WITH_THIS(_nua) NUTAG_WITH(sofia_current_request(_nua))
+
 void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void *obj);
 
 void launch_sofia_profile_thread(sofia_profile_t *profile);
@@ -269,7 +269,7 @@ void sofia_handle_sip_i_notify(switch_core_session_t *session, int status,
 	/* Automatically return a 200 OK for Event: keep-alive */
 	if (!strcasecmp(sip->sip_event->o_type, "keep-alive")) {
 		/* XXX MTK - is this right? in this case isn't sofia is already sending a 200 itself also? */
-		nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+		nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 		goto end;
 	}
 
@@ -347,7 +347,7 @@ void sofia_handle_sip_i_notify(switch_core_session_t *session, int status,
 				}
 			}
 		}
-		nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+		nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 	}
 
 	/* if no session, assume it could be an incoming notify from a gateway subscription */
@@ -361,7 +361,7 @@ void sofia_handle_sip_i_notify(switch_core_session_t *session, int status,
 			switch_channel_answer(channel);
 			switch_channel_set_variable(channel, "auto_answer_destination", switch_channel_get_variable(channel, "destination_number"));
 			switch_ivr_session_transfer(session, "auto_answer", NULL, NULL);
-			nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+			nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 			goto end;
 		}
 	}
@@ -411,7 +411,7 @@ void sofia_handle_sip_i_notify(switch_core_session_t *session, int status,
 
 	if (sip && sip->sip_event && sip->sip_event->o_type && !strcasecmp(sip->sip_event->o_type, "message-summary")) {
 		/* unsolicited mwi, just say ok */
-		nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+		nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 
 		if (sofia_test_pflag(profile, PFLAG_FORWARD_MWI_NOTIFY)) {
 			const char *mwi_status = NULL;
@@ -423,7 +423,7 @@ void sofia_handle_sip_i_notify(switch_core_session_t *session, int status,
 			if (sip->sip_to && sip->sip_to->a_url && sip->sip_to->a_url->url_user && sip->sip_to->a_url->url_host
 				&& sip->sip_payload && sip->sip_payload->pl_data ) {
 
-				sofia_glue_get_addr(nua_current_request(nua), network_ip, sizeof(network_ip), NULL); 
+				sofia_glue_get_addr(sofia_current_request(nua), network_ip, sizeof(network_ip), NULL); 
 				for (x = 0; x < profile->acl_count; x++) {
 					last_acl = profile->acl[x];
 					if (!(acl_ok = switch_check_network_list_ip(network_ip, last_acl))) {
@@ -454,7 +454,7 @@ void sofia_handle_sip_i_notify(switch_core_session_t *session, int status,
 		}
 
 	} else {
-		nua_respond(nh, 481, "Subscription Does Not Exist", NUTAG_WITH_THIS(nua), TAG_END());
+		nua_respond(nh, 481, "Subscription Does Not Exist", SOFIATAG_WITH_THIS(nua), TAG_END());
 	}
 
   end:
@@ -520,7 +520,7 @@ void sofia_handle_sip_i_bye(switch_core_session_t *session, int status,
 	sofia_glue_set_extra_headers(channel, sip, SOFIA_SIP_BYE_HEADER_PREFIX);
 
 	switch_channel_hangup(channel, cause);
-	nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua),
+	nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua),
 				TAG_IF(call_info, SIPTAG_CALL_INFO_STR(call_info)), TAG_IF(!zstr(extra_headers), SIPTAG_HEADER_STR(extra_headers)), TAG_END());
 
 	switch_safe_free(extra_headers);
@@ -680,6 +680,9 @@ void sofia_update_callee_id(switch_core_session_t *session, sofia_profile_t *pro
 		goto end;
 	}
 
+	/* show channels reports which way the callee id went */
+	switch_channel_set_variable(channel, "sip_callee_id_direction", "RECV");
+
 	if (switch_event_create(&event, SWITCH_EVENT_CALL_UPDATE) == SWITCH_STATUS_SUCCESS) {
 		const char *uuid = switch_channel_get_variable(channel, SWITCH_SIGNAL_BOND_VARIABLE);
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Direction", "RECV");
@@ -712,10 +715,10 @@ void sofia_update_callee_id(switch_core_session_t *session, sofia_profile_t *pro
 }
 
 
-void sofia_event_callback(nua_event_t event,
-						  int status,
-						  char const *phrase,
-						  nua_t *nua, sofia_profile_t *profile, nua_handle_t *nh, sofia_private_t *sofia_private, sip_t const *sip, tagi_t tags[])
+static void sofia_process_dispatch_event(nua_event_t event,
+										 int status,
+										 char const *phrase,
+										 nua_t *nua, sofia_profile_t *profile, nua_handle_t *nh, sofia_private_t *sofia_private, sip_t const *sip, tagi_t tags[])
 {
 	struct private_object *tech_pvt = NULL;
 	auth_res_t auth_res = AUTH_FORBIDDEN;
@@ -793,7 +796,7 @@ void sofia_event_callback(nua_event_t event,
 
 		if (authorization) {
 			char network_ip[80];
-			sofia_glue_get_addr(nua_current_request(nua), network_ip, sizeof(network_ip), NULL);
+			sofia_glue_get_addr(sofia_current_request(nua), network_ip, sizeof(network_ip), NULL);
 			auth_res = sofia_reg_parse_auth(profile, authorization, sip,
 											(char *) sip->sip_request->rq_method_name, tech_pvt->key, strlen(tech_pvt->key), network_ip, NULL, 0,
 											REG_INVITE, NULL, NULL, NULL);
@@ -901,7 +904,7 @@ void sofia_event_callback(nua_event_t event,
 		sofia_presence_handle_sip_i_publish(nua, profile, nh, sofia_private, sip, tags);
 		break;
 	case nua_i_register:
-		//nua_respond(nh, SIP_200_OK, SIPTAG_CONTACT(sip->sip_contact), NUTAG_WITH_THIS(nua), TAG_END());
+		//nua_respond(nh, SIP_200_OK, SIPTAG_CONTACT(sip->sip_contact), SOFIATAG_WITH_THIS(nua), TAG_END());
 		//nua_handle_destroy(nh);
 		sofia_reg_handle_sip_i_register(nua, profile, nh, sofia_private, sip, tags);
 		break;
@@ -1019,6 +1022,241 @@ void sofia_event_callback(nua_event_t event,
 	}
 }
 
+#define SOFIA_DISPATCH_KEYS 2
+
+typedef struct sofia_dispatch_event_s {
+	nua_saved_event_t event[1];
+	nua_t *nua;
+	sofia_profile_t *profile;
+	/* the in-flight entries this event holds a reference on */
+	char *keys[SOFIA_DISPATCH_KEYS];
+} sofia_dispatch_event_t;
+
+typedef struct {
+	uint32_t idx;
+	uint32_t refs;
+} sofia_dispatch_inflight_t;
+
+#ifdef WIN32
+static __declspec(thread) sofia_dispatch_event_t *dispatch_current = NULL;
+#else
+static __thread sofia_dispatch_event_t *dispatch_current = NULL;
+#endif
+
+msg_t *sofia_current_request(nua_t *nua)
+{
+	if (dispatch_current) {
+		return nua_saved_event_request(dispatch_current->event);
+	}
+
+	return nua_current_request(nua);
+}
+
+/* called with profile->dispatch_mutex held */
+static void sofia_dispatch_release(sofia_profile_t *profile, sofia_dispatch_event_t *de)
+{
+	sofia_dispatch_inflight_t *fl;
+	int i;
+
+	for (i = 0; i < SOFIA_DISPATCH_KEYS; i++) {
+		if (!de->keys[i]) {
+			continue;
+		}
+
+		if ((fl = switch_core_hash_find(profile->dispatch_inflight, de->keys[i])) && !--fl->refs) {
+			switch_core_hash_delete(profile->dispatch_inflight, de->keys[i]);
+			free(fl);
+		}
+
+		switch_safe_free(de->keys[i]);
+	}
+}
+
+static void *SWITCH_THREAD_FUNC sofia_dispatch_thread_run(switch_thread_t *thread, void *obj)
+{
+	switch_queue_t *queue = (switch_queue_t *) obj;
+	void *pop;
+
+	while (switch_queue_pop(queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		sofia_dispatch_event_t *de = (sofia_dispatch_event_t *) pop;
+		nua_event_data_t const *data = nua_event_data(de->event);
+		nua_handle_t *nh = data->e_nh;
+
+		dispatch_current = de;
+		sofia_process_dispatch_event(data->e_event, data->e_status, data->e_phrase, de->nua, de->profile,
+									 nh, nh ? nua_handle_magic(nh) : NULL, data->e_msg ? sip_object(data->e_msg) : NULL, (tagi_t *) data->e_tags);
+		dispatch_current = NULL;
+
+		switch_mutex_lock(de->profile->dispatch_mutex);
+		sofia_dispatch_release(de->profile, de);
+		switch_mutex_unlock(de->profile->dispatch_mutex);
+
+		nua_destroy_event(de->event);
+		free(de);
+	}
+
+	return NULL;
+}
+
+static void sofia_dispatch_start(sofia_profile_t *profile)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	uint32_t i;
+
+	if (profile->dispatch_threads && !profile->dispatch_mutex) {
+		switch_mutex_init(&profile->dispatch_mutex, SWITCH_MUTEX_NESTED, profile->pool);
+		switch_core_hash_init_case(&profile->dispatch_inflight, profile->pool, SWITCH_TRUE);
+	}
+
+	for (i = 0; i < profile->dispatch_threads; i++) {
+		switch_queue_create(&profile->dispatch_queue[i], SOFIA_QUEUE_SIZE, profile->pool);
+		switch_threadattr_create(&thd_attr, profile->pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&profile->dispatch_thread[i], thd_attr, sofia_dispatch_thread_run, profile->dispatch_queue[i], profile->pool);
+	}
+
+	profile->dispatch_running = profile->dispatch_threads;
+
+	if (profile->dispatch_running) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Started %u dispatch thread(s) for %s\n", profile->dispatch_running, profile->name);
+	}
+}
+
+static void sofia_dispatch_stop(sofia_profile_t *profile)
+{
+	switch_status_t st;
+	uint32_t i, count = profile->dispatch_running;
+
+	/* from here on the callback handles everything inline again */
+	profile->dispatch_running = 0;
+
+	for (i = 0; i < count; i++) {
+		switch_queue_push(profile->dispatch_queue[i], NULL);
+	}
+
+	for (i = 0; i < count; i++) {
+		switch_thread_join(&st, profile->dispatch_thread[i]);
+		profile->dispatch_thread[i] = NULL;
+	}
+}
+
+void sofia_event_callback(nua_event_t event,
+						  int status,
+						  char const *phrase,
+						  nua_t *nua, sofia_profile_t *profile, nua_handle_t *nh, sofia_private_t *sofia_private, sip_t const *sip, tagi_t tags[])
+{
+	sofia_dispatch_event_t *de;
+	sofia_dispatch_inflight_t *fl = NULL;
+	const char *call_id = NULL, *replaces = NULL;
+	char nh_key[64];
+	uint32_t idx = 0;
+	int i, found = 0;
+
+	/* Handle-less events and the shutdown reply stay on the stack thread. */
+	if (!profile->dispatch_running || !nh || event == nua_r_shutdown) {
+		sofia_process_dispatch_event(event, status, phrase, nua, profile, nh, sofia_private, sip, tags);
+		return;
+	}
+
+	switch_zmalloc(de, sizeof(*de));
+
+	if (!nua_save_event(nua, de->event)) {
+		free(de);
+		sofia_process_dispatch_event(event, status, phrase, nua, profile, nh, sofia_private, sip, tags);
+		return;
+	}
+
+	de->nua = nua;
+	de->profile = profile;
+
+	if (sip && sip->sip_call_id && sip->sip_call_id->i_id) {
+		call_id = sip->sip_call_id->i_id;
+	}
+
+	if (event == nua_i_invite && sip && sip->sip_replaces && sip->sip_replaces->rp_call_id) {
+		replaces = sip->sip_replaces->rp_call_id;
+	}
+
+	switch_snprintf(nh_key, sizeof(nh_key), "nh:%p", (void *) nh);
+
+	/*
+	   Events are pinned to a dispatch thread for as long as anything related is still queued: the same handle, the same
+	   Call-ID (a REGISTER refresh on a new handle) or the dialog an INVITE with Replaces takes over.  Once nothing is in
+	   flight the next event is free to hash anywhere, so the table only ever holds what is queued.
+	*/
+	switch_mutex_lock(profile->dispatch_mutex);
+
+	if ((fl = switch_core_hash_find(profile->dispatch_inflight, nh_key)) ||
+		(call_id && (fl = switch_core_hash_find(profile->dispatch_inflight, call_id))) ||
+		(replaces && (fl = switch_core_hash_find(profile->dispatch_inflight, replaces)))) {
+		idx = fl->idx;
+		found = 1;
+	}
+
+	if (!found) {
+		const char *hkey = replaces ? replaces : call_id;
+		switch_ssize_t klen = -1;
+
+		if (hkey) {
+			idx = (uint32_t) (switch_ci_hashfunc_default(hkey, &klen) % profile->dispatch_running);
+		} else {
+			idx = (uint32_t) (((uintptr_t) nh >> 4) % profile->dispatch_running);
+		}
+	}
+
+	de->keys[0] = strdup(nh_key);
+	if (call_id) {
+		de->keys[1] = strdup(call_id);
+	}
+
+	for (i = 0; i < SOFIA_DISPATCH_KEYS; i++) {
+		if (!de->keys[i]) {
+			continue;
+		}
+		if (!(fl = switch_core_hash_find(profile->dispatch_inflight, de->keys[i]))) {
+			switch_zmalloc(fl, sizeof(*fl));
+			fl->idx = idx;
+			switch_core_hash_insert(profile->dispatch_inflight, de->keys[i], fl);
+		}
+		fl->refs++;
+	}
+
+	if (switch_queue_trypush(profile->dispatch_queue[idx], de) == SWITCH_STATUS_SUCCESS) {
+		switch_mutex_unlock(profile->dispatch_mutex);
+		return;
+	}
+
+	switch (event) {
+	case nua_i_invite:
+	case nua_i_register:
+	case nua_i_subscribe:
+	case nua_i_publish:
+	case nua_i_message:
+	case nua_i_options:
+	case nua_i_notify:
+	case nua_i_info:
+	case nua_i_refer:
+		/* never stall the stack thread on a busy worker, new requests are turned away while it catches up */
+		sofia_dispatch_release(profile, de);
+		switch_mutex_unlock(profile->dispatch_mutex);
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Dispatch queue %u of %s is full, rejecting %s\n",
+						  idx, profile->name, nua_event_name(event));
+		nua_respond(nh, 503, "Maximum Calls In Progress", NUTAG_WITH_THIS(nua), SIPTAG_RETRY_AFTER_STR("5"), TAG_END());
+		if (!sofia_private) {
+			nua_handle_destroy(nh);
+		}
+		nua_destroy_event(de->event);
+		free(de);
+		break;
+	default:
+		/* responses and state changes for dialogs we already run can't be refused, they wait for room */
+		switch_mutex_unlock(profile->dispatch_mutex);
+		switch_queue_push(profile->dispatch_queue[idx], de);
+		break;
+	}
+}
+
 void event_handler(switch_event_t *event)
 {
 	char *subclass, *sql;
@@ -1528,6 +1766,7 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 	profile->started = switch_epoch_time_now(NULL);
 
 	sofia_set_pflag_locked(profile, PFLAG_RUNNING);
+	sofia_dispatch_start(profile);
 	worker_thread = launch_sofia_worker_thread(profile);
 
 	switch_yield(1000000);
@@ -1551,6 +1790,8 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 		}
 	}
 
+	sofia_dispatch_stop(profile);
+
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Write lock %s\n", profile->name);
 	switch_thread_rwlock_wrlock(profile->rwlock);
 	sofia_reg_unregister(profile);
@@ -3187,6 +3428,11 @@ switch_status_t config_sofia(int reload, char *profile_name)
 						if (v_max_proceeding >= 0) {
 							profile->max_proceeding = v_max_proceeding;
 						}
+					} else if (!strcasecmp(var, "dispatch-threads")) {
+						int v = atoi(val);
+						if (v >= 0) {
+							profile->dispatch_threads = v > SOFIA_MAX_DISPATCH_THREADS ? SOFIA_MAX_DISPATCH_THREADS : v;
+						}
 					} else if (!strcasecmp(var, "rtp-timeout-sec")) {
 						int v = atoi(val);
 						if (v >= 0) {
@@ -3839,7 +4085,7 @@ static void sofia_handle_sip_r_invite(switch_core_session_t *session, int status
 		switch_caller_profile_t *caller_profile = NULL;
 		int has_t38 = 0;
 
-		sofia_glue_get_addr(nua_current_request(nua), network_ip, sizeof(network_ip), &network_port);
+		sofia_glue_get_addr(sofia_current_request(nua), network_ip, sizeof(network_ip), &network_port);
 
 		switch_channel_set_variable_printf(channel, "sip_local_network_addr", "%s", profile->extsipip ? profile->extsipip : profile->sipip);
 		switch_channel_set_variable(channel, "sip_reply_host", network_ip);
@@ -5198,7 +5444,7 @@ void sofia_handle_sip_i_refer(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 	switch_memory_pool_t *npool;
 
 	if (!(profile->mflags & MFLAG_REFER)) {
-		nua_respond(nh, SIP_403_FORBIDDEN, NUTAG_WITH_THIS(nua), TAG_END());
+		nua_respond(nh, SIP_403_FORBIDDEN, SOFIATAG_WITH_THIS(nua), TAG_END());
 		goto done;
 	}
 
@@ -5213,7 +5459,7 @@ void sofia_handle_sip_i_refer(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 	home = su_home_new(sizeof(*home));
 	switch_assert(home != NULL);
 
-	nua_respond(nh, SIP_202_ACCEPTED, NUTAG_WITH_THIS(nua), SIPTAG_EXPIRES_STR("60"), TAG_END());
+	nua_respond(nh, SIP_202_ACCEPTED, SOFIATAG_WITH_THIS(nua), SIPTAG_EXPIRES_STR("60"), TAG_END());
 
 	if (sip->sip_referred_by) {
 		full_ref_by = sip_header_as_string(home, (void *) sip->sip_referred_by);
@@ -5695,17 +5941,17 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 							if (switch_core_session_queue_event(session, &event) == SWITCH_STATUS_SUCCESS) {
 								switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "queued freeswitch event for INFO\n");
 								nua_respond(nh, SIP_200_OK, SIPTAG_CONTENT_TYPE_STR("freeswitch/session-event-response"),
-											SIPTAG_PAYLOAD_STR("+OK MESSAGE QUEUED"), NUTAG_WITH_THIS(nua), TAG_END());	
+											SIPTAG_PAYLOAD_STR("+OK MESSAGE QUEUED"), SOFIATAG_WITH_THIS(nua), TAG_END());	
 							} else {
 								switch_event_destroy(&event);
 								nua_respond(nh, SIP_200_OK, SIPTAG_CONTENT_TYPE_STR("freeswitch/session-event-response"),
-											SIPTAG_PAYLOAD_STR("-ERR MESSAGE NOT QUEUED"), NUTAG_WITH_THIS(nua), TAG_END());	
+											SIPTAG_PAYLOAD_STR("-ERR MESSAGE NOT QUEUED"), SOFIATAG_WITH_THIS(nua), TAG_END());	
 							}
 						}
 						
 					} else {
 						nua_respond(nh, SIP_200_OK, SIPTAG_CONTENT_TYPE_STR("freeswitch/session-event-response"),
-									SIPTAG_PAYLOAD_STR("-ERR INVALID SESSION"), NUTAG_WITH_THIS(nua), TAG_END());	
+									SIPTAG_PAYLOAD_STR("-ERR INVALID SESSION"), SOFIATAG_WITH_THIS(nua), TAG_END());	
 						
 					}
 
@@ -5726,10 +5972,10 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 
 					if ((status = switch_api_execute(cmd, arg, NULL, &stream)) == SWITCH_STATUS_SUCCESS) {
 						nua_respond(nh, SIP_200_OK, SIPTAG_CONTENT_TYPE_STR("freeswitch/api-response"), 
-									SIPTAG_PAYLOAD_STR(stream.data), NUTAG_WITH_THIS(nua), TAG_END());	
+									SIPTAG_PAYLOAD_STR(stream.data), SOFIATAG_WITH_THIS(nua), TAG_END());	
 					} else {
 						nua_respond(nh, SIP_200_OK, SIPTAG_CONTENT_TYPE_STR("freeswitch/api-response"),
-									SIPTAG_PAYLOAD_STR("-ERR INVALID COMMAND"), NUTAG_WITH_THIS(nua), TAG_END());	
+									SIPTAG_PAYLOAD_STR("-ERR INVALID COMMAND"), SOFIATAG_WITH_THIS(nua), TAG_END());	
 					}
 					
 					switch_safe_free(stream.data);
@@ -5737,7 +5983,7 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 					return;
 				}
 
-				nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());	
+				nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());	
 
 				return;
 			}
@@ -5823,7 +6069,7 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 				}
 
 				/* Send 200 OK response */
-				nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+				nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 			}
 			goto end;
 		}
@@ -5832,7 +6078,7 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 			if (!zstr(clientcode_header)) {
 				switch_channel_set_variable(channel, "call_clientcode", clientcode_header);
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, "Setting CMC to %s\n", clientcode_header);
-				nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+				nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 			}
 			goto end;
 		}
@@ -5840,7 +6086,7 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 		if ((rec_header = sofia_glue_get_unknown_header(sip, "record"))) {
 			if (zstr(profile->record_template)) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "Record attempted but no template defined.\n");
-				nua_respond(nh, 488, "Recording not enabled", NUTAG_WITH_THIS(nua), TAG_END());
+				nua_respond(nh, 488, "Recording not enabled", SOFIATAG_WITH_THIS(nua), TAG_END());
 			} else {
 				if (!strcasecmp(rec_header, "on")) {
 					char *file = NULL, *tmp = NULL;
@@ -5853,7 +6099,7 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, "Recording %s to %s\n", switch_channel_get_name(channel),
 									  file);
 					switch_safe_free(tmp);
-					nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+					nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 					if (file != profile->record_template) {
 						free(file);
 						file = NULL;
@@ -5865,9 +6111,9 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, "Done recording %s to %s\n",
 										  switch_channel_get_name(channel), file);
 						switch_ivr_stop_record_session(session, file);
-						nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+						nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 					} else {
-						nua_respond(nh, 488, "Nothing to stop", NUTAG_WITH_THIS(nua), TAG_END());
+						nua_respond(nh, 488, "Nothing to stop", SOFIATAG_WITH_THIS(nua), TAG_END());
 					}
 				}
 			}
@@ -5881,7 +6127,7 @@ void sofia_handle_sip_i_info(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "dispatched freeswitch event for INFO\n");
 	}
 
-	nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+	nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 
 	return;
 
@@ -5947,7 +6193,9 @@ void sofia_handle_sip_i_invite(nua_t *nua, sofia_profile_t *profile, nua_handle_
 	char sip_acl_authed_by[512] = "";
 	char sip_acl_token[512] = "";
 
+	switch_mutex_lock(profile->flag_mutex);
 	profile->ib_calls++;
+	switch_mutex_unlock(profile->flag_mutex);
 
 	if (sess_count >= sess_max || !sofia_test_pflag(profile, PFLAG_RUNNING)) {
 		nua_respond(nh, 503, "Maximum Calls In Progress", SIPTAG_RETRY_AFTER_STR("300"), TAG_END());
@@ -5966,7 +6214,7 @@ void sofia_handle_sip_i_invite(nua_t *nua, sofia_profile_t *profile, nua_handle_
 		goto fail;
 	}
 
-	sofia_glue_get_addr(nua_current_request(nua), network_ip, sizeof(network_ip), &network_port);
+	sofia_glue_get_addr(sofia_current_request(nua), network_ip, sizeof(network_ip), &network_port);
 
 	if (sofia_test_pflag(profile, PFLAG_AGGRESSIVE_NAT_DETECTION)) {
 		if (sip && sip->sip_via) {
@@ -6573,7 +6821,10 @@ void sofia_handle_sip_i_invite(nua_t *nua, sofia_profile_t *profile, nua_handle_
 				destination_number = sip->sip_to->a_url->url_user;
 			}
 
+			/* gateways have no lock of their own, their counters go under the profile's */
+			switch_mutex_lock(profile->flag_mutex);
 			gateway->ib_calls++;
+			switch_mutex_unlock(profile->flag_mutex);
 
 			if (gateway->ib_vars) {
 				switch_event_header_t *hp;
@@ -6930,7 +7181,9 @@ void sofia_handle_sip_i_invite(nua_t *nua, sofia_profile_t *profile, nua_handle_
 	return;
 
   fail:
+	switch_mutex_lock(profile->flag_mutex);
 	profile->ib_failed_calls++;
+	switch_mutex_unlock(profile->flag_mutex);
 	return;
 
 }
@@ -6940,7 +7193,7 @@ void sofia_handle_sip_i_options(int status,
 								nua_t *nua, sofia_profile_t *profile, nua_handle_t *nh, sofia_private_t *sofia_private, sip_t const *sip,
 								tagi_t tags[])
 {
-	nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), TAG_END());
+	nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), TAG_END());
 }
 
 void sofia_info_send_sipfrag(switch_core_session_t *aleg, switch_core_session_t *bleg)
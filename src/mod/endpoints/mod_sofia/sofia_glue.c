@@ -2221,6 +2221,12 @@ static void set_stats(switch_rtp_t *rtp_session, private_object_t *tech_pvt, con
 		add_stat(stats->inbound.dtmf_packet_count, "in_dtmf_packet_count");
 		add_stat(stats->inbound.cng_packet_count, "in_cng_packet_count");
 		add_stat(stats->inbound.flush_packet_count, "in_flush_packet_count");
+		add_stat(stats->inbound.jb_plc_packet_count, "in_jb_plc_packet_count");
+		add_stat(stats->inbound.jb_late_packet_count, "in_jb_late_packet_count");
+		add_stat(stats->inbound.jb_reorder_packet_count, "in_jb_reorder_packet_count");
+		add_stat(stats->inbound.jb_drop_packet_count, "in_jb_drop_packet_count");
+		add_stat(stats->inbound.jb_jitter_ms, "in_jb_jitter_ms");
+		add_stat(stats->inbound.jb_target_ms, "in_jb_target_ms");
 
 		add_stat(stats->outbound.raw_bytes, "out_raw_bytes");
 		add_stat(stats->outbound.media_bytes, "out_media_bytes");
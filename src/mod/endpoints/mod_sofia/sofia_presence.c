@@ -1900,7 +1900,7 @@ void sofia_presence_handle_sip_i_subscribe(int status,
 			return;
 		}
 
-		sofia_glue_get_addr(nua_current_request(nua), network_ip, sizeof(network_ip), &network_port);
+		sofia_glue_get_addr(sofia_current_request(nua), network_ip, sizeof(network_ip), &network_port);
 
 		if (sofia_glue_check_nat(profile, network_ip)) {
 			is_auto_nat = 1;
@@ -2058,7 +2058,7 @@ void sofia_presence_handle_sip_i_subscribe(int status,
 			}
 
 			if (!(proto && to_user && to_host)) {
-				nua_respond(nh, SIP_404_NOT_FOUND, NUTAG_WITH_THIS(nua), TAG_END());
+				nua_respond(nh, SIP_404_NOT_FOUND, SOFIATAG_WITH_THIS(nua), TAG_END());
 				goto end;
 			}
 		}
@@ -2179,7 +2179,7 @@ void sofia_presence_handle_sip_i_subscribe(int status,
 
 			nua_respond(nh, SIP_202_ACCEPTED,
 						TAG_IF(new_contactstr, SIPTAG_CONTACT_STR(new_contactstr)),
-						NUTAG_WITH_THIS(nua),
+						SOFIATAG_WITH_THIS(nua),
 						SIPTAG_SUBSCRIPTION_STATE_STR(sstr), SIPTAG_EXPIRES_STR(exp_delta_str), TAG_IF(sticky, NUTAG_PROXY(sticky)), TAG_END());
 
 			switch_safe_free(new_contactstr);
@@ -2542,7 +2542,7 @@ void sofia_presence_handle_sip_i_publish(nua_t *nua, sofia_profile_t *profile, n
 
 		switch_snprintf(expstr, sizeof(expstr), "%d", exp_delta);
 		switch_stun_random_string(etag, 8, NULL);
-		nua_respond(nh, SIP_200_OK, NUTAG_WITH_THIS(nua), SIPTAG_ETAG_STR(etag), SIPTAG_EXPIRES_STR(expstr), TAG_END());
+		nua_respond(nh, SIP_200_OK, SOFIATAG_WITH_THIS(nua), SIPTAG_ETAG_STR(etag), SIPTAG_EXPIRES_STR(expstr), TAG_END());
 	}
 }
 
@@ -28,20 +28,41 @@
  */
 #include <sys/stat.h>
 #include <switch.h>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
+
+/* most lines the writer thread takes off the queue for one group write */
+#define CDR_GROUP_MAX 64
 
 typedef enum {
 	CDR_LEG_A = (1 << 0),
 	CDR_LEG_B = (1 << 1)
 } cdr_leg_t;
 
+typedef enum {
+	CDR_FSYNC_NONE,
+	CDR_FSYNC_GROUP,
+	CDR_FSYNC_IDLE
+} cdr_fsync_t;
+
+/* only the writer thread touches these once the module is loaded */
 struct cdr_fd {
 	int fd;
 	char *path;
 	int64_t bytes;
-	switch_mutex_t *mutex;
+	int dirty;
 };
 typedef struct cdr_fd cdr_fd_t;
 
+/* one rendered line on its way to the writer, path and line live right after it */
+struct cdr_line {
+	char *path;
+	char *line;
+	unsigned int len;
+};
+typedef struct cdr_line cdr_line_t;
+
 const char *default_template =
 	"\"${caller_id_name}\",\"${caller_id_number}\",\"${destination_number}\",\"${context}\",\"${start_stamp}\","
 	"\"${answer_stamp}\",\"${end_stamp}\",\"${duration}\",\"${billsec}\",\"${hangup_cause}\",\"${uuid}\",\"${bleg_uuid}\", \"${accountcode}\"\n";
@@ -57,8 +78,16 @@ static struct {
 	int rotate;
 	int debug;
 	cdr_leg_t legs;
+	cdr_fsync_t fsync;
+	uint32_t queue_size;
+	switch_queue_t *queue;
+	switch_thread_t *writer;
+	volatile int rotate_pending;
 } globals;
 
+/* pushed to wake the writer up for a rotate */
+static cdr_line_t rotate_marker;
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_cdr_csv_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_cdr_csv_shutdown);
 SWITCH_MODULE_DEFINITION(mod_cdr_csv, mod_cdr_csv_load, mod_cdr_csv_shutdown, NULL);
@@ -125,30 +154,32 @@ static void do_rotate(cdr_fd_t *fd)
 
 }
 
-static void write_cdr(const char *path, const char *log_line)
+static cdr_fd_t *get_fd(const char *path)
 {
 	cdr_fd_t *fd = NULL;
-	unsigned int bytes_in, bytes_out;
-	int loops = 0;
 
 	if (!(fd = switch_core_hash_find(globals.fd_hash, path))) {
 		fd = switch_core_alloc(globals.pool, sizeof(*fd));
 		switch_assert(fd);
 		memset(fd, 0, sizeof(*fd));
 		fd->fd = -1;
-		switch_mutex_init(&fd->mutex, SWITCH_MUTEX_NESTED, globals.pool);
 		fd->path = switch_core_strdup(globals.pool, path);
 		switch_core_hash_insert(globals.fd_hash, path, fd);
 	}
 
-	switch_mutex_lock(fd->mutex);
-	bytes_out = (unsigned) strlen(log_line);
+	return fd;
+}
+
+static void write_line(cdr_fd_t *fd, const char *log_line, unsigned int bytes_out)
+{
+	unsigned int bytes_in;
+	int loops = 0;
 
 	if (fd->fd < 0) {
 		do_reopen(fd);
 		if (fd->fd < 0) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error opening %s\n", path);
-			goto end;
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error opening %s\n", fd->path);
+			return;
 		}
 	}
 
@@ -157,18 +188,176 @@ static void write_cdr(const char *path, const char *log_line)
 	}
 
 	while ((bytes_in = write(fd->fd, log_line, bytes_out)) != bytes_out && ++loops < 10) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Write error to file %s %d/%d\n", path, (int) bytes_in, (int) bytes_out);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Write error to file %s %d/%d\n", fd->path, (int) bytes_in, (int) bytes_out);
 		do_rotate(fd);
 		switch_yield(250000);
 	}
 
 	if (bytes_in > 0) {
 		fd->bytes += bytes_in;
+		fd->dirty = 1;
+	}
+}
+
+/* all the lines of one group that go to the same file in a single writev, falls back to write_line on trouble */
+static void write_group(cdr_fd_t *fd, cdr_line_t **lines, int count)
+{
+#ifndef WIN32
+	struct iovec iov[CDR_GROUP_MAX];
+	ssize_t bytes_in = 0;
+	size_t bytes_out = 0;
+	int i;
+
+	if (fd->fd < 0) {
+		do_reopen(fd);
+	}
+
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = lines[i]->line;
+		iov[i].iov_len = lines[i]->len;
+		bytes_out += lines[i]->len;
+	}
+
+	if (fd->fd > -1 && fd->bytes + bytes_out <= UINT_MAX && (bytes_in = writev(fd->fd, iov, count)) > 0) {
+		fd->bytes += bytes_in;
+		fd->dirty = 1;
+	} else {
+		bytes_in = 0;
+	}
+
+	/* whatever did not make it goes the slow way, starting mid line if need be */
+	for (i = 0; i < count; i++) {
+		if ((size_t) bytes_in >= lines[i]->len) {
+			bytes_in -= lines[i]->len;
+			continue;
+		}
+		write_line(fd, lines[i]->line + bytes_in, lines[i]->len - (unsigned int) bytes_in);
+		bytes_in = 0;
+	}
+#else
+	int i;
+
+	for (i = 0; i < count; i++) {
+		write_line(fd, lines[i]->line, lines[i]->len);
+	}
+#endif
+}
+
+static void sync_fds(void)
+{
+	switch_hash_index_t *hi;
+	void *val;
+	cdr_fd_t *fd;
+
+	for (hi = switch_hash_first(NULL, globals.fd_hash); hi; hi = switch_hash_next(hi)) {
+		switch_hash_this(hi, NULL, NULL, &val);
+		fd = (cdr_fd_t *) val;
+		if (fd->dirty && fd->fd > -1) {
+#ifndef WIN32
+			fsync(fd->fd);
+#else
+			_commit(fd->fd);
+#endif
+		}
+		fd->dirty = 0;
+	}
+}
+
+static void rotate_fds(void)
+{
+	switch_hash_index_t *hi;
+	void *val;
+
+	for (hi = switch_hash_first(NULL, globals.fd_hash); hi; hi = switch_hash_next(hi)) {
+		switch_hash_this(hi, NULL, NULL, &val);
+		do_rotate((cdr_fd_t *) val);
+	}
+}
+
+/* writes one group, lines for the same file keep their order and share a writev */
+static void write_lines(cdr_line_t **lines, int count)
+{
+	cdr_line_t *same[CDR_GROUP_MAX];
+	int done[CDR_GROUP_MAX] = { 0 };
+	int i, j, n;
+
+	for (i = 0; i < count; i++) {
+		if (done[i]) {
+			continue;
+		}
+
+		n = 0;
+		for (j = i; j < count; j++) {
+			if (!done[j] && !strcmp(lines[j]->path, lines[i]->path)) {
+				same[n++] = lines[j];
+				done[j] = 1;
+			}
+		}
+
+		write_group(get_fd(lines[i]->path), same, n);
+	}
+
+	if (globals.fsync == CDR_FSYNC_GROUP || (globals.fsync == CDR_FSYNC_IDLE && !switch_queue_size(globals.queue))) {
+		sync_fds();
+	}
+}
+
+static void *SWITCH_THREAD_FUNC writer_thread(switch_thread_t *thread, void *obj)
+{
+	cdr_line_t *lines[CDR_GROUP_MAX];
+	void *pop;
+	int count, running = 1;
+
+	while (running && switch_queue_pop(globals.queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		count = 0;
+
+		do {
+			if (!pop) {
+				running = 0;
+				break;
+			}
+			if (pop != &rotate_marker) {
+				lines[count++] = (cdr_line_t *) pop;
+			}
+		} while (count < CDR_GROUP_MAX && switch_queue_trypop(globals.queue, &pop) == SWITCH_STATUS_SUCCESS);
+
+		if (count) {
+			int i;
+
+			write_lines(lines, count);
+
+			for (i = 0; i < count; i++) {
+				free(lines[i]);
+			}
+		}
+
+		if (globals.rotate_pending) {
+			globals.rotate_pending = 0;
+			rotate_fds();
+		}
 	}
 
-  end:
+	return NULL;
+}
 
-	switch_mutex_unlock(fd->mutex);
+/* hands the line to the writer thread, only waits when the queue is full */
+static void write_cdr(const char *path, const char *log_line)
+{
+	cdr_line_t *cdr_line;
+	size_t path_len = strlen(path) + 1, len = strlen(log_line);
+
+	cdr_line = malloc(sizeof(*cdr_line) + path_len + len + 1);
+	switch_assert(cdr_line);
+	cdr_line->path = (char *) (cdr_line + 1);
+	cdr_line->line = cdr_line->path + path_len;
+	cdr_line->len = (unsigned int) len;
+	memcpy(cdr_line->path, path, path_len);
+	memcpy(cdr_line->line, log_line, len + 1);
+
+	if (switch_queue_trypush(globals.queue, cdr_line) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "CDR write queue full, waiting on the writer\n");
+		switch_queue_push(globals.queue, cdr_line);
+	}
 }
 
 static switch_status_t my_on_reporting(switch_core_session_t *session)
@@ -269,22 +458,15 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 static void event_handler(switch_event_t *event)
 {
 	const char *sig = switch_event_get_header(event, "Trapped-Signal");
-	switch_hash_index_t *hi;
-	void *val;
-	cdr_fd_t *fd;
 
 	if (globals.shutdown) {
 		return;
 	}
 
 	if (sig && !strcmp(sig, "HUP")) {
-		for (hi = switch_hash_first(NULL, globals.fd_hash); hi; hi = switch_hash_next(hi)) {
-			switch_hash_this(hi, NULL, NULL, &val);
-			fd = (cdr_fd_t *) val;
-			switch_mutex_lock(fd->mutex);
-			do_rotate(fd);
-			switch_mutex_unlock(fd->mutex);
-		}
+		/* the writer thread owns the files, it rotates them before its next write */
+		globals.rotate_pending = 1;
+		switch_queue_trypush(globals.queue, &rotate_marker);
 	}
 }
 
@@ -320,6 +502,7 @@ static switch_status_t load_config(switch_memory_pool_t *pool)
 	switch_core_hash_insert(globals.template_hash, "default", default_template);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Adding default template.\n");
 	globals.legs = CDR_LEG_A;
+	globals.queue_size = 10000;
 
 	if ((xml = switch_xml_open_cfg(cf, &cfg, NULL))) {
 
@@ -347,6 +530,19 @@ static switch_status_t load_config(switch_memory_pool_t *pool)
 					globals.default_template = switch_core_strdup(pool, val);
 				} else if (!strcasecmp(var, "master-file-only")) {
 					globals.masterfileonly = switch_true(val);
+				} else if (!strcasecmp(var, "fsync")) {
+					if (!strcasecmp(val, "group")) {
+						globals.fsync = CDR_FSYNC_GROUP;
+					} else if (!strcasecmp(val, "idle")) {
+						globals.fsync = CDR_FSYNC_IDLE;
+					} else {
+						globals.fsync = CDR_FSYNC_NONE;
+					}
+				} else if (!strcasecmp(var, "queue-size")) {
+					int tmp = atoi(val);
+					if (tmp > 0) {
+						globals.queue_size = tmp;
+					}
 				}
 			}
 		}
@@ -388,6 +584,7 @@ static switch_status_t load_config(switch_memory_pool_t *pool)
 SWITCH_MODULE_LOAD_FUNCTION(mod_cdr_csv_load)
 {
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_threadattr_t *thd_attr = NULL;
 
 	load_config(pool);
 
@@ -401,11 +598,14 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_cdr_csv_load)
 		return status;
 	}
 
-	switch_core_add_state_handler(&state_handlers);
-	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
-
+	switch_queue_create(&globals.queue, globals.queue_size, pool);
 
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&globals.writer, thd_attr, writer_thread, NULL, pool);
 
+	switch_core_add_state_handler(&state_handlers);
+	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 
 	return status;
 }
@@ -413,11 +613,30 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_cdr_csv_load)
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_cdr_csv_shutdown)
 {
+	switch_status_t st;
+	void *pop;
 
 	globals.shutdown = 1;
 	switch_event_unbind_callback(event_handler);
 	switch_core_remove_state_handler(&state_handlers);
 
+	/* the writer drains the queue before it sees the NULL */
+	switch_queue_push(globals.queue, NULL);
+	switch_thread_join(&st, globals.writer);
+
+	/* anyone who raced the shutdown flag */
+	while (switch_queue_trypop(globals.queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		cdr_line_t *cdr_line = (cdr_line_t *) pop;
+
+		if (cdr_line && cdr_line != &rotate_marker) {
+			write_line(get_fd(cdr_line->path), cdr_line->line, cdr_line->len);
+			free(cdr_line);
+		}
+	}
+
+	if (globals.fsync != CDR_FSYNC_NONE) {
+		sync_fds();
+	}
 
 	return SWITCH_STATUS_SUCCESS;
 }
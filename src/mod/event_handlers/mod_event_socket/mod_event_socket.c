@@ -33,6 +33,8 @@
 #define CMD_BUFLEN 1024 * 1000
 #define MAX_QUEUE_LEN 5000
 #define MAX_MISSED 200
+#define ENVELOPE_LOCKS 16
+#define FILTER_MAX_SLOTS 64
 SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_socket_shutdown);
 SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime);
@@ -66,6 +68,23 @@ typedef enum {
 	EVENT_FORMAT_JSON
 } event_format_t;
 
+/* one copy of an event shared by every listener it was queued to, rendered at most once per format */
+typedef struct event_envelope {
+	switch_event_t *event;
+	char *rendered[EVENT_FORMAT_JSON + 1];
+	uint32_t refs;
+	switch_mutex_t *mutex;
+} event_envelope_t;
+
+/* a listener filter header parsed once, slot indexes the per event header lookup cache */
+typedef struct listener_filter {
+	const char *name;
+	const char *value;
+	int pos;
+	int regex;
+	int slot;
+} listener_filter_t;
+
 struct listener {
 	switch_socket_t *sock;
 	switch_queue_t *event_queue;
@@ -76,7 +95,6 @@ struct listener {
 	switch_mutex_t *filter_mutex;
 	uint32_t flags;
 	switch_log_level_t level;
-	char *ebuf;
 	uint8_t event_list[SWITCH_EVENT_ALL + 1];
 	uint8_t allowed_event_list[SWITCH_EVENT_ALL + 1];
 	switch_hash_t *event_hash;
@@ -94,6 +112,8 @@ struct listener {
 	char remote_ip[50];
 	switch_port_t remote_port;
 	switch_event_t *filters;
+	listener_filter_t *filter_index;
+	uint32_t filter_count;
 	struct listener *next;
 };
 
@@ -103,6 +123,10 @@ static struct {
 	switch_mutex_t *listener_mutex;
 	switch_event_node_t *node;
 	int debug;
+	switch_mutex_t *envelope_mutex[ENVELOPE_LOCKS];
+	switch_mutex_t *slot_mutex;
+	char *filter_slots[FILTER_MAX_SLOTS];
+	uint32_t filter_slot_count;
 } globals;
 
 static struct {
@@ -142,6 +166,152 @@ static const char *format2str(event_format_t format)
 	return "invalid";
 }
 
+static event_envelope_t *envelope_create(switch_event_t **event)
+{
+	event_envelope_t *env;
+
+	switch_zmalloc(env, sizeof(*env));
+	env->event = *event;
+	env->refs = 1;
+	env->mutex = globals.envelope_mutex[((uintptr_t) env >> 4) % ENVELOPE_LOCKS];
+	*event = NULL;
+
+	return env;
+}
+
+static void envelope_hold(event_envelope_t *env)
+{
+	switch_mutex_lock(env->mutex);
+	env->refs++;
+	switch_mutex_unlock(env->mutex);
+}
+
+static void envelope_release(event_envelope_t **envp)
+{
+	event_envelope_t *env = *envp;
+	int i, last;
+
+	*envp = NULL;
+
+	if (!env) {
+		return;
+	}
+
+	switch_mutex_lock(env->mutex);
+	last = !--env->refs;
+	switch_mutex_unlock(env->mutex);
+
+	if (!last) {
+		return;
+	}
+
+	for (i = 0; i <= EVENT_FORMAT_JSON; i++) {
+		switch_safe_free(env->rendered[i]);
+	}
+
+	switch_event_destroy(&env->event);
+	free(env);
+}
+
+/* the first listener wanting a format renders it, the rest reuse the text until the last reference goes away */
+static const char *envelope_render(event_envelope_t *env, event_format_t format)
+{
+	const char *text;
+
+	switch_mutex_lock(env->mutex);
+	if (!env->rendered[format]) {
+		switch (format) {
+		case EVENT_FORMAT_PLAIN:
+			switch_event_serialize(env->event, &env->rendered[format], SWITCH_TRUE);
+			break;
+		case EVENT_FORMAT_JSON:
+			switch_event_serialize_json(env->event, &env->rendered[format]);
+			break;
+		case EVENT_FORMAT_XML:
+			{
+				switch_xml_t xml;
+
+				if ((xml = switch_event_xmlize(env->event, SWITCH_VA_NONE))) {
+					env->rendered[format] = switch_xml_toxml(xml, SWITCH_FALSE);
+					switch_xml_free(xml);
+				}
+			}
+			break;
+		}
+	}
+	text = env->rendered[format];
+	switch_mutex_unlock(env->mutex);
+
+	return text;
+}
+
+static int filter_slot(const char *name)
+{
+	int slot = -1;
+	uint32_t i;
+
+	switch_mutex_lock(globals.slot_mutex);
+	for (i = 0; i < globals.filter_slot_count; i++) {
+		if (!strcasecmp(globals.filter_slots[i], name)) {
+			slot = (int) i;
+			break;
+		}
+	}
+
+	if (slot < 0 && globals.filter_slot_count < FILTER_MAX_SLOTS) {
+		slot = (int) globals.filter_slot_count;
+		globals.filter_slots[globals.filter_slot_count++] = strdup(name);
+	}
+	switch_mutex_unlock(globals.slot_mutex);
+
+	return slot;
+}
+
+/* rebuild the parsed filter list, call with the filter_mutex held whenever listener->filters changed */
+static void filters_compile(listener_t *listener)
+{
+	switch_event_header_t *hp;
+	listener_filter_t *index = NULL;
+	uint32_t count = 0;
+
+	if (listener->filters) {
+		for (hp = listener->filters->headers; hp; hp = hp->next) {
+			count++;
+		}
+	}
+
+	if (count) {
+		switch_zmalloc(index, sizeof(*index) * count);
+		count = 0;
+
+		for (hp = listener->filters->headers; hp; hp = hp->next) {
+			listener_filter_t *f = &index[count++];
+			const char *comp_to = hp->value;
+
+			f->pos = 1;
+			while (comp_to && *comp_to) {
+				if (*comp_to == '+') {
+					f->pos = 1;
+				} else if (*comp_to == '-') {
+					f->pos = 0;
+				} else if (*comp_to != ' ') {
+					break;
+				}
+				comp_to++;
+			}
+
+			f->name = hp->name;
+			f->value = comp_to;
+			f->regex = *hp->value == '/';
+			f->slot = filter_slot(hp->name);
+		}
+	}
+
+	switch_safe_free(listener->filter_index);
+	listener->filter_index = index;
+	listener->filter_count = count;
+}
+
 static void remove_listener(listener_t *listener);
 static void kill_listener(listener_t *l);
 static void kill_all_listeners(void);
@@ -209,10 +379,10 @@ static void flush_listener(listener_t *listener, switch_bool_t flush_log, switch
 
 	if (listener->event_queue) {
 		while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-			switch_event_t *pevent = (switch_event_t *) pop;
+			event_envelope_t *env = (event_envelope_t *) pop;
 			if (!pop)
 				continue;
-			switch_event_destroy(&pevent);
+			envelope_release(&env);
 		}
 	}
 }
@@ -251,6 +421,7 @@ static switch_status_t expire_listener(listener_t ** listener)
 	if (l->filters) {
 		switch_event_destroy(&l->filters);
 	}
+	filters_compile(l);
 
 	switch_mutex_unlock(l->filter_mutex);
 	switch_thread_rwlock_unlock(l->rwlock);
@@ -263,8 +434,11 @@ static switch_status_t expire_listener(listener_t ** listener)
 static void event_handler(switch_event_t *event)
 {
 	switch_event_t *clone = NULL;
+	event_envelope_t *env = NULL;
 	listener_t *l, *lp, *last = NULL;
 	time_t now = switch_epoch_time_now(NULL);
+	const char *slot_val[FILTER_MAX_SLOTS];
+	uint8_t slot_done[FILTER_MAX_SLOTS];
 
 	switch_assert(event != NULL);
 
@@ -272,6 +446,9 @@ static void event_handler(switch_event_t *event)
 		return;
 	}
 
+	/* each filtered header is looked up at most once per event no matter how many listeners filter on it */
+	memset(slot_done, 0, sizeof(slot_done));
+
 	lp = listen_list.listeners;
 
 	switch_mutex_lock(globals.listener_mutex);
@@ -305,52 +482,55 @@ static void event_handler(switch_event_t *event)
 			}
 		}
 
-		if (send && l->filters && l->filters->headers) {
-			switch_event_header_t *hp;
+		if (send && l->filter_count) {
+			listener_filter_t *f;
 			const char *hval;
+			uint32_t i;
 
 			send = 0;
 			switch_mutex_lock(l->filter_mutex);
-			for (hp = l->filters->headers; hp; hp = hp->next) {
-				if ((hval = switch_event_get_header(event, hp->name))) {
-					const char *comp_to = hp->value;
-					int pos = 1, cmp = 0;
-
-					while (comp_to && *comp_to) {
-						if (*comp_to == '+') {
-							pos = 1;
-						} else if (*comp_to == '-') {
-							pos = 0;
-						} else if (*comp_to != ' ') {
-							break;
-						}
-						comp_to++;
-					}
+			for (i = 0; i < l->filter_count; i++) {
+				int cmp = 0;
 
-					if (send && pos) {
-						continue;
-					}
+				f = &l->filter_index[i];
 
-					if (!comp_to) {
-						continue;
+				if (f->slot < 0) {
+					hval = switch_event_get_header(event, f->name);
+				} else {
+					if (!slot_done[f->slot]) {
+						slot_val[f->slot] = switch_event_get_header(event, f->name);
+						slot_done[f->slot] = 1;
 					}
+					hval = slot_val[f->slot];
+				}
 
-					if (*hp->value == '/') {
-						switch_regex_t *re = NULL;
-						int ovector[30];
-						cmp = !!switch_regex_perform(hval, comp_to, &re, ovector, sizeof(ovector) / sizeof(ovector[0]));
-						switch_regex_safe_free(re);
-					} else {
-						cmp = !strcasecmp(hval, comp_to);
-					}
+				if (!hval) {
+					continue;
+				}
 
-					if (cmp) {
-						if (pos) {
-							send = 1;
-						} else {
-							send = 0;
-							break;
-						}
+				if (send && f->pos) {
+					continue;
+				}
+
+				if (!f->value) {
+					continue;
+				}
+
+				if (f->regex) {
+					switch_regex_t *re = NULL;
+					int ovector[30];
+					cmp = !!switch_regex_perform(hval, f->value, &re, ovector, sizeof(ovector) / sizeof(ovector[0]));
+					switch_regex_safe_free(re);
+				} else {
+					cmp = !strcasecmp(hval, f->value);
+				}
+
+				if (cmp) {
+					if (f->pos) {
+						send = 1;
+					} else {
+						send = 0;
+						break;
 					}
 				}
 			}
@@ -364,32 +544,42 @@ static void event_handler(switch_event_t *event)
 			}
 		}
 
-		if (send) {
+		/* the event is copied once and every matching listener queues a reference to that copy */
+		if (send && !env) {
 			if (switch_event_dup(&clone, event) == SWITCH_STATUS_SUCCESS) {
-				if (switch_queue_trypush(l->event_queue, clone) == SWITCH_STATUS_SUCCESS) {
-					if (l->lost_events) {
-						int le = l->lost_events;
-						l->lost_events = 0;
-						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Lost %d events!\n", le);
-						clone = NULL;
-						if (switch_event_create(&clone, SWITCH_EVENT_TRAP) == SWITCH_STATUS_SUCCESS) {
-							switch_event_add_header(clone, SWITCH_STACK_BOTTOM, "info", "lost %d events", le);
-							switch_event_fire(&clone);
-						}
-					}
-				} else {
-					if (++l->lost_events > MAX_MISSED) {
-						kill_listener(l);
+				env = envelope_create(&clone);
+			} else {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_ERROR, "Memory Error!\n");
+			}
+		}
+
+		if (send && env) {
+			envelope_hold(env);
+			if (switch_queue_trypush(l->event_queue, env) == SWITCH_STATUS_SUCCESS) {
+				if (l->lost_events) {
+					int le = l->lost_events;
+					l->lost_events = 0;
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Lost %d events!\n", le);
+					clone = NULL;
+					if (switch_event_create(&clone, SWITCH_EVENT_TRAP) == SWITCH_STATUS_SUCCESS) {
+						switch_event_add_header(clone, SWITCH_STACK_BOTTOM, "info", "lost %d events", le);
+						switch_event_fire(&clone);
 					}
-					switch_event_destroy(&clone);
 				}
 			} else {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_ERROR, "Memory Error!\n");
+				event_envelope_t *dropped = env;
+
+				if (++l->lost_events > MAX_MISSED) {
+					kill_listener(l);
+				}
+				envelope_release(&dropped);
 			}
 		}
 		last = l;
 	}
 	switch_mutex_unlock(globals.listener_mutex);
+
+	envelope_release(&env);
 }
 
 SWITCH_STANDARD_APP(socket_function)
@@ -546,6 +736,12 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_socket_shutdown)
 
 	switch_event_unbind(&globals.node);
 
+	switch_mutex_lock(globals.slot_mutex);
+	while (globals.filter_slot_count) {
+		switch_safe_free(globals.filter_slots[--globals.filter_slot_count]);
+	}
+	switch_mutex_unlock(globals.slot_mutex);
+
 	switch_safe_free(prefs.ip);
 	switch_safe_free(prefs.password);
 
@@ -718,6 +914,8 @@ SWITCH_STANDARD_API(event_sink_function)
 			stream->write_function(stream, "<data><reply type=\"error\">Invalid Syntax</reply></data>\n");
 		}
 
+		filters_compile(listener);
+
 	  filter_end:
 
 		switch_mutex_unlock(listener->filter_mutex);
@@ -910,7 +1108,7 @@ SWITCH_STANDARD_API(event_sink_function)
 		char *id = switch_event_get_header(stream->param_event, "listen-id");
 		uint32_t idl = 0;
 		void *pop;
-		switch_event_t *pevent = NULL;
+		event_envelope_t *env = NULL;
 
 		if (id) {
 			idl = (uint32_t) atol(id);
@@ -952,40 +1150,29 @@ SWITCH_STANDARD_API(event_sink_function)
 		stream->write_function(stream, "<events>\n");
 
 		while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-			char *etype;
-			pevent = (switch_event_t *) pop;
+			const char *ebuf;
+			env = (event_envelope_t *) pop;
 
 			if (listener->format == EVENT_FORMAT_PLAIN) {
-				etype = "plain";
-				switch_event_serialize(pevent, &listener->ebuf, SWITCH_TRUE);
-				stream->write_function(stream, "<event type=\"plain\">\n%s</event>", listener->ebuf);
+				ebuf = envelope_render(env, EVENT_FORMAT_PLAIN);
+				stream->write_function(stream, "<event type=\"plain\">\n%s</event>", ebuf);
 			} else if (listener->format == EVENT_FORMAT_JSON) {
-				etype = "json";
-				switch_event_serialize_json(pevent, &listener->ebuf);
+				envelope_render(env, EVENT_FORMAT_JSON);
 			} else {
-				switch_xml_t xml;
-				etype = "xml";
-
-				if ((xml = switch_event_xmlize(pevent, SWITCH_VA_NONE))) {
-					listener->ebuf = switch_xml_toxml(xml, SWITCH_FALSE);
-					switch_xml_free(xml);
-				} else {
+				if (!(ebuf = envelope_render(env, EVENT_FORMAT_XML))) {
 					stream->write_function(stream, "<data><reply type=\"error\">XML Render Error</reply></data>\n");
 					break;
 				}
 
-				stream->write_function(stream, "%s\n", listener->ebuf);
+				stream->write_function(stream, "%s\n", ebuf);
 			}
 
-			switch_safe_free(listener->ebuf);
-			switch_event_destroy(&pevent);
+			envelope_release(&env);
 		}
 
 		stream->write_function(stream, " </events>\n</data>\n");
 
-		if (pevent) {
-			switch_event_destroy(&pevent);
-		}
+		envelope_release(&env);
 
 		switch_thread_rwlock_unlock(listener->rwlock);
 	} else if (!strcasecmp(wcmd, "exec-fsapi")) {
@@ -1030,10 +1217,15 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
 {
 	switch_application_interface_t *app_interface;
 	switch_api_interface_t *api_interface;
+	int x;
 
 	memset(&globals, 0, sizeof(globals));
 
 	switch_mutex_init(&globals.listener_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&globals.slot_mutex, SWITCH_MUTEX_NESTED, pool);
+	for (x = 0; x < ENVELOPE_LOCKS; x++) {
+		switch_mutex_init(&globals.envelope_mutex[x], SWITCH_MUTEX_NESTED, pool);
+	}
 
 	memset(&listen_list, 0, sizeof(listen_list));
 	switch_mutex_init(&listen_list.sock_mutex, SWITCH_MUTEX_NESTED, pool);
@@ -1233,7 +1425,12 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 				if (switch_channel_get_state(chan) < CS_HANGUP && switch_channel_test_flag(chan, CF_DIVERT_EVENTS)) {
 					switch_event_t *e = NULL;
 					while (switch_core_session_dequeue_event(listener->session, &e, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
-						if (switch_queue_trypush(listener->event_queue, e) != SWITCH_STATUS_SUCCESS) {
+						event_envelope_t *env = envelope_create(&e);
+
+						if (switch_queue_trypush(listener->event_queue, env) != SWITCH_STATUS_SUCCESS) {
+							e = env->event;
+							env->event = NULL;
+							envelope_release(&env);
 							switch_core_session_queue_event(listener->session, &e);
 							break;
 						}
@@ -1244,46 +1441,30 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 			if (switch_test_flag(listener, LFLAG_EVENTS)) {
 				while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
 					char hbuf[512];
-					switch_event_t *pevent = (switch_event_t *) pop;
-					char *etype;
+					event_envelope_t *env = (event_envelope_t *) pop;
+					const char *ebuf;
 
 					do_sleep = 0;
-					if (listener->format == EVENT_FORMAT_PLAIN) {
-						etype = "plain";
-						switch_event_serialize(pevent, &listener->ebuf, SWITCH_TRUE);
-					} else if (listener->format == EVENT_FORMAT_JSON) {
-						etype = "json";
-						switch_event_serialize_json(pevent, &listener->ebuf);
-					} else {
-						switch_xml_t xml;
-						etype = "xml";
-
-						if ((xml = switch_event_xmlize(pevent, SWITCH_VA_NONE))) {
-							listener->ebuf = switch_xml_toxml(xml, SWITCH_FALSE);
-							switch_xml_free(xml);
-						} else {
-							switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_ERROR, "XML ERROR!\n");
-							goto endloop;
-						}
-					}
 
-					switch_assert(listener->ebuf);
+					if (!(ebuf = envelope_render(env, listener->format))) {
+						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_ERROR, "XML ERROR!\n");
+						goto endloop;
+					}
 
-					len = strlen(listener->ebuf);
+					len = strlen(ebuf);
 
-					switch_snprintf(hbuf, sizeof(hbuf), "Content-Length: %" SWITCH_SSIZE_T_FMT "\n" "Content-Type: text/event-%s\n" "\n", len, etype);
+					switch_snprintf(hbuf, sizeof(hbuf), "Content-Length: %" SWITCH_SSIZE_T_FMT "\n" "Content-Type: text/event-%s\n" "\n", len,
+									format2str(listener->format));
 
 					len = strlen(hbuf);
 					switch_socket_send(listener->sock, hbuf, &len);
 
-					len = strlen(listener->ebuf);
-					switch_socket_send(listener->sock, listener->ebuf, &len);
-
-					switch_safe_free(listener->ebuf);
+					len = strlen(ebuf);
+					switch_socket_send(listener->sock, ebuf, &len);
 
 				  endloop:
 
-					switch_event_destroy(&pevent);
+					envelope_release(&env);
 				}
 			}
 		}
@@ -1771,6 +1952,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		} else {
 			switch_snprintf(reply, reply_len, "-ERR invalid syntax");
 		}
+		filters_compile(listener);
 		switch_mutex_unlock(listener->filter_mutex);
 
 		goto done;
@@ -2514,6 +2696,7 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 	if (listener->filters) {
 		switch_event_destroy(&listener->filters);
 	}
+	filters_compile(listener);
 	switch_mutex_unlock(listener->filter_mutex);
 
 	if (listener->session) {
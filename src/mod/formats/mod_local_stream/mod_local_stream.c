@@ -33,6 +33,9 @@
 #include <switch.h>
 /* for apr_pstrcat */
 #define DEFAULT_PREBUFFER_SIZE 1024 * 64
+/* frames a listener may fall behind before we call it a leak and skip it ahead, a power of two
+   so the slot of a frame number stays the same when the sequence wraps */
+#define RING_FRAMES 512
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_local_stream_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_local_stream_shutdown);
@@ -51,8 +54,9 @@ static int THREADS = 0;
 
 struct local_stream_context {
 	struct local_stream_source *source;
-	switch_mutex_t *audio_mutex;
-	switch_buffer_t *audio_buffer;
+	/* next frame to read from the source ring and how far into it we are */
+	uint32_t cursor;
+	switch_size_t pos;
 	int err;
 	const char *file;
 	const char *func;
@@ -90,6 +94,14 @@ struct local_stream_source {
 	int32_t chime_counter;
 	int32_t chime_max_counter;
 	switch_file_handle_t chime_fh;
+	/* every frame is written here once, listeners only keep a cursor into it.
+	   ring_start counts the frames the writer began and ring_seq the ones it finished,
+	   a reader that copied frame n knows it was not overwritten while ring_start <= n + RING_FRAMES */
+	switch_byte_t *ring;
+	switch_size_t *ring_len;
+	switch_size_t ring_frame;
+	volatile uint32_t ring_start;
+	volatile uint32_t ring_seq;
 };
 
 typedef struct local_stream_source local_stream_source_t;
@@ -111,12 +123,10 @@ static void *SWITCH_THREAD_FUNC read_stream_thread(switch_thread_t *thread, void
 {
 	local_stream_source_t *source = obj;
 	switch_file_handle_t fh = { 0 };
-	local_stream_context_t *cp;
 	char file_buf[128] = "", path_buf[512] = "";
 	switch_timer_t timer = { 0 };
 	int fd = -1;
 	switch_buffer_t *audio_buffer;
-	switch_byte_t *dist_buf;
 	switch_size_t used;
 	int skip = 0;
 	switch_memory_pool_t *temp_pool = NULL;
@@ -130,7 +140,10 @@ static void *SWITCH_THREAD_FUNC read_stream_thread(switch_thread_t *thread, void
 	}
 
 	switch_buffer_create_dynamic(&audio_buffer, 1024, source->prebuf + 10, 0);
-	dist_buf = switch_core_alloc(source->pool, source->prebuf + 10);
+
+	source->ring_frame = source->samples * 2;
+	source->ring = switch_core_alloc(source->pool, source->ring_frame * RING_FRAMES);
+	source->ring_len = switch_core_alloc(source->pool, sizeof(*source->ring_len) * RING_FRAMES);
 
 	if (source->shuffle) {
 		skip = do_rand();
@@ -288,25 +301,17 @@ static void *SWITCH_THREAD_FUNC read_stream_thread(switch_thread_t *thread, void
 				}
 
 				if (!is_open || used >= source->prebuf || (source->total && used > source->samples * 2)) {
-					used = switch_buffer_read(audio_buffer, dist_buf, source->samples * 2);
 					if (source->total) {
-
-						switch_mutex_lock(source->mutex);
-						for (cp = source->context_list; cp && RUNNING; cp = cp->next) {
-							if (switch_test_flag(cp->handle, SWITCH_FILE_CALLBACK)) {
-								continue;
-							}
-							switch_mutex_lock(cp->audio_mutex);
-							if (switch_buffer_inuse(cp->audio_buffer) > source->samples * 768) {
-								switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Leaking stream handle! [%s() %s:%d]\n", cp->func, cp->file,
-												  cp->line);
-								switch_buffer_zero(cp->audio_buffer);
-							} else {
-								switch_buffer_write(cp->audio_buffer, dist_buf, used);
-							}
-							switch_mutex_unlock(cp->audio_mutex);
-						}
-						switch_mutex_unlock(source->mutex);
+						uint32_t seq = source->ring_seq, slot = seq % RING_FRAMES;
+
+						/* one copy no matter how many are listening, the listeners never block us */
+						source->ring_start = seq + 1;
+						switch_memory_barrier();
+						source->ring_len[slot] = switch_buffer_read(audio_buffer, source->ring + slot * source->ring_frame, source->ring_frame);
+						switch_memory_barrier();
+						source->ring_seq = seq + 1;
+					} else {
+						switch_buffer_toss(audio_buffer, source->ring_frame);
 					}
 				}
 			}
@@ -420,18 +425,15 @@ static switch_status_t local_stream_file_open(switch_file_handle_t *handle, cons
 	handle->interval = source->interval;
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Opening Stream [%s] %dhz\n", path, handle->samplerate);
 
-	switch_mutex_init(&context->audio_mutex, SWITCH_MUTEX_NESTED, handle->memory_pool);
-	if (switch_buffer_create_dynamic(&context->audio_buffer, 512, 1024, 0) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Memory Error!\n");
-		status = SWITCH_STATUS_MEMERR;
-		goto end;
-	}
-
 	context->source = source;
 	context->file = handle->file;
 	context->func = handle->func;
 	context->line = handle->line;
 	context->handle = handle;
+
+	/* start with the next frame the source writes */
+	context->cursor = source->ring_seq;
+
 	switch_mutex_lock(source->mutex);
 	context->next = source->context_list;
 	source->context_list = context;
@@ -461,7 +463,6 @@ static switch_status_t local_stream_file_close(switch_file_handle_t *handle)
 	}
 	context->source->total--;
 	switch_mutex_unlock(context->source->mutex);
-	switch_buffer_destroy(&context->audio_buffer);
 	switch_thread_rwlock_unlock(context->source->rwlock);
 
 	return SWITCH_STATUS_SUCCESS;
@@ -470,16 +471,68 @@ static switch_status_t local_stream_file_close(switch_file_handle_t *handle)
 static switch_status_t local_stream_file_read(switch_file_handle_t *handle, void *data, size_t *len)
 {
 	local_stream_context_t *context = handle->private_info;
+	local_stream_source_t *source = context->source;
+	switch_byte_t *out = (switch_byte_t *) data;
 	switch_size_t bytes = 0;
 	size_t need = *len * 2;
+	uint32_t seq, first;
 
-	if (!context->source->ready) {
+	if (!source->ready) {
 		*len = 0;
 		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_mutex_lock(context->audio_mutex);
-	if ((bytes = switch_buffer_read(context->audio_buffer, data, need))) {
+	/* no lock, we copy what the writer finished and then check it did not start over any of it.
+	   A listener inside a read frame callback (SWITCH_FILE_CALLBACK) keeps its place like any other
+	   instead of losing the frames written meanwhile, the leak check below still bounds how far behind it gets. */
+	seq = source->ring_seq;
+	switch_memory_barrier();
+
+	if (seq - context->cursor > RING_FRAMES) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Leaking stream handle! [%s() %s:%d]\n", context->func, context->file, context->line);
+		context->cursor = seq;
+		context->pos = 0;
+	}
+
+	first = context->cursor;
+
+	while (bytes < need && context->cursor != seq) {
+		uint32_t slot = context->cursor % RING_FRAMES;
+		switch_size_t len = source->ring_len[slot], avail;
+
+		if (len > source->ring_frame) {
+			len = source->ring_frame;
+		}
+
+		if (context->pos < len) {
+			avail = len - context->pos;
+
+			if (avail > need - bytes) {
+				avail = need - bytes;
+			}
+
+			memcpy(out + bytes, source->ring + slot * source->ring_frame + context->pos, avail);
+			bytes += avail;
+			context->pos += avail;
+		}
+
+		if (context->pos >= len) {
+			context->cursor++;
+			context->pos = 0;
+		}
+	}
+
+	switch_memory_barrier();
+
+	if (bytes && source->ring_start - first > RING_FRAMES) {
+		/* the writer lapped us during the copy, what we have may be torn */
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Leaking stream handle! [%s() %s:%d]\n", context->func, context->file, context->line);
+		context->cursor = source->ring_seq;
+		context->pos = 0;
+		bytes = 0;
+	}
+
+	if (bytes) {
 		*len = bytes / 2;
 	} else {
 		if (need > 2560) {
@@ -488,7 +541,6 @@ static switch_status_t local_stream_file_read(switch_file_handle_t *handle, void
 		memset(data, 255, need);
 		*len = need / 2;
 	}
-	switch_mutex_unlock(context->audio_mutex);
 	handle->sample_count += *len;
 	return SWITCH_STATUS_SUCCESS;
 }
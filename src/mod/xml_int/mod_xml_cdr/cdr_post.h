@@ -0,0 +1,757 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2010, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * cdr_post.h -- queued CDR delivery over http shared by mod_xml_cdr and mod_json_cdr
+ *
+ * The reporting state handler only renders the CDR and hands it to
+ * cdr_post_enqueue(), a pool of worker threads owns the curl handles (so the
+ * connection to the collector is kept alive between posts), optionally packs
+ * several CDRs into one POST and retries.  CDRs that can not be delivered go
+ * to the spool-dir when one is configured, and are posted again from there
+ * once the collector answers, or else to the module's err-log-dir like before.
+ * When the queue is full the CDR is written out at once instead of making the
+ * hanging up session wait.
+ *
+ * Every function is static, the modules include this file once.
+ */
+#ifndef CDR_POST_H
+#define CDR_POST_H
+
+#include <switch.h>
+#include <curl/curl.h>
+
+#define CDR_POST_MAX_URLS 20
+#define CDR_POST_MAX_THREADS 32
+#define CDR_POST_MAX_BATCH 100
+#define CDR_POST_REPLAY_INTERVAL 30
+
+typedef enum {
+	CDR_POST_ENCODE_NONE,
+	CDR_POST_ENCODE_URL,
+	CDR_POST_ENCODE_BASE64
+} cdr_post_encode_t;
+
+typedef struct cdr_post_item {
+	char *uuid;
+	/* file name without extension, uuid with the optional a_ prefix */
+	char *name;
+	char *text;
+	/* set when the cdr was read back from the spool dir */
+	char *spool_file;
+} cdr_post_item_t;
+
+/* writes an undeliverable cdr to the err-log-dir of the module */
+typedef void (*cdr_post_err_func_t) (const char *name, const char *text);
+
+typedef struct cdr_post_settings {
+	const char *name;
+	const char *user_agent;
+	const char *ext;
+	const char *content_type;
+	/* prefix each cdr with cdr= like a form field */
+	int form;
+	cdr_post_encode_t encode;
+	/* used to join several unencoded cdrs into one body */
+	const char *batch_open;
+	const char *batch_sep;
+	const char *batch_close;
+	/* drop the <?xml ?> line of each cdr inside a batch, batch_open carries one */
+	int strip_xml_decl;
+	char *urls[CDR_POST_MAX_URLS];
+	int url_count;
+	char *cred;
+	long auth_scheme;
+	char *ssl_cert_file;
+	char *ssl_key_file;
+	char *ssl_key_password;
+	char *ssl_version;
+	char *ssl_cacert_file;
+	int enable_cacert_check;
+	int enable_ssl_verifyhost;
+	int disable100continue;
+	uint32_t retries;
+	uint32_t delay;
+	uint32_t timeout;
+	uint32_t threads;
+	uint32_t batch;
+	uint32_t queue_size;
+	char *spool_dir;
+	cdr_post_err_func_t err_func;
+} cdr_post_settings_t;
+
+typedef struct cdr_post {
+	cdr_post_settings_t settings;
+	switch_memory_pool_t *pool;
+	switch_queue_t *queue;
+	switch_mutex_t *mutex;
+	switch_thread_t *threads[CDR_POST_MAX_THREADS];
+	int url_index;
+	int shutdown;
+	int collector_up;
+	int replaying;
+	time_t last_replay;
+	/* backpressure and delivery counters, all under mutex */
+	uint32_t queued_max;
+	uint64_t enqueued;
+	uint64_t posted;
+	uint64_t posts;
+	uint64_t failed;
+	uint64_t overflowed;
+	uint64_t spooled;
+	uint64_t replayed;
+	uint64_t post_usec;
+} cdr_post_t;
+
+static size_t cdr_post_write_callback(char *buffer, size_t size, size_t nitems, void *outstream)
+{
+	return size * nitems;
+}
+
+static void cdr_post_item_free(cdr_post_item_t **itemp)
+{
+	cdr_post_item_t *item = *itemp;
+
+	if (item) {
+		switch_safe_free(item->uuid);
+		switch_safe_free(item->name);
+		switch_safe_free(item->text);
+		switch_safe_free(item->spool_file);
+		free(item);
+		*itemp = NULL;
+	}
+}
+
+static switch_status_t cdr_post_write_file(const char *path, const char *text)
+{
+	int fd;
+
+#ifdef _MSC_VER
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
+#else
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
+#endif
+		size_t len = strlen(text), off = 0;
+		int wrote = 0, err = 0;
+
+		/* a spooled cdr is what makes a failed post safe, so all of it must be on disk */
+		while (off < len && (wrote = write(fd, text + off, (unsigned) (len - off))) > 0) {
+			off += wrote;
+		}
+		err = errno;
+
+		if (close(fd)) {
+			err = errno;
+		} else if (off == len) {
+			return SWITCH_STATUS_SUCCESS;
+		}
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Short write to %s (%" SWITCH_SIZE_T_FMT "/%" SWITCH_SIZE_T_FMT " bytes): %s\n",
+						  path, (switch_size_t) off, (switch_size_t) len, strerror(err));
+		unlink(path);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't open %s: %s\n", path, strerror(errno));
+
+	return SWITCH_STATUS_FALSE;
+}
+
+/* a cdr we gave up on, goes to the spool dir for replay when we have one */
+static void cdr_post_spool(cdr_post_t *post, cdr_post_item_t *item)
+{
+	char *path;
+
+	if (item->spool_file) {
+		/* still in the spool from last time */
+		return;
+	}
+
+	if (post->settings.spool_dir && (path = switch_mprintf("%s%s%s%s", post->settings.spool_dir, SWITCH_PATH_SEPARATOR, item->name, post->settings.ext))) {
+		switch_status_t status = cdr_post_write_file(path, item->text);
+
+		if (status != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: can't spool to %s\n", post->settings.name, path);
+		}
+		free(path);
+
+		if (status == SWITCH_STATUS_SUCCESS) {
+			goto done;
+		}
+	}
+
+	if (post->settings.err_func) {
+		post->settings.err_func(item->name, item->text);
+	}
+
+  done:
+
+	switch_mutex_lock(post->mutex);
+	post->spooled++;
+	switch_mutex_unlock(post->mutex);
+}
+
+static char *cdr_post_encode(cdr_post_t *post, const char *text)
+{
+	switch_size_t need_bytes;
+	char *buf;
+
+	if (post->settings.encode == CDR_POST_ENCODE_NONE) {
+		return strdup(text);
+	}
+
+	need_bytes = strlen(text) * 3 + 1;
+	switch_zmalloc(buf, need_bytes);
+
+	if (post->settings.encode == CDR_POST_ENCODE_URL) {
+		switch_url_encode(text, buf, need_bytes);
+	} else {
+		switch_b64_encode((unsigned char *) text, strlen(text), (unsigned char *) buf, need_bytes);
+	}
+
+	return buf;
+}
+
+static char *cdr_post_body(cdr_post_t *post, cdr_post_item_t **items, uint32_t count)
+{
+	switch_stream_handle_t stream = { 0 };
+	uint32_t i;
+
+	SWITCH_STANDARD_STREAM(stream);
+
+	if (!post->settings.form && count > 1) {
+		stream.write_function(&stream, "%s", post->settings.batch_open);
+	}
+
+	for (i = 0; i < count; i++) {
+		const char *text = items[i]->text;
+		char *enc;
+
+		if (count > 1 && post->settings.strip_xml_decl && !strncmp(text, "<?xml", 5)) {
+			const char *e = strstr(text, "?>");
+
+			if (e) {
+				text = e + 2;
+				while (*text == '\r' || *text == '\n') {
+					text++;
+				}
+			}
+		}
+
+		enc = cdr_post_encode(post, text);
+
+		if (post->settings.form) {
+			stream.write_function(&stream, "%scdr=%s", i ? "&" : "", enc);
+		} else {
+			stream.write_function(&stream, "%s%s", i ? post->settings.batch_sep : "", enc);
+		}
+		free(enc);
+	}
+
+	if (!post->settings.form && count > 1) {
+		stream.write_function(&stream, "%s", post->settings.batch_close);
+	}
+
+	return (char *) stream.data;
+}
+
+static CURL *cdr_post_curl_init(cdr_post_t *post, struct curl_slist **headers)
+{
+	cdr_post_settings_t *s = &post->settings;
+	CURL *curl_handle = curl_easy_init();
+	char *ct;
+
+	if ((ct = switch_mprintf("Content-Type: %s", s->content_type))) {
+		*headers = curl_slist_append(*headers, ct);
+		free(ct);
+	}
+
+	if (s->disable100continue) {
+		*headers = curl_slist_append(*headers, "Expect:");
+	}
+
+	if (!zstr(s->cred)) {
+		curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, s->auth_scheme);
+		curl_easy_setopt(curl_handle, CURLOPT_USERPWD, s->cred);
+	}
+
+	curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, *headers);
+	curl_easy_setopt(curl_handle, CURLOPT_POST, 1);
+	curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, s->user_agent);
+	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, cdr_post_write_callback);
+	curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
+
+	if (s->ssl_cert_file) {
+		curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, s->ssl_cert_file);
+	}
+
+	if (s->ssl_key_file) {
+		curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, s->ssl_key_file);
+	}
+
+	if (s->ssl_key_password) {
+		curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, s->ssl_key_password);
+	}
+
+	if (s->ssl_version) {
+		if (!strcasecmp(s->ssl_version, "SSLv3")) {
+			curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
+		} else if (!strcasecmp(s->ssl_version, "TLSv1")) {
+			curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
+		}
+	}
+
+	if (s->ssl_cacert_file) {
+		curl_easy_setopt(curl_handle, CURLOPT_CAINFO, s->ssl_cacert_file);
+	}
+
+	curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, (long) s->timeout);
+
+	return curl_handle;
+}
+
+/* one POST carrying count cdrs, with the configured retries, true when the collector took it */
+static switch_bool_t cdr_post_send(cdr_post_t *post, CURL *curl_handle, cdr_post_item_t **items, uint32_t count)
+{
+	cdr_post_settings_t *s = &post->settings;
+	char *body, *dest_url = NULL;
+	uint32_t cur_try;
+	long httpRes = 0;
+	int url_index;
+	switch_time_t started = switch_micro_time_now();
+	switch_bool_t ok = SWITCH_FALSE;
+
+	if (!(body = cdr_post_body(post, items, count))) {
+		return SWITCH_FALSE;
+	}
+
+	curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, body);
+	curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long) strlen(body));
+
+	for (cur_try = 0; cur_try < s->retries && !ok; cur_try++) {
+		if (cur_try > 0) {
+			uint32_t waited = 0;
+
+			/* don't hold up shutdown with retries */
+			while (!post->shutdown && waited < s->delay * 10) {
+				switch_yield(100000);
+				waited++;
+			}
+
+			if (post->shutdown) {
+				break;
+			}
+		}
+
+		switch_mutex_lock(post->mutex);
+		url_index = post->url_index;
+		switch_mutex_unlock(post->mutex);
+
+		if (count == 1) {
+			dest_url = switch_mprintf("%s?uuid=%s", s->urls[url_index], items[0]->uuid);
+		} else {
+			dest_url = switch_mprintf("%s?batch=%u", s->urls[url_index], count);
+		}
+		curl_easy_setopt(curl_handle, CURLOPT_URL, dest_url);
+
+		if (!strncasecmp(dest_url, "https", 5)) {
+			curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0);
+			curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
+		}
+
+		if (s->enable_cacert_check) {
+			curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
+		}
+
+		if (s->enable_ssl_verifyhost) {
+			curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
+		}
+
+		httpRes = 0;
+		curl_easy_perform(curl_handle);
+		curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
+		switch_safe_free(dest_url);
+
+		if (httpRes == 200) {
+			ok = SWITCH_TRUE;
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: got error [%ld] posting to web server [%s]\n", s->name, httpRes, s->urls[url_index]);
+			switch_mutex_lock(post->mutex);
+			if (post->url_index == url_index && ++post->url_index >= s->url_count) {
+				post->url_index = 0;
+			}
+			url_index = post->url_index;
+			switch_mutex_unlock(post->mutex);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: retry will be with url [%s]\n", s->name, s->urls[url_index]);
+		}
+	}
+
+	free(body);
+
+	switch_mutex_lock(post->mutex);
+	post->posts++;
+	post->post_usec += (uint64_t) (switch_micro_time_now() - started);
+	post->collector_up = ok;
+	if (ok) {
+		post->posted += count;
+	} else {
+		post->failed += count;
+	}
+	switch_mutex_unlock(post->mutex);
+
+	return ok;
+}
+
+/* post spooled cdrs again, the replaying flag keeps it to one worker at a time and only while the collector answers */
+static void cdr_post_replay(cdr_post_t *post, CURL *curl_handle)
+{
+	cdr_post_settings_t *s = &post->settings;
+	cdr_post_item_t *items[CDR_POST_MAX_BATCH];
+	switch_memory_pool_t *pool = NULL;
+	switch_dir_t *dir = NULL;
+	const char *fname;
+	char buf[256];
+	uint32_t count = 0, i, total = 0;
+	switch_size_t ext_len = strlen(s->ext);
+	time_t now = switch_epoch_time_now(NULL);
+
+	switch_mutex_lock(post->mutex);
+	if (!s->spool_dir || post->shutdown || !post->collector_up || post->replaying || now - post->last_replay < CDR_POST_REPLAY_INTERVAL) {
+		switch_mutex_unlock(post->mutex);
+		return;
+	}
+	post->replaying = 1;
+	post->last_replay = now;
+	switch_mutex_unlock(post->mutex);
+
+	switch_core_new_memory_pool(&pool);
+
+	if (switch_dir_open(&dir, s->spool_dir, pool) != SWITCH_STATUS_SUCCESS) {
+		goto end;
+	}
+
+	while ((fname = switch_dir_next_file(dir, buf, sizeof(buf))) && !post->shutdown) {
+		switch_size_t len = strlen(fname);
+		cdr_post_item_t *item;
+		char *path, *text;
+		FILE *fp;
+		long size;
+
+		if (len <= ext_len || strcmp(fname + len - ext_len, s->ext)) {
+			continue;
+		}
+
+		if (!(path = switch_mprintf("%s%s%s", s->spool_dir, SWITCH_PATH_SEPARATOR, fname))) {
+			continue;
+		}
+
+		if (!(fp = fopen(path, "rb"))) {
+			free(path);
+			continue;
+		}
+
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		switch_zmalloc(text, size + 1);
+		if (size <= 0 || fread(text, 1, size, fp) != (size_t) size) {
+			fclose(fp);
+			free(text);
+			free(path);
+			continue;
+		}
+		fclose(fp);
+
+		switch_zmalloc(item, sizeof(*item));
+		item->name = strdup(fname);
+		item->name[len - ext_len] = '\0';
+		item->uuid = strdup(strncmp(item->name, "a_", 2) ? item->name : item->name + 2);
+		item->text = text;
+		item->spool_file = path;
+		items[count++] = item;
+
+		if (count == s->batch) {
+			if (cdr_post_send(post, curl_handle, items, count)) {
+				for (i = 0; i < count; i++) {
+					switch_file_remove(items[i]->spool_file, pool);
+				}
+				total += count;
+			}
+
+			for (i = 0; i < count; i++) {
+				cdr_post_item_free(&items[i]);
+			}
+
+			if (!post->collector_up) {
+				count = 0;
+				break;
+			}
+			count = 0;
+		}
+	}
+
+	if (count) {
+		if (cdr_post_send(post, curl_handle, items, count)) {
+			for (i = 0; i < count; i++) {
+				switch_file_remove(items[i]->spool_file, pool);
+			}
+			total += count;
+		}
+
+		for (i = 0; i < count; i++) {
+			cdr_post_item_free(&items[i]);
+		}
+	}
+
+	switch_dir_close(dir);
+
+	if (total) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "%s: replayed %u spooled cdr(s)\n", s->name, total);
+	}
+
+  end:
+
+	/* a replay can outlast the interval, the flag keeps a second worker off the same files */
+	switch_mutex_lock(post->mutex);
+	post->replayed += total;
+	post->replaying = 0;
+	switch_mutex_unlock(post->mutex);
+
+	switch_core_destroy_memory_pool(&pool);
+}
+
+static void *SWITCH_THREAD_FUNC cdr_post_thread(switch_thread_t *thread, void *obj)
+{
+	cdr_post_t *post = (cdr_post_t *) obj;
+	cdr_post_item_t *items[CDR_POST_MAX_BATCH];
+	struct curl_slist *headers = NULL;
+	CURL *curl_handle = cdr_post_curl_init(post, &headers);
+	void *pop;
+
+	while (switch_queue_pop(post->queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		uint32_t count = 0, i;
+
+		if (!pop) {
+			/* shutdown */
+			break;
+		}
+
+		items[count++] = (cdr_post_item_t *) pop;
+
+		while (count < post->settings.batch && switch_queue_trypop(post->queue, &pop) == SWITCH_STATUS_SUCCESS) {
+			if (!pop) {
+				/* put the shutdown marker back for after this batch */
+				switch_queue_push(post->queue, NULL);
+				break;
+			}
+			items[count++] = (cdr_post_item_t *) pop;
+		}
+
+		if (!cdr_post_send(post, curl_handle, items, count)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: unable to post %u cdr(s) to web server, spooling\n", post->settings.name, count);
+			for (i = 0; i < count; i++) {
+				cdr_post_spool(post, items[i]);
+			}
+		}
+
+		for (i = 0; i < count; i++) {
+			cdr_post_item_free(&items[i]);
+		}
+
+		if (!switch_queue_size(post->queue)) {
+			cdr_post_replay(post, curl_handle);
+		}
+	}
+
+	curl_easy_cleanup(curl_handle);
+	curl_slist_free_all(headers);
+
+	return NULL;
+}
+
+static char *cdr_post_strdup(switch_memory_pool_t *pool, const char *str)
+{
+	return zstr(str) ? NULL : switch_core_strdup(pool, str);
+}
+
+/* settings are copied, the strings in them only have to live for the call */
+static switch_status_t cdr_post_create(cdr_post_t **new_post, const cdr_post_settings_t *settings, switch_memory_pool_t *pool)
+{
+	cdr_post_t *post;
+	switch_threadattr_t *thd_attr = NULL;
+	cdr_post_settings_t *s;
+	uint32_t i;
+
+	post = switch_core_alloc(pool, sizeof(*post));
+	post->pool = pool;
+	post->settings = *settings;
+	s = &post->settings;
+
+	for (i = 0; i < (uint32_t) s->url_count; i++) {
+		s->urls[i] = cdr_post_strdup(pool, settings->urls[i]);
+	}
+	s->cred = cdr_post_strdup(pool, settings->cred);
+	s->ssl_cert_file = cdr_post_strdup(pool, settings->ssl_cert_file);
+	s->ssl_key_file = cdr_post_strdup(pool, settings->ssl_key_file);
+	s->ssl_key_password = cdr_post_strdup(pool, settings->ssl_key_password);
+	s->ssl_version = cdr_post_strdup(pool, settings->ssl_version);
+	s->ssl_cacert_file = cdr_post_strdup(pool, settings->ssl_cacert_file);
+	s->spool_dir = cdr_post_strdup(pool, settings->spool_dir);
+
+	if (!s->retries) {
+		s->retries = 1;
+	}
+
+	if (s->threads < 1) {
+		s->threads = 1;
+	} else if (s->threads > CDR_POST_MAX_THREADS) {
+		s->threads = CDR_POST_MAX_THREADS;
+	}
+
+	if (s->batch < 1) {
+		s->batch = 1;
+	} else if (s->batch > CDR_POST_MAX_BATCH) {
+		s->batch = CDR_POST_MAX_BATCH;
+	}
+
+	if (s->queue_size < s->batch) {
+		s->queue_size = s->batch;
+	}
+
+	if (s->spool_dir && switch_directory_exists(s->spool_dir, pool) != SWITCH_STATUS_SUCCESS &&
+		switch_dir_make_recursive(s->spool_dir, SWITCH_DEFAULT_DIR_PERMS, pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: can't create spool dir %s, failed posts go to the err-log-dir\n", s->name, s->spool_dir);
+		s->spool_dir = NULL;
+	}
+
+	switch_mutex_init(&post->mutex, SWITCH_MUTEX_NESTED, pool);
+	/* room for the shutdown markers on top of the cdrs */
+	switch_queue_create(&post->queue, s->queue_size + s->threads, pool);
+	post->collector_up = 1;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	for (i = 0; i < s->threads; i++) {
+		switch_thread_create(&post->threads[i], thd_attr, cdr_post_thread, post, pool);
+	}
+
+	*new_post = post;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* takes over text, never blocks: a full queue means the cdr is spooled right away */
+static void cdr_post_enqueue(cdr_post_t *post, const char *uuid, const char *prefix, char **text)
+{
+	cdr_post_item_t *item;
+	uint32_t depth;
+
+	switch_zmalloc(item, sizeof(*item));
+	item->uuid = strdup(uuid);
+	item->name = switch_mprintf("%s%s", prefix, uuid);
+	item->text = *text;
+	*text = NULL;
+
+	if (post->shutdown || switch_queue_trypush(post->queue, item) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s: delivery queue full, spooling cdr %s\n", post->settings.name, item->name);
+		switch_mutex_lock(post->mutex);
+		post->overflowed++;
+		switch_mutex_unlock(post->mutex);
+		cdr_post_spool(post, item);
+		cdr_post_item_free(&item);
+		return;
+	}
+
+	depth = switch_queue_size(post->queue);
+
+	switch_mutex_lock(post->mutex);
+	post->enqueued++;
+	if (depth > post->queued_max) {
+		post->queued_max = depth;
+	}
+	switch_mutex_unlock(post->mutex);
+}
+
+static void cdr_post_destroy(cdr_post_t **postp)
+{
+	cdr_post_t *post = *postp;
+	switch_status_t st;
+	uint32_t i;
+	void *pop;
+
+	if (!post) {
+		return;
+	}
+
+	/* workers finish what is queued, a single try each, then see their marker */
+	post->shutdown = 1;
+
+	for (i = 0; i < post->settings.threads; i++) {
+		switch_queue_push(post->queue, NULL);
+	}
+
+	for (i = 0; i < post->settings.threads; i++) {
+		if (post->threads[i]) {
+			switch_thread_join(&st, post->threads[i]);
+		}
+	}
+
+	while (switch_queue_trypop(post->queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		cdr_post_item_t *item = (cdr_post_item_t *) pop;
+
+		if (item) {
+			cdr_post_spool(post, item);
+			cdr_post_item_free(&item);
+		}
+	}
+
+	*postp = NULL;
+}
+
+static void cdr_post_status(cdr_post_t *post, switch_stream_handle_t *stream)
+{
+	switch_mutex_lock(post->mutex);
+	stream->write_function(stream, "threads: %u batch: %u collector: %s\n", post->settings.threads, post->settings.batch, post->collector_up ? "up" : "down");
+	stream->write_function(stream, "queue: %u/%u max %u\n", switch_queue_size(post->queue), post->settings.queue_size, post->queued_max);
+	stream->write_function(stream, "enqueued: %" SWITCH_UINT64_T_FMT " posted: %" SWITCH_UINT64_T_FMT " failed: %" SWITCH_UINT64_T_FMT "\n",
+						   post->enqueued, post->posted, post->failed);
+	stream->write_function(stream, "overflowed: %" SWITCH_UINT64_T_FMT " spooled: %" SWITCH_UINT64_T_FMT " replayed: %" SWITCH_UINT64_T_FMT "\n",
+						   post->overflowed, post->spooled, post->replayed);
+	stream->write_function(stream, "posts: %" SWITCH_UINT64_T_FMT " avg post time: %" SWITCH_UINT64_T_FMT "ms\n",
+						   post->posts, post->posts ? post->post_usec / post->posts / 1000 : 0);
+	switch_mutex_unlock(post->mutex);
+}
+
+#endif
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4:
+ */
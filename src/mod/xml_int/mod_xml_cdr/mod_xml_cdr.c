@@ -33,7 +33,8 @@
 #include <sys/stat.h>
 #include <switch.h>
 #include <curl/curl.h>
-#define MAX_URLS 20
+#include "cdr_post.h"
+#define MAX_URLS CDR_POST_MAX_URLS
 
 #define ENCODING_NONE 0
 #define ENCODING_DEFAULT 1
@@ -68,6 +69,11 @@ static struct {
 	int rotate;
 	int auth_scheme;
 	int timeout;
+	uint32_t post_threads;
+	uint32_t batch_size;
+	uint32_t queue_size;
+	char *spool_dir;
+	cdr_post_t *post;
 	switch_memory_pool_t *pool;
 	switch_event_node_t *node;
 } globals;
@@ -76,13 +82,37 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_cdr_shutdown);
 SWITCH_MODULE_DEFINITION(mod_xml_cdr, mod_xml_cdr_load, mod_xml_cdr_shutdown, NULL);
 
-/* this function would have access to the HTML returned by the webserver, we don't need it 
- * and the default curl activity is to print to stdout, something not as desirable
- * so we have a dummy function here
- */
-static size_t httpCallBack(char *buffer, size_t size, size_t nitems, void *outstream)
+/* a cdr the delivery threads could not post */
+static void write_err_cdr(const char *name, const char *text)
 {
-	return size * nitems;
+	char *path = NULL;
+	int fd = -1;
+
+	switch_thread_rwlock_rdlock(globals.log_path_lock);
+	path = switch_mprintf("%s%s%s.cdr.xml", globals.err_log_dir, SWITCH_PATH_SEPARATOR, name);
+	switch_thread_rwlock_unlock(globals.log_path_lock);
+
+	if (path) {
+#ifdef _MSC_VER
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
+#else
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
+#endif
+			int wrote;
+			wrote = write(fd, text, (unsigned) strlen(text));
+			close(fd);
+			fd = -1;
+		} else {
+			char ebuf[512] = { 0 };
+#ifdef WIN32
+			strerror_s(ebuf, sizeof(ebuf), errno);
+#else
+			strerror_r(errno, ebuf, sizeof(ebuf));
+#endif
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error![%s]\n", ebuf);
+		}
+		free(path);
+	}
 }
 
 static switch_status_t set_xml_cdr_log_dirs()
@@ -182,15 +212,8 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 	switch_xml_t cdr = NULL;
 	char *xml_text = NULL;
 	char *path = NULL;
-	char *curl_xml_text = NULL;
 	const char *logdir = NULL;
-	char *xml_text_escaped = NULL;
 	int fd = -1;
-	uint32_t cur_try;
-	long httpRes;
-	CURL *curl_handle = NULL;
-	struct curl_slist *headers = NULL;
-	struct curl_slist *slist = NULL;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	switch_status_t status = SWITCH_STATUS_FALSE;
 	int is_b;
@@ -256,173 +279,14 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 		switch_thread_rwlock_unlock(globals.log_path_lock);
 	}
 
-	/* try to post it to the web server */
-	if (globals.url_count) {
-		char *destUrl = NULL;
-		curl_handle = curl_easy_init();
-
-		if (globals.encode == ENCODING_TEXTXML) {
-			headers = curl_slist_append(headers, "Content-Type: text/xml");
-		} else if (globals.encode) {
-			switch_size_t need_bytes = strlen(xml_text) * 3;
-
-			xml_text_escaped = malloc(need_bytes);
-			switch_assert(xml_text_escaped);
-			memset(xml_text_escaped, 0, need_bytes);
-			if (globals.encode == ENCODING_DEFAULT) {
-				headers = curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
-				switch_url_encode(xml_text, xml_text_escaped, need_bytes);
-			} else {
-				headers = curl_slist_append(headers, "Content-Type: application/x-www-form-base64-encoded");
-				switch_b64_encode((unsigned char *) xml_text, need_bytes / 3, (unsigned char *) xml_text_escaped, need_bytes);
-			}
-			switch_safe_free(xml_text);
-			xml_text = xml_text_escaped;
-		} else {
-			headers = curl_slist_append(headers, "Content-Type: application/x-www-form-plaintext");
-		}
-
-		if (globals.encode == ENCODING_TEXTXML) {
-			curl_xml_text = xml_text;
-		} else if (!(curl_xml_text = switch_mprintf("cdr=%s", xml_text))) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error!\n");
-			goto error;
-		}
-
-		if (!zstr(globals.cred)) {
-			curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
-			curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
-		}
-
-		curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-		curl_easy_setopt(curl_handle, CURLOPT_POST, 1);
-		curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, curl_xml_text);
-		curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-xml/1.0");
-		curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, httpCallBack);
-
-		if (globals.disable100continue) {
-			slist = curl_slist_append(slist, "Expect:");
-			curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, slist);
-		}
-
-		if (globals.ssl_cert_file) {
-			curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
-		}
-
-		if (globals.ssl_key_file) {
-			curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
-		}
-
-		if (globals.ssl_key_password) {
-			curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
-		}
-
-		if (globals.ssl_version) {
-			if (!strcasecmp(globals.ssl_version, "SSLv3")) {
-				curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
-			} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
-				curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
-			}
-		}
-
-		if (globals.ssl_cacert_file) {
-			curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
-		}
-		
-		curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, globals.timeout);
-
-		/* these were used for testing, optionally they may be enabled if someone desires
-		   curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1); // 302 recursion level
-		 */
-
-		for (cur_try = 0; cur_try < globals.retries; cur_try++) {
-			if (cur_try > 0) {
-				switch_yield(globals.delay * 1000000);
-			}
-
-			destUrl = switch_mprintf("%s?uuid=%s", globals.urls[globals.url_index], switch_core_session_get_uuid(session));
-			curl_easy_setopt(curl_handle, CURLOPT_URL, destUrl);
-
-			if (!strncasecmp(destUrl, "https", 5)) {
-				curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0);
-				curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
-			}
-
-			if (globals.enable_cacert_check) {
-				curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
-			}
-
-			if (globals.enable_ssl_verifyhost) {
-				curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
-			}
-
-			curl_easy_perform(curl_handle);
-			curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
-			switch_safe_free(destUrl);
-			if (httpRes == 200) {
-				goto success;
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Got error [%ld] posting to web server [%s]\n",
-								  httpRes, globals.urls[globals.url_index]);
-				globals.url_index++;
-				switch_assert(globals.url_count <= MAX_URLS);
-				if (globals.url_index >= globals.url_count) {
-					globals.url_index = 0;
-				}
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Retry will be with url [%s]\n", globals.urls[globals.url_index]);
-			}
-		}
-		curl_easy_cleanup(curl_handle);
-		curl_slist_free_all(headers);
-		curl_slist_free_all(slist);
-		slist = NULL;
-		headers = NULL;
-		curl_handle = NULL;
-
-		/* if we are here the web post failed for some reason */
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to post to web server, writing to file\n");
-
-		switch_thread_rwlock_rdlock(globals.log_path_lock);
-		path = switch_mprintf("%s%s%s%s.cdr.xml", globals.err_log_dir, SWITCH_PATH_SEPARATOR, a_prefix, switch_core_session_get_uuid(session));
-		switch_thread_rwlock_unlock(globals.log_path_lock);
-		if (path) {
-#ifdef _MSC_VER
-			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
-#else
-			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
-#endif
-				int wrote;
-				wrote = write(fd, xml_text, (unsigned) strlen(xml_text));
-				close(fd);
-				fd = -1;
-			} else {
-				char ebuf[512] = { 0 };
-#ifdef WIN32
-				strerror_s(ebuf, sizeof(ebuf), errno);
-#else
-				strerror_r(errno, ebuf, sizeof(ebuf));
-#endif
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error![%s]\n", ebuf);
-			}
-		}
+	/* hand it to the delivery threads */
+	if (globals.post) {
+		cdr_post_enqueue(globals.post, switch_core_session_get_uuid(session), a_prefix, &xml_text);
 	}
 
-  success:
 	status = SWITCH_STATUS_SUCCESS;
 
   error:
-	if (curl_handle) {
-		curl_easy_cleanup(curl_handle);
-	}
-	if (headers) {
-		curl_slist_free_all(headers);
-	}
-	if (slist) {
-		curl_slist_free_all(slist);
-	}
-	if (curl_xml_text != xml_text) {
-		switch_safe_free(curl_xml_text);
-	}
 	switch_safe_free(xml_text);
 	switch_safe_free(path);
 	switch_xml_free(cdr);
@@ -455,10 +319,28 @@ static switch_state_handler_table_t state_handlers = {
 	/*.on_reporting */ my_on_reporting
 };
 
+SWITCH_STANDARD_API(xml_cdr_function)
+{
+	if (zstr(cmd) || strcasecmp(cmd, "status")) {
+		stream->write_function(stream, "-USAGE: status\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!globals.post) {
+		stream->write_function(stream, "http delivery is not configured\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	cdr_post_status(globals.post, stream);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 {
 	char *cf = "xml_cdr.conf";
 	switch_xml_t cfg, xml, settings, param;
+	switch_api_interface_t *api_interface;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
 
 	/* test global state handlers */
@@ -528,6 +410,18 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 				}
 			} else if (!strcasecmp(var, "retries") && !zstr(val)) {
 				globals.retries = (uint32_t) atoi(val);
+			} else if (!strcasecmp(var, "post-threads") && !zstr(val)) {
+				globals.post_threads = (uint32_t) atoi(val);
+			} else if (!strcasecmp(var, "batch-size") && !zstr(val)) {
+				globals.batch_size = (uint32_t) atoi(val);
+			} else if (!strcasecmp(var, "queue-size") && !zstr(val)) {
+				globals.queue_size = (uint32_t) atoi(val);
+			} else if (!strcasecmp(var, "spool-dir") && !zstr(val)) {
+				if (switch_is_file_path(val)) {
+					globals.spool_dir = switch_core_strdup(globals.pool, val);
+				} else {
+					globals.spool_dir = switch_core_sprintf(globals.pool, "%s%s%s", SWITCH_GLOBAL_dirs.log_dir, SWITCH_PATH_SEPARATOR, val);
+				}
 			} else if (!strcasecmp(var, "rotate") && !zstr(val)) {
 				globals.rotate = switch_true(val);
 			} else if (!strcasecmp(var, "log-dir")) {
@@ -607,7 +501,60 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 
 	set_xml_cdr_log_dirs();
 
+	if (globals.url_count) {
+		cdr_post_settings_t post_settings = { 0 };
+		int i;
+
+		post_settings.name = modname;
+		post_settings.user_agent = "freeswitch-xml/1.0";
+		post_settings.ext = ".cdr.xml";
+		if (globals.encode == ENCODING_TEXTXML) {
+			post_settings.content_type = "text/xml";
+		} else if (globals.encode) {
+			post_settings.content_type = "application/x-www-form-urlencoded";
+			post_settings.form = 1;
+			post_settings.encode = CDR_POST_ENCODE_URL;
+		} else {
+			post_settings.content_type = "application/x-www-form-plaintext";
+			post_settings.form = 1;
+		}
+		post_settings.batch_open = "<?xml version=\"1.0\"?>\n<cdrs>\n";
+		post_settings.batch_sep = "\n";
+		post_settings.batch_close = "\n</cdrs>\n";
+		post_settings.strip_xml_decl = 1;
+		for (i = 0; i < globals.url_count; i++) {
+			post_settings.urls[i] = globals.urls[i];
+		}
+		post_settings.url_count = globals.url_count;
+		post_settings.cred = globals.cred;
+		post_settings.auth_scheme = globals.auth_scheme;
+		post_settings.ssl_cert_file = globals.ssl_cert_file;
+		post_settings.ssl_key_file = globals.ssl_key_file;
+		post_settings.ssl_key_password = globals.ssl_key_password;
+		post_settings.ssl_version = globals.ssl_version;
+		post_settings.ssl_cacert_file = globals.ssl_cacert_file;
+		post_settings.enable_cacert_check = globals.enable_cacert_check;
+		post_settings.enable_ssl_verifyhost = globals.enable_ssl_verifyhost;
+		post_settings.disable100continue = globals.disable100continue;
+		post_settings.retries = globals.retries;
+		post_settings.delay = globals.delay;
+		post_settings.timeout = globals.timeout;
+		post_settings.threads = globals.post_threads;
+		post_settings.batch = globals.batch_size;
+		post_settings.queue_size = globals.queue_size ? globals.queue_size : 10000;
+		post_settings.spool_dir = globals.spool_dir;
+		post_settings.err_func = write_err_cdr;
+
+		cdr_post_create(&globals.post, &post_settings, globals.pool);
+	}
+
+	/* the ssl strings pointed into the config, the delivery threads have their own copies */
+	globals.ssl_cert_file = globals.ssl_key_file = globals.ssl_key_password = globals.ssl_version = globals.ssl_cacert_file = NULL;
+
 	switch_xml_free(xml);
+
+	SWITCH_ADD_API(api_interface, "xml_cdr", "xml_cdr delivery status", xml_cdr_function, "status");
+
 	return status;
 }
 
@@ -616,11 +563,15 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_cdr_shutdown)
 
 	globals.shutdown = 1;
 
+	switch_core_remove_state_handler(&state_handlers);
+
+	/* whatever is still queued is posted once or written out */
+	cdr_post_destroy(&globals.post);
+
 	switch_safe_free(globals.log_dir);
 	switch_safe_free(globals.err_log_dir);
 
 	switch_event_unbind(&globals.node);
-	switch_core_remove_state_handler(&state_handlers);
 
 	switch_thread_rwlock_destroy(globals.log_path_lock);
 
@@ -47,6 +47,7 @@
 #include <apr_thread_mutex.h>
 #include <apr_thread_cond.h>
 #include <apr_thread_rwlock.h>
+#include <apr_atomic.h>
 #include <apr_file_io.h>
 #include <apr_poll.h>
 #include <apr_dso.h>
@@ -281,6 +282,19 @@ SWITCH_DECLARE(switch_status_t) switch_thread_rwlock_unlock(switch_thread_rwlock
 	return apr_thread_rwlock_unlock(rwlock);
 }
 
+SWITCH_DECLARE(void) switch_memory_barrier(void)
+{
+#if defined(_MSC_VER)
+	MemoryBarrier();
+#elif defined(__GNUC__)
+	__sync_synchronize();
+#else
+	static volatile apr_uint32_t fence;
+
+	apr_atomic_inc32(&fence);
+#endif
+}
+
 /* thread mutex functions */
 
 SWITCH_DECLARE(switch_status_t) switch_mutex_init(switch_mutex_t ** lock, unsigned int flags, switch_memory_pool_t *pool)
@@ -660,6 +674,11 @@ SWITCH_DECLARE(switch_status_t) switch_socket_create(switch_socket_t ** new_sock
 	return apr_socket_create(new_sock, family, type, protocol, pool);
 }
 
+SWITCH_DECLARE(switch_status_t) switch_os_sock_get(switch_os_socket_t *thesock, switch_socket_t *sock)
+{
+	return apr_os_sock_get(thesock, sock);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_socket_shutdown(switch_socket_t *sock, switch_shutdown_how_e how)
 {
 	return apr_socket_shutdown(sock, (apr_shutdown_how_e) how);
@@ -818,6 +837,150 @@ SWITCH_DECLARE(switch_status_t) switch_socket_recvfrom(switch_sockaddr_t *from,
 	return r;
 }
 
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+#define SWITCH_MAX_MMSG 64
+#endif
+
+SWITCH_DECLARE(switch_status_t) switch_socket_recvmmsg(switch_socket_t *sock, switch_sockaddr_t **from, char **bufs, switch_size_t *lens, uint32_t *count)
+{
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[SWITCH_MAX_MMSG];
+	struct iovec iov[SWITCH_MAX_MMSG];
+	apr_os_sock_t fd;
+	uint32_t i, want = *count;
+	int n;
+
+	*count = 0;
+
+	if (!sock || !want || apr_os_sock_get(&fd, sock) != APR_SUCCESS) {
+		return SWITCH_STATUS_GENERR;
+	}
+
+	if (want > SWITCH_MAX_MMSG) {
+		want = SWITCH_MAX_MMSG;
+	}
+
+	memset(msgs, 0, sizeof(msgs[0]) * want);
+
+	for (i = 0; i < want; i++) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = lens[i];
+		msgs[i].msg_hdr.msg_name = &from[i]->sa;
+		msgs[i].msg_hdr.msg_namelen = sizeof(from[i]->sa);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	do {
+		n = recvmmsg(fd, msgs, want, MSG_DONTWAIT, NULL);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0) {
+		return (n == 0 || errno == EAGAIN || errno == EWOULDBLOCK) ? SWITCH_STATUS_BREAK : SWITCH_STATUS_GENERR;
+	}
+
+	for (i = 0; i < (uint32_t) n; i++) {
+		switch_sockaddr_t *sa = from[i];
+
+		lens[i] = msgs[i].msg_len;
+		sa->salen = msgs[i].msg_hdr.msg_namelen;
+		sa->family = sa->sa.sin.sin_family;
+		sa->port = ntohs(sa->sa.sin.sin_port);
+#if APR_HAVE_IPV6
+		if (sa->family == AF_INET6) {
+			sa->ipaddr_ptr = &sa->sa.sin6.sin6_addr;
+			sa->ipaddr_len = sizeof(struct in6_addr);
+			sa->addr_str_len = 46;
+		} else
+#endif
+		{
+			sa->ipaddr_ptr = &sa->sa.sin.sin_addr;
+			sa->ipaddr_len = sizeof(struct in_addr);
+			sa->addr_str_len = 16;
+		}
+	}
+
+	*count = (uint32_t) n;
+
+	return SWITCH_STATUS_SUCCESS;
+#else
+	switch_status_t status = SWITCH_STATUS_BREAK;
+	uint32_t i, want = *count;
+
+	for (i = 0; i < want; i++) {
+		size_t len = lens[i];
+
+		if ((status = switch_socket_recvfrom(from[i], sock, 0, bufs[i], &len)) != SWITCH_STATUS_SUCCESS || !len) {
+			break;
+		}
+		lens[i] = len;
+	}
+
+	*count = i;
+
+	return i ? SWITCH_STATUS_SUCCESS : status;
+#endif
+}
+
+SWITCH_DECLARE(switch_status_t) switch_socket_sendmmsg(switch_socket_t *sock, switch_sockaddr_t *where, char **bufs, switch_size_t *lens, uint32_t *count)
+{
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[SWITCH_MAX_MMSG];
+	struct iovec iov[SWITCH_MAX_MMSG];
+	apr_os_sock_t fd;
+	uint32_t i, want = *count;
+	int n;
+
+	*count = 0;
+
+	if (!sock || !where || !want || apr_os_sock_get(&fd, sock) != APR_SUCCESS) {
+		return SWITCH_STATUS_GENERR;
+	}
+
+	if (want > SWITCH_MAX_MMSG) {
+		want = SWITCH_MAX_MMSG;
+	}
+
+	memset(msgs, 0, sizeof(msgs[0]) * want);
+
+	for (i = 0; i < want; i++) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = lens[i];
+		msgs[i].msg_hdr.msg_name = &where->sa;
+		msgs[i].msg_hdr.msg_namelen = where->salen;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	do {
+		n = sendmmsg(fd, msgs, want, 0);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0) {
+		return SWITCH_STATUS_GENERR;
+	}
+
+	*count = (uint32_t) n;
+
+	return SWITCH_STATUS_SUCCESS;
+#else
+	switch_status_t status = SWITCH_STATUS_GENERR;
+	uint32_t i, want = *count;
+
+	for (i = 0; i < want; i++) {
+		switch_size_t len = lens[i];
+
+		if ((status = switch_socket_sendto(sock, where, 0, bufs[i], &len)) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+	}
+
+	*count = i;
+
+	return i ? SWITCH_STATUS_SUCCESS : status;
+#endif
+}
+
 /* poll stubs */
 
 SWITCH_DECLARE(switch_status_t) switch_pollset_create(switch_pollset_t ** pollset, uint32_t size, switch_memory_pool_t *p, uint32_t flags)
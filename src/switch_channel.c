@@ -33,6 +33,7 @@
 
 #include <switch.h>
 #include <switch_channel.h>
+#include "private/switch_core_pvt.h"
 
 struct switch_cause_table {
 	const char *name;
@@ -677,6 +678,22 @@ SWITCH_DECLARE(const char *) switch_channel_get_variable_dup(switch_channel_t *c
 	return r;
 }
 
+SWITCH_DECLARE(char *) switch_channel_get_variable_strdup(switch_channel_t *channel, const char *varname)
+{
+	const char *v;
+	char *r = NULL;
+
+	switch_assert(channel != NULL);
+
+	switch_mutex_lock(channel->profile_mutex);
+	if (channel->variables && (v = switch_event_get_header(channel->variables, varname))) {
+		r = strdup(v);
+	}
+	switch_mutex_unlock(channel->profile_mutex);
+
+	return r;
+}
+
 SWITCH_DECLARE(const char *) switch_channel_get_variable_partner(switch_channel_t *channel, const char *varname)
 {
 	const char *uuid;
@@ -902,6 +919,15 @@ SWITCH_DECLARE(switch_status_t) switch_channel_set_variable_var_check(switch_cha
 
 	switch_mutex_lock(channel->profile_mutex);
 	if (channel->variables && !zstr(varname)) {
+		const char *new_val = NULL;
+		char *old_val = NULL;
+		switch_bool_t indexed = switch_core_session_var_indexed(varname);
+
+		if (indexed && (new_val = switch_event_get_header(channel->variables, varname))) {
+			old_val = strdup(new_val);
+			new_val = NULL;
+		}
+
 		switch_event_del_header(channel->variables, varname);
 		if (!zstr(value)) {
 			int ok = 1;
@@ -911,10 +937,17 @@ SWITCH_DECLARE(switch_status_t) switch_channel_set_variable_var_check(switch_cha
 			}
 			if (ok) {
 				switch_event_add_header_string(channel->variables, SWITCH_STACK_BOTTOM, varname, value);
+				new_val = value;
 			} else {
 				switch_log_printf(SWITCH_CHANNEL_CHANNEL_LOG(channel), SWITCH_LOG_CRIT, "Invalid data (${%s} contains a variable)\n", varname);
 			}
 		}
+
+		if (indexed) {
+			switch_core_session_index_update(switch_channel_get_uuid(channel), varname, old_val, new_val);
+			switch_safe_free(old_val);
+		}
+
 		status = SWITCH_STATUS_SUCCESS;
 	}
 	switch_mutex_unlock(channel->profile_mutex);
@@ -935,8 +968,7 @@ SWITCH_DECLARE(switch_status_t) switch_channel_set_variable_printf(switch_channe
 
 	switch_mutex_lock(channel->profile_mutex);
 	if (channel->variables && !zstr(varname)) {
-		switch_event_del_header(channel->variables, varname);
-
+		/* switch_channel_set_variable replaces the old value itself, it has to see it to keep the var index right */
 		va_start(ap, fmt);
 		ret = switch_vasprintf(&data, fmt, ap);
 		va_end(ap);
@@ -45,6 +45,9 @@
 #ifdef HAVE_SETRLIMIT
 #include <sys/resource.h>
 #endif
+#ifdef HAVE_SCHED_GETCPU
+#include <sched.h>
+#endif
 #endif
 #include <errno.h>
 
@@ -1208,6 +1211,23 @@ static void switch_core_set_serial(void)
 	switch_core_set_variable("switch_serial", buf);
 }
 
+SWITCH_DECLARE(uint32_t) switch_core_cpu_count(void)
+{
+	return runtime.cpu_count;
+}
+
+uint32_t switch_core_cpu_slot(uint32_t slots)
+{
+#ifdef HAVE_SCHED_GETCPU
+	int cpu = sched_getcpu();
+
+	if (cpu >= 0) {
+		return (uint32_t) cpu % slots;
+	}
+#endif
+	return (uint32_t) (((uintptr_t) switch_thread_self() >> 4) % slots);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switch_bool_t console, const char **err)
 {
 	switch_uuid_t uuid;
@@ -1237,6 +1257,20 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	runtime.default_dtmf_duration = SWITCH_DEFAULT_DTMF_DURATION;
 	runtime.min_dtmf_duration = SWITCH_MIN_DTMF_DURATION;
 
+#ifdef WIN32
+	{
+		SYSTEM_INFO sysinfo;
+		GetSystemInfo(&sysinfo);
+		runtime.cpu_count = sysinfo.dwNumberOfProcessors;
+	}
+#elif defined(_SC_NPROCESSORS_ONLN)
+	runtime.cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	if (!runtime.cpu_count) {
+		runtime.cpu_count = 1;
+	}
+
 	/* INIT APR and Create the pool context */
 	if (apr_initialize() != SWITCH_STATUS_SUCCESS) {
 		*err = "FATAL ERROR! Could not initialize APR\n";
@@ -1303,6 +1337,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 
 	switch_console_init(runtime.memory_pool);
 	switch_event_init(runtime.memory_pool);
+	switch_regex_cache_init(runtime.memory_pool);
+	switch_resample_cache_init(runtime.memory_pool);
+	switch_core_file_cache_init(runtime.memory_pool);
+	switch_core_probes_init();
 
 	if (switch_xml_init(runtime.memory_pool, err) != SWITCH_STATUS_SUCCESS) {
 		apr_terminate();
@@ -1477,6 +1515,24 @@ static void switch_load_core_config(const char *file)
 					switch_time_set_cond_yield(switch_true(var));
 				} else if (!strcasecmp(var, "enable-timer-matrix")) {
 					switch_time_set_matrix(switch_true(var));
+				} else if (!strcasecmp(var, "enable-use-timerfd")) {
+					switch_time_set_timerfd(switch_true(val));
+				} else if (!strcasecmp(var, "regex-cache-size") && !zstr(val)) {
+					switch_regex_cache_size((uint32_t) atoi(val));
+				} else if (!strcasecmp(var, "resample-quality") && !zstr(val)) {
+					switch_resample_default_quality(atoi(val));
+				} else if (!strcasecmp(var, "resample-cache-size") && !zstr(val)) {
+					switch_resample_cache_size((uint32_t) atoi(val));
+				} else if (!strcasecmp(var, "file-cache-size") && !zstr(val)) {
+					int tmp = atoi(val);
+					switch_core_file_cache_size(tmp > 0 ? (uint32_t) tmp : 0);
+				} else if (!strcasecmp(var, "enable-latency-probes") && !zstr(val)) {
+					switch_core_probes_set(switch_true(val));
+				} else if (!strcasecmp(var, "max-recycled-pools") && !zstr(val)) {
+					int tmp = atoi(val);
+					switch_core_memory_pool_recycle_max(tmp > 0 ? (uint32_t) tmp : 0);
+				} else if (!strcasecmp(var, "rtp-reactor-threads") && !zstr(val)) {
+					switch_rtp_set_reactor_threads(!strcasecmp(val, "auto") ? -1 : atoi(val));
 				} else if (!strcasecmp(var, "max-sessions") && !zstr(val)) {
 					switch_core_session_limit(atoi(val));
 				} else if (!strcasecmp(var, "verbose-channel-events") && !zstr(val)) {
@@ -1909,6 +1965,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_destroy(void)
 
 	switch_console_shutdown();
 
+	switch_regex_cache_shutdown();
+	switch_resample_cache_shutdown();
+	switch_core_file_cache_shutdown();
+	switch_core_probes_shutdown();
+
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Closing Event Engine.\n");
 	switch_event_shutdown();
 
@@ -579,6 +579,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_encode(switch_codec_t *codec,
 														 void *encoded_data, uint32_t *encoded_data_len, uint32_t *encoded_rate, unsigned int *flag)
 {
 	switch_status_t status;
+	switch_time_t probe_start;
 
 	switch_assert(codec != NULL);
 	switch_assert(encoded_data != NULL);
@@ -594,10 +595,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_encode(switch_codec_t *codec,
 		return SWITCH_STATUS_NOT_INITALIZED;
 	}
 
+	probe_start = switch_core_probe_start();
 	if (codec->mutex) switch_mutex_lock(codec->mutex);
 	status = codec->implementation->encode(codec, other_codec, decoded_data, decoded_data_len,
 										   decoded_rate, encoded_data, encoded_data_len, encoded_rate, flag);
 	if (codec->mutex) switch_mutex_unlock(codec->mutex);
+	switch_core_probe_end(SWITCH_PROBE_CODEC_ENCODE, probe_start);
 
 	return status;
 
@@ -611,6 +614,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_decode(switch_codec_t *codec,
 														 void *decoded_data, uint32_t *decoded_data_len, uint32_t *decoded_rate, unsigned int *flag)
 {
 	switch_status_t status;
+	switch_time_t probe_start;
 
 	switch_assert(codec != NULL);
 	switch_assert(encoded_data != NULL);
@@ -636,10 +640,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_decode(switch_codec_t *codec,
 		}
 	}
 	
+	probe_start = switch_core_probe_start();
 	if (codec->mutex) switch_mutex_lock(codec->mutex);
 	status = codec->implementation->decode(codec, other_codec, encoded_data, encoded_data_len, encoded_rate,
 										   decoded_data, decoded_data_len, decoded_rate, flag);
 	if (codec->mutex) switch_mutex_unlock(codec->mutex);
+	switch_core_probe_end(SWITCH_PROBE_CODEC_DECODE, probe_start);
 
 	return status;
 }
@@ -35,6 +35,315 @@
 
 #include <switch.h>
 #include "private/switch_core_pvt.h"
+#include <sys/stat.h>
+
+#ifndef S_ISREG
+#define S_ISREG(mode) (((mode) & S_IFMT) == S_IFREG)
+#endif
+
+/* decoded audio of files played to the end, keyed by path, mtime, size, inode, rate and channels */
+struct switch_file_cache_entry {
+	char *key;
+	int16_t *data;
+	switch_size_t samples;
+	switch_size_t bytes;
+	uint32_t samplerate;
+	uint8_t channels;
+	int refs;
+	int dead;
+	struct switch_file_cache_entry *prev;
+	struct switch_file_cache_entry *next;
+};
+typedef struct switch_file_cache_entry switch_file_cache_entry_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	/* keys some handle is collecting right now, so concurrent misses decode the file only once */
+	switch_hash_t *filling;
+	/* most recently used first */
+	switch_file_cache_entry_t *head;
+	switch_file_cache_entry_t *tail;
+	switch_size_t bytes;
+	switch_size_t max_bytes;
+	uint32_t entries;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t stores;
+	uint64_t evictions;
+	int ready;
+} FILE_CACHE;
+
+static void file_cache_free(switch_file_cache_entry_t *entry)
+{
+	switch_safe_free(entry->data);
+	switch_safe_free(entry->key);
+	free(entry);
+}
+
+/* takes it out of the cache, handles still reading from it keep it alive. call with the mutex held */
+static void file_cache_unlink(switch_file_cache_entry_t *entry)
+{
+	switch_core_hash_delete(FILE_CACHE.hash, entry->key);
+
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		FILE_CACHE.head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		FILE_CACHE.tail = entry->prev;
+	}
+
+	FILE_CACHE.bytes -= entry->bytes;
+	FILE_CACHE.entries--;
+	entry->dead = 1;
+
+	if (!entry->refs) {
+		file_cache_free(entry);
+	}
+}
+
+static uint32_t file_cache_trim(switch_size_t max_bytes)
+{
+	uint32_t dropped = 0;
+
+	while (FILE_CACHE.tail && FILE_CACHE.bytes > max_bytes) {
+		file_cache_unlink(FILE_CACHE.tail);
+		dropped++;
+	}
+
+	return dropped;
+}
+
+static switch_file_cache_entry_t *file_cache_find(const char *key)
+{
+	switch_file_cache_entry_t *entry;
+
+	switch_mutex_lock(FILE_CACHE.mutex);
+	if ((entry = switch_core_hash_find(FILE_CACHE.hash, key))) {
+		entry->refs++;
+		FILE_CACHE.hits++;
+
+		if (entry != FILE_CACHE.head) {
+			entry->prev->next = entry->next;
+			if (entry->next) {
+				entry->next->prev = entry->prev;
+			} else {
+				FILE_CACHE.tail = entry->prev;
+			}
+			entry->prev = NULL;
+			entry->next = FILE_CACHE.head;
+			FILE_CACHE.head->prev = entry;
+			FILE_CACHE.head = entry;
+		}
+	} else {
+		FILE_CACHE.misses++;
+	}
+	switch_mutex_unlock(FILE_CACHE.mutex);
+
+	return entry;
+}
+
+static void file_cache_release(switch_file_cache_entry_t *entry)
+{
+	switch_mutex_lock(FILE_CACHE.mutex);
+	if (!--entry->refs && entry->dead) {
+		file_cache_free(entry);
+	}
+	switch_mutex_unlock(FILE_CACHE.mutex);
+}
+
+/* a changed or replaced file gets a new key from its mtime, size and inode, the old entry just ages out */
+static char *file_cache_key(switch_file_handle_t *fh, const char *file_path)
+{
+	struct stat st;
+
+	if (stat(file_path, &st) || !S_ISREG(st.st_mode)) {
+		return NULL;
+	}
+
+	return switch_core_sprintf(fh->memory_pool, "%s|%ld|%" SWITCH_INT64_T_FMT "|%" SWITCH_UINT64_T_FMT "|%u|%u", file_path, (long) st.st_mtime,
+							   (int64_t) st.st_size, (uint64_t) st.st_ino, fh->samplerate, fh->channels);
+}
+
+/* only the first handle to miss on a key collects the decoded audio, the others just play */
+static void file_cache_fill_start(switch_file_handle_t *fh)
+{
+	switch_bool_t ok = SWITCH_FALSE;
+
+	switch_mutex_lock(FILE_CACHE.mutex);
+	if (FILE_CACHE.ready && !switch_core_hash_find(FILE_CACHE.filling, fh->cache_key)) {
+		switch_core_hash_insert(FILE_CACHE.filling, fh->cache_key, fh);
+		ok = SWITCH_TRUE;
+	}
+	switch_mutex_unlock(FILE_CACHE.mutex);
+
+	if (ok) {
+		switch_buffer_create_dynamic(&fh->cache_fill, 16384, 65536, FILE_CACHE.max_bytes / 4);
+	}
+}
+
+static void file_cache_fill_stop(switch_file_handle_t *fh)
+{
+	switch_buffer_destroy(&fh->cache_fill);
+
+	switch_mutex_lock(FILE_CACHE.mutex);
+	if (FILE_CACHE.ready && switch_core_hash_find(FILE_CACHE.filling, fh->cache_key) == fh) {
+		switch_core_hash_delete(FILE_CACHE.filling, fh->cache_key);
+	}
+	switch_mutex_unlock(FILE_CACHE.mutex);
+}
+
+/* the module reached the end of the file, everything it decoded becomes an entry */
+static void file_cache_store(switch_file_handle_t *fh)
+{
+	switch_file_cache_entry_t *entry;
+	switch_size_t bytes = switch_buffer_inuse(fh->cache_fill);
+
+	if (bytes && fh->channels) {
+		switch_zmalloc(entry, sizeof(*entry));
+		entry->key = strdup(fh->cache_key);
+		entry->data = malloc(bytes);
+		switch_assert(entry->data);
+		entry->bytes = switch_buffer_read(fh->cache_fill, entry->data, bytes);
+		entry->channels = fh->channels;
+		entry->samples = entry->bytes / 2 / entry->channels;
+		entry->samplerate = fh->native_rate;
+
+		switch_mutex_lock(FILE_CACHE.mutex);
+		if (!FILE_CACHE.ready || !FILE_CACHE.max_bytes || switch_core_hash_find(FILE_CACHE.hash, entry->key)) {
+			file_cache_free(entry);
+		} else {
+			switch_core_hash_insert(FILE_CACHE.hash, entry->key, entry);
+			entry->next = FILE_CACHE.head;
+			if (FILE_CACHE.head) {
+				FILE_CACHE.head->prev = entry;
+			} else {
+				FILE_CACHE.tail = entry;
+			}
+			FILE_CACHE.head = entry;
+			FILE_CACHE.bytes += entry->bytes;
+			FILE_CACHE.entries++;
+			FILE_CACHE.stores++;
+			FILE_CACHE.evictions += file_cache_trim(FILE_CACHE.max_bytes);
+		}
+		switch_mutex_unlock(FILE_CACHE.mutex);
+	}
+
+	file_cache_fill_stop(fh);
+}
+
+/* the module's file_read, or the cached copy of what it returned last time */
+static switch_status_t file_read_raw(switch_file_handle_t *fh, void *data, switch_size_t *len)
+{
+	switch_status_t status;
+
+	if (fh->cache_entry) {
+		switch_file_cache_entry_t *entry = fh->cache_entry;
+		switch_size_t avail = entry->samples - fh->cache_pos;
+
+		if (*len > avail) {
+			*len = avail;
+		}
+
+		if (!*len) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		memcpy(data, entry->data + fh->cache_pos * entry->channels, *len * 2 * entry->channels);
+		fh->cache_pos += *len;
+		fh->pos = fh->cache_pos;
+
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	status = fh->file_interface->file_read(fh, data, len);
+
+	if (fh->cache_fill) {
+		if (status != SWITCH_STATUS_SUCCESS || !*len) {
+			file_cache_store(fh);
+		} else if (!switch_buffer_write(fh->cache_fill, data, *len * 2 * fh->channels)) {
+			/* bigger than we want to cache */
+			file_cache_fill_stop(fh);
+		}
+	}
+
+	return status;
+}
+
+void switch_core_file_cache_init(switch_memory_pool_t *pool)
+{
+	memset(&FILE_CACHE, 0, sizeof(FILE_CACHE));
+	switch_mutex_init(&FILE_CACHE.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&FILE_CACHE.hash, pool);
+	switch_core_hash_init(&FILE_CACHE.filling, pool);
+	FILE_CACHE.ready = 1;
+}
+
+void switch_core_file_cache_shutdown(void)
+{
+	if (!FILE_CACHE.ready) {
+		return;
+	}
+
+	switch_mutex_lock(FILE_CACHE.mutex);
+	FILE_CACHE.max_bytes = 0;
+	file_cache_trim(0);
+	FILE_CACHE.ready = 0;
+	switch_mutex_unlock(FILE_CACHE.mutex);
+
+	switch_core_hash_destroy(&FILE_CACHE.hash);
+	switch_core_hash_destroy(&FILE_CACHE.filling);
+}
+
+SWITCH_DECLARE(uint32_t) switch_core_file_cache_size(uint32_t megs)
+{
+	uint32_t old_megs = (uint32_t) (FILE_CACHE.max_bytes / (1024 * 1024));
+
+	if (!FILE_CACHE.ready) {
+		return 0;
+	}
+
+	switch_mutex_lock(FILE_CACHE.mutex);
+	FILE_CACHE.max_bytes = (switch_size_t) megs * 1024 * 1024;
+	FILE_CACHE.evictions += file_cache_trim(FILE_CACHE.max_bytes);
+	switch_mutex_unlock(FILE_CACHE.mutex);
+
+	return old_megs;
+}
+
+SWITCH_DECLARE(uint32_t) switch_core_file_cache_flush(void)
+{
+	uint32_t dropped = 0;
+
+	if (!FILE_CACHE.ready) {
+		return 0;
+	}
+
+	switch_mutex_lock(FILE_CACHE.mutex);
+	dropped = file_cache_trim(0);
+	switch_mutex_unlock(FILE_CACHE.mutex);
+
+	return dropped;
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_stats(switch_stream_handle_t *stream)
+{
+	if (!FILE_CACHE.ready) {
+		return;
+	}
+
+	switch_mutex_lock(FILE_CACHE.mutex);
+	stream->write_function(stream, "File cache: %u files %" SWITCH_SIZE_T_FMT "/%" SWITCH_SIZE_T_FMT " bytes, "
+						   "%" SWITCH_UINT64_T_FMT " hits %" SWITCH_UINT64_T_FMT " misses %" SWITCH_UINT64_T_FMT " stored %" SWITCH_UINT64_T_FMT " evicted\n",
+						   FILE_CACHE.entries, FILE_CACHE.bytes, FILE_CACHE.max_bytes,
+						   FILE_CACHE.hits, FILE_CACHE.misses, FILE_CACHE.stores, FILE_CACHE.evictions);
+	switch_mutex_unlock(FILE_CACHE.mutex);
+}
 
 SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file, const char *func, int line,
 															  switch_file_handle_t *fh,
@@ -149,8 +458,23 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file,
 
 	file_path = fh->spool_path ? fh->spool_path : fh->file_path;
 
-
-	if ((status = fh->file_interface->file_open(fh, file_path)) != SWITCH_STATUS_SUCCESS) {
+	fh->cache_entry = NULL;
+	fh->cache_fill = NULL;
+	fh->cache_key = NULL;
+
+	if (FILE_CACHE.max_bytes && (flags & SWITCH_FILE_FLAG_READ) && !(flags & SWITCH_FILE_FLAG_WRITE) && !is_stream &&
+		(fh->cache_key = file_cache_key(fh, file_path)) && (fh->cache_entry = file_cache_find(fh->cache_key))) {
+		/* the module never sees this handle, reads come from the cached copy */
+		fh->samplerate = fh->cache_entry->samplerate;
+		fh->channels = fh->cache_entry->channels;
+		fh->samples = (unsigned int) fh->cache_entry->samples;
+		fh->format = 0;
+		fh->sections = 0;
+		fh->seekable = 1;
+		fh->speed = 0;
+		fh->cache_pos = 0;
+		status = SWITCH_STATUS_SUCCESS;
+	} else if ((status = fh->file_interface->file_open(fh, file_path)) != SWITCH_STATUS_SUCCESS) {
 		if (fh->spool_path) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Spool dir is set.  Make sure [%s] is also a valid path\n", fh->spool_path);
 		}
@@ -185,6 +509,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file,
 		fh->pre_buffer_data = switch_core_alloc(fh->memory_pool, fh->pre_buffer_datalen * fh->channels);
 	}
 
+	if (fh->cache_key && !fh->cache_entry && !switch_test_flag(fh, SWITCH_FILE_NATIVE)) {
+		/* keep what the module decodes, if the file is played to the end it goes in the cache */
+		file_cache_fill_start(fh);
+	}
+
 	if (fh->channels > 1 && (flags & SWITCH_FILE_FLAG_READ)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "File has %d channels, muxing to mono will occur.\n", fh->channels);
 	}
@@ -238,7 +567,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 			rlen = asis ? fh->pre_buffer_datalen : fh->pre_buffer_datalen / 2;
 
 			if (switch_buffer_inuse(fh->pre_buffer) < rlen * 2) {
-				if ((status = fh->file_interface->file_read(fh, fh->pre_buffer_data, &rlen)) != SWITCH_STATUS_SUCCESS || !rlen) {
+				if ((status = file_read_raw(fh, fh->pre_buffer_data, &rlen)) != SWITCH_STATUS_SUCCESS || !rlen) {
 					switch_set_flag(fh, SWITCH_FILE_BUFFER_DONE);
 				} else {
 					fh->samples_in += rlen;
@@ -262,7 +591,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 
 	} else {
 
-		if ((status = fh->file_interface->file_read(fh, data, len)) != SWITCH_STATUS_SUCCESS || !*len) {
+		if ((status = file_read_raw(fh, data, len)) != SWITCH_STATUS_SUCCESS || !*len) {
 			switch_set_flag(fh, SWITCH_FILE_DONE);
 			goto top;
 		}
@@ -417,7 +746,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_seek(switch_file_handle_t *fh,
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if (!fh->file_interface->file_seek) {
+	if (!fh->cache_entry && !fh->file_interface->file_seek) {
 		return SWITCH_STATUS_FALSE;
 	}
 
@@ -436,7 +765,33 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_seek(switch_file_handle_t *fh,
 	}
 
 	switch_set_flag(fh, SWITCH_FILE_SEEK);
-	status = fh->file_interface->file_seek(fh, cur_pos, samples, whence);
+
+	if (fh->cache_entry) {
+		int64_t target = samples;
+
+		if (whence == SWITCH_SEEK_CUR) {
+			target += fh->cache_pos;
+		} else if (whence == SWITCH_SEEK_END) {
+			target += fh->cache_entry->samples;
+		}
+
+		if (target < 0) {
+			target = 0;
+		} else if (target > (int64_t) fh->cache_entry->samples) {
+			target = fh->cache_entry->samples;
+		}
+
+		fh->cache_pos = (switch_size_t) target;
+		fh->pos = target;
+		*cur_pos = (unsigned int) target;
+		status = SWITCH_STATUS_SUCCESS;
+	} else {
+		/* a partial play is not worth caching */
+		if (fh->cache_fill) {
+			file_cache_fill_stop(fh);
+		}
+		status = fh->file_interface->file_seek(fh, cur_pos, samples, whence);
+	}
 	if (samples) {
 		fh->offset_pos = *cur_pos;
 	}
@@ -452,7 +807,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_set_string(switch_file_handle_t
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if (!fh->file_interface->file_set_string) {
+	if (fh->cache_entry || !fh->file_interface->file_set_string) {
 		return SWITCH_STATUS_FALSE;
 	}
 
@@ -468,7 +823,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_get_string(switch_file_handle_t
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if (!fh->file_interface->file_get_string) {
+	if (fh->cache_entry || !fh->file_interface->file_get_string) {
 		return SWITCH_STATUS_FALSE;
 	}
 
@@ -544,7 +899,19 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(switch_file_handle_t *fh)
 	}
 
 	switch_clear_flag(fh, SWITCH_FILE_OPEN);
-	status = fh->file_interface->file_close(fh);
+
+	if (fh->cache_entry) {
+		file_cache_release(fh->cache_entry);
+		fh->cache_entry = NULL;
+		status = SWITCH_STATUS_SUCCESS;
+	} else {
+		status = fh->file_interface->file_close(fh);
+	}
+
+	if (fh->cache_fill) {
+		file_cache_fill_stop(fh);
+	}
+	fh->cache_key = NULL;
 
 	switch_resample_destroy(&fh->resampler);
 
@@ -107,6 +107,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 	int need_codec, perfect, do_bugs = 0, do_resample = 0, is_cng = 0;
 	unsigned int flag = 0;
 	switch_codec_implementation_t codec_impl;
+	switch_time_t probe_start = 0;
 
 	switch_assert(session != NULL);
 
@@ -185,6 +186,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 
 	}
 
+	probe_start = switch_core_probe_start();
+
 	if (status != SWITCH_STATUS_SUCCESS) {
 		goto done;
 	}
@@ -279,12 +282,14 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 			} else {
 				switch_codec_t *use_codec = read_frame->codec;
 				if (do_bugs) {
-					switch_thread_rwlock_wrlock(session->bug_rwlock);
 					if (!switch_core_codec_ready(&session->bug_codec)) {
-						switch_core_codec_copy(read_frame->codec, &session->bug_codec, NULL);
+						switch_thread_rwlock_wrlock(session->bug_rwlock);
+						if (!switch_core_codec_ready(&session->bug_codec)) {
+							switch_core_codec_copy(read_frame->codec, &session->bug_codec, NULL);
+						}
+						switch_thread_rwlock_unlock(session->bug_rwlock);
 					}
 					use_codec = &session->bug_codec;
-					switch_thread_rwlock_unlock(session->bug_rwlock);
 				}
 
 				status = switch_core_codec_decode(use_codec,
@@ -367,7 +372,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 			switch_media_bug_t *bp;
 			switch_bool_t ok = SWITCH_TRUE;
 			int prune = 0;
-			switch_thread_rwlock_rdlock(session->bug_rwlock);
+			switch_time_t bug_start = switch_core_probe_start();
+			uint32_t bug_epoch = switch_core_media_bug_enter(session);
 
 			for (bp = session->bugs; bp; bp = bp->next) {
 				if (!switch_channel_test_flag(session->channel, CF_ANSWERED) && switch_core_media_bug_test_flag(bp, SMBF_ANSWER_REQ)) {
@@ -379,12 +385,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 				}
 
 				if (bp->ready && switch_test_flag(bp, SMBF_READ_STREAM)) {
-					switch_mutex_lock(bp->read_mutex);
-					switch_buffer_write(bp->raw_read_buffer, read_frame->data, read_frame->datalen);
+					switch_core_media_bug_ring_write(bp->raw_read_buffer, read_frame->data, read_frame->datalen);
 					if (bp->callback) {
 						ok = bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_READ);
 					}
-					switch_mutex_unlock(bp->read_mutex);
 				}
 
 				if (ok && switch_test_flag(bp, SMBF_READ_REPLACE)) {
@@ -405,7 +409,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 
 
 			}
-			switch_thread_rwlock_unlock(session->bug_rwlock);
+			switch_core_media_bug_leave(session, bug_epoch);
+			switch_core_probe_end(SWITCH_PROBE_MEDIA_BUG, bug_start);
 			if (prune) {
 				switch_core_media_bug_prune(session);
 			}
@@ -528,7 +533,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 			switch_media_bug_t *bp;
 			switch_bool_t ok = SWITCH_TRUE;
 			int prune = 0;
-			switch_thread_rwlock_rdlock(session->bug_rwlock);
+			uint32_t bug_epoch = switch_core_media_bug_enter(session);
+
 			for (bp = session->bugs; bp; bp = bp->next) {
 				if (!switch_channel_test_flag(session->channel, CF_ANSWERED) && switch_core_media_bug_test_flag(bp, SMBF_ANSWER_REQ)) {
 					continue;
@@ -540,14 +546,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 				}
 
 				if (bp->ready && switch_test_flag(bp, SMBF_READ_PING)) {
-					switch_mutex_lock(bp->read_mutex);
 					if (bp->callback) {
 						if (bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_READ_PING) == SWITCH_FALSE
 							|| (bp->stop_time && bp->stop_time <= switch_epoch_time_now(NULL))) {
 							ok = SWITCH_FALSE;
 						}
 					}
-					switch_mutex_unlock(bp->read_mutex);
 				}
 
 				if (ok == SWITCH_FALSE) {
@@ -555,7 +559,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 					prune++;
 				}
 			}
-			switch_thread_rwlock_unlock(session->bug_rwlock);
+			switch_core_media_bug_leave(session, bug_epoch);
 			if (prune) {
 				switch_core_media_bug_prune(session);
 			}
@@ -568,6 +572,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 		*frame = &runtime.dummy_cng_frame;
 	}
 
+	switch_core_probe_end(SWITCH_PROBE_READ_FRAME, probe_start);
+
 	switch_mutex_unlock(session->read_codec->mutex);
 	switch_mutex_unlock(session->codec_read_mutex);
 
@@ -601,6 +607,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 	switch_frame_t *enc_frame = NULL, *write_frame = frame;
 	unsigned int flag = 0, need_codec = 0, perfect = 0, do_bugs = 0, do_write = 0, do_resample = 0, ptime_mismatch = 0, pass_cng = 0, resample = 0;
 	int did_write_resample = 0;
+	switch_time_t probe_start;
 
 	switch_assert(session != NULL);
 	switch_assert(frame != NULL);
@@ -647,6 +654,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 	switch_mutex_lock(session->write_codec->mutex);
 	switch_mutex_lock(frame->codec->mutex);
 
+	probe_start = switch_core_probe_start();
+
 	if (!(switch_core_codec_ready(session->write_codec) && switch_core_codec_ready(frame->codec))) goto error;
 	
 	if ((session->write_codec && frame->codec && session->write_codec->implementation != frame->codec->implementation)) {
@@ -812,8 +821,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 	if (session->bugs && !switch_channel_test_flag(session->channel, CF_PAUSE_BUGS)) {
 		switch_media_bug_t *bp;
 		int prune = 0;
+		switch_time_t bug_start = switch_core_probe_start();
+		uint32_t bug_epoch = switch_core_media_bug_enter(session);
 
-		switch_thread_rwlock_rdlock(session->bug_rwlock);
 		for (bp = session->bugs; bp; bp = bp->next) {
 			switch_bool_t ok = SWITCH_TRUE;
 			if (!bp->ready) {
@@ -830,10 +840,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 			}
 
 			if (switch_test_flag(bp, SMBF_WRITE_STREAM)) {
-
-				switch_mutex_lock(bp->write_mutex);
-				switch_buffer_write(bp->raw_write_buffer, write_frame->data, write_frame->datalen);
-				switch_mutex_unlock(bp->write_mutex);
+				switch_core_media_bug_ring_write(bp->raw_write_buffer, write_frame->data, write_frame->datalen);
 				if (bp->callback) {
 					ok = bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_WRITE);
 				}
@@ -860,7 +867,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 				prune++;
 			}
 		}
-		switch_thread_rwlock_unlock(session->bug_rwlock);
+		switch_core_media_bug_leave(session, bug_epoch);
+		switch_core_probe_end(SWITCH_PROBE_MEDIA_BUG, bug_start);
 		if (prune) {
 			switch_core_media_bug_prune(session);
 		}
@@ -1108,6 +1116,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 
   error:
 
+	switch_core_probe_end(SWITCH_PROBE_WRITE_FRAME, probe_start);
+
 	switch_mutex_unlock(session->write_codec->mutex);
 	switch_mutex_unlock(frame->codec->mutex);
 	switch_mutex_unlock(session->codec_write_mutex);
@@ -34,17 +34,158 @@
 
 #include "switch.h"
 #include "private/switch_core_pvt.h"
+#include <apr_atomic.h>
+
+/*
+ * The media threads walk session->bugs without taking bug_rwlock.  Each pass
+ * is bracketed by switch_core_media_bug_enter/leave which count the walker
+ * against the current epoch.  Anything changing the list takes the write lock,
+ * unlinks the bug and calls media_bug_sync() which waits until every walker
+ * that could still see the old list is gone before the bug is closed.
+ *
+ * Audio handed to a bug goes through a ring per direction with one producer
+ * (the thread reading or writing the session) and one consumer (whoever
+ * calls switch_core_media_bug_read), so neither side ever waits on the other.
+ */
+#define MAX_BUG_BUFFER 1024 * 512
+#define BUG_RING_FRAMES 128
+
+#define bug_atomic_load(_p) apr_atomic_add32((_p), 0)
+
+uint32_t switch_core_media_bug_enter(switch_core_session_t *session)
+{
+	uint32_t epoch = apr_atomic_read32(&session->bug_epoch) & 1;
+
+	apr_atomic_inc32(&session->bug_readers[epoch]);
+
+	return epoch;
+}
+
+void switch_core_media_bug_leave(switch_core_session_t *session, uint32_t epoch)
+{
+	apr_atomic_dec32(&session->bug_readers[epoch]);
+}
+
+/* call with bug_rwlock write locked, after unlinking */
+static void media_bug_sync(switch_core_session_t *session)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		uint32_t old = apr_atomic_add32(&session->bug_epoch, 1) & 1;
+
+		while (bug_atomic_load(&session->bug_readers[old])) {
+			switch_cond_next();
+		}
+	}
+}
+
+static switch_media_bug_ring_t *media_bug_ring_create(switch_size_t bytes)
+{
+	switch_media_bug_ring_t *ring;
+	switch_size_t want = bytes * BUG_RING_FRAMES;
+	uint32_t size = SWITCH_RECOMMENDED_BUFFER_SIZE;
+
+	while (size < want && size < MAX_BUG_BUFFER) {
+		size <<= 1;
+	}
+
+	switch_zmalloc(ring, sizeof(*ring) + size);
+	ring->data = (uint8_t *) (ring + 1);
+	ring->size = size;
+
+	return ring;
+}
+
+static void media_bug_ring_destroy(switch_media_bug_ring_t **ring)
+{
+	switch_safe_free(*ring);
+}
+
+switch_size_t switch_core_media_bug_ring_write(switch_media_bug_ring_t *ring, const void *data, switch_size_t datalen)
+{
+	uint32_t head = ring->head, off, first;
+
+	if (datalen > ring->size - (head - bug_atomic_load(&ring->tail))) {
+		apr_atomic_add32(&ring->dropped, (uint32_t) datalen);
+		return 0;
+	}
+
+	off = head & (ring->size - 1);
+	first = ring->size - off;
+
+	if (first >= datalen) {
+		memcpy(ring->data + off, data, datalen);
+	} else {
+		memcpy(ring->data + off, data, first);
+		memcpy(ring->data, (const uint8_t *) data + first, datalen - first);
+	}
+
+	apr_atomic_add32(&ring->head, (uint32_t) datalen);
+
+	return datalen;
+}
+
+static switch_size_t media_bug_ring_read(switch_media_bug_ring_t *ring, void *data, switch_size_t datalen)
+{
+	uint32_t head = bug_atomic_load(&ring->head), tail = ring->tail, flush, off, first;
+
+	if ((flush = bug_atomic_load(&ring->flush)) != ring->flushed) {
+		ring->flushed = flush;
+		apr_atomic_add32(&ring->tail, head - tail);
+		return 0;
+	}
+
+	if (datalen > head - tail) {
+		datalen = head - tail;
+	}
+
+	if (!datalen) {
+		return 0;
+	}
+
+	off = tail & (ring->size - 1);
+	first = ring->size - off;
+
+	if (first >= datalen) {
+		memcpy(data, ring->data + off, datalen);
+	} else {
+		memcpy(data, ring->data + off, first);
+		memcpy((uint8_t *) data + first, ring->data, datalen - first);
+	}
+
+	apr_atomic_add32(&ring->tail, (uint32_t) datalen);
+
+	return datalen;
+}
+
+static switch_size_t media_bug_ring_inuse(switch_media_bug_ring_t *ring)
+{
+	if (bug_atomic_load(&ring->flush) != ring->flushed) {
+		return 0;
+	}
+
+	return bug_atomic_load(&ring->head) - bug_atomic_load(&ring->tail);
+}
 
 static void switch_core_media_bug_destroy(switch_media_bug_t *bug)
 {
 	switch_event_t *event = NULL;
+	uint32_t dropped = 0;
 
 	if (bug->raw_read_buffer) {
-		switch_buffer_destroy(&bug->raw_read_buffer);
+		dropped += bug->raw_read_buffer->dropped;
+		media_bug_ring_destroy(&bug->raw_read_buffer);
 	}
 
 	if (bug->raw_write_buffer) {
-		switch_buffer_destroy(&bug->raw_write_buffer);
+		dropped += bug->raw_write_buffer->dropped;
+		media_bug_ring_destroy(&bug->raw_write_buffer);
+	}
+
+	if (dropped && bug->session) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(bug->session), SWITCH_LOG_DEBUG, "BUG %s dropped %u bytes of unread audio\n",
+						  bug->function, dropped);
 	}
 
 	if (switch_event_create(&event, SWITCH_EVENT_MEDIA_BUG_STOP) == SWITCH_STATUS_SUCCESS) {
@@ -112,29 +253,26 @@ SWITCH_DECLARE(void *) switch_core_media_bug_get_user_data(switch_media_bug_t *b
 
 SWITCH_DECLARE(void) switch_core_media_bug_flush(switch_media_bug_t *bug)
 {
+	/* only the consumer may move the read side, so just ask it to skip what is buffered */
 	if (bug->raw_read_buffer) {
-		switch_buffer_zero(bug->raw_read_buffer);
+		apr_atomic_inc32(&bug->raw_read_buffer->flush);
 	}
 
 	if (bug->raw_write_buffer) {
-		switch_buffer_zero(bug->raw_write_buffer);
+		apr_atomic_inc32(&bug->raw_write_buffer->flush);
 	}
 }
 
 SWITCH_DECLARE(void) switch_core_media_bug_inuse(switch_media_bug_t *bug, switch_size_t *readp, switch_size_t *writep)
 {
 	if (switch_test_flag(bug, SMBF_READ_STREAM)) {
-		switch_mutex_lock(bug->read_mutex);
-		*readp = bug->raw_read_buffer ? switch_buffer_inuse(bug->raw_read_buffer) : 0;
-		switch_mutex_unlock(bug->read_mutex);
+		*readp = bug->raw_read_buffer ? media_bug_ring_inuse(bug->raw_read_buffer) : 0;
 	} else {
 		*readp = 0;
 	}
 
 	if (switch_test_flag(bug, SMBF_WRITE_STREAM)) {
-		switch_mutex_lock(bug->write_mutex);
-		*writep = bug->raw_write_buffer ? switch_buffer_inuse(bug->raw_write_buffer) : 0;
-		switch_mutex_unlock(bug->write_mutex);
+		*writep = bug->raw_write_buffer ? media_bug_ring_inuse(bug->raw_write_buffer) : 0;
 	} else {
 		*writep = 0;
 	}
@@ -170,25 +308,19 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	frame->flags = 0;
 	frame->datalen = 0;
 
-	if (!switch_buffer_inuse(bug->raw_read_buffer)) {
+	if (!(frame->datalen = (uint32_t) media_bug_ring_read(bug->raw_read_buffer, frame->data, bytes))) {
 		return SWITCH_STATUS_FALSE;
 	}
-
-	switch_mutex_lock(bug->read_mutex);
-	frame->datalen = (uint32_t) switch_buffer_read(bug->raw_read_buffer, frame->data, bytes);
 	ttl += frame->datalen;
-	switch_mutex_unlock(bug->read_mutex);
 
 	if (switch_test_flag(bug, SMBF_WRITE_STREAM)) {
 		switch_assert(bug->raw_write_buffer);
-		switch_mutex_lock(bug->write_mutex);
-		datalen = (uint32_t) switch_buffer_read(bug->raw_write_buffer, bug->data, bytes);
+		datalen = (uint32_t) media_bug_ring_read(bug->raw_write_buffer, bug->data, bytes);
 		ttl += datalen;
 		if (fill && datalen < bytes) {
 			memset(((unsigned char *) bug->data) + datalen, 0, bytes - datalen);
 			datalen = bytes;
 		}
-		switch_mutex_unlock(bug->write_mutex);
 	}
 
 	tp = bug->tmp;
@@ -247,7 +379,6 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	return SWITCH_STATUS_SUCCESS;
 }
 
-#define MAX_BUG_BUFFER 1024 * 512
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t *session,
 														  const char *function,
 														  const char *target,
@@ -332,15 +463,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 	}
 
 	if (switch_test_flag(bug, SMBF_READ_STREAM) || switch_test_flag(bug, SMBF_READ_PING)) {
-		switch_buffer_create_dynamic(&bug->raw_read_buffer, bytes * SWITCH_BUFFER_BLOCK_FRAMES, bytes * SWITCH_BUFFER_START_FRAMES, MAX_BUG_BUFFER);
-		switch_mutex_init(&bug->read_mutex, SWITCH_MUTEX_NESTED, session->pool);
+		bug->raw_read_buffer = media_bug_ring_create(bytes);
 	}
 
 	bytes = write_impl.decoded_bytes_per_packet;
 
 	if (switch_test_flag(bug, SMBF_WRITE_STREAM)) {
-		switch_buffer_create_dynamic(&bug->raw_write_buffer, bytes * SWITCH_BUFFER_BLOCK_FRAMES, bytes * SWITCH_BUFFER_START_FRAMES, MAX_BUG_BUFFER);
-		switch_mutex_init(&bug->write_mutex, SWITCH_MUTEX_NESTED, session->pool);
+		bug->raw_write_buffer = media_bug_ring_create(bytes);
 	}
 
 	if ((bug->flags & SMBF_THREAD_LOCK)) {
@@ -361,6 +490,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 	bug->ready = 1;
 	switch_thread_rwlock_wrlock(session->bug_rwlock);
 	bug->next = session->bugs;
+	/* the write lock keeps other writers out, the barrier makes sure a media thread that
+	   sees the new head also sees the bug behind it */
+	switch_memory_barrier();
 	session->bugs = bug;
 	switch_thread_rwlock_unlock(session->bug_rwlock);
 	*new_bug = bug;
@@ -395,12 +527,16 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_flush_all(switch_core_sess
 
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_all(switch_core_session_t *session)
 {
-	switch_media_bug_t *bp;
+	switch_media_bug_t *bp, *list;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 
 	if (session->bugs) {
 		switch_thread_rwlock_wrlock(session->bug_rwlock);
-		for (bp = session->bugs; bp; bp = bp->next) {
+		list = session->bugs;
+		session->bugs = NULL;
+		media_bug_sync(session);
+
+		for (bp = list; bp; bp = bp->next) {
 			if (bp->thread_id && bp->thread_id != switch_thread_self()) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "BUG is thread locked skipping.\n");
 				continue;
@@ -412,7 +548,6 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_all(switch_core_ses
 			switch_core_media_bug_destroy(bp);
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Removing BUG from %s\n", switch_channel_get_name(session->channel));
 		}
-		session->bugs = NULL;
 		switch_thread_rwlock_unlock(session->bug_rwlock);
 		status = SWITCH_STATUS_SUCCESS;
 	}
@@ -468,6 +603,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove(switch_core_session
 		}
 	}
 
+	if (bp) {
+		media_bug_sync(session);
+	}
+
 	if (!session->bugs && switch_core_codec_ready(&session->bug_codec)) {
 		switch_core_codec_destroy(&session->bug_codec);
 	}
@@ -507,6 +646,10 @@ SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *sess
 		}
 	}
 
+	if (bp) {
+		media_bug_sync(session);
+	}
+
 	if (!session->bugs && switch_core_codec_ready(&session->bug_codec)) {
 		switch_core_codec_destroy(&session->bug_codec);
 	}
@@ -523,31 +666,53 @@ SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *sess
 }
 
 
+SWITCH_DECLARE(uint32_t) switch_core_media_bug_count(switch_core_session_t *session)
+{
+	switch_media_bug_t *bp;
+	uint32_t count = 0;
+
+	/* walked like the media path does, callers like the conference mixer ask every frame */
+	if (session->bugs) {
+		uint32_t epoch = switch_core_media_bug_enter(session);
+		for (bp = session->bugs; bp; bp = bp->next) {
+			count++;
+		}
+		switch_core_media_bug_leave(session, epoch);
+	}
+
+	return count;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_callback(switch_core_session_t *session, switch_media_bug_callback_t callback)
 {
 	switch_media_bug_t *cur = NULL, *bp = NULL, *last = NULL;
 	int total = 0;
 
 	switch_thread_rwlock_wrlock(session->bug_rwlock);
-	if (session->bugs) {
-		bp = session->bugs;
-		while (bp) {
+
+  top:
+
+	/* a walker may still be sitting on an unlinked bug and follow its next pointer, so unlink and close one at a time */
+	for (cur = NULL, last = NULL, bp = session->bugs; bp; last = bp, bp = bp->next) {
+		if ((!bp->thread_id || bp->thread_id == switch_thread_self()) && bp->ready && bp->callback == callback) {
 			cur = bp;
-			bp = bp->next;
+			break;
+		}
+	}
 
-			if ((!cur->thread_id || cur->thread_id == switch_thread_self()) && cur->ready && cur->callback == callback) {
-				if (last) {
-					last->next = cur->next;
-				} else {
-					session->bugs = cur->next;
-				}
-				if (switch_core_media_bug_close(&cur) == SWITCH_STATUS_SUCCESS) {
-					total++;
-				}
-			} else {
-				last = cur;
-			}
+	if (cur) {
+		if (last) {
+			last->next = cur->next;
+		} else {
+			session->bugs = cur->next;
+		}
+
+		media_bug_sync(session);
+
+		if (switch_core_media_bug_close(&cur) == SWITCH_STATUS_SUCCESS) {
+			total++;
 		}
+		goto top;
 	}
 
 	if (!session->bugs && switch_core_codec_ready(&session->bug_codec)) {
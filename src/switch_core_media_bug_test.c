@@ -0,0 +1,356 @@
+/*
+ * switch_core_media_bug_test.c -- many media bugs on one session
+ *
+ * One thread reads the session and one writes it, the way an endpoint's media threads do, while
+ * several more keep adding and removing bugs and draining the ones they own.  Half of the bugs are
+ * drained from their own READ callback on the media thread, the rest from the thread that added
+ * them, so both consumers of the bug rings get exercised against the lock free list walk.
+ *
+ * Nothing may crash or hang, every bug that was attached must be closed exactly once and the
+ * session must be left without bugs.
+ *
+ * switch_core_media_bug_test [seconds [workers [bugs per worker]]]
+ *
+ * The core runs out of a scratch directory with an empty configuration, so no modules beyond the
+ * built in ones are loaded.
+ */
+
+#include <switch.h>
+
+#define TEST_DIR "switch_core_media_bug_test.d"
+#define TEST_SAMPLES 160
+#define TEST_MAX_WORKERS 64
+#define TEST_MAX_BUGS 256
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_endpoint_interface_t *endpoint;
+	switch_core_session_t *session;
+	switch_codec_t read_codec;
+	switch_codec_t write_codec;
+	int16_t read_data[TEST_SAMPLES];
+	int16_t write_data[TEST_SAMPLES];
+	switch_frame_t read_frame;
+	switch_frame_t write_frame;
+	volatile int running;
+	int bugs_per_worker;
+	uint32_t inits;
+	uint32_t closes;
+	uint32_t adds;
+	uint32_t failed;
+	uint32_t frames;
+} globals;
+
+static switch_status_t test_read_frame(switch_core_session_t *session, switch_frame_t **frame, switch_io_flag_t flags, int stream_id)
+{
+	*frame = &globals.read_frame;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t test_write_frame(switch_core_session_t *session, switch_frame_t *frame, switch_io_flag_t flags, int stream_id)
+{
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_io_routines_t test_io_routines = {
+	/*.outgoing_channel */ NULL,
+	/*.read_frame */ test_read_frame,
+	/*.write_frame */ test_write_frame
+};
+
+static switch_bool_t test_bug_callback(switch_media_bug_t *bug, void *user_data, switch_abc_type_t type)
+{
+	uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	switch_frame_t frame = { 0 };
+
+	switch (type) {
+	case SWITCH_ABC_TYPE_INIT:
+		switch_mutex_lock(globals.mutex);
+		globals.inits++;
+		switch_mutex_unlock(globals.mutex);
+		break;
+	case SWITCH_ABC_TYPE_CLOSE:
+		switch_mutex_lock(globals.mutex);
+		globals.closes++;
+		switch_mutex_unlock(globals.mutex);
+		break;
+	case SWITCH_ABC_TYPE_READ:
+		/* user_data set means the media thread is this bug's only reader */
+		if (user_data) {
+			frame.data = data;
+			frame.buflen = sizeof(data);
+			while (switch_core_media_bug_read(bug, &frame, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return SWITCH_TRUE;
+}
+
+static void *SWITCH_THREAD_FUNC test_read_thread(switch_thread_t *thread, void *obj)
+{
+	switch_frame_t *frame;
+
+	while (globals.running) {
+		if (switch_core_session_read_frame(globals.session, &frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+			switch_mutex_lock(globals.mutex);
+			globals.failed++;
+			switch_mutex_unlock(globals.mutex);
+		}
+		switch_mutex_lock(globals.mutex);
+		globals.frames++;
+		switch_mutex_unlock(globals.mutex);
+		switch_cond_next();
+	}
+
+	return NULL;
+}
+
+static void *SWITCH_THREAD_FUNC test_write_thread(switch_thread_t *thread, void *obj)
+{
+	while (globals.running) {
+		if (switch_core_session_write_frame(globals.session, &globals.write_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+			switch_mutex_lock(globals.mutex);
+			globals.failed++;
+			switch_mutex_unlock(globals.mutex);
+		}
+		switch_cond_next();
+	}
+
+	return NULL;
+}
+
+static void *SWITCH_THREAD_FUNC test_bug_thread(switch_thread_t *thread, void *obj)
+{
+	switch_media_bug_t *bugs[TEST_MAX_BUGS] = { 0 };
+	uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	switch_frame_t frame = { 0 };
+	uint32_t seed = (uint32_t) (intptr_t) obj, n = 0;
+	int i;
+
+	frame.data = data;
+	frame.buflen = sizeof(data);
+
+	while (globals.running) {
+		seed = seed * 1103515245 + 12345;
+		i = (seed >> 16) % globals.bugs_per_worker;
+
+		if (bugs[i]) {
+			switch_core_media_bug_remove(globals.session, &bugs[i]);
+			bugs[i] = NULL;
+		} else {
+			void *self_drained = (n++ & 1) ? NULL : (void *) globals.session;
+
+			if (switch_core_media_bug_add(globals.session, "test", NULL, test_bug_callback, self_drained, 0,
+										  SMBF_READ_STREAM | SMBF_WRITE_STREAM, &bugs[i]) == SWITCH_STATUS_SUCCESS) {
+				switch_mutex_lock(globals.mutex);
+				globals.adds++;
+				switch_mutex_unlock(globals.mutex);
+			}
+		}
+
+		for (i = 0; i < globals.bugs_per_worker; i++) {
+			if (bugs[i] && !switch_core_media_bug_get_user_data(bugs[i])) {
+				while (switch_core_media_bug_read(bugs[i], &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS);
+			}
+		}
+
+		switch_core_media_bug_count(globals.session);
+		switch_cond_next();
+	}
+
+	for (i = 0; i < globals.bugs_per_worker; i++) {
+		if (bugs[i]) {
+			switch_core_media_bug_remove(globals.session, &bugs[i]);
+		}
+	}
+
+	return NULL;
+}
+
+static switch_status_t test_setup(void)
+{
+	switch_loadable_module_interface_t *module_interface;
+	const char *err = NULL;
+	FILE *f;
+	int i;
+
+	/* an empty configuration in a scratch directory, the built in modules give us L16.
+	   switch_core_destroy() frees every directory so each one gets its own copy. */
+	SWITCH_GLOBAL_dirs.base_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.mod_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.conf_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.log_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.run_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.db_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.script_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.temp_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.htdocs_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.grammar_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.storage_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.recordings_dir = strdup(TEST_DIR);
+	SWITCH_GLOBAL_dirs.sounds_dir = strdup(TEST_DIR);
+
+	mkdir(TEST_DIR, S_IRWXU);
+	if (!(f = fopen(TEST_DIR "/freeswitch.xml", "w"))) {
+		perror(TEST_DIR "/freeswitch.xml");
+		return SWITCH_STATUS_FALSE;
+	}
+	fprintf(f, "<document type=\"freeswitch/xml\"></document>\n");
+	fclose(f);
+
+	if (switch_core_init_and_modload(SCF_NONE, SWITCH_FALSE, &err) != SWITCH_STATUS_SUCCESS) {
+		fprintf(stderr, "core init failed: %s\n", err ? err : "unknown");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_core_new_memory_pool(&globals.pool);
+	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, globals.pool);
+
+	module_interface = switch_loadable_module_create_module_interface(globals.pool, "media_bug_test");
+	globals.endpoint = switch_loadable_module_create_interface(module_interface, SWITCH_ENDPOINT_INTERFACE);
+	globals.endpoint->interface_name = "media_bug_test";
+	globals.endpoint->io_routines = &test_io_routines;
+
+	/* the core hands out session slots once its heartbeat has run */
+	for (i = 0; i < 50 && !globals.session; i++) {
+		if (!(globals.session = switch_core_session_request(globals.endpoint, SWITCH_CALL_DIRECTION_INBOUND, NULL))) {
+			switch_yield(100000);
+		}
+	}
+
+	if (!globals.session) {
+		fprintf(stderr, "no session\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_channel_set_name(switch_core_session_get_channel(globals.session), "media_bug_test/0");
+
+	if (switch_core_codec_init(&globals.read_codec, "L16", NULL, 8000, 20, 1,
+							   SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, globals.pool) != SWITCH_STATUS_SUCCESS ||
+		switch_core_codec_init(&globals.write_codec, "L16", NULL, 8000, 20, 1,
+							   SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, globals.pool) != SWITCH_STATUS_SUCCESS) {
+		fprintf(stderr, "no L16 codec\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_core_session_set_read_codec(globals.session, &globals.read_codec);
+	switch_core_session_set_write_codec(globals.session, &globals.write_codec);
+
+	for (i = 0; i < TEST_SAMPLES; i++) {
+		globals.read_data[i] = (int16_t) (i * 97);
+		globals.write_data[i] = (int16_t) -(i * 89);
+	}
+
+	globals.read_frame.data = globals.read_data;
+	globals.read_frame.buflen = globals.read_frame.datalen = sizeof(globals.read_data);
+	globals.read_frame.samples = TEST_SAMPLES;
+	globals.read_frame.rate = 8000;
+	globals.read_frame.codec = &globals.read_codec;
+
+	globals.write_frame.data = globals.write_data;
+	globals.write_frame.buflen = globals.write_frame.datalen = sizeof(globals.write_data);
+	globals.write_frame.samples = TEST_SAMPLES;
+	globals.write_frame.rate = 8000;
+	globals.write_frame.codec = &globals.write_codec;
+
+	switch_channel_mark_pre_answered(switch_core_session_get_channel(globals.session));
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	switch_thread_t *threads[TEST_MAX_WORKERS + 2];
+	switch_threadattr_t *thd_attr = NULL;
+	switch_status_t st;
+	int seconds = 5, workers = 8, i, bad = 0;
+	uint32_t left;
+
+	globals.bugs_per_worker = 16;
+
+	if (argc > 1) {
+		seconds = atoi(argv[1]);
+	}
+
+	if (argc > 2 && (workers = atoi(argv[2])) > TEST_MAX_WORKERS) {
+		workers = TEST_MAX_WORKERS;
+	}
+
+	if (argc > 3 && (globals.bugs_per_worker = atoi(argv[3])) > TEST_MAX_BUGS) {
+		globals.bugs_per_worker = TEST_MAX_BUGS;
+	}
+
+	if (workers < 1 || globals.bugs_per_worker < 1) {
+		fprintf(stderr, "usage: %s [seconds [workers [bugs per worker]]]\n", argv[0]);
+		return 1;
+	}
+
+	if (test_setup() != SWITCH_STATUS_SUCCESS) {
+		return 1;
+	}
+
+	globals.running = 1;
+	switch_threadattr_create(&thd_attr, globals.pool);
+
+	switch_thread_create(&threads[0], thd_attr, test_read_thread, NULL, globals.pool);
+	switch_thread_create(&threads[1], thd_attr, test_write_thread, NULL, globals.pool);
+	for (i = 0; i < workers; i++) {
+		switch_thread_create(&threads[i + 2], thd_attr, test_bug_thread, (void *) (intptr_t) (i + 1), globals.pool);
+	}
+
+	switch_yield(seconds * 1000000);
+	globals.running = 0;
+
+	for (i = 0; i < workers + 2; i++) {
+		switch_thread_join(&st, threads[i]);
+	}
+
+	left = switch_core_media_bug_count(globals.session);
+
+	printf("%u frames, %u bugs attached, %u init, %u close, %u left, %u failed io\n",
+		   globals.frames, globals.adds, globals.inits, globals.closes, left, globals.failed);
+
+	if (!globals.adds) {
+		fprintf(stderr, "FAIL: no bug was ever attached\n");
+		bad++;
+	}
+
+	if (globals.inits != globals.adds || globals.closes != globals.adds) {
+		fprintf(stderr, "FAIL: every attached bug must be initialized and closed once\n");
+		bad++;
+	}
+
+	if (left) {
+		fprintf(stderr, "FAIL: %u bugs left on the session\n", left);
+		bad++;
+	}
+
+	if (globals.failed) {
+		fprintf(stderr, "FAIL: session io failed %u times\n", globals.failed);
+		bad++;
+	}
+
+	switch_core_session_destroy(&globals.session);
+	switch_core_codec_destroy(&globals.read_codec);
+	switch_core_codec_destroy(&globals.write_codec);
+	switch_core_destroy();
+
+	printf("%s\n", bad ? "FAIL" : "PASS");
+
+	return bad ? 1 : 0;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4:
+ */
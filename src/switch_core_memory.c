@@ -46,6 +46,32 @@
 #define PER_POOL_LOCK 1
 #endif
 
+#if defined(PER_POOL_LOCK) && !defined(INSTANTLY_DESTROY_POOLS) && !defined(DESTROY_POOLS)
+#define RECYCLE_POOLS 1
+#include <apr_atomic.h>
+#ifdef HAVE_SCHED_GETCPU
+#include <sched.h>
+#endif
+#endif
+
+#define POOL_RECYCLE_MAX_SHARDS 64
+#define POOL_RECYCLE_SHARD_LEN 4096
+#define POOL_RECYCLE_DEFAULT 1000
+/* set on session pools at destroy time, only those are recycled since the size class is learned from them */
+#define POOL_RECYCLE_KEY "_recycle_session"
+#define POOL_SIZE_WINDOW 128
+#define POOL_SIZE_CLASS_MIN (8 * 1024)
+#define POOL_SIZE_CLASS_MAX (1024 * 1024)
+#define POOL_STATS_MAX 256
+
+typedef struct {
+	char name[64];
+	uint32_t sessions;
+	switch_size_t last;
+	switch_size_t high;
+	uint64_t total;
+} pool_stat_t;
+
 static struct {
 #ifdef USE_MEM_LOCK
 	switch_mutex_t *mem_lock;
@@ -54,6 +80,23 @@ static struct {
 	switch_queue_t *pool_recycle_queue;
 	switch_memory_pool_t *memory_pool;
 	int pool_thread_running;
+#ifdef RECYCLE_POOLS
+	/* cleared pools waiting for reuse, one queue per cpu */
+	switch_queue_t *recycle_shards[POOL_RECYCLE_MAX_SHARDS];
+	uint32_t recycle_shard_count;
+	uint32_t recycle_next;
+	uint32_t recycle_max;
+	volatile apr_uint32_t pools_created;
+	volatile apr_uint32_t pools_reused;
+	volatile apr_uint32_t pools_dropped;
+#endif
+	/* footprints of recently destroyed sessions, used to pick how much a recycled pool keeps */
+	switch_mutex_t *stats_mutex;
+	switch_size_t size_window[POOL_SIZE_WINDOW];
+	uint32_t size_pos;
+	switch_size_t size_class;
+	switch_hash_t *stats_hash;
+	uint32_t stats_count;
 } memory_manager;
 
 SWITCH_DECLARE(switch_memory_pool_t *) switch_core_session_get_pool(switch_core_session_t *session)
@@ -341,6 +384,224 @@ SWITCH_DECLARE(void) switch_pool_clear(switch_memory_pool_t *p)
 
 
 
+static void pool_stat_add(const char *kind, const char *name, switch_size_t bytes)
+{
+	char key[80];
+	pool_stat_t *stat;
+
+	switch_snprintf(key, sizeof(key), "%s %s", kind, name);
+
+	if (!(stat = switch_core_hash_find(memory_manager.stats_hash, key))) {
+		if (memory_manager.stats_count >= POOL_STATS_MAX) {
+			return;
+		}
+		switch_zmalloc(stat, sizeof(*stat));
+		switch_copy_string(stat->name, key, sizeof(stat->name));
+		switch_core_hash_insert(memory_manager.stats_hash, key, stat);
+		memory_manager.stats_count++;
+	}
+
+	stat->sessions++;
+	stat->last = bytes;
+	stat->total += bytes;
+	if (bytes > stat->high) {
+		stat->high = bytes;
+	}
+}
+
+void switch_core_memory_pool_account(switch_memory_pool_t *pool, const char *endpoint, const char *app)
+{
+	switch_size_t bytes, high = 0, size_class = POOL_SIZE_CLASS_MIN;
+	uint32_t i;
+
+	if (!pool || !memory_manager.stats_mutex) {
+		return;
+	}
+
+	bytes = apr_pool_footprint(pool);
+
+	switch_mutex_lock(memory_manager.stats_mutex);
+
+	memory_manager.size_window[memory_manager.size_pos++ % POOL_SIZE_WINDOW] = bytes;
+
+	for (i = 0; i < POOL_SIZE_WINDOW; i++) {
+		if (memory_manager.size_window[i] > high) {
+			high = memory_manager.size_window[i];
+		}
+	}
+
+	while (size_class < high && size_class < POOL_SIZE_CLASS_MAX) {
+		size_class <<= 1;
+	}
+
+	memory_manager.size_class = size_class;
+
+	if (!zstr(endpoint)) {
+		pool_stat_add("endpoint", endpoint, bytes);
+	}
+
+	if (!zstr(app)) {
+		pool_stat_add("app", app, bytes);
+	}
+
+	switch_mutex_unlock(memory_manager.stats_mutex);
+
+	switch_core_memory_pool_set_data(pool, POOL_RECYCLE_KEY, pool);
+}
+
+SWITCH_DECLARE(void) switch_core_memory_pool_stats(switch_stream_handle_t *stream)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+
+#ifdef RECYCLE_POOLS
+	{
+		uint32_t i, cached = 0;
+
+		for (i = 0; i < memory_manager.recycle_shard_count; i++) {
+			cached += switch_queue_size(memory_manager.recycle_shards[i]);
+		}
+
+		stream->write_function(stream, "%u pool(s) recycled/%u max, %u reused/%u created/%u dropped, size class %" SWITCH_SIZE_T_FMT "\n",
+							   cached, memory_manager.recycle_max, apr_atomic_read32(&memory_manager.pools_reused),
+							   apr_atomic_read32(&memory_manager.pools_created), apr_atomic_read32(&memory_manager.pools_dropped),
+							   memory_manager.size_class);
+	}
+#endif
+
+	if (!memory_manager.stats_mutex) {
+		return;
+	}
+
+	switch_mutex_lock(memory_manager.stats_mutex);
+	for (hi = switch_hash_first(NULL, memory_manager.stats_hash); hi; hi = switch_hash_next(hi)) {
+		pool_stat_t *stat;
+
+		switch_hash_this(hi, &var, NULL, &val);
+		stat = (pool_stat_t *) val;
+
+		stream->write_function(stream, "pool %s high-water %" SWITCH_SIZE_T_FMT " last %" SWITCH_SIZE_T_FMT " avg %" SWITCH_SIZE_T_FMT " over %u session(s)\n",
+							   stat->name, stat->high, stat->last, (switch_size_t) (stat->total / stat->sessions), stat->sessions);
+	}
+	switch_mutex_unlock(memory_manager.stats_mutex);
+}
+
+#ifdef RECYCLE_POOLS
+static inline uint32_t pool_recycle_shard(void)
+{
+#ifdef HAVE_SCHED_GETCPU
+	int cpu = sched_getcpu();
+
+	if (cpu >= 0) {
+		return (uint32_t) cpu % memory_manager.recycle_shard_count;
+	}
+#endif
+	return (uint32_t) (((uintptr_t) switch_thread_self() >> 4) % memory_manager.recycle_shard_count);
+}
+
+static switch_memory_pool_t *pool_recycle_pop(void)
+{
+	uint32_t i, shard;
+	void *pop = NULL;
+
+	if (!memory_manager.recycle_max) {
+		return NULL;
+	}
+
+	/* try the local cpu first, then steal from any shard that has something */
+	shard = pool_recycle_shard();
+
+	for (i = 0; i < memory_manager.recycle_shard_count; i++) {
+		switch_queue_t *q = memory_manager.recycle_shards[(shard + i) % memory_manager.recycle_shard_count];
+
+		if (switch_queue_size(q) && switch_queue_trypop(q, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+			apr_atomic_inc32(&memory_manager.pools_reused);
+			return (switch_memory_pool_t *) pop;
+		}
+	}
+
+	return NULL;
+}
+
+static switch_bool_t pool_recycle_push(switch_memory_pool_t *pool)
+{
+	apr_allocator_t *my_allocator;
+	apr_thread_mutex_t *my_mutex;
+	uint32_t i, cached = 0;
+	switch_size_t size_class = memory_manager.size_class;
+
+	if (!memory_manager.recycle_max || !switch_core_memory_pool_get_data(pool, POOL_RECYCLE_KEY)) {
+		return SWITCH_FALSE;
+	}
+
+	for (i = 0; i < memory_manager.recycle_shard_count; i++) {
+		cached += switch_queue_size(memory_manager.recycle_shards[i]);
+	}
+
+	if (cached >= memory_manager.recycle_max) {
+		return SWITCH_FALSE;
+	}
+
+	if (!(my_allocator = apr_pool_allocator_get(pool)) || apr_allocator_owner_get(my_allocator) != pool) {
+		return SWITCH_FALSE;
+	}
+
+	/* pools far above what recent sessions needed are not worth keeping around */
+	if (apr_pool_footprint(pool) > size_class * 4) {
+		apr_atomic_inc32(&memory_manager.pools_dropped);
+		return SWITCH_FALSE;
+	}
+
+	/* the mutex lives in the pool and goes away with the clear */
+	apr_allocator_mutex_set(my_allocator, NULL);
+	apr_pool_mutex_set(pool, NULL);
+
+	/* keep about one size class worth of blocks on the allocator free list, release the rest */
+	apr_allocator_max_free_set(my_allocator, size_class);
+	apr_pool_clear(pool);
+
+	if ((apr_thread_mutex_create(&my_mutex, APR_THREAD_MUTEX_NESTED, pool)) != APR_SUCCESS) {
+		abort();
+	}
+
+	apr_allocator_mutex_set(my_allocator, my_mutex);
+	apr_pool_mutex_set(pool, my_mutex);
+
+	if (switch_queue_trypush(memory_manager.recycle_shards[memory_manager.recycle_next++ % memory_manager.recycle_shard_count], pool) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_FALSE;
+	}
+
+	return SWITCH_TRUE;
+}
+
+static void pool_recycle_drain(void)
+{
+	uint32_t i;
+	void *pop = NULL;
+
+	for (i = 0; i < memory_manager.recycle_shard_count; i++) {
+		while (switch_queue_trypop(memory_manager.recycle_shards[i], &pop) == SWITCH_STATUS_SUCCESS && pop) {
+			apr_pool_destroy(pop);
+			pop = NULL;
+		}
+	}
+}
+#endif
+
+void switch_core_memory_pool_recycle_max(uint32_t max)
+{
+#ifdef RECYCLE_POOLS
+	uint32_t limit = memory_manager.recycle_shard_count * POOL_RECYCLE_SHARD_LEN;
+
+	memory_manager.recycle_max = max > limit ? limit : max;
+
+	if (!memory_manager.recycle_max) {
+		pool_recycle_drain();
+	}
+#endif
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_perform_new_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line)
 {
 	char *tmp;
@@ -368,6 +629,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_new_memory_pool(switch_memor
 #endif
 
 #ifdef PER_POOL_LOCK
+#ifdef RECYCLE_POOLS
+	if (!(*pool = pool_recycle_pop())) {
+		apr_atomic_inc32(&memory_manager.pools_created);
+#endif
 		if ((apr_allocator_create(&my_allocator)) != APR_SUCCESS) {
 			abort();
 		}
@@ -384,6 +649,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_new_memory_pool(switch_memor
 		apr_allocator_owner_set(my_allocator, *pool);
 
 		apr_pool_mutex_set(*pool, my_mutex);
+#ifdef RECYCLE_POOLS
+	}
+#endif
 
 #else
 		apr_pool_create(pool, NULL);
@@ -474,6 +742,9 @@ SWITCH_DECLARE(void *) switch_core_perform_alloc(switch_memory_pool_t *pool, swi
 
 SWITCH_DECLARE(void) switch_core_memory_reclaim(void)
 {
+#ifdef RECYCLE_POOLS
+	pool_recycle_drain();
+#endif
 #if !defined(PER_POOL_LOCK) && !defined(INSTANTLY_DESTROY_POOLS)
 	switch_memory_pool_t *pool;
 	void *pop = NULL;
@@ -518,6 +789,12 @@ static void *SWITCH_THREAD_FUNC pool_thread(switch_thread_t *thread, void *obj)
 					break;
 				}
 #if defined(PER_POOL_LOCK) || defined(DESTROY_POOLS)
+#ifdef RECYCLE_POOLS
+				if (pool_recycle_push(pop)) {
+					x--;
+					continue;
+				}
+#endif
 #ifdef USE_MEM_LOCK
 				switch_mutex_lock(memory_manager.mem_lock);
 #endif
@@ -631,6 +908,29 @@ switch_memory_pool_t *switch_core_memory_init(void)
 	switch_mutex_init(&memory_manager.mem_lock, SWITCH_MUTEX_NESTED, memory_manager.memory_pool);
 #endif
 
+	switch_mutex_init(&memory_manager.stats_mutex, SWITCH_MUTEX_NESTED, memory_manager.memory_pool);
+	switch_core_hash_init(&memory_manager.stats_hash, memory_manager.memory_pool);
+	memory_manager.size_class = POOL_SIZE_CLASS_MIN;
+
+#ifdef RECYCLE_POOLS
+	{
+		uint32_t i;
+
+		memory_manager.recycle_shard_count = switch_core_cpu_count();
+		if (memory_manager.recycle_shard_count < 1) {
+			memory_manager.recycle_shard_count = 1;
+		} else if (memory_manager.recycle_shard_count > POOL_RECYCLE_MAX_SHARDS) {
+			memory_manager.recycle_shard_count = POOL_RECYCLE_MAX_SHARDS;
+		}
+
+		for (i = 0; i < memory_manager.recycle_shard_count; i++) {
+			switch_queue_create(&memory_manager.recycle_shards[i], POOL_RECYCLE_SHARD_LEN, memory_manager.memory_pool);
+		}
+
+		switch_core_memory_pool_recycle_max(POOL_RECYCLE_DEFAULT);
+	}
+#endif
+
 #ifdef INSTANTLY_DESTROY_POOLS
 	{
 		void *foo;
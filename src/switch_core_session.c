@@ -143,125 +143,278 @@ struct str_node {
 	struct str_node *next;
 };
 
-SWITCH_DECLARE(void) switch_core_session_hupall_matching_var(const char *var_name, const char *var_val, switch_call_cause_t cause)
+/* 
+   Live channels are looked up by a handful of variables often enough (call-id, presence id) that we keep an index of
+   them next to the session table instead of walking every session and locking every channel to compare values.
+*/
+
+static const char *INDEXED_VARS[] = {
+	"sip_call_id",
+	"presence_id",
+	NULL
+};
+
+typedef struct session_index_node {
+	char uuid[SWITCH_UUID_FORMATTED_LENGTH + 1];
+	struct session_index_node *next;
+} session_index_node_t;
+
+SWITCH_DECLARE(switch_bool_t) switch_core_session_var_indexed(const char *var_name)
 {
-	switch_hash_index_t *hi;
-	void *val;
-	switch_core_session_t *session;
-	switch_memory_pool_t *pool;
-	struct str_node *head = NULL, *np;
+	int i;
 
-	switch_core_new_memory_pool(&pool);
+	if (zstr(var_name)) {
+		return SWITCH_FALSE;
+	}
 
-	if (!var_val)
+	for (i = 0; INDEXED_VARS[i]; i++) {
+		if (!strcasecmp(var_name, INDEXED_VARS[i])) {
+			return SWITCH_TRUE;
+		}
+	}
+
+	return SWITCH_FALSE;
+}
+
+static void session_index_key(char *buf, switch_size_t len, const char *var_name, const char *var_val)
+{
+	const char *p;
+	char *d = buf;
+
+	/* the names are case insensitive, the values are not */
+	for (p = var_name; *p && d < buf + len - 2; p++) {
+		*d++ = (char) switch_tolower(*p);
+	}
+	*d++ = '=';
+	*d = '\0';
+
+	switch_copy_string(d, var_val, len - (d - buf));
+}
+
+void switch_core_session_index_update(const char *uuid, const char *var_name, const char *old_val, const char *new_val)
+{
+	char key[1024];
+	session_index_node_t *head, *np, *last = NULL;
+
+	if (zstr(uuid) || !session_manager.index_mutex || !switch_core_session_var_indexed(var_name)) {
 		return;
+	}
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_hash_first(NULL, session_manager.session_table); hi; hi = switch_hash_next(hi)) {
-		switch_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			const char *this_val;
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				if (switch_channel_up(session->channel) &&
-					(this_val = switch_channel_get_variable(session->channel, var_name)) && (!strcmp(this_val, var_val))) {
-					np = switch_core_alloc(pool, sizeof(*np));
-					np->str = switch_core_strdup(pool, session->uuid_str);
-					np->next = head;
-					head = np;
+	if (old_val && new_val && !strcmp(old_val, new_val)) {
+		return;
+	}
+
+	switch_mutex_lock(session_manager.index_mutex);
+
+	if (!zstr(old_val)) {
+		session_index_key(key, sizeof(key), var_name, old_val);
+
+		if ((head = switch_core_hash_find(session_manager.var_index, key))) {
+			for (np = head; np; np = np->next) {
+				if (!strcmp(np->uuid, uuid)) {
+					if (last) {
+						last->next = np->next;
+					} else if (np->next) {
+						switch_core_hash_insert(session_manager.var_index, key, np->next);
+					} else {
+						switch_core_hash_delete(session_manager.var_index, key);
+					}
+					free(np);
+					break;
 				}
-				switch_core_session_rwunlock(session);
+				last = np;
 			}
 		}
 	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
 
-	for(np = head; np; np = np->next) {
-		if ((session = switch_core_session_locate(np->str))) {
-			switch_channel_hangup(session->channel, cause);
-			switch_core_session_rwunlock(session);
-		}
+	if (!zstr(new_val)) {
+		session_index_key(key, sizeof(key), var_name, new_val);
+
+		switch_zmalloc(np, sizeof(*np));
+		switch_copy_string(np->uuid, uuid, sizeof(np->uuid));
+		np->next = switch_core_hash_find(session_manager.var_index, key);
+		switch_core_hash_insert(session_manager.var_index, key, np);
 	}
 
-	switch_core_destroy_memory_pool(&pool);
+	switch_mutex_unlock(session_manager.index_mutex);
+}
 
+static void session_index_move(switch_channel_t *channel, const char *old_uuid, const char *new_uuid)
+{
+	const char *val;
+	int i;
+
+	for (i = 0; INDEXED_VARS[i]; i++) {
+		if ((val = switch_channel_get_variable(channel, INDEXED_VARS[i]))) {
+			switch_core_session_index_update(old_uuid, INDEXED_VARS[i], val, NULL);
+			switch_core_session_index_update(new_uuid, INDEXED_VARS[i], NULL, val);
+		}
+	}
 }
 
-SWITCH_DECLARE(void) switch_core_session_hupall_endpoint(const switch_endpoint_interface_t *endpoint_interface, switch_call_cause_t cause)
+/* read lock every live session so the callbacks can run without holding up anyone creating or destroying sessions */
+static uint32_t session_snapshot(switch_core_session_t ***sessions)
 {
 	switch_hash_index_t *hi;
 	void *val;
-	switch_core_session_t *session;
-	switch_memory_pool_t *pool;
-    struct str_node *head = NULL, *np;
-	
-	switch_core_new_memory_pool(&pool);
-	
+	switch_core_session_t *session, **list;
+	uint32_t count = 0, max;
+
 	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_hash_first(NULL, session_manager.session_table); hi; hi = switch_hash_next(hi)) {
+
+	max = session_manager.session_count + 1;
+	switch_zmalloc(list, max * sizeof(*list));
+
+	for (hi = switch_hash_first(NULL, session_manager.session_table); hi && count < max; hi = switch_hash_next(hi)) {
 		switch_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				if (session->endpoint_interface == endpoint_interface) {
-					np = switch_core_alloc(pool, sizeof(*np));
-                    np->str = switch_core_strdup(pool, session->uuid_str);
-                    np->next = head;
-					head = np;
-				}
-				switch_core_session_rwunlock(session);
-			}
+		if ((session = (switch_core_session_t *) val) && switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
+			list[count++] = session;
 		}
 	}
+
 	switch_mutex_unlock(runtime.session_hash_mutex);
 
-	for(np = head; np; np = np->next) {
-		if ((session = switch_core_session_locate(np->str))) {
-			switch_channel_hangup(session->channel, cause);
-			switch_core_session_rwunlock(session);
+	*sessions = list;
+
+	return count;
+}
+
+static uint32_t session_walk_list(switch_core_session_t **list, uint32_t count, switch_core_session_walk_callback_t callback, void *pArg)
+{
+	uint32_t x, walked = 0;
+	int stop = 0;
+
+	for (x = 0; x < count; x++) {
+		if (!stop) {
+			walked++;
+			stop = callback(list[x], pArg);
 		}
+		switch_core_session_rwunlock(list[x]);
 	}
 
-	switch_core_destroy_memory_pool(&pool);
+	return walked;
+}
+
+SWITCH_DECLARE(uint32_t) switch_core_session_walk(switch_core_session_walk_callback_t callback, void *pArg)
+{
+	switch_core_session_t **list = NULL;
+	uint32_t count, walked;
+
+	count = session_snapshot(&list);
+	walked = session_walk_list(list, count, callback, pArg);
+	free(list);
 
+	return walked;
 }
 
-SWITCH_DECLARE(void) switch_core_session_hupall(switch_call_cause_t cause)
+SWITCH_DECLARE(uint32_t) switch_core_session_walk_matching_var(const char *var_name, const char *var_val,
+															   switch_core_session_walk_callback_t callback, void *pArg)
 {
-	switch_hash_index_t *hi;
-	void *val;
-	switch_core_session_t *session;
-	switch_memory_pool_t *pool;
-	struct str_node *head = NULL, *np;
+	switch_core_session_t **list = NULL, *session;
+	uint32_t count = 0, walked, x;
+	const char *this_val;
 
-	switch_core_new_memory_pool(&pool);
+	if (zstr(var_name) || !var_val) {
+		return 0;
+	}
 
+	if (switch_core_session_var_indexed(var_name)) {
+		char key[1024];
+		session_index_node_t *np;
+		struct str_node *head = NULL, *sp, *next;
+		uint32_t max = 0;
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_hash_first(NULL, session_manager.session_table); hi; hi = switch_hash_next(hi)) {
-		switch_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				np = switch_core_alloc(pool, sizeof(*np));
-				np->str = switch_core_strdup(pool, session->uuid_str);
-				np->next = head;
-				head = np;
-				switch_core_session_rwunlock(session);
+		session_index_key(key, sizeof(key), var_name, var_val);
+
+		switch_mutex_lock(session_manager.index_mutex);
+		for (np = switch_core_hash_find(session_manager.var_index, key); np; np = np->next) {
+			switch_zmalloc(sp, sizeof(*sp));
+			sp->str = strdup(np->uuid);
+			sp->next = head;
+			head = sp;
+			max++;
+		}
+		switch_mutex_unlock(session_manager.index_mutex);
+
+		if (max) {
+			switch_zmalloc(list, max * sizeof(*list));
+		}
+
+		for (sp = head; sp; sp = next) {
+			next = sp->next;
+			if ((session = switch_core_session_locate(sp->str))) {
+				/* the index only narrows the search, the value may have changed since we looked */
+				if ((this_val = switch_channel_get_variable(session->channel, var_name)) && !strcmp(this_val, var_val)) {
+					list[count++] = session;
+				} else {
+					switch_core_session_rwunlock(session);
+				}
 			}
+			free(sp->str);
+			free(sp);
 		}
+	} else {
+		switch_core_session_t **all = NULL;
+		uint32_t total = session_snapshot(&all);
+
+		switch_zmalloc(list, (total + 1) * sizeof(*list));
+
+		for (x = 0; x < total; x++) {
+			if ((this_val = switch_channel_get_variable(all[x]->channel, var_name)) && !strcmp(this_val, var_val)) {
+				list[count++] = all[x];
+			} else {
+				switch_core_session_rwunlock(all[x]);
+			}
+		}
+
+		free(all);
 	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
 
-	for(np = head; np; np = np->next) { 
-		if ((session = switch_core_session_locate(np->str))) {
-			switch_channel_hangup(session->channel, cause);
-			switch_core_session_rwunlock(session);
+	walked = session_walk_list(list, count, callback, pArg);
+	switch_safe_free(list);
+
+	return walked;
+}
+
+static int hupall_callback(switch_core_session_t *session, void *pArg)
+{
+	switch_call_cause_t *cause = (switch_call_cause_t *) pArg;
+
+	if (switch_channel_up(session->channel)) {
+		switch_channel_hangup(session->channel, *cause);
+	}
+
+	return 0;
+}
+
+SWITCH_DECLARE(void) switch_core_session_hupall_matching_var(const char *var_name, const char *var_val, switch_call_cause_t cause)
+{
+	if (!var_val)
+		return;
+
+	switch_core_session_walk_matching_var(var_name, var_val, hupall_callback, &cause);
+}
+
+SWITCH_DECLARE(void) switch_core_session_hupall_endpoint(const switch_endpoint_interface_t *endpoint_interface, switch_call_cause_t cause)
+{
+	switch_core_session_t **list = NULL;
+	uint32_t count, x;
+
+	count = session_snapshot(&list);
+
+	for (x = 0; x < count; x++) {
+		if (list[x]->endpoint_interface == endpoint_interface) {
+			switch_channel_hangup(list[x]->channel, cause);
 		}
+		switch_core_session_rwunlock(list[x]);
 	}
 
-	switch_core_destroy_memory_pool(&pool);
+	free(list);
+}
 
+SWITCH_DECLARE(void) switch_core_session_hupall(switch_call_cause_t cause)
+{
+	switch_core_session_walk(hupall_callback, &cause);
 }
 
 
@@ -1067,6 +1220,8 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 
 	switch_scheduler_del_task_group((*session)->uuid_str);
 
+	session_index_move((*session)->channel, (*session)->uuid_str, NULL);
+
 	switch_mutex_lock(runtime.session_hash_mutex);
 	switch_core_hash_delete(session_manager.session_table, (*session)->uuid_str);
 	if (session_manager.session_count) {
@@ -1084,6 +1239,10 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 	switch_buffer_destroy(&(*session)->raw_read_buffer);
 	switch_buffer_destroy(&(*session)->raw_write_buffer);
 	switch_ivr_clear_speech_cache(*session);
+
+	switch_core_memory_pool_account((*session)->pool, endpoint_interface->interface_name,
+									switch_channel_get_variable((*session)->channel, SWITCH_CURRENT_APPLICATION_VARIABLE));
+
 	switch_channel_uninit((*session)->channel);
 
 	pool = (*session)->pool;
@@ -1297,6 +1456,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_set_uuid(switch_core_session
 
 	switch_event_create(&event, SWITCH_EVENT_CHANNEL_UUID);
 	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Old-Unique-ID", session->uuid_str);
+	session_index_move(session->channel, session->uuid_str, use_uuid);
 	switch_core_hash_delete(session_manager.session_table, session->uuid_str);
 	switch_set_string(session->uuid_str, use_uuid);
 	switch_core_hash_insert(session_manager.session_table, session->uuid_str, session);
@@ -1727,11 +1887,14 @@ void switch_core_session_init(switch_memory_pool_t *pool)
 	session_manager.session_id = 1;
 	session_manager.memory_pool = pool;
 	switch_core_hash_init(&session_manager.session_table, session_manager.memory_pool);
+	switch_mutex_init(&session_manager.index_mutex, SWITCH_MUTEX_NESTED, session_manager.memory_pool);
+	switch_core_hash_init_case(&session_manager.var_index, session_manager.memory_pool, SWITCH_TRUE);
 }
 
 void switch_core_session_uninit(void)
 {
 	switch_core_hash_destroy(&session_manager.session_table);
+	switch_core_hash_destroy(&session_manager.var_index);
 }
 
 SWITCH_DECLARE(switch_app_log_t *) switch_core_session_get_app_log(switch_core_session_t *session)
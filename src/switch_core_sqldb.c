@@ -845,24 +845,578 @@ SWITCH_DECLARE(switch_bool_t) switch_cache_db_test_reactive(switch_cache_db_hand
 
 
 
-#define SQLLEN 1024 * 1024
+/*
+   The core tables are written by a single thread.  Channel and call rows come through as structured ops instead of sql
+   text so every update to the same row inside one batch can be folded together, and on the core db they are written with
+   cached prepared statements so sqlite doesn't have to parse the same statements over and over.
+*/
+
+typedef enum {
+	CCOL_DIRECTION,
+	CCOL_CREATED,
+	CCOL_CREATED_EPOCH,
+	CCOL_NAME,
+	CCOL_STATE,
+	CCOL_CALLSTATE,
+	CCOL_CID_NAME,
+	CCOL_CID_NUM,
+	CCOL_IP_ADDR,
+	CCOL_DEST,
+	CCOL_DIALPLAN,
+	CCOL_CONTEXT,
+	CCOL_PRESENCE_ID,
+	CCOL_PRESENCE_DATA,
+	CCOL_APPLICATION,
+	CCOL_APPLICATION_DATA,
+	CCOL_READ_CODEC,
+	CCOL_READ_RATE,
+	CCOL_WRITE_CODEC,
+	CCOL_WRITE_RATE,
+	CCOL_CALL_UUID,
+	CCOL_CALLEE_NAME,
+	CCOL_CALLEE_NUM,
+	CCOL_CALLEE_DIRECTION,
+	CCOL_SECURE,
+	CCOL_MAX
+} core_channel_col_t;
+
+static const char *CHANNEL_COLS[CCOL_MAX] = {
+	"direction",
+	"created",
+	"created_epoch",
+	"name",
+	"state",
+	"callstate",
+	"cid_name",
+	"cid_num",
+	"ip_addr",
+	"dest",
+	"dialplan",
+	"context",
+	"presence_id",
+	"presence_data",
+	"application",
+	"application_data",
+	"read_codec",
+	"read_rate",
+	"write_codec",
+	"write_rate",
+	"call_uuid",
+	"callee_name",
+	"callee_num",
+	"callee_direction",
+	"secure"
+};
+
+typedef enum {
+	CALLCOL_CALL_UUID,
+	CALLCOL_CALL_CREATED,
+	CALLCOL_CALL_CREATED_EPOCH,
+	CALLCOL_FUNCTION,
+	CALLCOL_CALLER_CID_NAME,
+	CALLCOL_CALLER_CID_NUM,
+	CALLCOL_CALLER_DEST_NUM,
+	CALLCOL_CALLER_CHAN_NAME,
+	CALLCOL_CALLEE_CID_NAME,
+	CALLCOL_CALLEE_CID_NUM,
+	CALLCOL_CALLEE_DEST_NUM,
+	CALLCOL_CALLEE_CHAN_NAME,
+	CALLCOL_CALLEE_UUID,
+	CALLCOL_MAX
+} core_call_col_t;
+
+static const char *CALL_COLS[CALLCOL_MAX] = {
+	"call_uuid",
+	"call_created",
+	"call_created_epoch",
+	"function",
+	"caller_cid_name",
+	"caller_cid_num",
+	"caller_dest_num",
+	"caller_chan_name",
+	"callee_cid_name",
+	"callee_cid_num",
+	"callee_dest_num",
+	"callee_chan_name",
+	"callee_uuid"
+};
+
+/* a table written with structured ops, rows are keyed by key_col and hostname */
+typedef struct {
+	const char *name;
+	const char *key_col;
+	const char **cols;
+	int ncols;
+} core_sql_table_t;
+
+static const core_sql_table_t CHANNELS_TABLE = { "channels", "uuid", CHANNEL_COLS, CCOL_MAX };
+static const core_sql_table_t CALLS_TABLE = { "calls", "caller_uuid", CALL_COLS, CALLCOL_MAX };
+
+typedef enum {
+	CSO_SQL,
+	CSO_INSERT,
+	CSO_UPDATE,
+	CSO_DELETE,
+	/* a channel went away, drop every call it was part of on either side */
+	CSO_CALL_DESTROY
+} core_sql_op_type_t;
+
+typedef struct core_sql_op {
+	core_sql_op_type_t type;
+	const core_sql_table_t *table;
+	char *sql;
+	char *uuid;
+	uint32_t cols;
+	char *vals[CCOL_MAX];
+	/* raw sql that touches the channels or calls table, ops queued before it may not be folded into ops after it */
+	uint8_t barrier;
+	uint8_t dead;
+	uint8_t indexed;
+	struct core_sql_op *next;
+} core_sql_op_t;
+
+static core_sql_op_t *core_sql_op_new(core_sql_op_type_t type, const core_sql_table_t *table, const char *uuid)
+{
+	core_sql_op_t *op;
+
+	switch_zmalloc(op, sizeof(*op));
+	op->type = type;
+	op->table = table;
+
+	if (uuid) {
+		op->uuid = strdup(uuid);
+	}
+
+	return op;
+}
+
+static void core_sql_op_set(core_sql_op_t *op, int col, const char *val)
+{
+	switch_safe_free(op->vals[col]);
+	op->vals[col] = strdup(switch_str_nil(val));
+	op->cols |= (1 << col);
+}
+
+static void core_sql_op_destroy(core_sql_op_t *op)
+{
+	int i;
+
+	for (i = 0; i < CCOL_MAX; i++) {
+		switch_safe_free(op->vals[i]);
+	}
+
+	switch_safe_free(op->sql);
+	switch_safe_free(op->uuid);
+	free(op);
+}
+
+typedef struct {
+	core_sql_op_t *head;
+	core_sql_op_t *tail;
+	switch_hash_t *index;
+	uint32_t count;
+	uint32_t folded;
+} core_sql_batch_t;
+
+static const char *core_sql_op_key(core_sql_op_t *op, char *buf, switch_size_t len)
+{
+	switch_snprintf(buf, len, "%s:%s", op->table->name, op->uuid);
+	return buf;
+}
+
+static void core_sql_batch_unindex(core_sql_batch_t *batch, core_sql_op_t *op)
+{
+	char key[512];
+
+	if (op->indexed) {
+		switch_core_hash_delete(batch->index, core_sql_op_key(op, key, sizeof(key)));
+		op->indexed = 0;
+	}
+}
+
+static void core_sql_batch_index(core_sql_batch_t *batch, core_sql_op_t *op)
+{
+	char key[512];
+
+	switch_core_hash_insert(batch->index, core_sql_op_key(op, key, sizeof(key)), op);
+	op->indexed = 1;
+}
+
+static void core_sql_batch_append(core_sql_batch_t *batch, core_sql_op_t *op)
+{
+	if (batch->tail) {
+		batch->tail->next = op;
+	} else {
+		batch->head = op;
+	}
+	batch->tail = op;
+	batch->count++;
+}
+
+/* adds an op to the batch folding it into what is already pending for the same row whenever we can */
+static void core_sql_batch_add(core_sql_batch_t *batch, core_sql_op_t *op)
+{
+	core_sql_op_t *pending = NULL, *np;
+	char key[512];
+	int i;
+
+	if (op->uuid && op->type != CSO_SQL && op->type != CSO_CALL_DESTROY) {
+		pending = switch_core_hash_find(batch->index, core_sql_op_key(op, key, sizeof(key)));
+	}
+
+	switch (op->type) {
+	case CSO_SQL:
+		if (op->barrier) {
+			for (np = batch->head; np; np = np->next) {
+				core_sql_batch_unindex(batch, np);
+			}
+		}
+		break;
+	case CSO_CALL_DESTROY:
+		/* it matches on the callee too, so no pending call row may be folded across it */
+		for (np = batch->head; np; np = np->next) {
+			if (np->table == &CALLS_TABLE) {
+				core_sql_batch_unindex(batch, np);
+			}
+		}
+		break;
+	case CSO_INSERT:
+		if (pending) {
+			core_sql_batch_unindex(batch, pending);
+		}
+		core_sql_batch_append(batch, op);
+		core_sql_batch_index(batch, op);
+		return;
+	case CSO_UPDATE:
+		if (pending) {
+			/* the row ends up the same whether we write it once or five times */
+			for (i = 0; i < op->table->ncols; i++) {
+				if ((op->cols & (1 << i))) {
+					switch_safe_free(pending->vals[i]);
+					pending->vals[i] = op->vals[i];
+					op->vals[i] = NULL;
+				}
+			}
+			pending->cols |= op->cols;
+			core_sql_op_destroy(op);
+			batch->folded++;
+			return;
+		}
+		core_sql_batch_append(batch, op);
+		core_sql_batch_index(batch, op);
+		return;
+	case CSO_DELETE:
+		if (pending) {
+			core_sql_batch_unindex(batch, pending);
+			pending->dead = 1;
+			batch->folded++;
+
+			if (pending->type == CSO_INSERT) {
+				/* created and gone inside the same batch, the row never has to be written at all */
+				core_sql_op_destroy(op);
+				return;
+			}
+		}
+		break;
+	}
+
+	core_sql_batch_append(batch, op);
+}
+
+static void core_sql_batch_reset(core_sql_batch_t *batch)
+{
+	core_sql_op_t *np, *next;
+
+	for (np = batch->head; np; np = next) {
+		next = np->next;
+		core_sql_batch_unindex(batch, np);
+		core_sql_op_destroy(np);
+	}
+
+	batch->head = batch->tail = NULL;
+	batch->count = 0;
+	batch->folded = 0;
+}
+
+static char *core_sql_op_to_sql(core_sql_op_t *op, const char *hostname)
+{
+	const core_sql_table_t *table = op->table;
+	switch_stream_handle_t stream = { 0 };
+	int i, n = 0;
+
+	if (op->type == CSO_SQL) {
+		return strdup(op->sql);
+	}
+
+	if (op->type == CSO_CALL_DESTROY) {
+		return switch_mprintf("delete from calls where (caller_uuid='%q' or callee_uuid='%q') and hostname='%q'", op->uuid, op->uuid, hostname);
+	}
+
+	if (op->type == CSO_DELETE) {
+		return switch_mprintf("delete from %s where %s='%q' and hostname='%q'", table->name, table->key_col, op->uuid, hostname);
+	}
+
+	SWITCH_STANDARD_STREAM(stream);
+
+	if (op->type == CSO_INSERT) {
+		stream.write_function(&stream, "insert into %s (%s,", table->name, table->key_col);
+		for (i = 0; i < table->ncols; i++) {
+			if ((op->cols & (1 << i))) {
+				stream.write_function(&stream, "%s,", table->cols[i]);
+			}
+		}
+		stream.write_function(&stream, "hostname) values('%q',", op->uuid);
+		for (i = 0; i < table->ncols; i++) {
+			if ((op->cols & (1 << i))) {
+				stream.write_function(&stream, "'%q',", op->vals[i]);
+			}
+		}
+		stream.write_function(&stream, "'%q')", hostname);
+	} else {
+		stream.write_function(&stream, "update %s set ", table->name);
+		for (i = 0; i < table->ncols; i++) {
+			if ((op->cols & (1 << i))) {
+				stream.write_function(&stream, "%s%s='%q'", n++ ? "," : "", table->cols[i], op->vals[i]);
+			}
+		}
+		stream.write_function(&stream, " where %s='%q' and hostname='%q'", table->key_col, op->uuid, hostname);
+	}
+
+	return (char *) stream.data;
+}
+
+/* the prepared statement text only depends on the table, the op type and which columns it carries */
+static char *core_sql_op_to_template(core_sql_op_t *op)
+{
+	const core_sql_table_t *table = op->table;
+	switch_stream_handle_t stream = { 0 };
+	int i, n = 0;
+
+	if (op->type == CSO_CALL_DESTROY) {
+		return strdup("delete from calls where (caller_uuid=? or callee_uuid=?) and hostname=?");
+	}
+
+	if (op->type == CSO_DELETE) {
+		return switch_mprintf("delete from %s where %s=? and hostname=?", table->name, table->key_col);
+	}
+
+	SWITCH_STANDARD_STREAM(stream);
+
+	if (op->type == CSO_INSERT) {
+		stream.write_function(&stream, "insert into %s (%s,", table->name, table->key_col);
+		for (i = 0; i < table->ncols; i++) {
+			if ((op->cols & (1 << i))) {
+				stream.write_function(&stream, "%s,", table->cols[i]);
+			}
+		}
+		stream.write_function(&stream, "hostname) values(?");
+		for (i = 0; i < table->ncols; i++) {
+			if ((op->cols & (1 << i))) {
+				stream.write_function(&stream, ",?");
+			}
+		}
+		stream.write_function(&stream, ",?)");
+	} else {
+		stream.write_function(&stream, "update %s set ", table->name);
+		for (i = 0; i < table->ncols; i++) {
+			if ((op->cols & (1 << i))) {
+				stream.write_function(&stream, "%s%s=?", n++ ? "," : "", table->cols[i]);
+			}
+		}
+		stream.write_function(&stream, " where %s=? and hostname=?", table->key_col);
+	}
+
+	return (char *) stream.data;
+}
+
+static switch_core_db_stmt_t *core_sql_get_stmt(switch_hash_t *stmts, switch_core_db_t *db, core_sql_op_t *op)
+{
+	char key[32];
+	switch_core_db_stmt_t *stmt;
+	char *sql;
+
+	switch_snprintf(key, sizeof(key), "%s:%d:%x", op->table->name, op->type, op->cols);
+
+	if ((stmt = switch_core_hash_find(stmts, key))) {
+		return stmt;
+	}
+
+	sql = core_sql_op_to_template(op);
+
+	if (switch_core_db_prepare(db, sql, -1, &stmt, NULL) != SWITCH_CORE_DB_OK) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SQL ERR [%s]\n%s\n", switch_core_db_errmsg(db), sql);
+		stmt = NULL;
+	} else {
+		switch_core_hash_insert(stmts, key, stmt);
+	}
+
+	free(sql);
+
+	return stmt;
+}
+
+static void core_sql_finalize_stmts(switch_hash_t *stmts)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+
+	while ((hi = switch_hash_first(NULL, stmts))) {
+		switch_hash_this(hi, &var, NULL, &val);
+		switch_core_db_finalize((switch_core_db_stmt_t *) val);
+		switch_core_hash_delete(stmts, (const char *) var);
+	}
+}
+
+static switch_status_t core_sql_exec_stmt(switch_core_db_t *db, switch_core_db_stmt_t *stmt, core_sql_op_t *op, const char *hostname)
+{
+	int i, x = 1, rc, tries = 100;
+
+	if (op->type != CSO_UPDATE) {
+		switch_core_db_bind_text(stmt, x++, op->uuid, -1, SWITCH_CORE_DB_STATIC);
+	}
+
+	if (op->type == CSO_CALL_DESTROY) {
+		switch_core_db_bind_text(stmt, x++, op->uuid, -1, SWITCH_CORE_DB_STATIC);
+	} else if (op->type != CSO_DELETE) {
+		for (i = 0; i < op->table->ncols; i++) {
+			if ((op->cols & (1 << i))) {
+				switch_core_db_bind_text(stmt, x++, op->vals[i], -1, SWITCH_CORE_DB_STATIC);
+			}
+		}
+	}
+
+	if (op->type == CSO_UPDATE) {
+		switch_core_db_bind_text(stmt, x++, op->uuid, -1, SWITCH_CORE_DB_STATIC);
+	}
+
+	switch_core_db_bind_text(stmt, x++, hostname, -1, SWITCH_CORE_DB_STATIC);
+
+	while ((rc = switch_core_db_step(stmt)) == SWITCH_CORE_DB_BUSY || rc == SWITCH_CORE_DB_LOCKED) {
+		if (!--tries) {
+			break;
+		}
+		switch_core_db_reset(stmt);
+		switch_yield(1000);
+	}
+
+	switch_core_db_reset(stmt);
+
+	if (rc != SWITCH_CORE_DB_DONE) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SQL ERR [%s] on %s row %s\n", switch_core_db_errmsg(db), op->table->name, op->uuid);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t core_sql_exec_batch_core_db(switch_cache_db_handle_t *dbh, switch_hash_t *stmts, core_sql_batch_t *batch, const char *hostname)
+{
+	switch_core_db_t *db = dbh->native_handle.core_db_dbh;
+	switch_core_db_stmt_t *stmt;
+	core_sql_op_t *op;
+	char *errmsg = NULL;
+	int begin_retries = 100;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	if (dbh->io_mutex) {
+		switch_mutex_lock(dbh->io_mutex);
+	}
+
+	while (switch_core_db_exec(db, "BEGIN", NULL, NULL, &errmsg) != SWITCH_CORE_DB_OK) {
+		if (errmsg) {
+			if (strstr(errmsg, "cannot start a transaction within a transaction")) {
+				switch_core_db_exec(db, "COMMIT", NULL, NULL, NULL);
+			} else {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "SQL Retry [%s]\n", errmsg);
+				switch_yield(100000);
+			}
+			switch_core_db_free(errmsg);
+			errmsg = NULL;
+		}
+
+		if (!--begin_retries) {
+			status = SWITCH_STATUS_FALSE;
+			goto done;
+		}
+	}
+
+	for (op = batch->head; op; op = op->next) {
+		if (op->dead) {
+			continue;
+		}
+
+		if (op->type == CSO_SQL) {
+			if (switch_core_db_exec(db, op->sql, NULL, NULL, &errmsg) != SWITCH_CORE_DB_OK) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SQL ERR [%s]\n%s\n", switch_str_nil(errmsg), op->sql);
+				status = SWITCH_STATUS_FALSE;
+			}
+			if (errmsg) {
+				switch_core_db_free(errmsg);
+				errmsg = NULL;
+			}
+		} else if ((stmt = core_sql_get_stmt(stmts, db, op))) {
+			if (core_sql_exec_stmt(db, stmt, op, hostname) != SWITCH_STATUS_SUCCESS) {
+				status = SWITCH_STATUS_FALSE;
+			}
+		} else {
+			status = SWITCH_STATUS_FALSE;
+		}
+	}
+
+	switch_core_db_exec(db, "COMMIT", NULL, NULL, NULL);
+
+  done:
+
+	if (dbh->io_mutex) {
+		switch_mutex_unlock(dbh->io_mutex);
+	}
+
+	return status;
+}
+
+static switch_status_t core_sql_exec_batch(switch_cache_db_handle_t *dbh, switch_hash_t *stmts, core_sql_batch_t *batch)
+{
+	switch_stream_handle_t stream = { 0 };
+	const char *hostname = switch_core_get_variable("hostname");
+	core_sql_op_t *op;
+	char *sql;
+	switch_status_t status;
+
+	if (dbh->type == SCDB_TYPE_CORE_DB) {
+		return core_sql_exec_batch_core_db(dbh, stmts, batch, hostname);
+	}
+
+	/* no prepared statements over odbc, send the folded batch as one sql transaction like always */
+	SWITCH_STANDARD_STREAM(stream);
+
+	for (op = batch->head; op; op = op->next) {
+		if (!op->dead && (sql = core_sql_op_to_sql(op, hostname))) {
+			stream.write_function(&stream, "%s;\n", sql);
+			free(sql);
+		}
+	}
+
+	status = switch_cache_db_persistant_execute_trans(dbh, (char *) stream.data, 1);
+	switch_safe_free(stream.data);
+
+	return status;
+}
+
 static void *SWITCH_THREAD_FUNC switch_core_sql_thread(switch_thread_t *thread, void *obj)
 {
 	void *pop;
 	uint32_t itterations = 0;
 	uint8_t trans = 0, nothing_in_queue = 0;
 	uint32_t target = 100000;
-	switch_size_t len = 0, sql_len = SQLLEN;
-	char *tmp, *sqlbuf = (char *) malloc(sql_len);
-	char *sql;
-	switch_size_t newlen;
+	core_sql_batch_t batch = { 0 };
+	switch_hash_t *stmts = NULL;
+	core_sql_op_t *op;
 	int lc = 0;
 	uint32_t loops = 0, sec = 0;
 	uint32_t l1 = 1000;
 	uint32_t sanity = 120;
 
-	switch_assert(sqlbuf);
-
 	if (!sql_manager.manage) {
 		l1 = 10;
 	}
@@ -880,6 +1434,8 @@ static void *SWITCH_THREAD_FUNC switch_core_sql_thread(switch_thread_t *thread,
 		return NULL;
 	}
 
+	switch_core_hash_init_case(&batch.index, sql_manager.memory_pool, SWITCH_TRUE);
+	switch_core_hash_init_case(&stmts, sql_manager.memory_pool, SWITCH_TRUE);
 
 	sql_manager.thread_running = 1;
 
@@ -899,32 +1455,13 @@ static void *SWITCH_THREAD_FUNC switch_core_sql_thread(switch_thread_t *thread,
 
 		if (switch_queue_trypop(sql_manager.sql_queue[0], &pop) == SWITCH_STATUS_SUCCESS ||
 			switch_queue_trypop(sql_manager.sql_queue[1], &pop) == SWITCH_STATUS_SUCCESS) {
-			sql = (char *) pop;
-
-			if (sql) {
-				newlen = strlen(sql) + 2;
 
+			if ((op = (core_sql_op_t *) pop)) {
 				if (itterations == 0) {
 					trans = 1;
 				}
-
-				/* ignore abnormally large strings sql strings as potential buffer overflow */
-				if (newlen < SQLLEN) {
-					itterations++;
-					if (len + newlen > sql_len) {
-						sql_len = len + SQLLEN;
-						if (!(tmp = realloc(sqlbuf, sql_len))) {
-							switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "SQL thread ending on mem err\n");
-							abort();
-							break;
-						}
-						sqlbuf = tmp;
-					}
-					sprintf(sqlbuf + len, "%s;\n", sql);
-					len += newlen;
-
-				}
-				free(sql);
+				itterations++;
+				core_sql_batch_add(&batch, op);
 			} else {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "SQL thread ending\n");
 				break;
@@ -935,14 +1472,16 @@ static void *SWITCH_THREAD_FUNC switch_core_sql_thread(switch_thread_t *thread,
 
 
 		if (trans && ((itterations == target) || (nothing_in_queue && ++lc >= 500))) {
-			if (switch_cache_db_persistant_execute_trans(sql_manager.event_db, sqlbuf, 1) != SWITCH_STATUS_SUCCESS) {
+			if (core_sql_exec_batch(sql_manager.event_db, stmts, &batch) != SWITCH_STATUS_SUCCESS) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "SQL thread unable to commit transaction, records lost!\n");
 			}
+			if (batch.folded) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG10, "SQL thread folded %u of %u channel writes\n", batch.folded, itterations);
+			}
+			core_sql_batch_reset(&batch);
 			itterations = 0;
 			trans = 0;
 			nothing_in_queue = 0;
-			len = 0;
-			*sqlbuf = '\0';
 			lc = 0;
 		}
 
@@ -952,14 +1491,21 @@ static void *SWITCH_THREAD_FUNC switch_core_sql_thread(switch_thread_t *thread,
 	}
 
 	while (switch_queue_trypop(sql_manager.sql_queue[0], &pop) == SWITCH_STATUS_SUCCESS) {
-		free(pop);
+		if (pop) {
+			core_sql_op_destroy((core_sql_op_t *) pop);
+		}
 	}
 
 	while (switch_queue_trypop(sql_manager.sql_queue[1], &pop) == SWITCH_STATUS_SUCCESS) {
-		free(pop);
+		if (pop) {
+			core_sql_op_destroy((core_sql_op_t *) pop);
+		}
 	}
 
-	free(sqlbuf);
+	core_sql_batch_reset(&batch);
+	core_sql_finalize_stmts(stmts);
+	switch_core_hash_destroy(&stmts);
+	switch_core_hash_destroy(&batch.index);
 
 	sql_manager.thread_running = 0;
 
@@ -1009,11 +1555,16 @@ static char *parse_presence_data_cols(switch_event_t *event)
 
 #define MAX_SQL 5
 #define new_sql() switch_assert(sql_idx+1 < MAX_SQL); sql[sql_idx++]
+#define new_op(_type, _uuid) switch_assert(op_idx+1 < MAX_SQL); op = ops[op_idx++] = core_sql_op_new(_type, &CHANNELS_TABLE, _uuid)
+#define new_call_op(_type, _uuid) switch_assert(op_idx+1 < MAX_SQL); op = ops[op_idx++] = core_sql_op_new(_type, &CALLS_TABLE, _uuid)
 
 static void core_event_handler(switch_event_t *event)
 {
 	char *sql[MAX_SQL] = { 0 };
 	int sql_idx = 0;
+	core_sql_op_t *ops[MAX_SQL] = { 0 };
+	core_sql_op_t *op;
+	int op_idx = 0;
 	char *extra_cols;
 
 	switch_assert(event);
@@ -1057,11 +1608,9 @@ static void core_event_handler(switch_event_t *event)
 			const char *sig = switch_event_get_header(event, "signal_bridge");
 			
 			if (uuid) {
-				new_sql() = switch_mprintf("delete from channels where uuid='%q' and hostname='%q'",
-										   uuid, switch_core_get_variable("hostname"));
+				new_op(CSO_DELETE, uuid);
 				if (switch_true(sig)) {
-					new_sql() = switch_mprintf("delete from calls where (caller_uuid='%q' || callee_uuid='%q') and hostname='%q'",
-											   uuid, uuid, switch_core_get_variable("hostname"));
+					new_call_op(CSO_CALL_DESTROY, uuid);
 				}
 			}
 		}
@@ -1083,41 +1632,38 @@ static void core_event_handler(switch_event_t *event)
 			break;
 		}
 	case SWITCH_EVENT_CHANNEL_CREATE:
-		new_sql() = switch_mprintf("insert into channels (uuid,direction,created,created_epoch, name,state,callstate,dialplan,context,hostname) "
-								   "values('%q','%q','%q','%ld','%q','%q','%q','%q','%q','%q')",
-								   switch_event_get_header_nil(event, "unique-id"),
-								   switch_event_get_header_nil(event, "call-direction"),
-								   switch_event_get_header_nil(event, "event-date-local"),
-								   (long) switch_epoch_time_now(NULL),
-								   switch_event_get_header_nil(event, "channel-name"),
-								   switch_event_get_header_nil(event, "channel-state"),
-								   switch_event_get_header_nil(event, "channel-call-state"),
-								   switch_event_get_header_nil(event, "caller-dialplan"),
-								   switch_event_get_header_nil(event, "caller-context"), switch_core_get_variable("hostname")
-								   );
+		{
+			char epoch[32];
+
+			switch_snprintf(epoch, sizeof(epoch), "%ld", (long) switch_epoch_time_now(NULL));
+
+			new_op(CSO_INSERT, switch_event_get_header_nil(event, "unique-id"));
+			core_sql_op_set(op, CCOL_DIRECTION, switch_event_get_header_nil(event, "call-direction"));
+			core_sql_op_set(op, CCOL_CREATED, switch_event_get_header_nil(event, "event-date-local"));
+			core_sql_op_set(op, CCOL_CREATED_EPOCH, epoch);
+			core_sql_op_set(op, CCOL_NAME, switch_event_get_header_nil(event, "channel-name"));
+			core_sql_op_set(op, CCOL_STATE, switch_event_get_header_nil(event, "channel-state"));
+			core_sql_op_set(op, CCOL_CALLSTATE, switch_event_get_header_nil(event, "channel-call-state"));
+			core_sql_op_set(op, CCOL_DIALPLAN, switch_event_get_header_nil(event, "caller-dialplan"));
+			core_sql_op_set(op, CCOL_CONTEXT, switch_event_get_header_nil(event, "caller-context"));
+		}
 		break;
 	case SWITCH_EVENT_CODEC:
-		new_sql() =
-			switch_mprintf
-			("update channels set read_codec='%q',read_rate='%q',write_codec='%q',write_rate='%q' where uuid='%q' and hostname='%q'",
-			 switch_event_get_header_nil(event, "channel-read-codec-name"),
-			 switch_event_get_header_nil(event, "channel-read-codec-rate"),
-			 switch_event_get_header_nil(event, "channel-write-codec-name"),
-			 switch_event_get_header_nil(event, "channel-write-codec-rate"),
-			 switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
+		new_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+		core_sql_op_set(op, CCOL_READ_CODEC, switch_event_get_header_nil(event, "channel-read-codec-name"));
+		core_sql_op_set(op, CCOL_READ_RATE, switch_event_get_header_nil(event, "channel-read-codec-rate"));
+		core_sql_op_set(op, CCOL_WRITE_CODEC, switch_event_get_header_nil(event, "channel-write-codec-name"));
+		core_sql_op_set(op, CCOL_WRITE_RATE, switch_event_get_header_nil(event, "channel-write-codec-rate"));
 		break;
 	case SWITCH_EVENT_CHANNEL_HOLD:
 	case SWITCH_EVENT_CHANNEL_UNHOLD:
 	case SWITCH_EVENT_CHANNEL_EXECUTE: {
 		
-		new_sql() = switch_mprintf("update channels set application='%q',application_data='%q',"
-								   "presence_id='%q',presence_data='%q' where uuid='%q' and hostname='%q'",
-								   switch_event_get_header_nil(event, "application"),
-								   switch_event_get_header_nil(event, "application-data"),
-								   switch_event_get_header_nil(event, "channel-presence-id"),
-								   switch_event_get_header_nil(event, "channel-presence-data"),
-								   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname")
-								   );
+		new_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+		core_sql_op_set(op, CCOL_APPLICATION, switch_event_get_header_nil(event, "application"));
+		core_sql_op_set(op, CCOL_APPLICATION_DATA, switch_event_get_header_nil(event, "application-data"));
+		core_sql_op_set(op, CCOL_PRESENCE_ID, switch_event_get_header_nil(event, "channel-presence-id"));
+		core_sql_op_set(op, CCOL_PRESENCE_DATA, switch_event_get_header_nil(event, "channel-presence-data"));
 
 	}
 		break;
@@ -1134,12 +1680,10 @@ static void core_event_handler(switch_event_t *event)
 										   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
 				free(extra_cols);
 			} else {
-				new_sql() = switch_mprintf("update channels set "
-										   "presence_id='%q',presence_data='%q', call_uuid='%q' where uuid='%q' and hostname='%q'",
-										   switch_event_get_header_nil(event, "channel-presence-id"),
-										   switch_event_get_header_nil(event, "channel-presence-data"),
-										   switch_event_get_header_nil(event, "channel-call-uuid"),
-										   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
+				new_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+				core_sql_op_set(op, CCOL_PRESENCE_ID, switch_event_get_header_nil(event, "channel-presence-id"));
+				core_sql_op_set(op, CCOL_PRESENCE_DATA, switch_event_get_header_nil(event, "channel-presence-data"));
+				core_sql_op_set(op, CCOL_CALL_UUID, switch_event_get_header_nil(event, "channel-call-uuid"));
 			}
 
 		}
@@ -1167,31 +1711,28 @@ static void core_event_handler(switch_event_t *event)
 			}
 
 			if (!zstr(name) && !zstr(number)) {
-				new_sql() = switch_mprintf("update channels set state='%s',callstate='%s',callee_name='%q',"
-										   "callee_num='%q',callee_direction='%q' where uuid='%s' and hostname='%q'",
-										   switch_event_get_header_nil(event, "channel-state"),
-										   switch_event_get_header_nil(event, "channel-call-state"),
-										   switch_str_nil(name),
-										   switch_str_nil(number),
-										   switch_event_get_header_nil(event, "direction"),
-										   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
+				new_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+				core_sql_op_set(op, CCOL_STATE, switch_event_get_header_nil(event, "channel-state"));
+				core_sql_op_set(op, CCOL_CALLSTATE, switch_event_get_header_nil(event, "channel-call-state"));
+				core_sql_op_set(op, CCOL_CALLEE_NAME, name);
+				core_sql_op_set(op, CCOL_CALLEE_NUM, number);
+				core_sql_op_set(op, CCOL_CALLEE_DIRECTION, switch_event_get_header_nil(event, "direction"));
 
 				name = switch_event_get_header(event, "callee-name");
 				number = switch_event_get_header(event, "callee-number");
 
 				if (name && number && recv) {
-					new_sql() = switch_mprintf("update calls set callee_cid_name='%q',callee_cid_num='%q' where caller_uuid='%q'",
-											   name, number, switch_event_get_header_nil(event, "unique-id"));
-
+					new_call_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+					core_sql_op_set(op, CALLCOL_CALLEE_CID_NAME, name);
+					core_sql_op_set(op, CALLCOL_CALLEE_CID_NUM, number);
 				}
 			}
 		}
 		break;
 	case SWITCH_EVENT_CHANNEL_CALLSTATE:
 		{
-			new_sql() = switch_mprintf("update channels set callstate='%q' where uuid='%q' and hostname='%q'",
-									   switch_event_get_header_nil(event, "channel-call-state"),
-									   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
+			new_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+			core_sql_op_set(op, CCOL_CALLSTATE, switch_event_get_header_nil(event, "channel-call-state"));
 
 		}
 		break;
@@ -1226,25 +1767,21 @@ static void core_event_handler(switch_event_t *event)
 											   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
 					free(extra_cols);
 				} else {
-					new_sql() = switch_mprintf("update channels set state='%s',cid_name='%q',cid_num='%q',"
-											   "ip_addr='%s',dest='%q',dialplan='%q',context='%q',presence_id='%q',presence_data='%q' "
-											   "where uuid='%s' and hostname='%q'",
-											   switch_event_get_header_nil(event, "channel-state"),
-											   switch_event_get_header_nil(event, "caller-caller-id-name"),
-											   switch_event_get_header_nil(event, "caller-caller-id-number"),
-											   switch_event_get_header_nil(event, "caller-network-addr"),
-											   switch_event_get_header_nil(event, "caller-destination-number"),
-											   switch_event_get_header_nil(event, "caller-dialplan"),
-											   switch_event_get_header_nil(event, "caller-context"),
-											   switch_event_get_header_nil(event, "channel-presence-id"),
-											   switch_event_get_header_nil(event, "channel-presence-data"),
-											   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
+					new_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+					core_sql_op_set(op, CCOL_STATE, switch_event_get_header_nil(event, "channel-state"));
+					core_sql_op_set(op, CCOL_CID_NAME, switch_event_get_header_nil(event, "caller-caller-id-name"));
+					core_sql_op_set(op, CCOL_CID_NUM, switch_event_get_header_nil(event, "caller-caller-id-number"));
+					core_sql_op_set(op, CCOL_IP_ADDR, switch_event_get_header_nil(event, "caller-network-addr"));
+					core_sql_op_set(op, CCOL_DEST, switch_event_get_header_nil(event, "caller-destination-number"));
+					core_sql_op_set(op, CCOL_DIALPLAN, switch_event_get_header_nil(event, "caller-dialplan"));
+					core_sql_op_set(op, CCOL_CONTEXT, switch_event_get_header_nil(event, "caller-context"));
+					core_sql_op_set(op, CCOL_PRESENCE_ID, switch_event_get_header_nil(event, "channel-presence-id"));
+					core_sql_op_set(op, CCOL_PRESENCE_DATA, switch_event_get_header_nil(event, "channel-presence-data"));
 				}
 				break;
 			default:
-				new_sql() = switch_mprintf("update channels set state='%s' where uuid='%s' and hostname='%q'",
-										   switch_event_get_header_nil(event, "channel-state"),
-										   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
+				new_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+				core_sql_op_set(op, CCOL_STATE, switch_event_get_header_nil(event, "channel-state"));
 				break;
 			}
 
@@ -1255,6 +1792,7 @@ static void core_event_handler(switch_event_t *event)
 	case SWITCH_EVENT_CHANNEL_BRIDGE:
 		{
 			const char *callee_cid_name, *callee_cid_num, *direction;
+			char epoch[32];
 
 			direction = switch_event_get_header(event, "other-leg-direction");
 
@@ -1267,33 +1805,27 @@ static void core_event_handler(switch_event_t *event)
 			}
 
 
-			new_sql() = switch_mprintf("update channels set call_uuid='%q' where uuid='%s' and hostname='%q'",
-									   switch_event_get_header_nil(event, "channel-call-uuid"),
-									   switch_event_get_header_nil(event, "unique-id"), switch_core_get_variable("hostname"));
-			new_sql() = switch_mprintf("insert into calls (call_uuid,call_created,call_created_epoch,function,caller_cid_name,"
-									   "caller_cid_num,caller_dest_num,caller_chan_name,caller_uuid,callee_cid_name,"
-									   "callee_cid_num,callee_dest_num,callee_chan_name,callee_uuid,hostname) "
-									   "values ('%s', '%s', '%ld', '%s','%q','%q','%q','%q','%s','%q','%q','%q','%q','%s','%q')",
-									   switch_event_get_header_nil(event, "channel-call-uuid"),
-									   switch_event_get_header_nil(event, "event-date-local"),
-									   (long) switch_epoch_time_now(NULL),
-									   switch_event_get_header_nil(event, "event-calling-function"),
-									   switch_event_get_header_nil(event, "caller-caller-id-name"),
-									   switch_event_get_header_nil(event, "caller-caller-id-number"),
-									   switch_event_get_header_nil(event, "caller-destination-number"),
-									   switch_event_get_header_nil(event, "caller-channel-name"),
-									   switch_event_get_header_nil(event, "caller-unique-id"),
-									   callee_cid_name,
-									   callee_cid_num,
-									   switch_event_get_header_nil(event, "Other-Leg-destination-number"),
-									   switch_event_get_header_nil(event, "Other-Leg-channel-name"),
-									   switch_event_get_header_nil(event, "Other-Leg-unique-id"), switch_core_get_variable("hostname")
-									   );
+			new_op(CSO_UPDATE, switch_event_get_header_nil(event, "unique-id"));
+			core_sql_op_set(op, CCOL_CALL_UUID, switch_event_get_header_nil(event, "channel-call-uuid"));
+			switch_snprintf(epoch, sizeof(epoch), "%ld", (long) switch_epoch_time_now(NULL));
+			new_call_op(CSO_INSERT, switch_event_get_header_nil(event, "caller-unique-id"));
+			core_sql_op_set(op, CALLCOL_CALL_UUID, switch_event_get_header_nil(event, "channel-call-uuid"));
+			core_sql_op_set(op, CALLCOL_CALL_CREATED, switch_event_get_header_nil(event, "event-date-local"));
+			core_sql_op_set(op, CALLCOL_CALL_CREATED_EPOCH, epoch);
+			core_sql_op_set(op, CALLCOL_FUNCTION, switch_event_get_header_nil(event, "event-calling-function"));
+			core_sql_op_set(op, CALLCOL_CALLER_CID_NAME, switch_event_get_header_nil(event, "caller-caller-id-name"));
+			core_sql_op_set(op, CALLCOL_CALLER_CID_NUM, switch_event_get_header_nil(event, "caller-caller-id-number"));
+			core_sql_op_set(op, CALLCOL_CALLER_DEST_NUM, switch_event_get_header_nil(event, "caller-destination-number"));
+			core_sql_op_set(op, CALLCOL_CALLER_CHAN_NAME, switch_event_get_header_nil(event, "caller-channel-name"));
+			core_sql_op_set(op, CALLCOL_CALLEE_CID_NAME, callee_cid_name);
+			core_sql_op_set(op, CALLCOL_CALLEE_CID_NUM, callee_cid_num);
+			core_sql_op_set(op, CALLCOL_CALLEE_DEST_NUM, switch_event_get_header_nil(event, "Other-Leg-destination-number"));
+			core_sql_op_set(op, CALLCOL_CALLEE_CHAN_NAME, switch_event_get_header_nil(event, "Other-Leg-channel-name"));
+			core_sql_op_set(op, CALLCOL_CALLEE_UUID, switch_event_get_header_nil(event, "Other-Leg-unique-id"));
 		}
 		break;
 	case SWITCH_EVENT_CHANNEL_UNBRIDGE:
-		new_sql() = switch_mprintf("delete from calls where caller_uuid='%s' and hostname='%q'",
-								   switch_event_get_header_nil(event, "caller-unique-id"), switch_core_get_variable("hostname"));
+		new_call_op(CSO_DELETE, switch_event_get_header_nil(event, "caller-unique-id"));
 		break;
 	case SWITCH_EVENT_SHUTDOWN:
 		new_sql() = switch_mprintf("delete from channels where hostname='%q';"
@@ -1339,9 +1871,8 @@ static void core_event_handler(switch_event_t *event)
 			if (zstr(type)) {
 				break;
 			}
-			new_sql() = switch_mprintf("update channels set secure='%s' where uuid='%s' and hostname='%q'",
-									   type, switch_event_get_header_nil(event, "caller-unique-id"), switch_core_get_variable("hostname")
-									   );
+			new_op(CSO_UPDATE, switch_event_get_header_nil(event, "caller-unique-id"));
+			core_sql_op_set(op, CCOL_SECURE, type);
 			break;
 		}
 	case SWITCH_EVENT_NAT:
@@ -1374,14 +1905,28 @@ static void core_event_handler(switch_event_t *event)
 		int i = 0;
 
 		for (i = 0; i < sql_idx; i++) {
+			op = core_sql_op_new(CSO_SQL, NULL, NULL);
+			op->sql = sql[i];
 			if (switch_stristr("update channels", sql[i]) || switch_stristr("delete from channels", sql[i])) {
-				switch_queue_push(sql_manager.sql_queue[1], sql[i]);
+				/* also covers the uuid rename and shutdown sql that touch the calls table */
+				op->barrier = 1;
+				switch_queue_push(sql_manager.sql_queue[1], op);
 			} else {
-				switch_queue_push(sql_manager.sql_queue[0], sql[i]);
+				switch_queue_push(sql_manager.sql_queue[0], op);
 			}
 			sql[i] = NULL;
 		}
 	}
+
+	if (op_idx) {
+		int i = 0;
+
+		/* channel inserts go ahead of updates and deletes and call rows stay on the insert queue, just like the sql they replace */
+		for (i = 0; i < op_idx; i++) {
+			switch_queue_push(sql_manager.sql_queue[ops[i]->type == CSO_INSERT || ops[i]->table == &CALLS_TABLE ? 0 : 1], ops[i]);
+			ops[i] = NULL;
+		}
+	}
 }
 
 
@@ -36,6 +36,7 @@
 #include <switch_event.h>
 
 #define DISPATCH_QUEUE_LEN 5000
+#define SUBCLASS_INDEX_MAX 4096
 //#define DEBUG_DISPATCH_QUEUES
 
 /*! \brief A node to store binded events */
@@ -70,6 +71,18 @@ static char hostname[128] = "";
 static char guess_ip_v4[80] = "";
 static char guess_ip_v6[80] = "";
 static switch_event_node_t *EVENT_NODES[SWITCH_EVENT_ALL + 1] = { NULL };
+/* bindings with a subclass are kept apart so events without a subclass never have to look at them */
+static switch_event_node_t *SUBCLASS_NODES[SWITCH_EVENT_ALL + 1] = { NULL };
+/* per event id and subclass name, the subclass bindings that can match it, rebuilt when SUBCLASS_GEN moves */
+typedef struct {
+	uint32_t gen;
+	uint32_t count;
+	switch_event_node_t **nodes;
+} subclass_index_t;
+static switch_hash_t *SUBCLASS_INDEX = NULL;
+static switch_mutex_t *SUBCLASS_INDEX_MUTEX = NULL;
+static uint32_t SUBCLASS_INDEX_COUNT = 0;
+static uint32_t SUBCLASS_GEN = 1;
 static switch_thread_rwlock_t *RWLOCK = NULL;
 static switch_mutex_t *BLOCK = NULL;
 static switch_mutex_t *POOL_LOCK = NULL;
@@ -87,7 +100,6 @@ static int THREAD_COUNT = 0;
 static int SYSTEM_RUNNING = 0;
 #ifdef SWITCH_EVENT_RECYCLE
 static switch_queue_t *EVENT_RECYCLE_QUEUE = NULL;
-static switch_queue_t *EVENT_HEADER_RECYCLE_QUEUE = NULL;
 #endif
 static void launch_dispatch_threads(uint32_t max, int len, switch_memory_pool_t *pool);
 
@@ -279,6 +291,27 @@ static void *SWITCH_THREAD_FUNC switch_event_dispatch_thread(switch_thread_t *th
 }
 
 
+/* 
+   Pick the dispatch queue for an event.  Everything about one channel goes to the same queue
+   so its events are delivered in the order they were fired, other events are spread by type.
+*/
+static uint32_t switch_event_shard(switch_event_t *event)
+{
+	const char *key;
+	switch_ssize_t klen = -1;
+	uint32_t max = SOFT_MAX_DISPATCH;
+
+	if (max < 2) {
+		return 0;
+	}
+
+	if ((key = switch_event_get_header(event, "Unique-ID")) || (key = event->subclass_name)) {
+		return (uint32_t) (switch_ci_hashfunc_default(key, &klen) % max);
+	}
+
+	return (uint32_t) event->event_id % max;
+}
+
 static void *SWITCH_THREAD_FUNC switch_event_thread(switch_thread_t *thread, void *obj)
 {
 	switch_queue_t *queue = (switch_queue_t *) obj;
@@ -312,35 +345,13 @@ static void *SWITCH_THREAD_FUNC switch_event_thread(switch_thread_t *thread, voi
 		}
 
 		event = (switch_event_t *) pop;
+		index = switch_event_shard(event);
 
-		while (event) {
-			int max;
-
-			switch_mutex_lock(EVENT_QUEUE_MUTEX);
-			max = SOFT_MAX_DISPATCH;
-			switch_mutex_unlock(EVENT_QUEUE_MUTEX);
-
-			for (index = 0; (int)index < max; index++) {
-				if (switch_queue_trypush(EVENT_DISPATCH_QUEUE[index], event) == SWITCH_STATUS_SUCCESS) {
-					event = NULL;
-					break;
-				}
-			}
-
-			if (event) {
-				switch_mutex_lock(EVENT_QUEUE_MUTEX);
-				if (SOFT_MAX_DISPATCH + 1 < MAX_DISPATCH) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Adding a new event thread #%d\n", SOFT_MAX_DISPATCH + 1);
-					launch_dispatch_threads(SOFT_MAX_DISPATCH + 1, DISPATCH_QUEUE_LEN, RUNTIME_POOL);
-				} else {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Event threads maxed out at %d.\n", SOFT_MAX_DISPATCH);
-					switch_yield(1000000);
-				}
-				switch_mutex_unlock(EVENT_QUEUE_MUTEX);
-			}
-			
-
-			switch_cond_next();
+		/* a full shard makes us wait, that keeps each channel's events in order and slows the producers down
+		   instead of losing events the cdr, event socket and core db depend on */
+		if (switch_queue_push(EVENT_DISPATCH_QUEUE[index], event) != SWITCH_STATUS_SUCCESS) {
+			/* only when shutdown interrupts the queue */
+			switch_event_destroy(&event);
 		}
 	}
 
@@ -354,10 +365,65 @@ static void *SWITCH_THREAD_FUNC switch_event_thread(switch_thread_t *thread, voi
 }
 
 
+/*
+   Look up the subclass bindings of event id e that can match subclass name.  Must be called with RWLOCK read locked,
+   bindings only change under the write lock and bump SUBCLASS_GEN so an entry that is in use is never rebuilt.
+*/
+static subclass_index_t *subclass_index_get(switch_event_types_t e, const char *name)
+{
+	subclass_index_t *idx;
+	switch_event_node_t *node;
+	char key[512];
+	uint32_t n = 0;
+
+	switch_snprintf(key, sizeof(key), "%d:%s", (int) e, name);
+
+	switch_mutex_lock(SUBCLASS_INDEX_MUTEX);
+
+	if (!(idx = switch_core_hash_find(SUBCLASS_INDEX, key))) {
+		if (SUBCLASS_INDEX_COUNT >= SUBCLASS_INDEX_MAX) {
+			switch_mutex_unlock(SUBCLASS_INDEX_MUTEX);
+			return NULL;
+		}
+		switch_zmalloc(idx, sizeof(*idx));
+		switch_core_hash_insert(SUBCLASS_INDEX, key, idx);
+		SUBCLASS_INDEX_COUNT++;
+	}
+
+	if (idx->gen != SUBCLASS_GEN) {
+		for (node = SUBCLASS_NODES[e]; node; node = node->next) {
+			n++;
+		}
+
+		switch_safe_free(idx->nodes);
+		idx->count = 0;
+
+		if (n) {
+			switch_zmalloc(idx->nodes, n * sizeof(*idx->nodes));
+			for (node = SUBCLASS_NODES[e]; node; node = node->next) {
+				const char *bname = node->subclass ? node->subclass->name : NULL;
+
+				/* file: and func: bindings depend on headers, everything else is a substring of the subclass name */
+				if (!bname || !strncasecmp(bname, "file:", 5) || !strncasecmp(bname, "func:", 5) || strstr(name, bname)) {
+					idx->nodes[idx->count++] = node;
+				}
+			}
+		}
+
+		idx->gen = SUBCLASS_GEN;
+	}
+
+	switch_mutex_unlock(SUBCLASS_INDEX_MUTEX);
+
+	return idx;
+}
+
 SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event)
 {
 	switch_event_types_t e;
 	switch_event_node_t *node;
+	subclass_index_t *idx;
+	uint32_t i;
 
 	if (SYSTEM_RUNNING) {
 		switch_thread_rwlock_rdlock(RWLOCK);
@@ -369,6 +435,25 @@ SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event)
 				}
 			}
 
+			if ((*event)->subclass_name && SUBCLASS_NODES[e]) {
+				if ((idx = subclass_index_get(e, (*event)->subclass_name))) {
+					for (i = 0; i < idx->count; i++) {
+						node = idx->nodes[i];
+						if (switch_events_match(*event, node)) {
+							(*event)->bind_user_data = node->user_data;
+							node->callback(*event);
+						}
+					}
+				} else {
+					for (node = SUBCLASS_NODES[e]; node; node = node->next) {
+						if (switch_events_match(*event, node)) {
+							(*event)->bind_user_data = node->user_data;
+							node->callback(*event);
+						}
+					}
+				}
+			}
+
 			if (e == SWITCH_EVENT_ALL) {
 				break;
 			}
@@ -470,13 +555,6 @@ SWITCH_DECLARE(void) switch_core_memory_reclaim_events(void)
 	size = switch_queue_size(EVENT_RECYCLE_QUEUE);
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %d recycled event(s) %d bytes\n", size, (int) sizeof(switch_event_t) * size);
-	size = switch_queue_size(EVENT_HEADER_RECYCLE_QUEUE);
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %d recycled event header(s) %d bytes\n",
-					  size, (int) sizeof(switch_event_header_t) * size);
-
-	while (switch_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		free(pop);
-	}
 	while (switch_queue_trypop(EVENT_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
 		free(pop);
 	}
@@ -557,6 +635,18 @@ SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 	}
 
 	switch_core_hash_destroy(&CUSTOM_HASH);
+
+	for (hi = switch_hash_first(NULL, SUBCLASS_INDEX); hi; hi = switch_hash_next(hi)) {
+		subclass_index_t *idx;
+		switch_hash_this(hi, &var, NULL, &val);
+		if ((idx = (subclass_index_t *) val)) {
+			switch_safe_free(idx->nodes);
+			free(idx);
+		}
+	}
+
+	switch_core_hash_destroy(&SUBCLASS_INDEX);
+	SUBCLASS_INDEX_COUNT = 0;
 	switch_core_memory_reclaim_events();
 
 	return SWITCH_STATUS_SUCCESS;
@@ -610,6 +700,8 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 	switch_mutex_init(&POOL_LOCK, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_mutex_init(&EVENT_QUEUE_MUTEX, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_core_hash_init(&CUSTOM_HASH, RUNTIME_POOL);
+	switch_mutex_init(&SUBCLASS_INDEX_MUTEX, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
+	switch_core_hash_init_case(&SUBCLASS_INDEX, RUNTIME_POOL, SWITCH_TRUE);
 
 	switch_mutex_lock(EVENT_QUEUE_MUTEX);
 	SYSTEM_RUNNING = -1;
@@ -626,13 +718,13 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 	switch_queue_create(&EVENT_QUEUE[2], POOL_COUNT_MAX + 10, THRUNTIME_POOL);
 #ifdef SWITCH_EVENT_RECYCLE
 	switch_queue_create(&EVENT_RECYCLE_QUEUE, 250000, THRUNTIME_POOL);
-	switch_queue_create(&EVENT_HEADER_RECYCLE_QUEUE, 250000, THRUNTIME_POOL);
 #endif
 
 	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 	switch_threadattr_priority_increase(thd_attr);
 
-	launch_dispatch_threads(1, DISPATCH_QUEUE_LEN, RUNTIME_POOL);
+	/* the dispatch queues are shards, their number can't change once events start flowing */
+	launch_dispatch_threads(switch_core_cpu_count() < MAX_DISPATCH ? switch_core_cpu_count() : MAX_DISPATCH, DISPATCH_QUEUE_LEN, RUNTIME_POOL);
 	switch_thread_create(&EVENT_QUEUE_THREADS[0], thd_attr, switch_event_thread, EVENT_QUEUE[0], RUNTIME_POOL);
 	switch_thread_create(&EVENT_QUEUE_THREADS[1], thd_attr, switch_event_thread, EVENT_QUEUE[1], RUNTIME_POOL);
 	switch_thread_create(&EVENT_QUEUE_THREADS[2], thd_attr, switch_event_thread, EVENT_QUEUE[2], RUNTIME_POOL);
@@ -698,6 +790,194 @@ SWITCH_DECLARE(switch_status_t) switch_event_set_priority(switch_event_t *event,
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* header storage flags */
+#define EHF_VALUE_EXTERN (1 << 0)	/* the value was handed to us already allocated, it is freed on its own */
+#define EHF_ARENA (1 << 1)			/* the header lives in event->arena and is released with the event */
+
+/* headers are indexed once an event carries this many of them, below that a list walk is cheaper */
+#define EVENT_INDEX_MIN_HEADERS 16
+
+#define EVENT_HEADER_ALIGN(_l) (((_l) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static switch_event_header_t *event_index_find(switch_event_t *event, const char *header_name, unsigned long hash, uint32_t *pos)
+{
+	uint32_t mask = event->index_size - 1;
+	uint32_t i = (uint32_t) (hash & mask);
+	switch_event_header_t *hp;
+
+	while ((hp = event->index[i])) {
+		if (hp->hash == hash && !strcasecmp(hp->name, header_name)) {
+			break;
+		}
+		i = (i + 1) & mask;
+	}
+
+	if (pos) {
+		*pos = i;
+	}
+
+	return hp;
+}
+
+static void event_index_build(switch_event_t *event)
+{
+	switch_event_header_t *hp;
+	uint32_t pos, size = 64;
+
+	while (size < event->header_count * 4) {
+		size <<= 1;
+	}
+
+	FREE(event->index);
+	switch_zmalloc(event->index, size * sizeof(switch_event_header_t *));
+	event->index_size = size;
+
+	/* the index always points at the first header of a given name, that's the one switch_event_get_header returns */
+	for (hp = event->headers; hp; hp = hp->next) {
+		if (!event_index_find(event, hp->name, hp->hash, &pos)) {
+			event->index[pos] = hp;
+		}
+	}
+}
+
+static void event_index_add(switch_event_t *event, switch_event_header_t *header, int top)
+{
+	uint32_t pos;
+
+	if (!event->index) {
+		if (event->header_count >= EVENT_INDEX_MIN_HEADERS) {
+			event_index_build(event);
+		}
+		return;
+	}
+
+	if (event->header_count * 2 > event->index_size) {
+		event_index_build(event);
+		return;
+	}
+
+	if (!event_index_find(event, header->name, header->hash, &pos) || top) {
+		event->index[pos] = header;
+	}
+}
+
+static void event_index_del(switch_event_t *event, switch_event_header_t *header)
+{
+	switch_event_header_t *hp;
+	uint32_t pos, next, home, mask;
+
+	if (!event->index || event_index_find(event, header->name, header->hash, &pos) != header) {
+		return;
+	}
+
+	/* a later header with the same name becomes the first one */
+	if (!switch_test_flag(event, EF_UNIQ_HEADERS)) {
+		for (hp = header->next; hp; hp = hp->next) {
+			if (hp->hash == header->hash && !strcasecmp(hp->name, header->name)) {
+				event->index[pos] = hp;
+				return;
+			}
+		}
+	}
+
+	/* backward shift deletion, keeps the probe chains intact without tombstones */
+	mask = event->index_size - 1;
+	event->index[pos] = NULL;
+
+	for (next = (pos + 1) & mask; (hp = event->index[next]); next = (next + 1) & mask) {
+		home = (uint32_t) (hp->hash & mask);
+		if ((next > pos && (home <= pos || home > next)) || (next < pos && home <= pos && home > next)) {
+			event->index[pos] = hp;
+			event->index[next] = NULL;
+			pos = next;
+		}
+	}
+}
+
+static void event_link_header(switch_event_t *event, switch_event_header_t *header, switch_stack_t stack)
+{
+	if ((stack & SWITCH_STACK_TOP)) {
+		header->prev = NULL;
+		header->next = event->headers;
+		if (event->headers) {
+			event->headers->prev = header;
+		}
+		event->headers = header;
+		if (!event->last_header) {
+			event->last_header = header;
+		}
+	} else {
+		header->next = NULL;
+		header->prev = event->last_header;
+		if (event->last_header) {
+			event->last_header->next = header;
+		} else {
+			event->headers = header;
+		}
+		event->last_header = header;
+	}
+
+	event->header_count++;
+	event_index_add(event, header, (stack & SWITCH_STACK_TOP));
+}
+
+static void event_unlink_header(switch_event_t *event, switch_event_header_t *header)
+{
+	event_index_del(event, header);
+
+	if (header->prev) {
+		header->prev->next = header->next;
+	} else {
+		event->headers = header->next;
+	}
+
+	if (header->next) {
+		header->next->prev = header->prev;
+	} else {
+		event->last_header = header->prev;
+	}
+
+	event->header_count--;
+}
+
+static void event_free_header(switch_event_header_t *header)
+{
+	if ((header->flags & EHF_VALUE_EXTERN)) {
+		FREE(header->value);
+	}
+
+	if (!(header->flags & EHF_ARENA)) {
+		FREE(header);
+	}
+}
+
+/* the name (and the value unless we are adopting it) are stored in the same allocation as the header */
+static switch_event_header_t *event_new_header(const char *header_name, const char *data, switch_bool_t adopt)
+{
+	switch_event_header_t *header;
+	switch_size_t nlen = strlen(header_name) + 1, vlen = adopt ? 0 : strlen(data) + 1;
+	switch_ssize_t hlen = -1;
+
+	header = ALLOC(sizeof(*header) + nlen + vlen);
+	switch_assert(header);
+	memset(header, 0, sizeof(*header));
+
+	header->name = (char *) (header + 1);
+	memcpy(header->name, header_name, nlen);
+
+	if (adopt) {
+		header->value = (char *) data;
+		header->flags |= EHF_VALUE_EXTERN;
+	} else {
+		header->value = header->name + nlen;
+		memcpy(header->value, data, vlen);
+	}
+
+	header->hash = switch_ci_hashfunc_default(header->name, &hlen);
+
+	return header;
+}
+
 SWITCH_DECLARE(char *) switch_event_get_header(switch_event_t *event, const char *header_name)
 {
 	switch_event_header_t *hp;
@@ -711,6 +991,10 @@ SWITCH_DECLARE(char *) switch_event_get_header(switch_event_t *event, const char
 
 	hash = switch_ci_hashfunc_default(header_name, &hlen);
 
+	if (event->index) {
+		return (hp = event_index_find(event, header_name, hash, NULL)) ? hp->value : NULL;
+	}
+
 	for (hp = event->headers; hp; hp = hp->next) {
 		if ((!hp->hash || hash == hp->hash) && !strcasecmp(hp->name, header_name)) {
 			return hp->value;
@@ -726,95 +1010,54 @@ SWITCH_DECLARE(char *) switch_event_get_body(switch_event_t *event)
 
 SWITCH_DECLARE(switch_status_t) switch_event_del_header_val(switch_event_t *event, const char *header_name, const char *val)
 {
-	switch_event_header_t *hp, *lp = NULL, *tp;
+	switch_event_header_t *hp, *tp;
 	switch_status_t status = SWITCH_STATUS_FALSE;
-	int x = 0;
 	switch_ssize_t hlen = -1;
 	unsigned long hash = 0;
 
-	tp = event->headers;
+	hash = switch_ci_hashfunc_default(header_name, &hlen);
+
+	if (event->index) {
+		/* nothing before the indexed header can match */
+		tp = event_index_find(event, header_name, hash, NULL);
+	} else {
+		tp = event->headers;
+	}
+
 	while (tp) {
 		hp = tp;
 		tp = tp->next;
 
-		x++;
-		switch_assert(x < 1000);
-		hash = switch_ci_hashfunc_default(header_name, &hlen);
-
 		if ((!hp->hash || hash == hp->hash) && !strcasecmp(header_name, hp->name) && (zstr(val) || !strcmp(hp->value, val))) {
-			if (lp) {
-				lp->next = hp->next;
-			} else {
-				event->headers = hp->next;
-			}
-			if (hp == event->last_header || !hp->next) {
-				event->last_header = lp;
-			}
-			FREE(hp->name);
-			FREE(hp->value);
-			memset(hp, 0, sizeof(*hp));
-#ifdef SWITCH_EVENT_RECYCLE
-			if (switch_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, hp) != SWITCH_STATUS_SUCCESS) {
-				FREE(hp);
-			}
-#else
-			FREE(hp);
-#endif
+			event_unlink_header(event, hp);
+			event_free_header(hp);
 			status = SWITCH_STATUS_SUCCESS;
-		} else {
-			lp = hp;
 		}
 	}
 
 	return status;
 }
 
-switch_status_t switch_event_base_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name, char *data)
+static switch_status_t switch_event_base_add_header_detailed(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *data,
+															 switch_bool_t adopt)
 {
 	switch_event_header_t *header;
-	switch_ssize_t hlen = -1;
-
-#ifdef SWITCH_EVENT_RECYCLE
-	void *pop;
-	if (switch_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS) {
-		header = (switch_event_header_t *) pop;
-	} else {
-#endif
-		header = ALLOC(sizeof(*header));
-		switch_assert(header);
-#ifdef SWITCH_EVENT_RECYCLE
-	}
-#endif
 
 	if (switch_test_flag(event, EF_UNIQ_HEADERS)) {
 		switch_event_del_header(event, header_name);
 	}
 
-	memset(header, 0, sizeof(*header));
-
-	header->name = DUP(header_name);
-	header->value = data;
-	header->hash = switch_ci_hashfunc_default(header->name, &hlen);
-
-	if ((stack & SWITCH_STACK_TOP)) {
-		header->next = event->headers;
-		event->headers = header;
-		if (!event->last_header) {
-			event->last_header = header;
-		}
-	} else {
-		if (event->last_header) {
-			event->last_header->next = header;
-		} else {
-			event->headers = header;
-			header->next = NULL;
-		}
-		event->last_header = header;
-	}
+	header = event_new_header(header_name, data, adopt);
+	event_link_header(event, header, stack);
 
 	return SWITCH_STATUS_SUCCESS;
 }
 
+switch_status_t switch_event_base_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name, char *data)
+{
+	return switch_event_base_add_header_detailed(event, stack, header_name, data, SWITCH_TRUE);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *fmt, ...)
 {
 	int ret = 0;
@@ -847,7 +1090,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_set_subclass_name(switch_event_t *e
 SWITCH_DECLARE(switch_status_t) switch_event_add_header_string(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *data)
 {
 	if (data) {
-		return switch_event_base_add_header(event, stack, header_name, (stack & SWITCH_STACK_NODUP) ? (char *)data : DUP(data));
+		return switch_event_base_add_header_detailed(event, stack, header_name, data, (stack & SWITCH_STACK_NODUP) ? SWITCH_TRUE : SWITCH_FALSE);
 	}
 	return SWITCH_STATUS_GENERR;
 }
@@ -884,18 +1127,10 @@ SWITCH_DECLARE(void) switch_event_destroy(switch_event_t **event)
 		for (hp = ep->headers; hp;) {
 			this = hp;
 			hp = hp->next;
-			FREE(this->name);
-			FREE(this->value);
-#ifdef SWITCH_EVENT_RECYCLE
-			if (switch_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, this) != SWITCH_STATUS_SUCCESS) {
-				FREE(this);
-			}
-#else
-			FREE(this);
-#endif
-
-
+			event_free_header(this);
 		}
+		FREE(ep->index);
+		FREE(ep->arena);
 		FREE(ep->body);
 		FREE(ep->subclass_name);
 #ifdef SWITCH_EVENT_RECYCLE
@@ -924,7 +1159,9 @@ SWITCH_DECLARE(void) switch_event_merge(switch_event_t *event, switch_event_t *t
 
 SWITCH_DECLARE(switch_status_t) switch_event_dup(switch_event_t **event, switch_event_t *todup)
 {
-	switch_event_header_t *hp;
+	switch_event_header_t *hp, *header;
+	switch_size_t len = 0, nlen, vlen;
+	char *p;
 
 	if (switch_event_create_subclass(event, SWITCH_EVENT_CLONE, todup->subclass_name) != SWITCH_STATUS_SUCCESS) {
 		return SWITCH_STATUS_GENERR;
@@ -934,11 +1171,41 @@ SWITCH_DECLARE(switch_status_t) switch_event_dup(switch_event_t **event, switch_
 	(*event)->event_user_data = todup->event_user_data;
 	(*event)->bind_user_data = todup->bind_user_data;
 	(*event)->flags = todup->flags;
+
+	/* copy all the headers into a single block rather than doing three allocations for every one of them */
 	for (hp = todup->headers; hp; hp = hp->next) {
 		if (todup->subclass_name && !strcmp(hp->name, "Event-Subclass")) {
 			continue;
 		}
-		switch_event_add_header_string(*event, SWITCH_STACK_BOTTOM, hp->name, hp->value);
+		len += EVENT_HEADER_ALIGN(sizeof(*hp) + strlen(hp->name) + strlen(hp->value) + 2);
+	}
+
+	if (len) {
+		(*event)->arena = p = ALLOC(len);
+		switch_assert(p);
+
+		for (hp = todup->headers; hp; hp = hp->next) {
+			if (todup->subclass_name && !strcmp(hp->name, "Event-Subclass")) {
+				continue;
+			}
+
+			nlen = strlen(hp->name) + 1;
+			vlen = strlen(hp->value) + 1;
+
+			header = (switch_event_header_t *) p;
+			memset(header, 0, sizeof(*header));
+			header->name = (char *) (header + 1);
+			memcpy(header->name, hp->name, nlen);
+			header->value = header->name + nlen;
+			memcpy(header->value, hp->value, vlen);
+			header->hash = hp->hash;
+			header->flags = EHF_ARENA;
+
+			p += EVENT_HEADER_ALIGN(sizeof(*header) + nlen + vlen);
+
+			/* the source headers are already unique and ordered, no need to go through the uniq check */
+			event_link_header(*event, header, SWITCH_STACK_BOTTOM);
+		}
 	}
 
 	if (todup->body) {
@@ -952,111 +1219,58 @@ SWITCH_DECLARE(switch_status_t) switch_event_dup(switch_event_t **event, switch_
 
 SWITCH_DECLARE(switch_status_t) switch_event_serialize(switch_event_t *event, char **str, switch_bool_t encode)
 {
-	switch_size_t len = 0;
+	switch_size_t len = 0, dlen = 0, blen = 0, nlen;
 	switch_event_header_t *hp;
-	switch_size_t llen = 0, dlen = 0, blocksize = 512, encode_len = 1536, new_len = 0;
-	char *buf;
-	char *encode_buf = NULL;	/* used for url encoding of variables to make sure unsafe things stay out of the serialized copy */
+	char *buf, *value;
 
 	*str = NULL;
 
-	dlen = blocksize * 2;
+	/* 
+	 * size the whole thing up front (url encoding can turn one char into %XX so allow 3x every value)
+	 * so the string is built in place in a single buffer without any reallocs or intermediate copies.
+	 */
+	for (hp = event->headers; hp; hp = hp->next) {
+		dlen += strlen(hp->name) + (strlen(hp->value) * 3) + 12;
+	}
 
-	if (!(buf = malloc(dlen))) {
-		return SWITCH_STATUS_MEMERR;
+	if (event->body) {
+		blen = strlen(event->body);
+		dlen += blen + 32;
 	}
 
-	/* go ahead and give ourselves some space to work with, should save a few reallocs */
-	if (!(encode_buf = malloc(encode_len))) {
-		switch_safe_free(buf);
+	dlen += 2;
+
+	if (!(buf = malloc(dlen))) {
 		return SWITCH_STATUS_MEMERR;
 	}
 
-	/* switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "hit serialized!.\n"); */
 	for (hp = event->headers; hp; hp = hp->next) {
-		/*
-		 * grab enough memory to store 3x the string (url encode takes one char and turns it into %XX)
-		 * so we could end up with a string that is 3 times the originals length, unlikely but rather
-		 * be safe than destroy the string, also add one for the null.  And try to be smart about using 
-		 * the memory, allocate and only reallocate if we need more.  This avoids an alloc, free CPU
-		 * destroying loop.
-		 */
-
-		new_len = (strlen(hp->value) * 3) + 1;
-
-		if (encode_len < new_len) {
-			char *tmp;
-			/* switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Allocing %d was %d.\n", ((strlen(hp->value) * 3) + 1), encode_len); */
-			/* we can use realloc for initial alloc as well, if encode_buf is zero it treats it as a malloc */
-
-			/* keep track of the size of our allocation */
-			encode_len = new_len;
-
-			if (!(tmp = realloc(encode_buf, encode_len))) {
-				/* oh boy, ram's gone, give back what little we grabbed and bail */
-				switch_safe_free(buf);
-				switch_safe_free(encode_buf);
-				return SWITCH_STATUS_MEMERR;
-			}
-
-			encode_buf = tmp;
-		}
+		nlen = strlen(hp->name);
+		memcpy(buf + len, hp->name, nlen);
+		len += nlen;
+		buf[len++] = ':';
+		buf[len++] = ' ';
 
 		/* handle any bad things in the string like newlines : etc that screw up the serialized format */
+		value = buf + len;
 		if (encode) {
-			switch_url_encode(hp->value, encode_buf, encode_len);
+			switch_url_encode(hp->value, value, dlen - len);
 		} else {
-			switch_snprintf(encode_buf, encode_len, "[%s]", hp->value);
-		}
-
-		llen = strlen(hp->name) + strlen(encode_buf) + 8;
-
-		if ((len + llen) > dlen) {
-			char *m;
-			dlen += (blocksize + (len + llen));
-			if ((m = realloc(buf, dlen))) {
-				buf = m;
-			} else {
-				/* we seem to be out of memory trying to resize the serialize string, give back what we already have and give up */
-				switch_safe_free(buf);
-				switch_safe_free(encode_buf);
-				return SWITCH_STATUS_MEMERR;
-			}
+			switch_snprintf(value, dlen - len, "[%s]", hp->value);
 		}
 
-		switch_snprintf(buf + len, dlen - len, "%s: %s\n", hp->name, *encode_buf == '\0' ? "_undef_" : encode_buf);
-		len = strlen(buf);
-	}
-
-	/* we are done with the memory we used for encoding, give it back */
-	switch_safe_free(encode_buf);
-
-	if (event->body) {
-		int blen = (int) strlen(event->body);
-		llen = blen;
-
-		if (blen) {
-			llen += 25;
+		if (*value == '\0') {
+			memcpy(value, "_undef_", 7);
+			len += 7;
 		} else {
-			llen += 5;
+			len += strlen(value);
 		}
 
-		if ((len + llen) > dlen) {
-			char *m;
-			dlen += (blocksize + (len + llen));
-			if ((m = realloc(buf, dlen))) {
-				buf = m;
-			} else {
-				switch_safe_free(buf);
-				return SWITCH_STATUS_MEMERR;
-			}
-		}
+		buf[len++] = '\n';
+	}
 
-		if (blen) {
-			switch_snprintf(buf + len, dlen - len, "Content-Length: %d\n\n%s", blen, event->body);
-		} else {
-			switch_snprintf(buf + len, dlen - len, "\n");
-		}
+	if (blen) {
+		switch_snprintf(buf + len, dlen - len, "Content-Length: %d\n\n%s", (int) blen, event->body);
 	} else {
 		switch_snprintf(buf + len, dlen - len, "\n");
 	}
@@ -1329,6 +1543,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_fire_detailed(const char *file, con
 {
 
 	int index;
+	switch_time_t probe_start = switch_core_probe_start();
 
 	switch_assert(BLOCK != NULL);
 	switch_assert(RUNTIME_POOL != NULL);
@@ -1364,6 +1579,8 @@ SWITCH_DECLARE(switch_status_t) switch_event_fire_detailed(const char *file, con
 
 	*event = NULL;
 
+	switch_core_probe_end(SWITCH_PROBE_EVENT_FIRE, probe_start);
+
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -1393,6 +1610,8 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 	}
 
 	if (event <= SWITCH_EVENT_ALL) {
+		switch_event_node_t **list = subclass ? &SUBCLASS_NODES[event] : &EVENT_NODES[event];
+
 		switch_zmalloc(event_node, sizeof(*event_node));
 		switch_mutex_lock(BLOCK);
 		switch_thread_rwlock_wrlock(RWLOCK);
@@ -1403,11 +1622,14 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 		event_node->callback = callback;
 		event_node->user_data = user_data;
 
-		if (EVENT_NODES[event]) {
-			event_node->next = EVENT_NODES[event];
+		if (*list) {
+			event_node->next = *list;
 		}
 
-		EVENT_NODES[event] = event_node;
+		*list = event_node;
+		if (subclass) {
+			SUBCLASS_GEN++;
+		}
 		switch_thread_rwlock_unlock(RWLOCK);
 		switch_mutex_unlock(BLOCK);
 		/* </LOCKED> ----------------------------------------------- */
@@ -1433,28 +1655,32 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind(const char *id, switch_event_t
 SWITCH_DECLARE(switch_status_t) switch_event_unbind_callback(switch_event_callback_t callback)
 {
 	switch_event_node_t *n, *np, *lnp = NULL;
+	switch_event_node_t **list;
 	switch_status_t status = SWITCH_STATUS_FALSE;
-	int id;
+	int id, x;
 
 	switch_thread_rwlock_wrlock(RWLOCK);
 	switch_mutex_lock(BLOCK);
 	/* <LOCKED> ----------------------------------------------- */
-	for (id = 0; id <= SWITCH_EVENT_ALL; id++) {
+	for (x = 0; x < (SWITCH_EVENT_ALL + 1) * 2; x++) {
+		id = x % (SWITCH_EVENT_ALL + 1);
+		list = x > SWITCH_EVENT_ALL ? &SUBCLASS_NODES[id] : &EVENT_NODES[id];
 		lnp = NULL;
 
-		for (np = EVENT_NODES[id]; np;) {
+		for (np = *list; np;) {
 			n = np;
 			np = np->next;
 			if (n->callback == callback) {
 				if (lnp) {
 					lnp->next = n->next;
 				} else {
-					EVENT_NODES[n->event_id] = n->next;
+					*list = n->next;
 				}
 
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Event Binding deleted for %s:%s\n", n->id, switch_event_name(n->event_id));
 				FREE(n->id);
 				FREE(n);
+				SUBCLASS_GEN++;
 				status = SWITCH_STATUS_SUCCESS;
 			} else {
 				lnp = n;
@@ -1473,6 +1699,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind_callback(switch_event_callba
 SWITCH_DECLARE(switch_status_t) switch_event_unbind(switch_event_node_t **node)
 {
 	switch_event_node_t *n, *np, *lnp = NULL;
+	switch_event_node_t **list;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 
 	n = *node;
@@ -1484,17 +1711,20 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind(switch_event_node_t **node)
 	switch_thread_rwlock_wrlock(RWLOCK);
 	switch_mutex_lock(BLOCK);
 	/* <LOCKED> ----------------------------------------------- */
-	for (np = EVENT_NODES[n->event_id]; np; np = np->next) {
+	list = n->subclass ? &SUBCLASS_NODES[n->event_id] : &EVENT_NODES[n->event_id];
+
+	for (np = *list; np; np = np->next) {
 		if (np == n) {
 			if (lnp) {
 				lnp->next = n->next;
 			} else {
-				EVENT_NODES[n->event_id] = n->next;
+				*list = n->next;
 			}
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Event Binding deleted for %s:%s\n", n->id, switch_event_name(n->event_id));
 			n->subclass = NULL;
 			FREE(n->id);
 			FREE(n);
+			SUBCLASS_GEN++;
 			*node = NULL;
 			status = SWITCH_STATUS_SUCCESS;
 			break;
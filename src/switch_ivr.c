@@ -2145,6 +2145,8 @@ SWITCH_DECLARE(void) switch_ivr_delay_echo(switch_core_session_t *session, uint3
 	qlen = delay_ms / (interval);
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Setting delay to %dms (%d frames)\n", delay_ms, qlen);
 	jb = stfu_n_init(qlen);
+	/* an echo wants the full delay all the time, not an adaptive one */
+	stfu_n_set_delay_range(jb, qlen, qlen);
 
 	write_frame.codec = switch_core_session_get_read_codec(session);
 
@@ -159,6 +159,37 @@ struct switch_ivr_bridge_data {
 };
 typedef struct switch_ivr_bridge_data switch_ivr_bridge_data_t;
 
+/* the rtp packets of a can go straight out of b when nothing needs to see or change the audio */
+static switch_bool_t fast_relay_ready(switch_core_session_t *session_a, switch_core_session_t *session_b)
+{
+	switch_channel_t *chan_a = switch_core_session_get_channel(session_a);
+	switch_channel_t *chan_b = switch_core_session_get_channel(session_b);
+	switch_codec_implementation_t read_impl = { 0 }, write_impl = { 0 };
+
+	if (switch_channel_test_flag(chan_a, CF_HOLD) || switch_channel_test_flag(chan_b, CF_HOLD) ||
+		switch_channel_test_flag(chan_a, CF_SUSPEND) || switch_channel_test_flag(chan_b, CF_SUSPEND) ||
+		switch_channel_test_flag(chan_a, CF_BROADCAST) || switch_channel_test_flag(chan_b, CF_BROADCAST) ||
+		switch_channel_test_flag(chan_a, CF_VIDEO) || switch_channel_test_flag(chan_b, CF_VIDEO) ||
+		switch_core_media_bug_count(session_a) || switch_core_media_bug_count(session_b)) {
+		return SWITCH_FALSE;
+	}
+
+	/* bind_meta_app has to see the dtmf the read path would have handed it */
+	if (switch_channel_get_private(chan_a, "__dtmf_meta") || switch_channel_get_private(chan_b, "__dtmf_meta")) {
+		return SWITCH_FALSE;
+	}
+
+	if (switch_core_session_get_read_impl(session_a, &read_impl) != SWITCH_STATUS_SUCCESS ||
+		switch_core_session_get_write_impl(session_b, &write_impl) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_FALSE;
+	}
+
+	return (read_impl.ianacode == write_impl.ianacode && !strcasecmp(read_impl.iananame, write_impl.iananame) &&
+			read_impl.samples_per_second == write_impl.samples_per_second &&
+			read_impl.microseconds_per_packet == write_impl.microseconds_per_packet &&
+			read_impl.number_of_channels == write_impl.number_of_channels) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
 static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 {
 	switch_ivr_bridge_data_t *data = obj;
@@ -181,6 +212,8 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 	const char *bridge_answer_timeout = NULL;
 	int answer_timeout, sent_update = 0;
 	time_t answer_limit = 0;
+	int fast_relay = 0, relaying = 0;
+	switch_rtp_t *relay_rtp = NULL;
 
 #ifdef SWITCH_VIDEO_IN_THREADS
 	switch_thread_t *vid_thread = NULL;
@@ -213,6 +246,9 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 
 	inner_bridge = switch_channel_test_flag(chan_a, CF_INNER_BRIDGE);
 
+	fast_relay = !inner_bridge && (switch_true(switch_channel_get_variable(chan_a, "bridge_fast_relay")) ||
+								   switch_true(switch_channel_get_variable(chan_b, "bridge_fast_relay")));
+
 	if (!switch_channel_test_flag(chan_a, CF_ANSWERED) && (bridge_answer_timeout = switch_channel_get_variable(chan_a, "bridge_answer_timeout"))) {
 		if ((answer_timeout = atoi(bridge_answer_timeout)) < 0) {
 			answer_timeout = 0;
@@ -450,6 +486,45 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 		}
 #endif
 
+		if (fast_relay) {
+			if (loop_count > DEFAULT_LEAD_FRAMES && ans_a && ans_b && !silence_val && !input_callback && !data->skip_frames &&
+				fast_relay_ready(session_a, session_b)) {
+				if (!relaying) {
+					switch_rtp_t *rtp_a = switch_channel_get_private(chan_a, "__rtp_audio_session");
+					switch_rtp_t *rtp_b = switch_channel_get_private(chan_b, "__rtp_audio_session");
+
+					if (rtp_a && rtp_b && switch_rtp_set_relay(rtp_a, rtp_b) == SWITCH_STATUS_SUCCESS) {
+						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session_a), SWITCH_LOG_DEBUG, "Fast relay from %s to %s\n",
+										  switch_channel_get_name(chan_a), switch_channel_get_name(chan_b));
+						relay_rtp = rtp_a;
+						relaying = 1;
+					}
+				}
+
+				if (relaying) {
+					/* the rtp reactor moves the audio, keep servicing signalling and the media timeout the read would have checked */
+					if (switch_rtp_relay_check(relay_rtp) == SWITCH_STATUS_SUCCESS) {
+						switch_yield(20000);
+						continue;
+					}
+
+					/* let the full read path find the timeout and hang up the way it always has */
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session_a), SWITCH_LOG_DEBUG, "Fast relay from %s has no media, back to full media\n",
+									  switch_channel_get_name(chan_a));
+					switch_rtp_set_relay(relay_rtp, NULL);
+					rtp_flush_read_buffer(relay_rtp, SWITCH_RTP_FLUSH_ONCE);
+					relaying = 0;
+					fast_relay = 0;
+				}
+			} else if (relaying) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session_a), SWITCH_LOG_DEBUG, "Fast relay from %s ended, back to full media\n",
+								  switch_channel_get_name(chan_a));
+				switch_rtp_set_relay(relay_rtp, NULL);
+				rtp_flush_read_buffer(relay_rtp, SWITCH_RTP_FLUSH_ONCE);
+				relaying = 0;
+			}
+		}
+
 		/* read audio from 1 channel and write it to the other */
 		status = switch_core_session_read_frame(session_a, &read_frame, SWITCH_IO_FLAG_NONE, stream_id);
 
@@ -483,6 +558,11 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 
   end_of_bridge_loop:
 
+	if (relaying) {
+		switch_rtp_set_relay(relay_rtp, NULL);
+		rtp_flush_read_buffer(relay_rtp, SWITCH_RTP_FLUSH_ONCE);
+	}
+
 #ifdef SWITCH_VIDEO_IN_THREADS
 	if (vid_thread) {
 		vh.up = -1;
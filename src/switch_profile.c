@@ -32,7 +32,8 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "switch.h"
-#include "switch_profile.h"
+#include "private/switch_core_pvt.h"
+#include <apr_atomic.h>
 
 #ifdef __linux__
 #include <stdio.h>
@@ -287,3 +288,280 @@ SWITCH_DECLARE(void) switch_delete_profile_timer(switch_profile_timer_t **p)
 }
 
 
+
+/*
+ * Latency probes
+ *
+ * Each probe keeps a log-linear histogram of microsecond samples: values below
+ * 32us get a bucket each, above that every power of two is split in 16 buckets,
+ * which keeps the reported percentiles within ~6% up to 64 seconds.
+ * Histograms are kept per cpu and only summed when dumped so recording is a
+ * couple of uncontended atomic ops.
+ */
+
+#define PROBE_SUB_BITS 4
+#define PROBE_SUB (1 << PROBE_SUB_BITS)
+#define PROBE_MAX_EXP 26
+#define PROBE_MAX_VALUE ((1 << PROBE_MAX_EXP) - 1)
+#define PROBE_BUCKETS ((PROBE_MAX_EXP - PROBE_SUB_BITS) * PROBE_SUB + PROBE_SUB)
+#define PROBE_SHARDS_MAX 64
+#define SWITCH_PROBES_EVENT "core::probes"
+
+typedef struct {
+	volatile apr_uint32_t count[SWITCH_PROBE_MAX][PROBE_BUCKETS];
+	volatile apr_uint32_t max[SWITCH_PROBE_MAX];
+} probe_shard_t;
+
+typedef struct {
+	uint64_t count;
+	uint32_t p50;
+	uint32_t p90;
+	uint32_t p99;
+	uint32_t p999;
+	uint32_t max;
+	uint32_t mean;
+} probe_summary_t;
+
+static const char *PROBE_NAMES[] = {
+	"read_frame",
+	"write_frame",
+	"codec_encode",
+	"codec_decode",
+	"media_bug",
+	"rtp_read",
+	"event_fire",
+	"xml_fetch",
+	NULL
+};
+
+static struct {
+	probe_shard_t *shards;
+	uint32_t shard_count;
+	switch_time_t since;
+} PROBES;
+
+SWITCH_DECLARE_DATA volatile int switch_core_probes_active = 0;
+
+static inline uint32_t probe_bucket(uint32_t v)
+{
+	uint32_t e = 0, x = v;
+
+	if (v < PROBE_SUB * 2) {
+		return v;
+	}
+
+	while (x >>= 1) {
+		e++;
+	}
+
+	return (e - PROBE_SUB_BITS) * PROBE_SUB + ((v >> (e - PROBE_SUB_BITS)) & (PROBE_SUB - 1)) + PROBE_SUB;
+}
+
+static inline uint32_t probe_bucket_high(uint32_t idx)
+{
+	uint32_t e, sub;
+
+	if (idx < PROBE_SUB * 2) {
+		return idx;
+	}
+
+	e = (idx - PROBE_SUB) / PROBE_SUB + PROBE_SUB_BITS;
+	sub = (idx - PROBE_SUB) % PROBE_SUB;
+
+	return ((PROBE_SUB + sub + 1) << (e - PROBE_SUB_BITS)) - 1;
+}
+
+SWITCH_DECLARE(void) switch_core_probe_record(switch_probe_t probe, switch_time_t usec)
+{
+	probe_shard_t *shard;
+	apr_uint32_t v, old;
+
+	if (!PROBES.shards || probe >= SWITCH_PROBE_MAX) {
+		return;
+	}
+
+	v = usec < 0 ? 0 : usec > PROBE_MAX_VALUE ? PROBE_MAX_VALUE : (apr_uint32_t) usec;
+	shard = &PROBES.shards[switch_core_cpu_slot(PROBES.shard_count)];
+
+	apr_atomic_inc32(&shard->count[probe][probe_bucket(v)]);
+
+	while ((old = apr_atomic_read32(&shard->max[probe])) < v) {
+		if (apr_atomic_cas32(&shard->max[probe], v, old) == old) {
+			break;
+		}
+	}
+}
+
+static void probe_summarize(switch_probe_t probe, probe_summary_t *sum)
+{
+	uint32_t i, s, idx = 0;
+	uint64_t seen = 0, total = 0;
+	uint64_t want[4];
+	uint32_t *out[4];
+	uint32_t buckets[PROBE_BUCKETS];
+
+	memset(sum, 0, sizeof(*sum));
+
+	if (!PROBES.shards) {
+		return;
+	}
+
+	out[0] = &sum->p50;
+	out[1] = &sum->p90;
+	out[2] = &sum->p99;
+	out[3] = &sum->p999;
+
+	memset(buckets, 0, sizeof(buckets));
+
+	for (s = 0; s < PROBES.shard_count; s++) {
+		probe_shard_t *shard = &PROBES.shards[s];
+
+		for (i = 0; i < PROBE_BUCKETS; i++) {
+			buckets[i] += apr_atomic_read32(&shard->count[probe][i]);
+		}
+
+		if (apr_atomic_read32(&shard->max[probe]) > sum->max) {
+			sum->max = apr_atomic_read32(&shard->max[probe]);
+		}
+	}
+
+	for (i = 0; i < PROBE_BUCKETS; i++) {
+		sum->count += buckets[i];
+		total += (uint64_t) buckets[i] * ((probe_bucket_high(i) + (i ? probe_bucket_high(i - 1) + 1 : 0)) / 2);
+	}
+
+	if (!sum->count) {
+		return;
+	}
+
+	sum->mean = (uint32_t) (total / sum->count);
+
+	want[0] = (sum->count * 500 + 999) / 1000;
+	want[1] = (sum->count * 900 + 999) / 1000;
+	want[2] = (sum->count * 990 + 999) / 1000;
+	want[3] = (sum->count * 999 + 999) / 1000;
+
+	for (i = 0; i < PROBE_BUCKETS && idx < 4; i++) {
+		seen += buckets[i];
+		while (idx < 4 && seen >= want[idx]) {
+			*out[idx] = probe_bucket_high(i) < sum->max ? probe_bucket_high(i) : sum->max;
+			idx++;
+		}
+	}
+}
+
+SWITCH_DECLARE(const char *) switch_core_probe_name(switch_probe_t probe)
+{
+	return probe < SWITCH_PROBE_MAX ? PROBE_NAMES[probe] : NULL;
+}
+
+SWITCH_DECLARE(void) switch_core_probes_set(switch_bool_t on)
+{
+	if (!PROBES.shards) {
+		return;
+	}
+
+	if (on && !switch_core_probes_active) {
+		PROBES.since = switch_micro_time_now();
+	}
+
+	switch_core_probes_active = on ? 1 : 0;
+}
+
+SWITCH_DECLARE(void) switch_core_probes_reset(void)
+{
+	uint32_t s;
+	int i, j;
+
+	for (s = 0; s < PROBES.shard_count; s++) {
+		probe_shard_t *shard = &PROBES.shards[s];
+
+		for (i = 0; i < SWITCH_PROBE_MAX; i++) {
+			for (j = 0; j < PROBE_BUCKETS; j++) {
+				apr_atomic_set32(&shard->count[i][j], 0);
+			}
+			apr_atomic_set32(&shard->max[i], 0);
+		}
+	}
+
+	PROBES.since = switch_micro_time_now();
+}
+
+SWITCH_DECLARE(void) switch_core_probes_dump(switch_stream_handle_t *stream, switch_bool_t csv)
+{
+	probe_summary_t sum;
+	int i;
+
+	if (csv) {
+		stream->write_function(stream, "probe,count,p50,p90,p99,p999,max,mean\n");
+	} else {
+		stream->write_function(stream, "probes %s, sampling for %" SWITCH_TIME_T_FMT " second(s), values in usec\n",
+							   switch_core_probes_active ? "on" : "off",
+							   PROBES.since ? (switch_micro_time_now() - PROBES.since) / 1000000 : (switch_time_t) 0);
+		stream->write_function(stream, "%-14s %12s %9s %9s %9s %9s %9s %9s\n", "probe", "count", "p50", "p90", "p99", "p99.9", "max", "mean");
+	}
+
+	for (i = 0; i < SWITCH_PROBE_MAX; i++) {
+		probe_summarize(i, &sum);
+
+		if (csv) {
+			stream->write_function(stream, "%s,%" SWITCH_UINT64_T_FMT ",%u,%u,%u,%u,%u,%u\n",
+								   PROBE_NAMES[i], sum.count, sum.p50, sum.p90, sum.p99, sum.p999, sum.max, sum.mean);
+		} else {
+			stream->write_function(stream, "%-14s %12" SWITCH_UINT64_T_FMT " %9u %9u %9u %9u %9u %9u\n",
+								   PROBE_NAMES[i], sum.count, sum.p50, sum.p90, sum.p99, sum.p999, sum.max, sum.mean);
+		}
+	}
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_probes_fire_events(void)
+{
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	probe_summary_t sum;
+	switch_event_t *event;
+	int i;
+
+	for (i = 0; i < SWITCH_PROBE_MAX; i++) {
+		probe_summarize(i, &sum);
+
+		if (!sum.count) {
+			continue;
+		}
+
+		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, SWITCH_PROBES_EVENT) == SWITCH_STATUS_SUCCESS) {
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Probe-Name", PROBE_NAMES[i]);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Probe-Count", "%" SWITCH_UINT64_T_FMT, sum.count);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Probe-P50", "%u", sum.p50);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Probe-P90", "%u", sum.p90);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Probe-P99", "%u", sum.p99);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Probe-P999", "%u", sum.p999);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Probe-Max", "%u", sum.max);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Probe-Mean", "%u", sum.mean);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Probe-Since", "%" SWITCH_TIME_T_FMT, PROBES.since);
+			switch_event_fire(&event);
+			status = SWITCH_STATUS_SUCCESS;
+		}
+	}
+
+	return status;
+}
+
+void switch_core_probes_init(void)
+{
+	PROBES.shard_count = switch_core_cpu_count();
+
+	if (PROBES.shard_count < 1) {
+		PROBES.shard_count = 1;
+	} else if (PROBES.shard_count > PROBE_SHARDS_MAX) {
+		PROBES.shard_count = PROBE_SHARDS_MAX;
+	}
+
+	PROBES.shards = calloc(PROBES.shard_count, sizeof(probe_shard_t));
+	switch_assert(PROBES.shards);
+}
+
+void switch_core_probes_shutdown(void)
+{
+	switch_core_probes_active = 0;
+	/* the shards are left alone, a media thread may still be inside switch_core_probe_record */
+}
@@ -32,6 +32,302 @@
 
 #include <switch.h>
 #include <pcre.h>
+#include "private/switch_core_pvt.h"
+
+/* 
+   Compiled regex cache.  Expressions are cached by their text as handed to switch_regex_perform
+   (so the _ and /re/flags forms skip the rewriting too) in a set of independently locked buckets,
+   each one with its own LRU list, so lookups for different expressions rarely contend.
+*/
+
+#define REGEX_CACHE_BUCKETS 32
+#define REGEX_CACHE_DEFAULT_SIZE 4096
+
+typedef struct regex_cache_node {
+	char *expression;
+	pcre *re;
+	pcre_extra *extra;
+	uint32_t refs;
+	uint8_t dead;
+	struct regex_cache_node *prev;
+	struct regex_cache_node *next;
+} regex_cache_node_t;
+
+typedef struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	regex_cache_node_t *head;
+	regex_cache_node_t *tail;
+	uint32_t count;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} regex_cache_bucket_t;
+
+static struct {
+	regex_cache_bucket_t buckets[REGEX_CACHE_BUCKETS];
+	uint32_t max_size;
+	uint32_t flushes;
+	switch_event_node_t *node;
+	int ready;
+} REGEX_CACHE;
+
+static void regex_cache_node_free(regex_cache_node_t *node)
+{
+	pcre_free(node->re);
+	if (node->extra) {
+		pcre_free(node->extra);
+	}
+	free(node->expression);
+	free(node);
+}
+
+/* must be called with the bucket locked */
+static void regex_cache_unlink(regex_cache_bucket_t *bucket, regex_cache_node_t *node)
+{
+	if (node->prev) {
+		node->prev->next = node->next;
+	} else {
+		bucket->head = node->next;
+	}
+
+	if (node->next) {
+		node->next->prev = node->prev;
+	} else {
+		bucket->tail = node->prev;
+	}
+
+	switch_core_hash_delete(bucket->hash, node->expression);
+	bucket->count--;
+	node->dead = 1;
+
+	/* anyone still running the regex will free it when they are done */
+	if (!node->refs) {
+		regex_cache_node_free(node);
+	}
+}
+
+static regex_cache_bucket_t *regex_cache_bucket(const char *expression)
+{
+	switch_ssize_t len = -1;
+	return &REGEX_CACHE.buckets[switch_hashfunc_default(expression, &len) % REGEX_CACHE_BUCKETS];
+}
+
+static regex_cache_node_t *regex_cache_acquire(const char *expression)
+{
+	regex_cache_bucket_t *bucket;
+	regex_cache_node_t *node;
+
+	if (!REGEX_CACHE.ready || !REGEX_CACHE.max_size) {
+		return NULL;
+	}
+
+	bucket = regex_cache_bucket(expression);
+
+	switch_mutex_lock(bucket->mutex);
+	if ((node = switch_core_hash_find(bucket->hash, expression))) {
+		node->refs++;
+		bucket->hits++;
+
+		if (node->prev) {
+			/* move to the front of the LRU list */
+			node->prev->next = node->next;
+			if (node->next) {
+				node->next->prev = node->prev;
+			} else {
+				bucket->tail = node->prev;
+			}
+			node->prev = NULL;
+			node->next = bucket->head;
+			bucket->head->prev = node;
+			bucket->head = node;
+		}
+	} else {
+		bucket->misses++;
+	}
+	switch_mutex_unlock(bucket->mutex);
+
+	return node;
+}
+
+static void regex_cache_release(regex_cache_node_t *node)
+{
+	regex_cache_bucket_t *bucket = regex_cache_bucket(node->expression);
+	int destroy;
+
+	switch_mutex_lock(bucket->mutex);
+	destroy = (!--node->refs && node->dead);
+	switch_mutex_unlock(bucket->mutex);
+
+	if (destroy) {
+		regex_cache_node_free(node);
+	}
+}
+
+/* hands the compiled regex over to the cache, returns the (acquired) node that ended up in it */
+static regex_cache_node_t *regex_cache_insert(const char *expression, pcre *re, pcre_extra *extra)
+{
+	regex_cache_bucket_t *bucket;
+	regex_cache_node_t *node, *exists;
+	uint32_t max;
+
+	if (!REGEX_CACHE.ready || !REGEX_CACHE.max_size) {
+		return NULL;
+	}
+
+	switch_zmalloc(node, sizeof(*node));
+	node->expression = strdup(expression);
+	switch_assert(node->expression);
+	node->re = re;
+	node->extra = extra;
+	node->refs = 1;
+
+	bucket = regex_cache_bucket(expression);
+	max = REGEX_CACHE.max_size / REGEX_CACHE_BUCKETS;
+	if (!max) {
+		max = 1;
+	}
+
+	switch_mutex_lock(bucket->mutex);
+	if ((exists = switch_core_hash_find(bucket->hash, expression))) {
+		/* somebody compiled it at the same time, use theirs */
+		exists->refs++;
+		switch_mutex_unlock(bucket->mutex);
+		regex_cache_node_free(node);
+		return exists;
+	}
+
+	while (bucket->count >= max && bucket->tail) {
+		regex_cache_unlink(bucket, bucket->tail);
+		bucket->evictions++;
+	}
+
+	node->next = bucket->head;
+	if (bucket->head) {
+		bucket->head->prev = node;
+	}
+	bucket->head = node;
+	if (!bucket->tail) {
+		bucket->tail = node;
+	}
+	switch_core_hash_insert(bucket->hash, node->expression, node);
+	bucket->count++;
+	switch_mutex_unlock(bucket->mutex);
+
+	return node;
+}
+
+/* callers own the regex switch_regex_perform returns, give them a private copy of the cached one */
+static pcre *regex_copy(const pcre *re)
+{
+	size_t size = 0;
+	pcre *copy;
+
+	if (pcre_fullinfo(re, NULL, PCRE_INFO_SIZE, &size) || !size || !(copy = (pcre *) pcre_malloc(size))) {
+		return NULL;
+	}
+
+	memcpy(copy, re, size);
+
+	return copy;
+}
+
+SWITCH_DECLARE(void) switch_regex_cache_flush(void)
+{
+	int x;
+
+	if (!REGEX_CACHE.ready) {
+		return;
+	}
+
+	for (x = 0; x < REGEX_CACHE_BUCKETS; x++) {
+		regex_cache_bucket_t *bucket = &REGEX_CACHE.buckets[x];
+
+		switch_mutex_lock(bucket->mutex);
+		while (bucket->head) {
+			regex_cache_unlink(bucket, bucket->head);
+		}
+		switch_mutex_unlock(bucket->mutex);
+	}
+
+	REGEX_CACHE.flushes++;
+}
+
+SWITCH_DECLARE(uint32_t) switch_regex_cache_size(uint32_t new_size)
+{
+	if (new_size != (uint32_t) -1) {
+		REGEX_CACHE.max_size = new_size;
+		switch_regex_cache_flush();
+	}
+
+	return REGEX_CACHE.max_size;
+}
+
+SWITCH_DECLARE(void) switch_regex_cache_status(switch_stream_handle_t *stream)
+{
+	uint64_t hits = 0, misses = 0, evictions = 0;
+	uint32_t count = 0;
+	int x;
+
+	if (REGEX_CACHE.ready) {
+		for (x = 0; x < REGEX_CACHE_BUCKETS; x++) {
+			regex_cache_bucket_t *bucket = &REGEX_CACHE.buckets[x];
+
+			switch_mutex_lock(bucket->mutex);
+			count += bucket->count;
+			hits += bucket->hits;
+			misses += bucket->misses;
+			evictions += bucket->evictions;
+			switch_mutex_unlock(bucket->mutex);
+		}
+	}
+
+	stream->write_function(stream, "entries: %u\nmax-entries: %u\nhits: %" SWITCH_UINT64_T_FMT "\nmisses: %" SWITCH_UINT64_T_FMT
+						   "\nevictions: %" SWITCH_UINT64_T_FMT "\nflushes: %u\n",
+						   count, REGEX_CACHE.max_size, hits, misses, evictions, REGEX_CACHE.flushes);
+}
+
+static void regex_cache_event_handler(switch_event_t *event)
+{
+	switch_regex_cache_flush();
+}
+
+void switch_regex_cache_init(switch_memory_pool_t *pool)
+{
+	int x;
+
+	memset(&REGEX_CACHE, 0, sizeof(REGEX_CACHE));
+	REGEX_CACHE.max_size = REGEX_CACHE_DEFAULT_SIZE;
+
+	for (x = 0; x < REGEX_CACHE_BUCKETS; x++) {
+		switch_mutex_init(&REGEX_CACHE.buckets[x].mutex, SWITCH_MUTEX_NESTED, pool);
+		switch_core_hash_init_case(&REGEX_CACHE.buckets[x].hash, pool, SWITCH_TRUE);
+	}
+
+	if (switch_event_bind_removable("core_regex_cache", SWITCH_EVENT_RELOADXML, NULL, regex_cache_event_handler, NULL, &REGEX_CACHE.node) !=
+		SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind regex cache to reloadxml!\n");
+	}
+
+	REGEX_CACHE.ready = 1;
+}
+
+void switch_regex_cache_shutdown(void)
+{
+	int x;
+
+	if (!REGEX_CACHE.ready) {
+		return;
+	}
+
+	switch_event_unbind(&REGEX_CACHE.node);
+	switch_regex_cache_flush();
+	REGEX_CACHE.ready = 0;
+
+	for (x = 0; x < REGEX_CACHE_BUCKETS; x++) {
+		switch_core_hash_destroy(&REGEX_CACHE.buckets[x].hash);
+	}
+}
 
 SWITCH_DECLARE(switch_regex_t *) switch_regex_compile(const char *pattern,
 													  int options, const char **errorptr, int *erroroffset, const unsigned char *tables)
@@ -57,6 +353,9 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 	const char *error = NULL;
 	int erroffset = 0;
 	pcre *re = NULL;
+	pcre_extra *extra = NULL;
+	regex_cache_node_t *node;
+	const char *key = expression;
 	int match_count = 0;
 	char *tmp = NULL;
 	uint32_t flags = 0;
@@ -66,6 +365,10 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 		return 0;
 	}
 
+	if ((node = regex_cache_acquire(key))) {
+		goto exec;
+	}
+
 	if (*expression == '_') {
 		if (switch_ast2regex(expression + 1, abuf, sizeof(abuf))) {
 			expression = abuf;
@@ -103,8 +406,20 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 		goto end;
 	}
 
+	/* only worth studying if we are going to keep it */
+	if (REGEX_CACHE.ready && REGEX_CACHE.max_size) {
+		extra = pcre_study(re, 0, &error);
+		error = NULL;
+	}
+
+	if ((node = regex_cache_insert(key, re, extra))) {
+		re = NULL;
+		extra = NULL;
+		goto exec;
+	}
+
 	match_count = pcre_exec(re,	/* result of pcre_compile() */
-							NULL,	/* we didn't study the pattern */
+							extra,	/* studied pattern info */
 							field,	/* the subject string */
 							(int) strlen(field),	/* the length of the subject string */
 							0,	/* start at offset 0 in the subject */
@@ -112,6 +427,9 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 							ovector,	/* vector of integers for substring information */
 							olen);	/* number of elements (NOT size in bytes) */
 
+	if (extra) {
+		pcre_free(extra);
+	}
 
 	if (match_count <= 0) {
 		switch_regex_safe_free(re);
@@ -120,6 +438,20 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 
 	*new_re = (switch_regex_t *) re;
 
+	goto end;
+
+  exec:
+
+	match_count = pcre_exec(node->re, node->extra, field, (int) strlen(field), 0, 0, ovector, olen);
+
+	if (match_count > 0) {
+		*new_re = (switch_regex_t *) regex_copy(node->re);
+	} else {
+		match_count = 0;
+	}
+
+	regex_cache_release(node);
+
   end:
 	switch_safe_free(tmp);
 	return match_count;
@@ -173,38 +505,68 @@ SWITCH_DECLARE(switch_status_t) switch_regex_match_partial(const char *target, c
 	const char *error = NULL;	/* Used to hold any errors                                           */
 	int error_offset = 0;		/* Holds the offset of an error                                      */
 	pcre *pcre_prepared = NULL;	/* Holds the compiled regex                                          */
+	pcre_extra *extra = NULL;	/* Holds the studied regex info                                      */
+	regex_cache_node_t *node = NULL;	/* Holds the cache entry, if any                                     */
+	char key[512] = "";			/* Cache key, keeps raw expressions apart from switch_regex_perform  */
 	int match_count = 0;		/* Number of times the regex was matched                             */
 	int offset_vectors[255];	/* not used, but has to exist or pcre won't even try to find a match */
 	int pcre_flags = 0;
 
-	/* Compile the expression */
-	pcre_prepared = pcre_compile(expression, 0, &error, &error_offset, NULL);
+	/* Expressions too long for the key are simply not cached */
+	if (strlen(expression) + 2 <= sizeof(key)) {
+		switch_snprintf(key, sizeof(key), "\001%s", expression);
+		node = regex_cache_acquire(key);
+	}
+
+	if (node) {
+		pcre_prepared = node->re;
+		extra = node->extra;
+	} else {
+		/* Compile the expression */
+		pcre_prepared = pcre_compile(expression, 0, &error, &error_offset, NULL);
+
+		/* See if there was an error in the expression */
+		if (error != NULL) {
+			/* Clean up after ourselves */
+			if (pcre_prepared) {
+				pcre_free(pcre_prepared);
+				pcre_prepared = NULL;
+			}
+			/* Note our error */
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR,
+							  "Regular Expression Error expression[%s] error[%s] location[%d]\n", expression, error, error_offset);
 
-	/* See if there was an error in the expression */
-	if (error != NULL) {
-		/* Clean up after ourselves */
-		if (pcre_prepared) {
-			pcre_free(pcre_prepared);
-			pcre_prepared = NULL;
+			/* We definitely didn't match anything */
+			return SWITCH_STATUS_FALSE;
 		}
-		/* Note our error */
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR,
-						  "Regular Expression Error expression[%s] error[%s] location[%d]\n", expression, error, error_offset);
 
-		/* We definitely didn't match anything */
-		return SWITCH_STATUS_FALSE;
+		/* Hand it to the cache so the next caller doesn't have to compile it again */
+		if (*key && REGEX_CACHE.ready && REGEX_CACHE.max_size) {
+			extra = pcre_study(pcre_prepared, 0, &error);
+			if ((node = regex_cache_insert(key, pcre_prepared, extra))) {
+				pcre_prepared = node->re;
+				extra = node->extra;
+			} else if (extra) {
+				pcre_free(extra);
+				extra = NULL;
+			}
+		}
 	}
 
 	if (*partial) {
 		pcre_flags = PCRE_PARTIAL;
+		/* studied patterns are not safe to use for partial matching */
+		extra = NULL;
 	}
 
 	/* So far so good, run the regex */
 	match_count =
-		pcre_exec(pcre_prepared, NULL, target, (int) strlen(target), 0, pcre_flags, offset_vectors, sizeof(offset_vectors) / sizeof(offset_vectors[0]));
+		pcre_exec(pcre_prepared, extra, target, (int) strlen(target), 0, pcre_flags, offset_vectors, sizeof(offset_vectors) / sizeof(offset_vectors[0]));
 
 	/* Clean up */
-	if (pcre_prepared) {
+	if (node) {
+		regex_cache_release(node);
+	} else if (pcre_prepared) {
 		pcre_free(pcre_prepared);
 		pcre_prepared = NULL;
 	}
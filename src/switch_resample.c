@@ -37,6 +37,15 @@
 #endif
 #include <speex/speex_resampler.h>
 
+/* SSE2 and NEON are part of the x86_64 and aarch64 baselines so the kernels below are picked at compile time. */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SWITCH_SLN_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SWITCH_SLN_NEON
+#endif
+
 #define NORMFACT (float)0x8000
 #define MAXSAMPLE (float)0x7FFF
 #define MAXSAMPLEC (char)0x7F
@@ -52,6 +61,171 @@
 
 #define resample_buffer(a, b, c) a > b ? ((a / 1000) / 2) * c : ((b / 1000) / 2) * c
 
+/*
+  Building a speex resampler computes its whole polyphase filter table, which is most of the cost of a handle.
+  Destroyed handles park their speex state here and the next create for the same rates, quality and channels
+  just clears the history and takes it.  The list runs from most to least recently parked, a full cache
+  throws out its tail.
+*/
+
+#define RESAMPLE_CACHE_DEFAULT_SIZE 256
+
+typedef struct resample_cache_node {
+	SpeexResamplerState *state;
+	uint32_t from_rate;
+	uint32_t to_rate;
+	uint32_t channels;
+	int quality;
+	struct resample_cache_node *prev;
+	struct resample_cache_node *next;
+} resample_cache_node_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	resample_cache_node_t *idle;
+	resample_cache_node_t *tail;
+	uint32_t count;
+	uint32_t max_size;
+	int quality;
+	int ready;
+} RESAMPLE_CACHE = { NULL, NULL, NULL, 0, 0, SWITCH_RESAMPLE_DEFAULT_QUALITY, 0 };
+
+/* call with RESAMPLE_CACHE.mutex locked */
+static void resample_cache_unlink(resample_cache_node_t *np)
+{
+	if (np->prev) {
+		np->prev->next = np->next;
+	} else {
+		RESAMPLE_CACHE.idle = np->next;
+	}
+
+	if (np->next) {
+		np->next->prev = np->prev;
+	} else {
+		RESAMPLE_CACHE.tail = np->prev;
+	}
+
+	RESAMPLE_CACHE.count--;
+}
+
+static SpeexResamplerState *resample_cache_take(uint32_t from_rate, uint32_t to_rate, int quality, uint32_t channels)
+{
+	resample_cache_node_t *np;
+	SpeexResamplerState *state = NULL;
+
+	if (!RESAMPLE_CACHE.ready) {
+		return NULL;
+	}
+
+	switch_mutex_lock(RESAMPLE_CACHE.mutex);
+	for (np = RESAMPLE_CACHE.idle; np; np = np->next) {
+		if (np->from_rate == from_rate && np->to_rate == to_rate && np->quality == quality && np->channels == channels) {
+			resample_cache_unlink(np);
+			break;
+		}
+	}
+	switch_mutex_unlock(RESAMPLE_CACHE.mutex);
+
+	if (np) {
+		state = np->state;
+		free(np);
+		speex_resampler_reset_mem(state);
+	}
+
+	return state;
+}
+
+static switch_bool_t resample_cache_put(SpeexResamplerState *state, uint32_t from_rate, uint32_t to_rate, int quality, uint32_t channels)
+{
+	resample_cache_node_t *np, *old = NULL;
+
+	if (!RESAMPLE_CACHE.ready || !RESAMPLE_CACHE.max_size) {
+		return SWITCH_FALSE;
+	}
+
+	switch_zmalloc(np, sizeof(*np));
+	np->state = state;
+	np->from_rate = from_rate;
+	np->to_rate = to_rate;
+	np->quality = quality;
+	np->channels = channels;
+
+	switch_mutex_lock(RESAMPLE_CACHE.mutex);
+	if (RESAMPLE_CACHE.count >= RESAMPLE_CACHE.max_size && (old = RESAMPLE_CACHE.tail)) {
+		resample_cache_unlink(old);
+	}
+	np->next = RESAMPLE_CACHE.idle;
+	if (np->next) {
+		np->next->prev = np;
+	} else {
+		RESAMPLE_CACHE.tail = np;
+	}
+	RESAMPLE_CACHE.idle = np;
+	RESAMPLE_CACHE.count++;
+	switch_mutex_unlock(RESAMPLE_CACHE.mutex);
+
+	if (old) {
+		speex_resampler_destroy(old->state);
+		free(old);
+	}
+
+	return SWITCH_TRUE;
+}
+
+static void resample_cache_trim(uint32_t size)
+{
+	resample_cache_node_t *np;
+
+	switch_mutex_lock(RESAMPLE_CACHE.mutex);
+	while (RESAMPLE_CACHE.count > size && (np = RESAMPLE_CACHE.tail)) {
+		resample_cache_unlink(np);
+		speex_resampler_destroy(np->state);
+		free(np);
+	}
+	switch_mutex_unlock(RESAMPLE_CACHE.mutex);
+}
+
+void switch_resample_cache_init(switch_memory_pool_t *pool)
+{
+	switch_mutex_init(&RESAMPLE_CACHE.mutex, SWITCH_MUTEX_NESTED, pool);
+	RESAMPLE_CACHE.idle = RESAMPLE_CACHE.tail = NULL;
+	RESAMPLE_CACHE.count = 0;
+	RESAMPLE_CACHE.max_size = RESAMPLE_CACHE_DEFAULT_SIZE;
+	RESAMPLE_CACHE.ready = 1;
+}
+
+void switch_resample_cache_shutdown(void)
+{
+	if (!RESAMPLE_CACHE.ready) {
+		return;
+	}
+
+	resample_cache_trim(0);
+	RESAMPLE_CACHE.ready = 0;
+}
+
+SWITCH_DECLARE(uint32_t) switch_resample_cache_size(uint32_t new_size)
+{
+	uint32_t old_size = RESAMPLE_CACHE.max_size;
+
+	RESAMPLE_CACHE.max_size = new_size;
+
+	if (RESAMPLE_CACHE.ready && new_size < old_size) {
+		resample_cache_trim(new_size);
+	}
+
+	return old_size;
+}
+
+SWITCH_DECLARE(int) switch_resample_default_quality(int quality)
+{
+	if (quality >= 0 && quality <= 10) {
+		RESAMPLE_CACHE.quality = quality;
+	}
+
+	return RESAMPLE_CACHE.quality;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
 															   uint32_t from_rate, uint32_t to_rate,
 															   uint32_t to_size,
@@ -61,15 +235,28 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 	switch_audio_resampler_t *resampler;
 	double lto_rate, lfrom_rate;
 
+	if (!channels) {
+		channels = 1;
+	}
+
+	if (quality < 0) {
+		quality = RESAMPLE_CACHE.quality;
+	}
+
 	switch_zmalloc(resampler, sizeof(*resampler));
 
-	resampler->resampler = speex_resampler_init(channels ? channels : 1, from_rate, to_rate, quality, &err);
+	if (!(resampler->resampler = resample_cache_take(from_rate, to_rate, quality, channels))) {
+		resampler->resampler = speex_resampler_init(channels, from_rate, to_rate, quality, &err);
+	}
 
 	if (!resampler->resampler) {
 		free(resampler);
 		return SWITCH_STATUS_GENERR;
 	}
 
+	resampler->quality = quality;
+	resampler->channels = channels;
+
 	*new_resampler = resampler;
 	lto_rate = (double) resampler->to_rate;
 	lfrom_rate = (double) resampler->from_rate;
@@ -95,7 +282,8 @@ SWITCH_DECLARE(void) switch_resample_destroy(switch_audio_resampler_t **resample
 {
 
 	if (resampler && *resampler) {
-		if ((*resampler)->resampler) {
+		if ((*resampler)->resampler && !resample_cache_put((*resampler)->resampler, (*resampler)->from_rate, (*resampler)->to_rate,
+														   (*resampler)->quality, (*resampler)->channels)) {
 			speex_resampler_destroy((*resampler)->resampler);
 		}
 		free((*resampler)->to);
@@ -238,7 +426,21 @@ SWITCH_DECLARE(uint32_t) switch_merge_sln(int16_t *data, uint32_t samples, int16
 		x = samples;
 	}
 
-	for (i = 0; i < x; i++) {
+	i = 0;
+
+#if defined(SWITCH_SLN_SSE2)
+	for (; i + 8 <= x; i += 8) {
+		__m128i a = _mm_loadu_si128((__m128i *) (data + i));
+		__m128i b = _mm_loadu_si128((__m128i *) (other_data + i));
+		_mm_storeu_si128((__m128i *) (data + i), _mm_adds_epi16(a, b));
+	}
+#elif defined(SWITCH_SLN_NEON)
+	for (; i + 8 <= x; i += 8) {
+		vst1q_s16(data + i, vqaddq_s16(vld1q_s16(data + i), vld1q_s16(other_data + i)));
+	}
+#endif
+
+	for (; i < x; i++) {
 		z = data[i] + other_data[i];
 		switch_normalize_to_16bit(z);
 		data[i] = (int16_t) z;
@@ -291,10 +493,41 @@ SWITCH_DECLARE(void) switch_change_sln_volume(int16_t *data, uint32_t samples, i
 
 	if (newrate) {
 		int32_t tmp;
-		uint32_t x;
+		uint32_t x = 0;
 		int16_t *fp = data;
 
-		for (x = 0; x < samples; x++) {
+#if defined(SWITCH_SLN_SSE2)
+		/* same double precision math and truncation as the scalar loop, packs saturates like switch_normalize_to_16bit */
+		__m128d rate = _mm_set1_pd(newrate);
+
+		for (; x + 8 <= samples; x += 8) {
+			__m128i in = _mm_loadu_si128((__m128i *) (fp + x));
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+			__m128d d0 = _mm_cvtepi32_pd(lo);
+			__m128d d1 = _mm_cvtepi32_pd(_mm_srli_si128(lo, 8));
+			__m128d d2 = _mm_cvtepi32_pd(hi);
+			__m128d d3 = _mm_cvtepi32_pd(_mm_srli_si128(hi, 8));
+
+			if (div) {
+				d0 = _mm_div_pd(d0, rate);
+				d1 = _mm_div_pd(d1, rate);
+				d2 = _mm_div_pd(d2, rate);
+				d3 = _mm_div_pd(d3, rate);
+			} else {
+				d0 = _mm_mul_pd(d0, rate);
+				d1 = _mm_mul_pd(d1, rate);
+				d2 = _mm_mul_pd(d2, rate);
+				d3 = _mm_mul_pd(d3, rate);
+			}
+
+			lo = _mm_unpacklo_epi64(_mm_cvttpd_epi32(d0), _mm_cvttpd_epi32(d1));
+			hi = _mm_unpacklo_epi64(_mm_cvttpd_epi32(d2), _mm_cvttpd_epi32(d3));
+			_mm_storeu_si128((__m128i *) (fp + x), _mm_packs_epi32(lo, hi));
+		}
+#endif
+
+		for (; x < samples; x++) {
 			tmp = (int32_t) (div ? fp[x] / newrate : fp[x] * newrate);
 			switch_normalize_to_16bit(tmp);
 			fp[x] = (int16_t) tmp;
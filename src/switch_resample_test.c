@@ -0,0 +1,233 @@
+/*
+ * switch_resample_test.c - check the SSE2/NEON mixing and volume kernels against the scalar loops
+ *
+ * switch_merge_sln and switch_change_sln_volume run their vector paths on whole blocks of 8 and
+ * the scalar loop on the tail.  Every case here is run through the library and through a copy of
+ * the scalar loop kept in this file, any difference fails the test.  Random input, input that
+ * saturates, every length from 0 to a few blocks (so every tail) and every volume level are covered.
+ *
+ * switch_resample_test [rounds]
+ */
+
+#include <switch.h>
+
+#define TEST_MAX_SAMPLES 1024
+
+/* the scalar loops of switch_resample.c, as they were before the vector paths */
+static uint32_t merge_ref(int16_t *data, uint32_t samples, int16_t *other_data, uint32_t other_samples)
+{
+	uint32_t i, x = samples > other_samples ? other_samples : samples;
+	int32_t z;
+
+	for (i = 0; i < x; i++) {
+		z = data[i] + other_data[i];
+		switch_normalize_to_16bit(z);
+		data[i] = (int16_t) z;
+	}
+
+	return x;
+}
+
+static void volume_ref(int16_t *data, uint32_t samples, int32_t vol)
+{
+	double newrate = 0;
+	int div = 0;
+	uint32_t x;
+	int32_t tmp;
+
+	switch_normalize_volume(vol);
+
+	if (vol > 0) {
+		vol++;
+	} else if (vol < 0) {
+		vol--;
+	}
+
+	newrate = vol * 1.3;
+
+	if (vol < 0) {
+		newrate *= -1;
+		div++;
+	}
+
+	if (!newrate) {
+		return;
+	}
+
+	for (x = 0; x < samples; x++) {
+		tmp = (int32_t) (div ? data[x] / newrate : data[x] * newrate);
+		switch_normalize_to_16bit(tmp);
+		data[x] = (int16_t) tmp;
+	}
+}
+
+/* small deterministic generator so every run checks the same data */
+static uint32_t rnd_state = 1;
+
+static int16_t rnd16(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return (int16_t) (rnd_state >> 8);
+}
+
+enum {
+	FILL_RANDOM,
+	FILL_FULL_SCALE,
+	FILL_EDGES,
+	FILL_QUIET,
+	FILL_COUNT
+};
+
+static const char *fill_names[FILL_COUNT] = { "random", "full scale", "edges", "quiet" };
+
+static void fill(int16_t *data, uint32_t samples, int how)
+{
+	static const int16_t edges[] = { 32767, -32768, 32766, -32767, 16384, -16384, 1, -1, 0, 25206, -25206 };
+	uint32_t i;
+
+	for (i = 0; i < samples; i++) {
+		switch (how) {
+		case FILL_FULL_SCALE:
+			/* sums of these always saturate one way or the other */
+			data[i] = (rnd16() & 1) ? (int16_t) (32767 - (rnd16() & 0xff)) : (int16_t) (-32768 + (rnd16() & 0xff));
+			break;
+		case FILL_EDGES:
+			data[i] = edges[(uint16_t) rnd16() % (sizeof(edges) / sizeof(edges[0]))];
+			break;
+		case FILL_QUIET:
+			data[i] = (int16_t) (rnd16() % 64);
+			break;
+		default:
+			data[i] = rnd16();
+			break;
+		}
+	}
+}
+
+static int check_merge(int rounds)
+{
+	static int16_t a[TEST_MAX_SAMPLES], b[TEST_MAX_SAMPLES], got[TEST_MAX_SAMPLES], want[TEST_MAX_SAMPLES];
+	int bad = 0, r, how, cases = 0;
+	uint32_t len, other, i, rg, rw;
+
+	for (r = 0; r < rounds; r++) {
+		for (how = 0; how < FILL_COUNT; how++) {
+			for (len = 0; len <= 67; len++) {
+				/* the other side shorter, equal and longer */
+				for (other = len > 3 ? len - 3 : 0; other <= len + 3; other++) {
+					fill(a, len, how);
+					fill(b, other, how);
+					memcpy(got, a, len * sizeof(*a));
+					memcpy(want, a, len * sizeof(*a));
+
+					rg = switch_merge_sln(got, len, b, other);
+					rw = merge_ref(want, len, b, other);
+					cases++;
+
+					if (rg != rw || memcmp(got, want, len * sizeof(*got))) {
+						if (bad++ < 10) {
+							for (i = 0; i < len && got[i] == want[i]; i++);
+							fprintf(stderr, "merge %s len %u other %u: returned %u/%u, sample %u is %d want %d\n",
+									fill_names[how], len, other, rg, rw, i, i < len ? got[i] : 0, i < len ? want[i] : 0);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	printf("merge: %d cases, %d mismatches\n", cases, bad);
+
+	return bad;
+}
+
+static int check_volume(int rounds)
+{
+	static int16_t got[TEST_MAX_SAMPLES], want[TEST_MAX_SAMPLES];
+	int bad = 0, r, how, cases = 0;
+	int32_t vol;
+	uint32_t len, i;
+
+	for (r = 0; r < rounds; r++) {
+		for (how = 0; how < FILL_COUNT; how++) {
+			/* every level, and a few past the ends that must be clamped the same way */
+			for (vol = -6; vol <= 6; vol++) {
+				for (len = 0; len <= 67; len++) {
+					fill(want, len, how);
+					memcpy(got, want, len * sizeof(*want));
+
+					switch_change_sln_volume(got, len, vol);
+					volume_ref(want, len, vol);
+					cases++;
+
+					if (memcmp(got, want, len * sizeof(*got))) {
+						if (bad++ < 10) {
+							for (i = 0; i < len && got[i] == want[i]; i++);
+							fprintf(stderr, "volume %s level %d len %u: sample %u is %d want %d\n",
+									fill_names[how], vol, len, i, got[i], want[i]);
+						}
+					}
+				}
+			}
+		}
+
+		/* one long buffer holding every input value once per level */
+		for (vol = -4; vol <= 4; vol++) {
+			static int16_t all[65536], all_want[65536];
+
+			for (i = 0; i < 65536; i++) {
+				all[i] = all_want[i] = (int16_t) (i - 32768);
+			}
+
+			switch_change_sln_volume(all, 65536, vol);
+			volume_ref(all_want, 65536, vol);
+			cases++;
+
+			if (memcmp(all, all_want, sizeof(all))) {
+				if (bad++ < 10) {
+					for (i = 0; i < 65536 && all[i] == all_want[i]; i++);
+					fprintf(stderr, "volume every input level %d: input %d gives %d want %d\n", vol, (int) i - 32768, all[i], all_want[i]);
+				}
+			}
+		}
+	}
+
+	printf("volume: %d cases, %d mismatches\n", cases, bad);
+
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	int bad = 0, rounds = 20;
+
+	if (argc > 1) {
+		rounds = atoi(argv[1]);
+	}
+
+#if defined(__SSE2__)
+	printf("vector path: SSE2\n");
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	printf("vector path: NEON\n");
+#else
+	printf("vector path: none, checking the scalar code against itself\n");
+#endif
+
+	bad += check_merge(rounds);
+	bad += check_volume(rounds);
+
+	printf("%s\n", bad ? "FAIL" : "PASS");
+
+	return bad ? 1 : 0;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4:
+ */
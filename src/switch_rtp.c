@@ -34,6 +34,14 @@
 //#define RTP_DEBUG_WRITE_DELTA
 #include <switch.h>
 #include <switch_stun.h>
+#ifndef WIN32
+#include <switch_private.h>
+#endif
+#if defined(HAVE_SYS_EPOLL_H)
+#define RTP_REACTOR 1
+#include <sys/epoll.h>
+#include <apr_atomic.h>
+#endif
 #undef PACKAGE_NAME
 #undef PACKAGE_STRING
 #undef PACKAGE_TARNAME
@@ -51,6 +59,7 @@
 #define WRITE_DEC(rtp_session) switch_mutex_unlock(rtp_session->write_mutex); rtp_session->writing--
 
 #include "stfu.h"
+#include <g711.h>
 
 #define rtp_header_len 12
 #define RTP_START_PORT 16384
@@ -58,6 +67,10 @@
 #define MASTER_KEY_LEN   30
 #define RTP_MAGIC_NUMBER 42
 #define MAX_SRTP_ERRS 10
+/* concealment pitch search range, in samples at 8khz */
+#define RTP_PLC_MIN_PITCH 20
+#define RTP_PLC_MAX_PITCH 120
+#define RTP_PLC_MAX_SAMPLES 960
 
 static switch_port_t START_PORT = RTP_START_PORT;
 static switch_port_t END_PORT = RTP_END_PORT;
@@ -84,6 +97,59 @@ static int zrtp_on = 0;
 
 static switch_hash_t *alloc_hash = NULL;
 
+#ifdef RTP_REACTOR
+#define RTP_REACTOR_MAX 64
+#define RTP_REACTOR_EVENTS 128
+#define RTP_REACTOR_RING 16
+#define RTP_REACTOR_PACKET 2048
+#define RTP_REACTOR_BATCH 32
+
+/* one received datagram waiting for the session thread */
+typedef struct {
+	switch_size_t bytes;
+	switch_sockaddr_t *from;
+	char data[RTP_REACTOR_PACKET];
+} rtp_reactor_packet_t;
+
+typedef struct {
+	switch_rtp_t *rtp_session;
+	uint32_t gen;
+	int next_free;
+} rtp_reactor_slot_t;
+
+typedef struct rtp_reactor {
+	int efd;
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+	rtp_reactor_slot_t *slots;
+	int slot_count;
+	int slot_free;
+	uint32_t sessions;
+	switch_sockaddr_t *scratch_from;
+	char scratch[16];
+	/* batch buffers for sessions relaying straight to a peer */
+	char *relay_buf;
+	switch_sockaddr_t *relay_from[RTP_REACTOR_BATCH];
+	/* relaying sessions that found a lock busy, their datagrams stay in the socket until the next pass */
+	int relay_pending;
+} rtp_reactor_t;
+
+static struct {
+	int threads;
+	int started;
+	volatile int running;
+	volatile apr_uint32_t next;
+	/* what the reactors saved and cost, packets per batch is the syscalls saved, wakeups are the extra context switches */
+	volatile apr_uint32_t packets;
+	volatile apr_uint32_t batches;
+	volatile apr_uint32_t wakeups;
+	volatile apr_uint32_t drops;
+	rtp_reactor_t reactors[RTP_REACTOR_MAX];
+	switch_mutex_t *mutex;
+	switch_memory_pool_t *pool;
+} rtp_reactor_globals;
+#endif
+
 typedef struct {
 	srtp_hdr_t header;
 	char body[SWITCH_RTP_MAX_BUF_LEN];
@@ -213,6 +279,11 @@ struct switch_rtp {
 	uint8_t ready;
 	uint8_t cn;
 	stfu_instance_t *jb;
+	uint32_t jb_ssrc;
+	int16_t plc_hist[RTP_PLC_MAX_SAMPLES];
+	uint32_t plc_len;
+	uint32_t plc_pitch;
+	uint32_t plc_pos;
 	uint32_t max_missed_packets;
 	uint32_t missed_count;
 	rtp_msg_t write_msg;
@@ -239,6 +310,30 @@ struct switch_rtp {
 #endif
 
 	switch_time_t send_time;
+
+#ifdef RTP_REACTOR
+	/* set while sock_input is serviced by a reactor thread instead of being read directly */
+	rtp_reactor_t *reactor;
+	int reactor_slot;
+	rtp_reactor_packet_t *ring;
+	volatile apr_uint32_t ring_head;
+	volatile apr_uint32_t ring_tail;
+	volatile apr_uint32_t reactor_waiting;
+	uint32_t reactor_drops;
+	/* taken by the session thread for each pop and by the reactor only when it has to drop the oldest packet */
+	switch_mutex_t *ring_mutex;
+	switch_mutex_t *reactor_mutex;
+	switch_thread_cond_t *reactor_cond;
+	/* fast relay: packets read here are rewritten and sent out of relay_peer by the reactor */
+	switch_rtp_t *relay_peer;
+	switch_rtp_t *relay_source;
+	uint32_t relay_ts_offset;
+	int relay_sync;
+	int relay_pending;
+	/* under read_mutex, packets relayed since the last switch_rtp_relay_check() and when that last saw any */
+	uint32_t relay_packets;
+	switch_time_t relay_heard;
+#endif
 };
 
 struct switch_rtcp_senderinfo {
@@ -604,6 +699,675 @@ static void zrtp_logger(int level, const char *data, int len, int offset)
 }
 #endif
 
+#ifdef RTP_REACTOR
+static void rtp_reactor_drain(rtp_reactor_t *reactor, switch_rtp_t *rtp_session)
+{
+	switch_sockaddr_t *from[RTP_REACTOR_RING];
+	char *bufs[RTP_REACTOR_RING];
+	switch_size_t lens[RTP_REACTOR_RING];
+	switch_status_t status;
+	switch_size_t bytes;
+	int queued = 0;
+
+	for (;;) {
+		apr_uint32_t head = apr_atomic_read32(&rtp_session->ring_head);
+		uint32_t i, count, space = RTP_REACTOR_RING - (head - apr_atomic_read32(&rtp_session->ring_tail));
+
+		if (!space) {
+			rtp_reactor_packet_t *pkt;
+
+			/* only make room if there really is something newer waiting */
+			bytes = sizeof(reactor->scratch);
+			status = switch_socket_recvfrom(reactor->scratch_from, rtp_session->sock_input, MSG_PEEK, reactor->scratch, &bytes);
+			if (status != SWITCH_STATUS_SUCCESS || !bytes) {
+				break;
+			}
+
+			/* the session is not keeping up, the oldest packet is the least useful to it so that is the one we drop */
+			switch_mutex_lock(rtp_session->ring_mutex);
+			if (head - apr_atomic_read32(&rtp_session->ring_tail) == RTP_REACTOR_RING) {
+				apr_atomic_inc32(&rtp_session->ring_tail);
+				rtp_session->reactor_drops++;
+				apr_atomic_inc32(&rtp_reactor_globals.drops);
+			}
+			switch_mutex_unlock(rtp_session->ring_mutex);
+
+			pkt = &rtp_session->ring[head % RTP_REACTOR_RING];
+			pkt->bytes = sizeof(pkt->data);
+			if (switch_socket_recvfrom(pkt->from, rtp_session->sock_input, 0, pkt->data, &pkt->bytes) != SWITCH_STATUS_SUCCESS || !pkt->bytes) {
+				break;
+			}
+
+			apr_atomic_xchg32(&rtp_session->ring_head, head + 1);
+			apr_atomic_inc32(&rtp_reactor_globals.packets);
+			apr_atomic_inc32(&rtp_reactor_globals.batches);
+			queued++;
+			continue;
+		}
+
+		for (i = 0; i < space; i++) {
+			rtp_reactor_packet_t *pkt = &rtp_session->ring[(head + i) % RTP_REACTOR_RING];
+			from[i] = pkt->from;
+			bufs[i] = pkt->data;
+			lens[i] = sizeof(pkt->data);
+		}
+
+		/* every free slot is filled by one recvmmsg() where available */
+		count = space;
+		if (switch_socket_recvmmsg(rtp_session->sock_input, from, bufs, lens, &count) != SWITCH_STATUS_SUCCESS || !count) {
+			break;
+		}
+
+		for (i = 0; i < count; i++) {
+			rtp_session->ring[(head + i) % RTP_REACTOR_RING].bytes = lens[i];
+		}
+
+		apr_atomic_xchg32(&rtp_session->ring_head, head + count);
+		apr_atomic_add32(&rtp_reactor_globals.packets, count);
+		apr_atomic_inc32(&rtp_reactor_globals.batches);
+		queued += count;
+
+		/* a short batch means the socket is empty, a later datagram raises a new edge */
+		if (count < space) {
+			break;
+		}
+	}
+
+	if (queued && apr_atomic_read32(&rtp_session->reactor_waiting)) {
+		apr_atomic_inc32(&rtp_reactor_globals.wakeups);
+		switch_mutex_lock(rtp_session->reactor_mutex);
+		switch_thread_cond_signal(rtp_session->reactor_cond);
+		switch_mutex_unlock(rtp_session->reactor_mutex);
+	}
+}
+
+static void rtp_reactor_relay(rtp_reactor_t *reactor, switch_rtp_t *rtp_session, switch_rtp_t *peer)
+{
+	char *bufs[RTP_REACTOR_BATCH];
+	switch_size_t lens[RTP_REACTOR_BATCH];
+	uint32_t i, count, out;
+
+	if (rtp_session->relay_pending) {
+		rtp_session->relay_pending = 0;
+		reactor->relay_pending--;
+	}
+
+	for (;;) {
+		/* never block the reactor on a session thread, take both locks before reading so a busy lock costs no packets */
+		if (switch_mutex_trylock(rtp_session->read_mutex) != SWITCH_STATUS_SUCCESS) {
+			goto busy;
+		}
+
+		if (switch_mutex_trylock(peer->write_mutex) != SWITCH_STATUS_SUCCESS) {
+			switch_mutex_unlock(rtp_session->read_mutex);
+			goto busy;
+		}
+
+		for (i = 0; i < RTP_REACTOR_BATCH; i++) {
+			bufs[i] = reactor->relay_buf + (i * RTP_REACTOR_PACKET);
+			lens[i] = RTP_REACTOR_PACKET;
+		}
+
+		count = RTP_REACTOR_BATCH;
+		if (switch_socket_recvmmsg(rtp_session->sock_input, reactor->relay_from, bufs, lens, &count) != SWITCH_STATUS_SUCCESS || !count) {
+			switch_mutex_unlock(peer->write_mutex);
+			switch_mutex_unlock(rtp_session->read_mutex);
+			break;
+		}
+
+		for (i = 0, out = 0; i < count; i++) {
+			rtp_msg_t *msg = (rtp_msg_t *) bufs[i];
+			switch_payload_t pt = peer->payload;
+			uint32_t ts;
+			int cng = 0;
+
+			if (lens[i] < rtp_header_len || msg->header.version != 2) {
+				continue;
+			}
+
+			rtp_session->stats.inbound.raw_bytes += lens[i];
+			rtp_session->stats.inbound.packet_count++;
+			rtp_session->relay_packets++;
+
+			if (rtp_session->recv_te && msg->header.pt == rtp_session->recv_te) {
+				rtp_session->stats.inbound.dtmf_packet_count++;
+				if (!(pt = peer->te)) {
+					continue;
+				}
+			} else if ((rtp_session->cng_pt && msg->header.pt == rtp_session->cng_pt) || msg->header.pt == 13) {
+				rtp_session->stats.inbound.cng_packet_count++;
+				if (!(pt = peer->cng_pt)) {
+					continue;
+				}
+				cng = 1;
+			} else {
+				rtp_session->stats.inbound.media_packet_count++;
+				rtp_session->stats.inbound.media_bytes += lens[i];
+			}
+
+			ts = ntohl(msg->header.ts);
+
+			if (rtp_session->relay_sync) {
+				/* continue the peer's own timeline so falling back to the full path is seamless */
+				rtp_session->relay_ts_offset = peer->last_write_ts + peer->samples_per_interval - ts;
+				rtp_session->relay_sync = 0;
+				msg->header.m = 1;
+			}
+
+			ts += rtp_session->relay_ts_offset;
+
+			msg->header.pt = pt;
+			msg->header.ssrc = htonl(peer->ssrc);
+			msg->header.seq = htons(++peer->seq);
+			msg->header.ts = htonl(ts);
+			peer->ts = peer->last_write_ts = ts;
+
+			peer->stats.outbound.raw_bytes += lens[i];
+			peer->stats.outbound.packet_count++;
+			if (cng) {
+				peer->stats.outbound.cng_packet_count++;
+			} else {
+				peer->stats.outbound.media_packet_count++;
+				peer->stats.outbound.media_bytes += lens[i];
+			}
+
+			bufs[out] = bufs[i];
+			lens[out] = lens[i];
+			out++;
+		}
+
+		if (out) {
+			if (peer->timer.interval) {
+				peer->last_write_samplecount = peer->timer.samplecount;
+			} else {
+				peer->last_write_timestamp = (uint32_t) switch_micro_time_now();
+			}
+			switch_socket_sendmmsg(peer->sock_output, peer->remote_addr, bufs, lens, &out);
+		}
+
+		switch_mutex_unlock(peer->write_mutex);
+		switch_mutex_unlock(rtp_session->read_mutex);
+
+		if (count < RTP_REACTOR_BATCH) {
+			break;
+		}
+	}
+
+	return;
+
+  busy:
+	/* edge triggered, so nothing would wake us for what is already queued, the reactor retries on a short timeout */
+	rtp_session->relay_pending = 1;
+	reactor->relay_pending++;
+}
+
+/* caller holds reactor->mutex */
+static void rtp_reactor_relay_retry(rtp_reactor_t *reactor)
+{
+	int idx;
+
+	for (idx = 0; idx < reactor->slot_count && reactor->relay_pending; idx++) {
+		switch_rtp_t *rtp_session = reactor->slots[idx].rtp_session;
+
+		if (!rtp_session || !rtp_session->relay_pending) {
+			continue;
+		}
+
+		if (rtp_session->relay_peer) {
+			rtp_reactor_relay(reactor, rtp_session, rtp_session->relay_peer);
+		} else {
+			rtp_session->relay_pending = 0;
+			reactor->relay_pending--;
+			rtp_reactor_drain(reactor, rtp_session);
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC rtp_reactor_thread(switch_thread_t *thread, void *obj)
+{
+	rtp_reactor_t *reactor = (rtp_reactor_t *) obj;
+	struct epoll_event events[RTP_REACTOR_EVENTS];
+	int pending = 0;
+
+	while (rtp_reactor_globals.running) {
+		int i, n = epoll_wait(reactor->efd, events, RTP_REACTOR_EVENTS, pending ? 1 : 100);
+
+		if (n < 0 || (!n && !pending)) {
+			continue;
+		}
+
+		switch_mutex_lock(reactor->mutex);
+		for (i = 0; i < n; i++) {
+			int idx = (int) (events[i].data.u64 & 0xffffffff);
+			uint32_t gen = (uint32_t) (events[i].data.u64 >> 32);
+
+			if (idx < reactor->slot_count && reactor->slots[idx].rtp_session && reactor->slots[idx].gen == gen) {
+				switch_rtp_t *rtp_session = reactor->slots[idx].rtp_session;
+
+				if (rtp_session->relay_peer) {
+					rtp_reactor_relay(reactor, rtp_session, rtp_session->relay_peer);
+				} else {
+					rtp_reactor_drain(reactor, rtp_session);
+				}
+			}
+		}
+		if (reactor->relay_pending) {
+			rtp_reactor_relay_retry(reactor);
+		}
+		pending = reactor->relay_pending;
+		switch_mutex_unlock(reactor->mutex);
+	}
+
+	return NULL;
+}
+
+static switch_status_t rtp_reactor_start(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	int i, j;
+
+	switch_mutex_lock(rtp_reactor_globals.mutex);
+
+	if (rtp_reactor_globals.started) {
+		switch_mutex_unlock(rtp_reactor_globals.mutex);
+		return rtp_reactor_globals.running ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+	}
+
+	rtp_reactor_globals.started = 1;
+	rtp_reactor_globals.running = 1;
+
+	for (i = 0; i < rtp_reactor_globals.threads; i++) {
+		rtp_reactor_t *reactor = &rtp_reactor_globals.reactors[i];
+
+		if ((reactor->efd = epoll_create(1024)) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create RTP reactor epoll fd, RTP will be read by the session threads.\n");
+			rtp_reactor_globals.threads = i;
+			break;
+		}
+
+		switch_mutex_init(&reactor->mutex, SWITCH_MUTEX_NESTED, rtp_reactor_globals.pool);
+		switch_sockaddr_info_get(&reactor->scratch_from, NULL, SWITCH_UNSPEC, 0, 0, rtp_reactor_globals.pool);
+		reactor->relay_buf = switch_core_alloc(rtp_reactor_globals.pool, RTP_REACTOR_BATCH * RTP_REACTOR_PACKET);
+		for (j = 0; j < RTP_REACTOR_BATCH; j++) {
+			switch_sockaddr_info_get(&reactor->relay_from[j], NULL, SWITCH_UNSPEC, 0, 0, rtp_reactor_globals.pool);
+		}
+		reactor->slot_free = -1;
+
+		switch_threadattr_create(&thd_attr, rtp_reactor_globals.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_increase(thd_attr);
+		switch_thread_create(&reactor->thread, thd_attr, rtp_reactor_thread, reactor, rtp_reactor_globals.pool);
+	}
+
+	if (!rtp_reactor_globals.threads) {
+		rtp_reactor_globals.running = 0;
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Started %d RTP reactor thread(s)\n", rtp_reactor_globals.threads);
+	}
+
+	switch_mutex_unlock(rtp_reactor_globals.mutex);
+
+	return rtp_reactor_globals.running ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
+static void rtp_reactor_stop(void)
+{
+	switch_status_t st;
+	int i;
+
+	if (!rtp_reactor_globals.started) {
+		return;
+	}
+
+	rtp_reactor_globals.running = 0;
+
+	for (i = 0; i < rtp_reactor_globals.threads; i++) {
+		rtp_reactor_t *reactor = &rtp_reactor_globals.reactors[i];
+
+		if (reactor->thread) {
+			switch_thread_join(&st, reactor->thread);
+			reactor->thread = NULL;
+		}
+		if (reactor->efd > -1) {
+			close(reactor->efd);
+			reactor->efd = -1;
+		}
+		switch_safe_free(reactor->slots);
+	}
+}
+
+static void rtp_reactor_add(switch_rtp_t *rtp_session)
+{
+	rtp_reactor_t *reactor;
+	switch_os_socket_t fd;
+	struct epoll_event ev = { 0 };
+	int idx, i;
+
+	if (!rtp_reactor_globals.threads || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO) || rtp_session->reactor ||
+		switch_os_sock_get(&fd, rtp_session->sock_input) != SWITCH_STATUS_SUCCESS || rtp_reactor_start() != SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	if (!rtp_session->ring) {
+		rtp_session->ring = switch_core_alloc(rtp_session->pool, sizeof(rtp_reactor_packet_t) * RTP_REACTOR_RING);
+		for (i = 0; i < RTP_REACTOR_RING; i++) {
+			switch_sockaddr_info_get(&rtp_session->ring[i].from, NULL, SWITCH_UNSPEC, 0, 0, rtp_session->pool);
+		}
+		switch_mutex_init(&rtp_session->reactor_mutex, SWITCH_MUTEX_NESTED, rtp_session->pool);
+		switch_mutex_init(&rtp_session->ring_mutex, SWITCH_MUTEX_NESTED, rtp_session->pool);
+		switch_thread_cond_create(&rtp_session->reactor_cond, rtp_session->pool);
+	}
+
+	apr_atomic_set32(&rtp_session->ring_head, 0);
+	apr_atomic_set32(&rtp_session->ring_tail, 0);
+
+	/* the reactor reads until EAGAIN, the session thread never touches the socket again */
+	switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, TRUE);
+
+	reactor = &rtp_reactor_globals.reactors[apr_atomic_inc32(&rtp_reactor_globals.next) % rtp_reactor_globals.threads];
+
+	switch_mutex_lock(reactor->mutex);
+
+	if ((idx = reactor->slot_free) > -1) {
+		reactor->slot_free = reactor->slots[idx].next_free;
+	} else {
+		if (!reactor->slot_count || !(reactor->sessions < (uint32_t) reactor->slot_count)) {
+			int count = reactor->slot_count ? reactor->slot_count * 2 : 256;
+			rtp_reactor_slot_t *slots = realloc(reactor->slots, sizeof(*slots) * count);
+
+			switch_assert(slots);
+			memset(slots + reactor->slot_count, 0, sizeof(*slots) * (count - reactor->slot_count));
+			reactor->slots = slots;
+			reactor->slot_count = count;
+		}
+		idx = reactor->sessions;
+	}
+
+	reactor->slots[idx].rtp_session = rtp_session;
+	reactor->slots[idx].next_free = -1;
+	reactor->sessions++;
+
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.u64 = ((uint64_t) reactor->slots[idx].gen << 32) | (uint32_t) idx;
+
+	if (epoll_ctl(reactor->efd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+		rtp_session->reactor = reactor;
+		rtp_session->reactor_slot = idx;
+	} else {
+		reactor->slots[idx].rtp_session = NULL;
+		reactor->slots[idx].next_free = reactor->slot_free;
+		reactor->slot_free = idx;
+		reactor->sessions--;
+		switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK) ? TRUE : FALSE);
+	}
+
+	switch_mutex_unlock(reactor->mutex);
+}
+
+/* caller holds rtp_reactor_globals.mutex */
+static void rtp_relay_unlink(switch_rtp_t *rtp_session)
+{
+	switch_rtp_t *source;
+
+	if (rtp_session->relay_peer) {
+		switch_mutex_lock(rtp_session->reactor->mutex);
+		rtp_session->relay_peer->relay_source = NULL;
+		rtp_session->relay_peer = NULL;
+		switch_mutex_unlock(rtp_session->reactor->mutex);
+	}
+
+	if ((source = rtp_session->relay_source)) {
+		switch_mutex_lock(source->reactor->mutex);
+		source->relay_peer = NULL;
+		switch_mutex_unlock(source->reactor->mutex);
+		rtp_session->relay_source = NULL;
+	}
+}
+
+static int rtp_relay_capable(switch_rtp_t *rtp_session)
+{
+	return rtp_session->reactor && rtp_session->sock_output && rtp_session->remote_addr &&
+		switch_test_flag(rtp_session, SWITCH_RTP_FLAG_IO) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SHUTDOWN) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_UDPTL) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_AUTOADJ) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VAD) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_RECV) &&
+		!switch_test_flag(rtp_session, SWITCH_ZRTP_FLAG_SECURE_SEND) &&
+		!switch_test_flag(rtp_session, SWITCH_ZRTP_FLAG_SECURE_RECV);
+}
+
+static void rtp_reactor_remove(switch_rtp_t *rtp_session)
+{
+	rtp_reactor_t *reactor = rtp_session->reactor;
+	switch_os_socket_t fd;
+	int idx = rtp_session->reactor_slot;
+
+	if (!reactor) {
+		return;
+	}
+
+	switch_mutex_lock(rtp_reactor_globals.mutex);
+	rtp_relay_unlink(rtp_session);
+	switch_mutex_unlock(rtp_reactor_globals.mutex);
+
+	/* once the slot is cleared under the reactor mutex no event for this session can be in flight */
+	switch_mutex_lock(reactor->mutex);
+	if (rtp_session->relay_pending) {
+		rtp_session->relay_pending = 0;
+		reactor->relay_pending--;
+	}
+	reactor->slots[idx].rtp_session = NULL;
+	reactor->slots[idx].gen++;
+	reactor->slots[idx].next_free = reactor->slot_free;
+	reactor->slot_free = idx;
+	reactor->sessions--;
+	switch_mutex_unlock(reactor->mutex);
+
+	if (switch_os_sock_get(&fd, rtp_session->sock_input) == SWITCH_STATUS_SUCCESS) {
+		epoll_ctl(reactor->efd, EPOLL_CTL_DEL, fd, NULL);
+	}
+
+	rtp_session->reactor = NULL;
+
+	switch_mutex_lock(rtp_session->reactor_mutex);
+	switch_thread_cond_signal(rtp_session->reactor_cond);
+	switch_mutex_unlock(rtp_session->reactor_mutex);
+}
+
+static switch_status_t rtp_reactor_pop(switch_rtp_t *rtp_session, switch_size_t *bytes)
+{
+	apr_uint32_t tail;
+	rtp_reactor_packet_t *pkt;
+	switch_sockaddr_t *from;
+
+	/* the reactor may drop the oldest packet under us when the ring is full, so the slot is only read under ring_mutex */
+	switch_mutex_lock(rtp_session->ring_mutex);
+
+	tail = apr_atomic_read32(&rtp_session->ring_tail);
+
+	if (apr_atomic_read32(&rtp_session->ring_head) == tail) {
+		switch_mutex_unlock(rtp_session->ring_mutex);
+		*bytes = 0;
+		return SWITCH_STATUS_BREAK;
+	}
+
+	pkt = &rtp_session->ring[tail % RTP_REACTOR_RING];
+
+	*bytes = pkt->bytes;
+	memcpy((void *) &rtp_session->recv_msg, pkt->data, pkt->bytes);
+
+	/* hand our address holder to the slot and keep the one the packet came with */
+	from = rtp_session->from_addr;
+	rtp_session->from_addr = pkt->from;
+	pkt->from = from;
+
+	apr_atomic_xchg32(&rtp_session->ring_tail, tail + 1);
+
+	switch_mutex_unlock(rtp_session->ring_mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t rtp_reactor_wait(switch_rtp_t *rtp_session, switch_interval_time_t timeout)
+{
+	switch_status_t status = SWITCH_STATUS_TIMEOUT;
+
+	if (apr_atomic_read32(&rtp_session->ring_head) != apr_atomic_read32(&rtp_session->ring_tail)) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!timeout) {
+		return SWITCH_STATUS_TIMEOUT;
+	}
+
+	switch_mutex_lock(rtp_session->reactor_mutex);
+	apr_atomic_xchg32(&rtp_session->reactor_waiting, 1);
+	if (rtp_session->reactor && apr_atomic_read32(&rtp_session->ring_head) == apr_atomic_read32(&rtp_session->ring_tail)) {
+		switch_thread_cond_timedwait(rtp_session->reactor_cond, rtp_session->reactor_mutex, timeout);
+	}
+	apr_atomic_xchg32(&rtp_session->reactor_waiting, 0);
+	switch_mutex_unlock(rtp_session->reactor_mutex);
+
+	if (apr_atomic_read32(&rtp_session->ring_head) != apr_atomic_read32(&rtp_session->ring_tail)) {
+		status = SWITCH_STATUS_SUCCESS;
+	} else if (!rtp_session->reactor) {
+		status = SWITCH_STATUS_BREAK;
+	}
+
+	return status;
+}
+#endif
+
+static switch_status_t rtp_read_poll(switch_rtp_t *rtp_session, int32_t *fdr, switch_interval_time_t timeout)
+{
+#ifdef RTP_REACTOR
+	if (rtp_session->reactor) {
+		return rtp_reactor_wait(rtp_session, timeout);
+	}
+#endif
+	return switch_poll(rtp_session->read_pollfd, 1, fdr, timeout);
+}
+
+SWITCH_DECLARE(void) switch_rtp_set_reactor_threads(int threads)
+{
+#ifdef RTP_REACTOR
+	if (rtp_reactor_globals.started) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "RTP reactor threads can only be set before the first call.\n");
+		return;
+	}
+
+	if (threads < 0) {
+		threads = (int) switch_core_cpu_count();
+	}
+
+	rtp_reactor_globals.threads = threads > RTP_REACTOR_MAX ? RTP_REACTOR_MAX : threads;
+#else
+	if (threads) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "RTP reactor mode is not supported on this platform.\n");
+	}
+#endif
+}
+
+SWITCH_DECLARE(void) switch_rtp_reactor_stats(switch_stream_handle_t *stream)
+{
+#ifdef RTP_REACTOR
+	uint32_t packets, batches;
+
+	if (!rtp_reactor_globals.running) {
+		return;
+	}
+
+	packets = apr_atomic_read32(&rtp_reactor_globals.packets);
+	batches = apr_atomic_read32(&rtp_reactor_globals.batches);
+
+	stream->write_function(stream, "%d rtp reactor thread(s), %u packet(s) in %u read(s) (%0.2f per read), %u session wakeup(s), %u dropped\n",
+						   rtp_reactor_globals.threads, packets, batches, batches ? (double) packets / batches : 0.0,
+						   apr_atomic_read32(&rtp_reactor_globals.wakeups), apr_atomic_read32(&rtp_reactor_globals.drops));
+#endif
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_set_relay(switch_rtp_t *rtp_session, switch_rtp_t *peer)
+{
+#ifdef RTP_REACTOR
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	if (!rtp_session || !rtp_session->reactor || rtp_session == peer) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* before the globals mutex, socket teardown takes them the other way round */
+	if (peer) {
+		READ_INC(rtp_session);
+		rtp_session->relay_packets = 0;
+		rtp_session->relay_heard = switch_micro_time_now();
+		READ_DEC(rtp_session);
+	}
+
+	switch_mutex_lock(rtp_reactor_globals.mutex);
+
+	if (!peer) {
+		rtp_relay_unlink(rtp_session);
+		status = SWITCH_STATUS_SUCCESS;
+		goto end;
+	}
+
+	if (rtp_session->relay_peer == peer) {
+		status = SWITCH_STATUS_SUCCESS;
+		goto end;
+	}
+
+	if (rtp_session->relay_peer || peer->relay_source || !rtp_relay_capable(rtp_session) || !rtp_relay_capable(peer) ||
+		(rtp_session->recv_te && !peer->te)) {
+		goto end;
+	}
+
+	switch_mutex_lock(rtp_session->reactor->mutex);
+	rtp_session->relay_peer = peer;
+	rtp_session->relay_sync = 1;
+	switch_mutex_unlock(rtp_session->reactor->mutex);
+	peer->relay_source = rtp_session;
+	status = SWITCH_STATUS_SUCCESS;
+
+  end:
+	switch_mutex_unlock(rtp_reactor_globals.mutex);
+
+	return status;
+#else
+	return SWITCH_STATUS_FALSE;
+#endif
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_relay_check(switch_rtp_t *rtp_session)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+#ifdef RTP_REACTOR
+	switch_time_t now = switch_micro_time_now();
+	uint32_t ms = rtp_session->ms_per_packet ? rtp_session->ms_per_packet / 1000 : 20;
+
+	/* the read path is bypassed while relaying, so keep its media timeout going from what the reactor saw */
+	READ_INC(rtp_session);
+	if (rtp_session->relay_packets) {
+		rtp_session->relay_packets = 0;
+		rtp_session->relay_heard = now;
+		rtp_session->missed_count = 0;
+	} else if (rtp_session->relay_heard) {
+		rtp_session->missed_count = (uint32_t) ((now - rtp_session->relay_heard) / 1000) / ms;
+	}
+
+	if (rtp_session->max_missed_packets && rtp_session->missed_count >= rtp_session->max_missed_packets) {
+		status = SWITCH_STATUS_TIMEOUT;
+	}
+	READ_DEC(rtp_session);
+#endif
+
+	return status;
+}
+
 SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool)
 {
 #ifdef ENABLE_ZRTP
@@ -646,6 +1410,10 @@ SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool)
 #endif
 	srtp_init();
 	switch_mutex_init(&port_lock, SWITCH_MUTEX_NESTED, pool);
+#ifdef RTP_REACTOR
+	rtp_reactor_globals.pool = pool;
+	switch_mutex_init(&rtp_reactor_globals.mutex, SWITCH_MUTEX_NESTED, pool);
+#endif
 	global_init = 1;
 }
 
@@ -675,6 +1443,10 @@ SWITCH_DECLARE(void) switch_rtp_shutdown(void)
 	switch_core_hash_destroy(&alloc_hash);
 	switch_mutex_unlock(port_lock);
 
+#ifdef RTP_REACTOR
+	rtp_reactor_stop();
+#endif
+
 #ifdef ENABLE_ZRTP
 	if (zrtp_on) {
 		zrtp_status_t status = zrtp_status_ok;
@@ -978,6 +1750,10 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 		status = SWITCH_STATUS_SUCCESS;
 		*err = "Success";
 	}
+
+#ifdef RTP_REACTOR
+	rtp_reactor_add(rtp_session);
+#endif
 	
 	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_IO);
 
@@ -1074,6 +1850,9 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_udptl_mode(switch_rtp_t *rtp_session)
 
 	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_UDPTL);
 	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA);
+#ifdef RTP_REACTOR
+	if (!rtp_session->reactor)
+#endif
 	switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, FALSE);
 
 	switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
@@ -1425,6 +2204,9 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_create(switch_rtp_t **new_rtp_session
 
 	if (channel) {
 		switch_channel_set_private(channel, "__rtcp_audio_rtp_session", rtp_session);
+		if (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO)) {
+			switch_channel_set_private(channel, "__rtp_audio_session", rtp_session);
+		}
 	}
 
 #ifdef ENABLE_ZRTP
@@ -1608,10 +2390,98 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_activate_stun_ping(switch_rtp_t *rtp_
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* Waveform substitution for G.711: keep repeating the last pitch period of the last good frame, fading it out */
+static int rtp_jb_plc(stfu_instance_t *jb, stfu_frame_t *frame, uint32_t count, void *user_data)
+{
+	switch_rtp_t *rtp_session = (switch_rtp_t *) user_data;
+	int16_t out[RTP_PLC_MAX_SAMPLES];
+	uint32_t n = (uint32_t) frame->dlen, k, lag, max_lag;
+	double gain, step;
+
+	if ((frame->pt != 0 && frame->pt != 8) || n < RTP_PLC_MIN_PITCH * 2 || n > RTP_PLC_MAX_SAMPLES) {
+		return 0;
+	}
+
+	if (count == 1) {
+		double best = 0;
+
+		if (frame->pt == 0) {
+			ulaw_decode_block(rtp_session->plc_hist, frame->data, n);
+		} else {
+			alaw_decode_block(rtp_session->plc_hist, frame->data, n);
+		}
+
+		/* pick the lag where the tail of the frame best matches itself */
+		max_lag = n / 2 < RTP_PLC_MAX_PITCH ? n / 2 : RTP_PLC_MAX_PITCH;
+		rtp_session->plc_pitch = max_lag;
+
+		for (lag = RTP_PLC_MIN_PITCH; lag <= max_lag; lag++) {
+			double corr = 0, energy = 1;
+
+			for (k = n - max_lag; k < n; k++) {
+				corr += (double) rtp_session->plc_hist[k] * rtp_session->plc_hist[k - lag];
+				energy += (double) rtp_session->plc_hist[k - lag] * rtp_session->plc_hist[k - lag];
+			}
+
+			if (corr > 0 && corr * corr / energy > best) {
+				best = corr * corr / energy;
+				rtp_session->plc_pitch = lag;
+			}
+		}
+
+		rtp_session->plc_len = n;
+		rtp_session->plc_pos = 0;
+	} else if (n != rtp_session->plc_len) {
+		return 0;
+	}
+
+	/* full level for the first frame, then fade to silence by the time the jitter buffer gives up */
+	gain = count == 1 ? 1.0 : 1.0 - (double) (count - 1) / STFU_MAX_PLC;
+	step = count == 1 ? 0 : (1.0 / STFU_MAX_PLC) / n;
+
+	for (k = 0; k < n; k++) {
+		uint32_t src = n - rtp_session->plc_pitch + (rtp_session->plc_pos++ % rtp_session->plc_pitch);
+
+		out[k] = (int16_t) (rtp_session->plc_hist[src] * (gain > 0 ? gain : 0));
+		gain -= step;
+	}
+
+	if (frame->pt == 0) {
+		ulaw_encode_block(frame->data, out, n);
+	} else {
+		alaw_encode_block(frame->data, out, n);
+	}
+
+	return 1;
+}
+
+/* Mirror the jitter buffer's own counters into the session stats */
+static void rtp_jb_stats(switch_rtp_t *rtp_session)
+{
+	stfu_report_t r = { 0 };
+	uint32_t ms = rtp_session->ms_per_packet / 1000;
+
+	stfu_n_report(rtp_session->jb, &r);
+
+	rtp_session->stats.inbound.jb_plc_packet_count = r.plc;
+	rtp_session->stats.inbound.jb_late_packet_count = r.late;
+	rtp_session->stats.inbound.jb_reorder_packet_count = r.reordered;
+	rtp_session->stats.inbound.jb_drop_packet_count = r.dropped;
+	rtp_session->stats.inbound.jb_target_ms = r.out_len * ms;
+
+	if (rtp_session->samples_per_interval) {
+		rtp_session->stats.inbound.jb_jitter_ms = (switch_size_t) r.jitter * ms / rtp_session->samples_per_interval;
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_rtp_activate_jitter_buffer(switch_rtp_t *rtp_session, uint32_t queue_frames)
 {
 
-	rtp_session->jb = stfu_n_init(queue_frames);
+	if (!(rtp_session->jb = stfu_n_init(queue_frames))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	stfu_n_set_plc_func(rtp_session->jb, rtp_jb_plc, rtp_session);
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -1686,6 +2556,9 @@ SWITCH_DECLARE(void) switch_rtp_kill_socket(switch_rtp_t *rtp_session)
 	switch_mutex_lock(rtp_session->flag_mutex);
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_IO)) {
 		switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_IO);
+#ifdef RTP_REACTOR
+		rtp_reactor_remove(rtp_session);
+#endif
 		if (rtp_session->sock_input) {
 			ping_socket(rtp_session);
 			switch_socket_shutdown(rtp_session->sock_input, SWITCH_SHUTDOWN_READWRITE);
@@ -2022,6 +2895,18 @@ static void do_flush(switch_rtp_t *rtp_session)
 			}
 		}
 
+#ifdef RTP_REACTOR
+		if (rtp_session->reactor) {
+			while (rtp_reactor_pop(rtp_session, &bytes) == SWITCH_STATUS_SUCCESS) {
+				rtp_session->stats.inbound.raw_bytes += bytes;
+				rtp_session->stats.inbound.flush_packet_count++;
+				rtp_session->stats.inbound.packet_count++;
+			}
+			READ_DEC(rtp_session);
+			return;
+		}
+#endif
+
 		if (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK)) {
 			was_blocking = 1;
 			switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
@@ -2060,8 +2945,15 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 
 	switch_assert(bytes);
 
-	*bytes = sizeof(rtp_msg_t);
-	status = switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, bytes);
+#ifdef RTP_REACTOR
+	if (rtp_session->reactor) {
+		status = rtp_reactor_pop(rtp_session, bytes);
+	} else
+#endif
+	{
+		*bytes = sizeof(rtp_msg_t);
+		status = switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, bytes);
+	}
 
 	if (*bytes) {
 		rtp_session->stats.inbound.raw_bytes += *bytes;
@@ -2085,7 +2977,11 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 	
 
 	if (rtp_session->jb && rtp_session->recv_msg.header.version == 2 && *bytes) {
-		if (rtp_session->recv_msg.header.m && rtp_session->recv_msg.header.pt != rtp_session->recv_te && 
+		if (rtp_session->recv_msg.header.ssrc != rtp_session->jb_ssrc) {
+			/* another sender, its timestamps say nothing about the old one's transit times */
+			rtp_session->jb_ssrc = rtp_session->recv_msg.header.ssrc;
+			stfu_n_resync(rtp_session->jb);
+		} else if (rtp_session->recv_msg.header.m && rtp_session->recv_msg.header.pt != rtp_session->recv_te && 
 			!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO) && !(rtp_session->rtp_bugs & RTP_BUG_IGNORE_MARK_BIT)) {
 			stfu_n_reset(rtp_session->jb);
 		}
@@ -2110,6 +3006,8 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 
 			status = SWITCH_STATUS_SUCCESS;
 		}
+
+		rtp_jb_stats(rtp_session);
 	}
 
 	return status;
@@ -2258,7 +3156,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 		if (rtp_session->timer.interval) {
 			if ((switch_test_flag(rtp_session, SWITCH_RTP_FLAG_AUTOFLUSH) || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH)) &&
 				rtp_session->read_pollfd) {
-				if (switch_poll(rtp_session->read_pollfd, 1, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
+				if (rtp_read_poll(rtp_session, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
 					rtp_session->hot_hits += rtp_session->samples_per_interval;
 
 					if (rtp_session->hot_hits >= rtp_session->samples_per_second * 5) {
@@ -2301,7 +3199,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 				pt = 20000;
 			}
 			
-			poll_status = switch_poll(rtp_session->read_pollfd, 1, &fdr, pt);
+			poll_status = rtp_read_poll(rtp_session, &fdr, pt);
 			if (rtp_session->dtmf_data.out_digit_dur > 0) {
 				do_2833(rtp_session);
 			}
@@ -2798,7 +3696,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 			uint8_t *data = (uint8_t *) rtp_session->recv_msg.body;
 			int fdr;
 
-			if ((poll_status = switch_poll(rtp_session->read_pollfd, 1, &fdr, 0)) == SWITCH_STATUS_SUCCESS) {
+			if ((poll_status = rtp_read_poll(rtp_session, &fdr, 0)) == SWITCH_STATUS_SUCCESS) {
 				goto recvfrom;
 			}
 
@@ -3012,12 +3910,15 @@ SWITCH_DECLARE(switch_status_t) switch_rtcp_zerocopy_read_frame(switch_rtp_t *rt
 SWITCH_DECLARE(switch_status_t) switch_rtp_zerocopy_read_frame(switch_rtp_t *rtp_session, switch_frame_t *frame, switch_io_flag_t io_flags)
 {
 	int bytes = 0;
+	switch_time_t probe_start;
 
 	if (!switch_rtp_ready(rtp_session)) {
 		return SWITCH_STATUS_FALSE;
 	}
 
+	probe_start = switch_core_probe_start();
 	bytes = rtp_common_read(rtp_session, &frame->payload, &frame->flags, io_flags);
+	switch_core_probe_end(SWITCH_PROBE_RTP_READ, probe_start);
 
 	frame->data = rtp_session->recv_msg.body;
 	frame->packet = &rtp_session->recv_msg;
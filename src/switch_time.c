@@ -34,6 +34,10 @@
 #include <switch.h>
 #include <stdio.h>
 #include "private/switch_core_pvt.h"
+#if defined(HAVE_TIMERFD_CREATE)
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#endif
 
 //#if defined(DARWIN)
 #define DISABLE_1MS_COND
@@ -71,6 +75,8 @@ static int COND = 1;
 
 static int MATRIX = 1;
 
+static int TFD = 0;
+
 #ifdef WIN32
 static switch_time_t win32_tick_time_since_start = -1;
 static DWORD win32_last_get_time_tick = 0;
@@ -332,6 +338,14 @@ SWITCH_DECLARE(void) switch_time_set_nanosleep(switch_bool_t enable)
 #endif
 }
 
+SWITCH_DECLARE(void) switch_time_set_timerfd(switch_bool_t enable)
+{
+#if defined(HAVE_TIMERFD_CREATE)
+	TFD = enable ? 1 : 0;
+	switch_time_sync();
+#endif
+}
+
 SWITCH_DECLARE(void) switch_time_set_cond_yield(switch_bool_t enable)
 {
 	COND = enable ? 1 : 0;
@@ -485,7 +499,6 @@ static switch_status_t timer_init(switch_timer_t *timer)
 		switch_mutex_unlock(globals.mutex);
 		timer->private_info = private_info;
 		private_info->start = private_info->reference = TIMER_MATRIX[timer->interval].tick;
-		private_info->start -= 2; /* switch_core_timer_init sets samplecount to samples, this makes first next() step once */
 		private_info->roll = TIMER_MATRIX[timer->interval].roll;
 		private_info->ready = 1;
 
@@ -526,7 +539,9 @@ static switch_status_t timer_step(switch_timer_t *timer)
 	}
 
 	check_roll();
-	samples = timer->samples * (private_info->reference - private_info->start);
+	/* switch_core_timer_init already accounts for the first interval in samplecount, each step adds one more */
+	private_info->reference++;
+	samples = timer->samples * (private_info->reference - private_info->start + 1);
 
 	if (samples > UINT32_MAX) {
 		private_info->start = private_info->reference;
@@ -534,7 +549,6 @@ static switch_status_t timer_step(switch_timer_t *timer)
 	}
 
 	timer->samplecount = (uint32_t) samples;
-	private_info->reference++;
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -658,6 +672,379 @@ static switch_status_t timer_destroy(switch_timer_t *timer)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#if defined(HAVE_TIMERFD_CREATE)
+/* 
+   timerfd timer: every interval bucket owns one periodic CLOCK_MONOTONIC timerfd, 
+   a single epoll reactor thread reads the expirations and wakes the waiters of that bucket
+   so nobody has to poll the 1ms soft clock.
+*/
+
+#define MAX_TFD_EVENTS 64
+
+struct interval_timer {
+	int fd;
+	uint32_t count;
+	uint64_t tick;
+	switch_time_t last;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+};
+typedef struct interval_timer interval_timer_t;
+
+struct tfd_private {
+	uint64_t reference;
+	uint64_t start;
+	uint32_t ready;
+};
+typedef struct tfd_private tfd_private_t;
+
+static interval_timer_t TFD_MATRIX[MAX_ELEMENTS + 1];
+
+static struct {
+	int epfd;
+	int32_t running;
+	switch_mutex_t *mutex;
+	switch_thread_t *thread;
+} tfd_globals;
+
+static void *SWITCH_THREAD_FUNC timerfd_reactor_thread(switch_thread_t *thread, void *obj)
+{
+	struct epoll_event events[MAX_TFD_EVENTS];
+	switch_time_t too_late = STEP_MIC * 1000;
+	int i, n, fwd_errs = 0, rev_errs = 0;
+	uint32_t x;
+
+	while (tfd_globals.running == 1) {
+		if ((n = epoll_wait(tfd_globals.epfd, events, MAX_TFD_EVENTS, 100)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "timerfd reactor epoll_wait failed: %s\n", strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			interval_timer_t *it = &TFD_MATRIX[events[i].data.u32];
+			uint64_t expirations = 0, steps;
+			switch_time_t now;
+
+			if (read(it->fd, &expirations, sizeof(expirations)) != sizeof(expirations) || !expirations) {
+				continue;
+			}
+
+			now = time_now(0);
+			steps = expirations;
+
+			if (it->last && now < it->last) {
+				if (MONO) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Virtual Migration Detected! Syncing Clock\n");
+					switch_time_sync();
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Reverse Clock Skew Detected!\n");
+					rev_errs++;
+				}
+				steps = 1;
+			} else if (it->last && (now - it->last) > too_late) {
+				/* the kernel counted every period we missed, don't make the timers burst to catch up */
+				if (MONO) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Virtual Migration Detected! Syncing Clock\n");
+					switch_time_sync();
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Forward Clock Skew Detected!\n");
+					fwd_errs++;
+				}
+				steps = 1;
+			} else {
+				fwd_errs = rev_errs = 0;
+			}
+
+			if (fwd_errs > 9 || rev_errs > 9) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Auto Re-Syncing clock.\n");
+				switch_time_sync();
+				fwd_errs = rev_errs = 0;
+			}
+
+			it->last = now;
+
+			switch_mutex_lock(it->mutex);
+			it->tick += steps;
+			switch_thread_cond_broadcast(it->cond);
+			switch_mutex_unlock(it->mutex);
+		}
+	}
+
+	tfd_globals.running = 0;
+
+	for (x = 1; x <= MAX_ELEMENTS; x++) {
+		if (TFD_MATRIX[x].mutex) {
+			switch_mutex_lock(TFD_MATRIX[x].mutex);
+			switch_thread_cond_broadcast(TFD_MATRIX[x].cond);
+			switch_mutex_unlock(TFD_MATRIX[x].mutex);
+		}
+	}
+
+	return NULL;
+}
+
+static switch_status_t tfd_timer_start(void)
+{
+	uint32_t x;
+
+	memset(&tfd_globals, 0, sizeof(tfd_globals));
+	memset(TFD_MATRIX, 0, sizeof(TFD_MATRIX));
+
+	for (x = 0; x <= MAX_ELEMENTS; x++) {
+		TFD_MATRIX[x].fd = -1;
+	}
+
+	tfd_globals.epfd = -1;
+	switch_mutex_init(&tfd_globals.mutex, SWITCH_MUTEX_NESTED, module_pool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* called with tfd_globals.mutex held by the first tfd_timer_init, nothing runs until a timerfd timer is actually used */
+static switch_status_t tfd_reactor_start(void)
+{
+	switch_threadattr_t *thd_attr;
+
+	if (tfd_globals.running) {
+		return tfd_globals.running == 1 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+	}
+
+	if ((tfd_globals.epfd = epoll_create(MAX_TFD_EVENTS)) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "epoll_create failed, timerfd timer disabled: %s\n", strerror(errno));
+		tfd_globals.running = -1;
+		return SWITCH_STATUS_FALSE;
+	}
+
+	tfd_globals.running = 1;
+
+	switch_threadattr_create(&thd_attr, module_pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_threadattr_priority_increase(thd_attr);
+	switch_thread_create(&tfd_globals.thread, thd_attr, timerfd_reactor_thread, NULL, module_pool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void tfd_timer_stop(void)
+{
+	switch_status_t st;
+	uint32_t x;
+
+	switch_mutex_lock(tfd_globals.mutex);
+	if (!tfd_globals.thread) {
+		tfd_globals.running = -1;
+		switch_mutex_unlock(tfd_globals.mutex);
+		return;
+	}
+
+	tfd_globals.running = -1;
+	switch_mutex_unlock(tfd_globals.mutex);
+	switch_thread_join(&st, tfd_globals.thread);
+	tfd_globals.thread = NULL;
+	tfd_globals.running = -1;
+
+	for (x = 1; x <= MAX_ELEMENTS; x++) {
+		if (TFD_MATRIX[x].fd > -1) {
+			close(TFD_MATRIX[x].fd);
+			TFD_MATRIX[x].fd = -1;
+		}
+	}
+
+	if (tfd_globals.epfd > -1) {
+		close(tfd_globals.epfd);
+		tfd_globals.epfd = -1;
+	}
+}
+
+static int tfd_timer_arm(int fd, int interval)
+{
+	struct itimerspec val;
+
+	memset(&val, 0, sizeof(val));
+
+	if (interval) {
+		val.it_interval.tv_sec = interval / 1000;
+		val.it_interval.tv_nsec = (interval % 1000) * 1000000;
+		val.it_value = val.it_interval;
+	}
+
+	return timerfd_settime(fd, 0, &val, NULL);
+}
+
+static switch_status_t tfd_timer_init(switch_timer_t *timer)
+{
+	tfd_private_t *private_info;
+	interval_timer_t *it;
+
+	if (tfd_globals.running < 0 || timer->interval < 1 || timer->interval > MAX_ELEMENTS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!(private_info = switch_core_alloc(timer->memory_pool, sizeof(*private_info)))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	it = &TFD_MATRIX[timer->interval];
+
+	switch_mutex_lock(tfd_globals.mutex);
+
+	if (tfd_reactor_start() != SWITCH_STATUS_SUCCESS) {
+		switch_mutex_unlock(tfd_globals.mutex);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!it->mutex) {
+		switch_mutex_init(&it->mutex, SWITCH_MUTEX_NESTED, module_pool);
+		switch_thread_cond_create(&it->cond, module_pool);
+	}
+
+	if (it->fd < 0) {
+		struct epoll_event e = { 0 };
+
+		if ((it->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "timerfd_create failed: %s\n", strerror(errno));
+			it->fd = -1;
+			switch_mutex_unlock(tfd_globals.mutex);
+			return SWITCH_STATUS_FALSE;
+		}
+
+		e.events = EPOLLIN;
+		e.data.u32 = timer->interval;
+
+		if (epoll_ctl(tfd_globals.epfd, EPOLL_CTL_ADD, it->fd, &e) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "epoll_ctl failed: %s\n", strerror(errno));
+			close(it->fd);
+			it->fd = -1;
+			switch_mutex_unlock(tfd_globals.mutex);
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	if (!it->count++) {
+		/* the fd is kept open once created, it is only disarmed while the bucket is unused */
+		it->last = 0;
+		tfd_timer_arm(it->fd, timer->interval);
+	}
+
+	switch_mutex_unlock(tfd_globals.mutex);
+
+	timer->private_info = private_info;
+	private_info->start = private_info->reference = it->tick;
+	private_info->ready = 1;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t tfd_timer_step(switch_timer_t *timer)
+{
+	tfd_private_t *private_info = timer->private_info;
+	uint64_t samples;
+
+	if (tfd_globals.running != 1 || private_info->ready == 0) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* switch_core_timer_init already accounts for the first interval in samplecount, each step adds one more */
+	private_info->reference++;
+	samples = timer->samples * (private_info->reference - private_info->start + 1);
+
+	if (samples > UINT32_MAX) {
+		private_info->start = private_info->reference;
+		samples = timer->samples;
+	}
+
+	timer->samplecount = (uint32_t) samples;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t tfd_timer_sync(switch_timer_t *timer)
+{
+	tfd_private_t *private_info = timer->private_info;
+
+	if (tfd_globals.running != 1 || private_info->ready == 0) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	private_info->reference = timer->tick = TFD_MATRIX[timer->interval].tick;
+
+	tfd_timer_step(timer);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t tfd_timer_next(switch_timer_t *timer)
+{
+	tfd_private_t *private_info = timer->private_info;
+	interval_timer_t *it = &TFD_MATRIX[timer->interval];
+
+	/* sync up timer if it's not been called for a while otherwise it will return instantly several times until it catches up */
+	if ((int64_t) (private_info->reference - it->tick) < -1) {
+		private_info->reference = timer->tick = it->tick;
+	}
+	tfd_timer_step(timer);
+
+	switch_mutex_lock(it->mutex);
+	while (tfd_globals.running == 1 && private_info->ready && it->tick < private_info->reference) {
+		switch_thread_cond_wait(it->cond, it->mutex);
+	}
+	switch_mutex_unlock(it->mutex);
+
+	timer->tick = it->tick;
+
+	return tfd_globals.running == 1 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
+static switch_status_t tfd_timer_check(switch_timer_t *timer, switch_bool_t step)
+{
+	tfd_private_t *private_info = timer->private_info;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	if (tfd_globals.running != 1 || !private_info->ready) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	timer->tick = TFD_MATRIX[timer->interval].tick;
+
+	if (timer->tick < private_info->reference) {
+		timer->diff = private_info->reference - timer->tick;
+	} else {
+		timer->diff = 0;
+	}
+
+	if (timer->diff) {
+		status = SWITCH_STATUS_FALSE;
+	} else if (step) {
+		tfd_timer_step(timer);
+	}
+
+	return status;
+}
+
+static switch_status_t tfd_timer_destroy(switch_timer_t *timer)
+{
+	tfd_private_t *private_info = timer->private_info;
+	interval_timer_t *it = &TFD_MATRIX[timer->interval];
+
+	if (!private_info) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	private_info->ready = 0;
+
+	switch_mutex_lock(tfd_globals.mutex);
+	if (it->count && !--it->count && it->fd > -1) {
+		tfd_timer_arm(it->fd, 0);
+	}
+	switch_mutex_unlock(tfd_globals.mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+#endif
+
 SWITCH_MODULE_RUNTIME_FUNCTION(softtimer_runtime)
 {
 	switch_time_t too_late = STEP_MIC * 1000;
@@ -666,6 +1053,7 @@ SWITCH_MODULE_RUNTIME_FUNCTION(softtimer_runtime)
 	switch_time_t ts = 0, last = 0;
 	int fwd_errs = 0, rev_errs = 0;
 	int profile_tick = 0;
+	int tfd = -1;
 
 	runtime.profile_timer = switch_new_profile_timer();
 	switch_get_system_idle_time(runtime.profile_timer, &runtime.profile_time);
@@ -716,6 +1104,27 @@ SWITCH_MODULE_RUNTIME_FUNCTION(softtimer_runtime)
 #endif
 
 
+#if defined(HAVE_TIMERFD_CREATE)
+	if (TFD) {
+		struct itimerspec val;
+
+		/* pace the 1ms loop with a periodic timerfd so it blocks in read() instead of yielding in a busy loop */
+		if ((tfd = timerfd_create(CLOCK_MONOTONIC, 0)) > -1) {
+			val.it_interval.tv_sec = 0;
+			val.it_interval.tv_nsec = STEP_MIC * 1000;
+			val.it_value = val.it_interval;
+			if (timerfd_settime(tfd, 0, &val, NULL) < 0) {
+				close(tfd);
+				tfd = -1;
+			}
+		}
+
+		if (tfd < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create timerfd, falling back to sleep/yield: %s\n", strerror(errno));
+		}
+	}
+#endif
+
 	switch_time_sync();
 
 	globals.use_cond_yield = COND;
@@ -741,7 +1150,12 @@ SWITCH_MODULE_RUNTIME_FUNCTION(softtimer_runtime)
 				rev_errs = 0;
 			}
 
-			if (globals.timer_count >= runtime.tipping_point) {
+			if (tfd > -1) {
+				uint64_t expirations;
+				if (read(tfd, &expirations, sizeof(expirations)) < 0 && errno != EINTR) {
+					do_sleep(1000);
+				}
+			} else if (globals.timer_count >= runtime.tipping_point) {
 				os_yield();
 			} else {
 				do_sleep(1000);
@@ -843,6 +1257,10 @@ SWITCH_MODULE_RUNTIME_FUNCTION(softtimer_runtime)
 	}
 
 
+	if (tfd > -1) {
+		close(tfd);
+	}
+
 	switch_mutex_lock(globals.mutex);
 	globals.RUNNING = 0;
 	switch_mutex_unlock(globals.mutex);
@@ -1058,6 +1476,19 @@ SWITCH_MODULE_LOAD_FUNCTION(softtimer_load)
 	timer_interface->timer_check = timer_check;
 	timer_interface->timer_destroy = timer_destroy;
 
+#if defined(HAVE_TIMERFD_CREATE)
+	if (tfd_timer_start() == SWITCH_STATUS_SUCCESS) {
+		timer_interface = switch_loadable_module_create_interface(*module_interface, SWITCH_TIMER_INTERFACE);
+		timer_interface->interface_name = "timerfd";
+		timer_interface->timer_init = tfd_timer_init;
+		timer_interface->timer_next = tfd_timer_next;
+		timer_interface->timer_step = tfd_timer_step;
+		timer_interface->timer_sync = tfd_timer_sync;
+		timer_interface->timer_check = tfd_timer_check;
+		timer_interface->timer_destroy = tfd_timer_destroy;
+	}
+#endif
+
 	if (!switch_test_flag((&runtime), SCF_USE_CLOCK_RT)) {
 		switch_time_set_nanosleep(SWITCH_FALSE);
 	}
@@ -1094,6 +1525,10 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(softtimer_shutdown)
 			do_sleep(10000);
 		}
 	}
+
+#if defined(HAVE_TIMERFD_CREATE)
+	tfd_timer_stop();
+#endif
 #if defined(WIN32)
 	timeEndPeriod(1);
 	win32_tick_time_since_start = -1; /* we are not initialized anymore */
@@ -124,6 +124,7 @@ struct switch_xml_root {		/* additional data for the root tag */
 	char ***pi;					/* processing instructions */
 	short standalone;			/* non-zero if <?xml standalone="yes"?> */
 	char err[SWITCH_XML_ERRL];	/* error string */
+	int refs;					/* references held on a document shared from the user cache */
 };
 
 char *SWITCH_XML_NIL[] = { NULL };	/* empty, null terminated array of strings */
@@ -144,6 +145,32 @@ static switch_thread_rwlock_t *B_RWLOCK = NULL;
 static switch_mutex_t *XML_LOCK = NULL;
 static switch_mutex_t *XML_GEN_LOCK = NULL;
 
+/* documents shared out of the user cache, switch_xml_free() only drops a reference on these */
+#define SWITCH_XML_CACHED (1 << 8)
+
+typedef struct xml_user_cache_node {
+	char *mega_key;
+	char *key;
+	char *user_name;
+	char *domain_name;
+	switch_xml_t root;
+	switch_xml_t domain;
+	switch_xml_t group;
+	switch_xml_t user;
+	switch_xml_t merged;
+	switch_time_t expires;
+	struct xml_user_cache_node *prev;
+	struct xml_user_cache_node *next;
+} xml_user_cache_node_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	xml_user_cache_node_t *head;
+	uint32_t count;
+	switch_time_t last_sweep;
+} USER_CACHE;
+
 
 struct xml_section_t {
 	const char *name;
@@ -1590,6 +1617,7 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 	switch_xml_binding_t *binding;
 	uint8_t loops = 0;
 	switch_xml_section_t sections = BINDINGS ? switch_xml_parse_section_string(section) : 0;
+	switch_time_t probe_start = BINDINGS ? switch_core_probe_start() : 0;
 
 	switch_thread_rwlock_rdlock(B_RWLOCK);
 
@@ -1626,6 +1654,8 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 	}
 	switch_thread_rwlock_unlock(B_RWLOCK);
 
+	switch_core_probe_end(SWITCH_PROBE_XML_FETCH, probe_start);
+
 	for (;;) {
 		if (!xml) {
 			if (!(xml = switch_xml_root())) {
@@ -1836,16 +1866,293 @@ SWITCH_DECLARE(void) switch_xml_merge_user(switch_xml_t user, switch_xml_t domai
 	do_merge(user, domain, "variables", "variable");
 }
 
+static switch_xml_t xml_copy_tag(switch_xml_t parent, switch_xml_t src)
+{
+	switch_xml_t tag, child;
+	int i;
+
+	tag = switch_xml_add_child_d(parent, src->name, src->off);
+
+	for (i = 0; src->attr[i]; i += 2) {
+		switch_xml_set_attr_d(tag, src->attr[i], src->attr[i + 1]);
+	}
+
+	if (!zstr(src->txt)) {
+		switch_xml_set_txt_d(tag, src->txt);
+	}
+
+	for (child = src->child; child; child = child->ordered) {
+		xml_copy_tag(tag, child);
+	}
+
+	return tag;
+}
+
+static void xml_copy_attrs(switch_xml_t dst, switch_xml_t src)
+{
+	int i;
+
+	for (i = 0; src->attr[i]; i += 2) {
+		switch_xml_set_attr_d(dst, src->attr[i], src->attr[i + 1]);
+	}
+}
+
+/* 
+   Build a standalone document holding only what a user lookup hands back: the domain with its own settings,
+   the group the user was found in and the user itself.  No matter how big the directory is, that's all we keep.
+*/
+static switch_xml_t xml_user_cache_build(switch_xml_t domain, switch_xml_t group, switch_xml_t user,
+										 switch_xml_t *c_domain, switch_xml_t *c_group, switch_xml_t *c_user)
+{
+	switch_xml_t doc, child, groups, users;
+
+	if (!(doc = switch_xml_new_d(domain->name))) {
+		return NULL;
+	}
+
+	xml_copy_attrs(doc, domain);
+
+	for (child = domain->child; child; child = child->ordered) {
+		if (strcasecmp(child->name, "groups") && strcasecmp(child->name, "user")) {
+			xml_copy_tag(doc, child);
+		}
+	}
+
+	*c_group = NULL;
+
+	if (group) {
+		groups = switch_xml_add_child_d(doc, "groups", 0);
+		*c_group = switch_xml_add_child_d(groups, "group", 0);
+		xml_copy_attrs(*c_group, group);
+
+		for (child = group->child; child; child = child->ordered) {
+			if (strcasecmp(child->name, "users")) {
+				xml_copy_tag(*c_group, child);
+			}
+		}
+
+		users = switch_xml_add_child_d(*c_group, "users", 0);
+		*c_user = xml_copy_tag(users, user);
+	} else {
+		*c_user = xml_copy_tag(doc, user);
+	}
+
+	*c_domain = doc;
+	doc->flags |= SWITCH_XML_CACHED;
+	((switch_xml_root_t) doc)->refs = 1;
+
+	return doc;
+}
+
+/* must be called with USER_CACHE.mutex locked */
+static void xml_user_cache_unlink(xml_user_cache_node_t *node)
+{
+	if (node->prev) {
+		node->prev->next = node->next;
+	} else {
+		USER_CACHE.head = node->next;
+	}
+
+	if (node->next) {
+		node->next->prev = node->prev;
+	}
+
+	switch_core_hash_delete(USER_CACHE.hash, node->mega_key);
+	USER_CACHE.count--;
+}
+
+static void xml_user_cache_node_free(xml_user_cache_node_t *node)
+{
+	/* only drops the cache's own reference, lookups still holding the documents free them when they are done */
+	switch_xml_free(node->merged);
+	switch_xml_free(node->root);
+	free(node->mega_key);
+	free(node->key);
+	free(node->user_name);
+	free(node->domain_name);
+	free(node);
+}
+
+static void xml_user_cache_mega_key(char *buf, switch_size_t len, const char *key, const char *user_name, const char *domain_name,
+									const char *ip, switch_event_t *params)
+{
+	switch_snprintf(buf, len, "%s|%s|%s|%s|%s", key, switch_str_nil(user_name), switch_str_nil(domain_name), switch_str_nil(ip),
+					switch_str_nil(params ? switch_event_get_header(params, "user_type") : NULL));
+}
+
+static xml_user_cache_node_t *xml_user_cache_find(const char *mega_key)
+{
+	xml_user_cache_node_t *node;
+
+	if ((node = switch_core_hash_find(USER_CACHE.hash, mega_key)) && node->expires && node->expires < switch_micro_time_now()) {
+		xml_user_cache_unlink(node);
+		xml_user_cache_node_free(node);
+		node = NULL;
+	}
+
+	return node;
+}
+
+static switch_bool_t xml_user_cache_lookup(const char *mega_key, switch_xml_t *root, switch_xml_t *domain, switch_xml_t *user, switch_xml_t *ingroup)
+{
+	xml_user_cache_node_t *node;
+
+	if (!USER_CACHE.mutex) {
+		return SWITCH_FALSE;
+	}
+
+	switch_mutex_lock(USER_CACHE.mutex);
+	if ((node = xml_user_cache_find(mega_key))) {
+		((switch_xml_root_t) node->root)->refs++;
+		*root = node->root;
+		*domain = node->domain;
+		*user = node->user;
+		if (ingroup) {
+			*ingroup = node->group;
+		}
+	}
+	switch_mutex_unlock(USER_CACHE.mutex);
+
+	return node ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static void xml_user_cache_add(const char *mega_key, const char *key, const char *user_name, const char *domain_name,
+							   switch_xml_t domain, switch_xml_t group, switch_xml_t user)
+{
+	const char *cacheable;
+	switch_time_t now, ttl = 0;
+	xml_user_cache_node_t *node, *np;
+
+	if (!USER_CACHE.mutex) {
+		return;
+	}
+
+	/* directory entries opt in with cacheable="true" (until the next flush) or cacheable="<ms>" on the user or the domain */
+	if (!(cacheable = switch_xml_attr(user, "cacheable")) && !(cacheable = switch_xml_attr(domain, "cacheable"))) {
+		return;
+	}
+
+	if (switch_is_number(cacheable)) {
+		ttl = (switch_time_t) atol(cacheable) * 1000;
+	} else if (!switch_true(cacheable)) {
+		return;
+	}
+
+	switch_zmalloc(node, sizeof(*node));
+
+	if (!(node->root = xml_user_cache_build(domain, group, user, &node->domain, &node->group, &node->user))) {
+		free(node);
+		return;
+	}
+
+	node->mega_key = strdup(mega_key);
+	node->key = strdup(key);
+	node->user_name = strdup(switch_str_nil(user_name));
+	node->domain_name = strdup(switch_str_nil(domain_name));
+
+	now = switch_micro_time_now();
+	if (ttl) {
+		node->expires = now + ttl;
+	}
+
+	switch_mutex_lock(USER_CACHE.mutex);
+
+	if (switch_core_hash_find(USER_CACHE.hash, mega_key)) {
+		switch_mutex_unlock(USER_CACHE.mutex);
+		xml_user_cache_node_free(node);
+		return;
+	}
+
+	/* expired entries are otherwise only noticed when somebody looks them up again */
+	if (now - USER_CACHE.last_sweep > 60000000) {
+		xml_user_cache_node_t *next;
+
+		for (np = USER_CACHE.head; np; np = next) {
+			next = np->next;
+			if (np->expires && np->expires < now) {
+				xml_user_cache_unlink(np);
+				xml_user_cache_node_free(np);
+			}
+		}
+		USER_CACHE.last_sweep = now;
+	}
+
+	node->next = USER_CACHE.head;
+	if (USER_CACHE.head) {
+		USER_CACHE.head->prev = node;
+	}
+	USER_CACHE.head = node;
+	switch_core_hash_insert(USER_CACHE.hash, node->mega_key, node);
+	USER_CACHE.count++;
+
+	switch_mutex_unlock(USER_CACHE.mutex);
+}
+
+SWITCH_DECLARE(uint32_t) switch_xml_clear_user_cache(const char *key, const char *user_name, const char *domain_name)
+{
+	xml_user_cache_node_t *np, *next;
+	uint32_t count = 0;
+
+	if (!USER_CACHE.mutex) {
+		return 0;
+	}
+
+	switch_mutex_lock(USER_CACHE.mutex);
+	for (np = USER_CACHE.head; np; np = next) {
+		next = np->next;
+
+		if ((!key || !strcasecmp(np->key, key)) && (!user_name || !strcasecmp(np->user_name, user_name)) &&
+			(!domain_name || !strcasecmp(np->domain_name, domain_name))) {
+			xml_user_cache_unlink(np);
+			xml_user_cache_node_free(np);
+			count++;
+		}
+	}
+	switch_mutex_unlock(USER_CACHE.mutex);
+
+	return count;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_xml_locate_user_merged(const char *key, const char *user_name, const char *domain_name,
 															  const char *ip, switch_xml_t *user, switch_event_t *params)
 {
 	switch_xml_t xml, domain, group, x_user, x_user_dup;
 	switch_status_t status = SWITCH_STATUS_FALSE;
+	xml_user_cache_node_t *node;
+	char mega_key[1024];
+
+	xml_user_cache_mega_key(mega_key, sizeof(mega_key), key, user_name, domain_name, ip, params);
+
+	if (USER_CACHE.mutex) {
+		switch_mutex_lock(USER_CACHE.mutex);
+		if ((node = xml_user_cache_find(mega_key)) && node->merged) {
+			((switch_xml_root_t) node->merged)->refs++;
+			*user = node->merged;
+			status = SWITCH_STATUS_SUCCESS;
+		}
+		switch_mutex_unlock(USER_CACHE.mutex);
+
+		if (status == SWITCH_STATUS_SUCCESS) {
+			return status;
+		}
+	}
 
 	if ((status = switch_xml_locate_user(key, user_name, domain_name, ip, &xml, &domain, &x_user, &group, params)) == SWITCH_STATUS_SUCCESS) {
 		x_user_dup = switch_xml_dup(x_user);
 		switch_xml_merge_user(x_user_dup, domain, group);
 		*user = x_user_dup;
+
+		/* if the lookup came from the cache keep the merged result next to it so the next one is free */
+		if ((xml->flags & SWITCH_XML_CACHED) && x_user_dup) {
+			switch_mutex_lock(USER_CACHE.mutex);
+			if ((node = xml_user_cache_find(mega_key)) && node->root == xml && !node->merged) {
+				x_user_dup->flags |= SWITCH_XML_CACHED;
+				((switch_xml_root_t) x_user_dup)->refs = 2;
+				node->merged = x_user_dup;
+			}
+			switch_mutex_unlock(USER_CACHE.mutex);
+		}
+
 		switch_xml_free(xml);
 	}
 
@@ -1863,6 +2170,7 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user(const char *key,
 	switch_status_t status = SWITCH_STATUS_FALSE;
 	switch_event_t *my_params = NULL, *search_params = NULL;
 	switch_xml_t group = NULL, groups = NULL, users = NULL;
+	char mega_key[1024];
 
 	*root = NULL;
 	*user = NULL;
@@ -1892,6 +2200,13 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user(const char *key,
 		switch_event_add_header_string(params, SWITCH_STACK_BOTTOM, "ip", ip);
 	}
 
+	xml_user_cache_mega_key(mega_key, sizeof(mega_key), key, user_name, domain_name, ip, params);
+
+	if (xml_user_cache_lookup(mega_key, root, domain, user, ingroup)) {
+		status = SWITCH_STATUS_SUCCESS;
+		goto end;
+	}
+
 	if ((status = switch_xml_locate_domain(domain_name, params, root, domain)) != SWITCH_STATUS_SUCCESS) {
 		goto end;
 	}
@@ -1916,9 +2231,14 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user(const char *key,
 	}
 
 	if (status != SWITCH_STATUS_SUCCESS) {
+		group = NULL;
 		status = find_user_in_tag(*domain, ip, user_name, key, params, user);
 	}
 
+	if (status == SWITCH_STATUS_SUCCESS) {
+		xml_user_cache_add(mega_key, key, user_name, domain_name, *domain, group, *user);
+	}
+
   end:
 
 	if (my_params) {
@@ -2011,6 +2331,7 @@ SWITCH_DECLARE(switch_xml_t) switch_xml_open_root(uint8_t reload, const char **e
 			MAIN_XML_ROOT = new_main;
 			switch_set_flag(MAIN_XML_ROOT, SWITCH_XML_ROOT);
 			switch_xml_free(old_root);
+			switch_xml_clear_user_cache(NULL, NULL, NULL);
 			/* switch_xml_free_in_thread(old_root); */
 		}
 	} else {
@@ -2049,6 +2370,8 @@ SWITCH_DECLARE(switch_status_t) switch_xml_init(switch_memory_pool_t *pool, cons
 	switch_mutex_init(&XML_GEN_LOCK, SWITCH_MUTEX_NESTED, XML_MEMORY_POOL);
 	switch_thread_rwlock_create(&RWLOCK, XML_MEMORY_POOL);
 	switch_thread_rwlock_create(&B_RWLOCK, XML_MEMORY_POOL);
+	switch_mutex_init(&USER_CACHE.mutex, SWITCH_MUTEX_NESTED, XML_MEMORY_POOL);
+	switch_core_hash_init_case(&USER_CACHE.hash, XML_MEMORY_POOL, SWITCH_TRUE);
 
 	assert(pool != NULL);
 
@@ -2063,6 +2386,9 @@ SWITCH_DECLARE(switch_status_t) switch_xml_init(switch_memory_pool_t *pool, cons
 SWITCH_DECLARE(switch_status_t) switch_xml_destroy(void)
 {
 	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	switch_xml_clear_user_cache(NULL, NULL, NULL);
+
 	switch_mutex_lock(XML_LOCK);
 
 	if (MAIN_XML_ROOT) {
@@ -2370,6 +2696,18 @@ SWITCH_DECLARE(void) switch_xml_free(switch_xml_t xml)
 		return;
 	}
 
+	if ((xml->flags & SWITCH_XML_CACHED)) {
+		int last;
+
+		switch_mutex_lock(USER_CACHE.mutex);
+		last = !--root->refs;
+		switch_mutex_unlock(USER_CACHE.mutex);
+
+		if (!last) {
+			return;
+		}
+	}
+
 	if (xml->free_path) {
 		if (!switch_stristr("freeswitch.xml.fsxml", xml->free_path)) {
 			if (unlink(xml->free_path) != 0) {